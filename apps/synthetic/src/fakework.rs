@@ -1,19 +1,94 @@
 extern crate test;
 
+use std::mem;
+use std::ptr;
 use std::result::Result;
-use std::sync::Arc;
+use std::slice;
+use std::sync::atomic::{AtomicPtr, AtomicUsize, Ordering};
+use std::sync::{Arc, Once};
 
 extern crate mersenne_twister;
 extern crate rand;
 use mersenne_twister::MersenneTwister;
 use rand::{Rng, SeedableRng};
 
+use shenango::rmem::{self, PAGE_SIZE};
+use zipf::ZipfDistribution;
+
+/// Accesses in the schedule of farzipf.
+const FAR_ZIPF_SCHED_LEN: usize = 1 << 20;
+
+/// A buffer in far memory whose pages are accessed with zipf-distributed
+/// popularity. The buffer is allocated with rmalloc() on first use, once the
+/// runtime is up, and every access is hinted; sched holds word offsets into
+/// it.
+pub struct FarZipfMem {
+    buf: AtomicPtr<u64>,
+    init: Once,
+    len: usize,
+    sched: Vec<usize>,
+    cursor: AtomicUsize,
+}
+
+impl FarZipfMem {
+    fn new(rng: &mut MersenneTwister, size: usize, s: f64) -> Self {
+        let words = PAGE_SIZE / mem::size_of::<u64>();
+        let npages = (size / PAGE_SIZE).max(1);
+        let zipf = ZipfDistribution::new(npages, s).unwrap();
+
+        // scatter the popular pages over the buffer
+        let mut pages: Vec<usize> = (0..npages).collect();
+        rng.shuffle(&mut pages);
+        let sched = (0..FAR_ZIPF_SCHED_LEN)
+            .map(|_| {
+                let page = pages[zipf.next(rng.gen::<f64>()) - 1];
+                page * words + rng.gen::<usize>() % words
+            })
+            .collect();
+
+        FarZipfMem {
+            buf: AtomicPtr::new(ptr::null_mut()),
+            init: Once::new(),
+            len: npages * words,
+            sched: sched,
+            cursor: AtomicUsize::new(0),
+        }
+    }
+
+    fn buf(&self) -> *const u64 {
+        self.init.call_once(|| {
+            let words = PAGE_SIZE / mem::size_of::<u64>();
+            let buf = rmem::rmalloc(self.len * mem::size_of::<u64>()) as *mut u64;
+            assert!(!buf.is_null(), "farzipf: out of remote memory");
+            for page in (0..self.len).step_by(words) {
+                let p = unsafe { buf.add(page) };
+                rmem::hint_write_fault(p);
+                for w in unsafe { slice::from_raw_parts_mut(p, words) } {
+                    *w = 1;
+                }
+            }
+            self.buf.store(buf, Ordering::Release);
+        });
+        self.buf.load(Ordering::Acquire)
+    }
+}
+
+impl Drop for FarZipfMem {
+    fn drop(&mut self) {
+        let buf = self.buf.load(Ordering::Acquire);
+        if !buf.is_null() {
+            unsafe { rmem::rmfree(buf as *mut u8, self.len * mem::size_of::<u64>()) };
+        }
+    }
+}
+
 #[derive(Clone)]
 pub enum FakeWorker {
     Sqrt,
     StridedMem(Arc<Vec<u8>>, usize),
     RandomMem(Arc<Vec<u8>>, Arc<Vec<usize>>),
     StreamingMem(Arc<Vec<u8>>),
+    FarZipf(Arc<FarZipfMem>),
 }
 
 impl FakeWorker {
@@ -44,6 +119,12 @@ impl FakeWorker {
                     _ => unreachable!(),
                 }
             }
+            "farzipf" => {
+                assert!(tokens.len() > 2);
+                let size: usize = tokens[1].parse().unwrap();
+                let s: f64 = tokens[2].parse().unwrap();
+                Ok(FakeWorker::FarZipf(Arc::new(FarZipfMem::new(&mut rng, size, s))))
+            }
             _ => Err("bad fakework spec"),
         }
     }
@@ -73,6 +154,16 @@ impl FakeWorker {
                     }
                 }
             }
+            FakeWorker::FarZipf(ref m) => {
+                // workers carry on where the last one stopped
+                let buf = m.buf();
+                let start = m.cursor.fetch_add(iters as usize, Ordering::Relaxed);
+                for i in 0..iters as usize {
+                    let p = unsafe { buf.add(m.sched[(start + i) % m.sched.len()]) };
+                    rmem::hint_read_fault(p);
+                    test::black_box::<u64>(unsafe { *p });
+                }
+            }
         }
     }
 }
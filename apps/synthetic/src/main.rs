@@ -880,7 +880,7 @@ fn main() {
                 .long("fakework")
                 .takes_value(true)
                 .default_value("stridedmem:1024:7")
-                .help("fake worker spec"),
+                .help("fake worker spec (farzipf:<size>:<s> for zipf page accesses to far memory)"),
         )
         .arg(
             Arg::with_name("transport")
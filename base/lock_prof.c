@@ -0,0 +1,307 @@
+/*
+ * lock_prof.c - spin lock contention profiling (built with LOCK_PROFILER)
+ *
+ * Counters are kept per kthread for every site (see inc/base/lock.h) and are
+ * only ever written by their owner, so taking a lock costs no extra shared
+ * writes. This code must not take spin locks itself.
+ */
+
+#ifdef LOCK_PROFILER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <base/atomic.h>
+#include <base/lock.h>
+#include <base/log.h>
+#include <base/time.h>
+
+#define LOCK_PROF_MAX_SITES	1024
+#define LOCK_PROF_MAX_THREADS	256
+#define LOCK_PROF_TOP_N		50
+#define LOCK_PROF_MAX_HELD	16
+#define LOCK_SITE_DROPPED	(-1)	/* out of site ids, counted in slot 0 */
+
+struct lock_stat {
+	uint64_t	acquired;
+	uint64_t	contended;
+	uint64_t	spin_cycles;
+	uint64_t	max_spin_cycles;
+	uint64_t	hold_cycles;
+	uint64_t	max_hold_cycles;
+};
+
+/* a lock taken by this kthread that was not released yet */
+struct lock_held {
+	spinlock_t	*l;
+	int		site;
+	uint64_t	tsc;
+};
+
+struct lock_prof_thread {
+	pid_t			tid;
+	int			nheld;
+	struct lock_held	held[LOCK_PROF_MAX_HELD];
+	struct lock_stat	sites[LOCK_PROF_MAX_SITES];
+};
+
+static __thread struct lock_prof_thread *lock_prof_local;
+static __thread bool lock_prof_failed;
+static struct lock_prof_thread *lock_prof_threads[LOCK_PROF_MAX_THREADS];
+static int lock_prof_nthreads;
+static struct lock_site *lock_prof_sites[LOCK_PROF_MAX_SITES];
+static int lock_prof_nsites;
+
+/* claims counters for the current kthread; mmap keeps malloc out of it and
+ * the counters stay readable after the thread exits */
+static struct lock_prof_thread *lock_prof_init_thread(void)
+{
+	struct lock_prof_thread *t;
+	int id;
+
+	lock_prof_failed = true;
+	id = __sync_fetch_and_add(&lock_prof_nthreads, 1);
+	if (id >= LOCK_PROF_MAX_THREADS)
+		return NULL;
+
+	t = mmap(NULL, sizeof(*t), PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (t == MAP_FAILED)
+		return NULL;
+	t->tid = syscall(SYS_gettid);
+	store_release(&lock_prof_threads[id], t);
+
+	lock_prof_failed = false;
+	lock_prof_local = t;
+	return t;
+}
+
+/* returns the counter slot of a site, assigning it on first use */
+static int lock_prof_site_id(struct lock_site *site)
+{
+	int id, old;
+
+	id = ACCESS_ONCE(site->id);
+	if (likely(id > 0))
+		return id;
+	if (id == LOCK_SITE_DROPPED)
+		return 0;
+
+	/* racing threads may both take an id, the loser's stays unused */
+	id = __sync_add_and_fetch(&lock_prof_nsites, 1);
+	if (id >= LOCK_PROF_MAX_SITES)
+		id = LOCK_SITE_DROPPED;
+	old = __sync_val_compare_and_swap(&site->id, 0, id);
+	if (old)
+		return old > 0 ? old : 0;
+	if (id == LOCK_SITE_DROPPED)
+		return 0;
+	store_release(&lock_prof_sites[id], site);
+	return id;
+}
+
+/**
+ * __lock_prof_acquired - accounts for a lock that was just taken
+ * @l: the lock
+ * @site: where it was taken
+ * @spin_cycles: cycles spent waiting for it (0 if it was free)
+ */
+void __lock_prof_acquired(spinlock_t *l, struct lock_site *site,
+			  uint64_t spin_cycles)
+{
+	struct lock_prof_thread *t = lock_prof_local;
+	struct lock_held *h;
+	struct lock_stat *s;
+	int id;
+
+	if (unlikely(!t)) {
+		if (lock_prof_failed)
+			return;
+		t = lock_prof_init_thread();
+		if (!t)
+			return;
+	}
+	id = lock_prof_site_id(site);
+
+	/* remember it for the hold time. Locks released elsewhere (e.g., by a
+	 * uthread that migrated) linger, so make room by forgetting the oldest */
+	if (t->nheld == LOCK_PROF_MAX_HELD) {
+		memmove(&t->held[0], &t->held[1],
+			(LOCK_PROF_MAX_HELD - 1) * sizeof(struct lock_held));
+		t->nheld--;
+	}
+	h = &t->held[t->nheld++];
+	h->l = l;
+	h->site = id;
+	h->tsc = rdtsc();
+
+	s = &t->sites[id];
+	s->acquired++;
+	if (spin_cycles) {
+		s->contended++;
+		s->spin_cycles += spin_cycles;
+		if (spin_cycles > s->max_spin_cycles)
+			s->max_spin_cycles = spin_cycles;
+	}
+}
+
+/**
+ * __lock_prof_released - accounts for the hold time of a lock being released
+ * @l: the lock
+ */
+void __lock_prof_released(spinlock_t *l)
+{
+	struct lock_prof_thread *t = lock_prof_local;
+	struct lock_stat *s;
+	uint64_t hold;
+	int i;
+
+	if (unlikely(!t))
+		return;
+
+	/* usually the latest one taken */
+	for (i = t->nheld - 1; i >= 0; i--)
+		if (t->held[i].l == l)
+			break;
+	if (i < 0)
+		return;
+
+	hold = rdtsc() - t->held[i].tsc;
+	s = &t->sites[t->held[i].site];
+	s->hold_cycles += hold;
+	if (hold > s->max_hold_cycles)
+		s->max_hold_cycles = hold;
+
+	t->nheld--;
+	memmove(&t->held[i], &t->held[i + 1],
+		(t->nheld - i) * sizeof(struct lock_held));
+}
+
+static void lock_prof_add(struct lock_stat *to, struct lock_stat *from)
+{
+	to->acquired += ACCESS_ONCE(from->acquired);
+	to->contended += ACCESS_ONCE(from->contended);
+	to->spin_cycles += ACCESS_ONCE(from->spin_cycles);
+	to->hold_cycles += ACCESS_ONCE(from->hold_cycles);
+	to->max_spin_cycles = MAX(to->max_spin_cycles,
+				  ACCESS_ONCE(from->max_spin_cycles));
+	to->max_hold_cycles = MAX(to->max_hold_cycles,
+				  ACCESS_ONCE(from->max_hold_cycles));
+}
+
+static struct lock_stat lock_prof_totals[LOCK_PROF_MAX_SITES];
+
+static int cmp_site_spin(const void *a, const void *b)
+{
+	const struct lock_stat *sa = &lock_prof_totals[*(const int *)a];
+	const struct lock_stat *sb = &lock_prof_totals[*(const int *)b];
+
+	if (sa->spin_cycles != sb->spin_cycles)
+		return sa->spin_cycles < sb->spin_cycles ? 1 : -1;
+	if (sa->acquired != sb->acquired)
+		return sa->acquired < sb->acquired ? 1 : -1;
+	return 0;
+}
+
+static void lock_prof_write_site(FILE *fp, int id)
+{
+	struct lock_site *site = load_acquire(&lock_prof_sites[id]);
+
+	if (site)
+		fprintf(fp, "%s:%d", site->file, site->line);
+	else
+		fprintf(fp, id ? "unknown" : "dropped");
+}
+
+static void lock_prof_write_stat(FILE *fp, struct lock_stat *s)
+{
+	fprintf(fp, ",%lu,%lu,%.2f,%.3f,%.3f,%.3f,%.3f\n", s->acquired,
+		s->contended, 100.0 * s->contended / s->acquired,
+		(double)s->spin_cycles / cycles_per_us,
+		1000.0 * s->max_spin_cycles / cycles_per_us,
+		1000.0 * s->hold_cycles / s->acquired / cycles_per_us,
+		1000.0 * s->max_hold_cycles / cycles_per_us);
+}
+
+/**
+ * lock_prof_write - writes the sites ranked by time spent spinning, totaled
+ * over all kthreads and then for each kthread. Counters are read while they
+ * are being updated so the report is approximate. Meant for a single stats
+ * thread.
+ */
+static int lock_prof_write(FILE *fp)
+{
+	static int order[LOCK_PROF_MAX_SITES];
+	struct lock_prof_thread *t;
+	int i, j, n, nthreads, nsites;
+
+	nthreads = MIN(load_acquire(&lock_prof_nthreads), LOCK_PROF_MAX_THREADS);
+	nsites = MIN(load_acquire(&lock_prof_nsites) + 1, LOCK_PROF_MAX_SITES);
+
+	memset(lock_prof_totals, 0, sizeof(lock_prof_totals));
+	for (i = 0; i < nthreads; i++) {
+		t = load_acquire(&lock_prof_threads[i]);
+		if (!t)
+			continue;
+		for (j = 0; j < nsites; j++)
+			lock_prof_add(&lock_prof_totals[j], &t->sites[j]);
+	}
+
+	for (j = 0, n = 0; j < nsites; j++)
+		if (lock_prof_totals[j].acquired)
+			order[n++] = j;
+	qsort(order, n, sizeof(int), cmp_site_spin);
+
+	fprintf(fp, "# lock sites by spin time (%d sites, %d kthreads)\n",
+		n, nthreads);
+	fprintf(fp, "site,acquired,contended,contended_pct,spin_us,"
+		"max_spin_ns,mean_hold_ns,max_hold_ns\n");
+	for (i = 0; i < n && i < LOCK_PROF_TOP_N; i++) {
+		lock_prof_write_site(fp, order[i]);
+		lock_prof_write_stat(fp, &lock_prof_totals[order[i]]);
+	}
+
+	fprintf(fp, "# contended lock sites per kthread\n");
+	fprintf(fp, "tid,site,acquired,contended,contended_pct,spin_us,"
+		"max_spin_ns,mean_hold_ns,max_hold_ns\n");
+	for (i = 0; i < nthreads; i++) {
+		t = load_acquire(&lock_prof_threads[i]);
+		if (!t)
+			continue;
+		for (j = 0; j < n && j < LOCK_PROF_TOP_N; j++) {
+			struct lock_stat s = {0};
+
+			lock_prof_add(&s, &t->sites[order[j]]);
+			if (!s.contended)
+				continue;
+			fprintf(fp, "%d,", t->tid);
+			lock_prof_write_site(fp, order[j]);
+			lock_prof_write_stat(fp, &s);
+		}
+	}
+	return 0;
+}
+
+/**
+ * lock_prof_dump - writes the latest report to lockprof-<pid>
+ */
+void lock_prof_dump(void)
+{
+	char fname[32];
+	FILE *fp;
+
+	snprintf(fname, sizeof(fname), "lockprof-%d", getpid());
+	fp = fopen(fname, "w");
+	if (!fp) {
+		log_err("couldn't open %s for lock profile", fname);
+		return;
+	}
+	lock_prof_write(fp);
+	fclose(fp);
+}
+
+#endif /* LOCK_PROFILER */
@@ -0,0 +1,392 @@
+// coro.h - C++20 coroutines on top of uthreads
+//
+// A CoScheduler runs many coroutines (rt::Task) on the uthread that calls
+// Run(). Coroutines wait for page faults and network I/O with co_await:
+//
+//   rt::Task<void> Serve(rt::TcpConn *c) {
+//     char buf[64];
+//     ssize_t n = co_await rt::TcpRead(c, buf, sizeof(buf));
+//     co_await rt::Fault(obj, false, 0);
+//     ...
+//   }
+//
+// A coroutine costs its frame rather than a uthread stack. When a wait
+// really has to block (the page is not there or the socket has no data), the
+// blocking call runs on a helper uthread that makes the coroutine ready again
+// once it returns, so a uthread stack is only taken while the call blocks.
+
+#pragma once
+
+#if __cplusplus < 202002L
+#error "coro.h needs C++20 (-std=gnu++20)"
+#endif
+
+extern "C" {
+#include <base/stddef.h>
+#include <base/lock.h>
+#include <rmem/api.h>
+#include <runtime/sync.h>
+#include <runtime/thread.h>
+}
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "net.h"
+#include "pgfault.h"
+#include "thread.h"
+
+namespace rt {
+
+class CoScheduler;
+
+namespace coro_internal {
+
+// State shared by the promises of all tasks.
+struct promise_base {
+  CoScheduler *sched = nullptr;
+  std::coroutine_handle<> self;
+  std::coroutine_handle<> continuation;  // the awaiting task, if any
+  promise_base *next = nullptr;          // in the ready queue
+  std::exception_ptr error;
+};
+
+// Resumes the awaiting task, or retires a task started with Spawn().
+struct final_awaiter {
+  bool await_ready() const noexcept { return false; }
+  template <typename P>
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<P> h) noexcept;
+  void await_resume() const noexcept {}
+};
+
+}  // namespace coro_internal
+
+// A lazily started coroutine that returns a T. Tasks run on the scheduler of
+// the task that awaits them, or are started with CoScheduler::Spawn().
+template <typename T = void>
+class Task;
+
+namespace coro_internal {
+
+template <typename T>
+struct promise : promise_base {
+  T value;
+
+  Task<T> get_return_object();
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  final_awaiter final_suspend() noexcept { return {}; }
+  void return_value(T v) { value = std::move(v); }
+  void unhandled_exception() { error = std::current_exception(); }
+  T result() {
+    if (error) std::rethrow_exception(error);
+    return std::move(value);
+  }
+};
+
+template <>
+struct promise<void> : promise_base {
+  Task<void> get_return_object();
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  final_awaiter final_suspend() noexcept { return {}; }
+  void return_void() {}
+  void unhandled_exception() { error = std::current_exception(); }
+  void result() {
+    if (error) std::rethrow_exception(error);
+  }
+};
+
+}  // namespace coro_internal
+
+template <typename T>
+class Task {
+ public:
+  typedef coro_internal::promise<T> promise_type;
+
+  Task() : h_(nullptr) {}
+  explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+  Task(Task &&t) noexcept : h_(std::exchange(t.h_, nullptr)) {}
+  Task &operator=(Task &&t) noexcept {
+    if (this != &t) {
+      if (h_) h_.destroy();
+      h_ = std::exchange(t.h_, nullptr);
+    }
+    return *this;
+  }
+  ~Task() {
+    if (h_) h_.destroy();
+  }
+
+  // Runs the task on the scheduler of the awaiting task and returns its
+  // result once it is done.
+  bool await_ready() const noexcept { return false; }
+  template <typename P>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+    h_.promise().sched = h.promise().sched;
+    h_.promise().continuation = h;
+    return h_;
+  }
+  T await_resume() { return h_.promise().result(); }
+
+ private:
+  friend class CoScheduler;
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  std::coroutine_handle<promise_type> h_;
+};
+
+namespace coro_internal {
+
+template <typename T>
+inline Task<T> promise<T>::get_return_object() {
+  auto h = std::coroutine_handle<promise<T>>::from_promise(*this);
+  self = h;
+  return Task<T>(h);
+}
+
+inline Task<void> promise<void>::get_return_object() {
+  auto h = std::coroutine_handle<promise<void>>::from_promise(*this);
+  self = h;
+  return Task<void>(h);
+}
+
+}  // namespace coro_internal
+
+// Runs coroutines on the uthread that calls Run(). Other uthreads (e.g., the
+// helpers running blocking calls) hand coroutines back through a ready queue.
+class CoScheduler {
+ public:
+  CoScheduler() : head_(nullptr), tail_(nullptr), waiter_(nullptr), live_(0) {
+    spin_lock_init(&lock_);
+  }
+  ~CoScheduler() { assert(live_ == 0); }
+
+  // Adds a task, which starts running once Run() gets to it. Call it before
+  // Run() or from a task. The scheduler owns the task from then on; its
+  // result (and any exception) is dropped.
+  void Spawn(Task<void> &&t) {
+    coro_internal::promise_base *p = &t.h_.promise();
+
+    t.h_ = nullptr;
+    p->sched = this;
+    live_++;
+    Ready(p);
+  }
+
+  // Runs the tasks until all of them returned. Parks the uthread while all
+  // of them wait.
+  void Run() {
+    coro_internal::promise_base *p;
+
+    while (true) {
+      spin_lock_np(&lock_);
+      while (!head_) {
+        if (!live_) {
+          spin_unlock_np(&lock_);
+          return;
+        }
+        waiter_ = thread_self();
+        thread_park_and_unlock_np(&lock_);
+        spin_lock_np(&lock_);
+      }
+      p = head_;
+      head_ = p->next;
+      if (!head_) tail_ = nullptr;
+      spin_unlock_np(&lock_);
+
+      p->next = nullptr;
+      p->self.resume();
+    }
+  }
+
+  // Makes a suspended task ready to run. Safe from any uthread.
+  void Ready(coro_internal::promise_base *p) {
+    thread_t *th;
+
+    spin_lock_np(&lock_);
+    if (tail_)
+      tail_->next = p;
+    else
+      head_ = p;
+    tail_ = p;
+    th = waiter_;
+    waiter_ = nullptr;
+    spin_unlock_np(&lock_);
+    if (th) thread_ready(th);
+  }
+
+  // Runs a blocking call on a helper uthread and makes the task ready again
+  // once it returns.
+  template <typename F>
+  void Block(coro_internal::promise_base *p, F f) {
+    rt::Spawn([this, p, f]() mutable {
+      f();
+      Ready(p);
+    });
+  }
+
+ private:
+  friend struct coro_internal::final_awaiter;
+
+  // Only called from Run()'s uthread, with the task suspended at its end.
+  void Retire(std::coroutine_handle<> h) {
+    h.destroy();
+    live_--;
+  }
+
+  spinlock_t lock_;
+  coro_internal::promise_base *head_;
+  coro_internal::promise_base *tail_;
+  thread_t *waiter_;
+  unsigned long live_;
+
+  CoScheduler(const CoScheduler &) = delete;
+  CoScheduler &operator=(const CoScheduler &) = delete;
+};
+
+namespace coro_internal {
+
+template <typename P>
+inline std::coroutine_handle<> final_awaiter::await_suspend(
+    std::coroutine_handle<P> h) noexcept {
+  promise_base &p = h.promise();
+
+  if (p.continuation) return p.continuation;
+  p.sched->Retire(h);
+  return std::noop_coroutine();
+}
+
+// Awaits a blocking call, which runs on a helper uthread.
+template <typename R, typename F>
+class blocking_awaiter {
+ public:
+  explicit blocking_awaiter(F f) : f_(std::move(f)) {}
+
+  bool await_ready() const noexcept { return false; }
+  template <typename P>
+  void await_suspend(std::coroutine_handle<P> h) {
+    promise_base *p = &h.promise();
+    p->sched->Block(p, [this] { ret_ = f_(); });
+  }
+  R await_resume() { return std::move(ret_); }
+
+ private:
+  F f_;
+  R ret_;
+};
+
+template <typename F>
+class blocking_awaiter<void, F> {
+ public:
+  explicit blocking_awaiter(F f) : f_(std::move(f)) {}
+
+  bool await_ready() const noexcept { return false; }
+  template <typename P>
+  void await_suspend(std::coroutine_handle<P> h) {
+    promise_base *p = &h.promise();
+    p->sched->Block(p, [this] { f_(); });
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  F f_;
+};
+
+// Awaits an I/O call: tries its non-blocking form (which returns -EAGAIN if
+// it would block) and only runs the blocking form on a helper uthread when
+// it has to wait.
+template <typename Try, typename Block>
+class io_awaiter {
+ public:
+  io_awaiter(Try t, Block b) : try_(std::move(t)), block_(std::move(b)) {}
+
+  bool await_ready() {
+    ret_ = try_();
+    return ret_ != -EAGAIN;
+  }
+  template <typename P>
+  void await_suspend(std::coroutine_handle<P> h) {
+    promise_base *p = &h.promise();
+    p->sched->Block(p, [this] { ret_ = block_(); });
+  }
+  ssize_t await_resume() const noexcept { return ret_; }
+
+ private:
+  Try try_;
+  Block block_;
+  ssize_t ret_;
+};
+
+template <typename Try, typename Block>
+io_awaiter<Try, Block> make_io_awaiter(Try t, Block b) {
+  return io_awaiter<Try, Block>(std::move(t), std::move(b));
+}
+
+}  // namespace coro_internal
+
+// Awaits a page of remote memory, like the hint_fault() hints: returns right
+// away if the page is there, otherwise suspends the task until the fault is
+// serviced (with up to rdahead pages read ahead).
+class Fault {
+ public:
+  Fault(const void *addr, bool write = false, int rdahead = 0)
+      : addr_(const_cast<void *>(addr)), write_(write), rdahead_(rdahead) {}
+
+  bool await_ready() const noexcept {
+#if defined(REMOTE_MEMORY_HINTS) || defined(EDEN_HINTS)
+    return !is_rmem_ptr(addr_) || !__is_fault_pending(addr_, write_, true);
+#else
+    return true;
+#endif
+  }
+  template <typename P>
+  void await_suspend(std::coroutine_handle<P> h) {
+    coro_internal::promise_base *p = &h.promise();
+    void *addr = addr_;
+    bool write = write_;
+    int rdahead = rdahead_;
+
+    p->sched->Block(p, [addr, write, rdahead] {
+      if (__is_fault_pending(addr, write, false))
+        thread_park_on_fault(addr, write, rdahead, 0);
+    });
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  void *addr_;
+  bool write_;
+  int rdahead_;
+};
+
+// Awaits any blocking call (e.g., TcpQueue::Accept()) and returns its result.
+template <typename F>
+auto RunBlocking(F f) {
+  return coro_internal::blocking_awaiter<decltype(f()), F>(std::move(f));
+}
+
+// Awaits a read from a TCP stream.
+inline auto TcpRead(TcpConn *c, void *buf, size_t len) {
+  return coro_internal::make_io_awaiter(
+      [c, buf, len] { return c->TryRead(buf, len); },
+      [c, buf, len] { return c->Read(buf, len); });
+}
+
+// Awaits a write to a TCP stream.
+inline auto TcpWrite(TcpConn *c, const void *buf, size_t len) {
+  return coro_internal::make_io_awaiter(
+      [c, buf, len] { return c->TryWrite(buf, len); },
+      [c, buf, len] { return c->Write(buf, len); });
+}
+
+// Awaits a datagram and gets its remote address.
+inline auto UdpReadFrom(UdpConn *c, void *buf, size_t len, netaddr *raddr) {
+  return coro_internal::make_io_awaiter(
+      [c, buf, len, raddr] { return c->TryReadFrom(buf, len, raddr); },
+      [c, buf, len, raddr] { return c->ReadFrom(buf, len, raddr); });
+}
+
+}  // namespace rt
@@ -0,0 +1,732 @@
+// far_memory.h - far-memory pointers and containers that hint their accesses
+//
+// far_ptr<T>, far_vector<T> and far_hash_map<K, V> place the page fault hints
+// of pgfault.h themselves, so data structures can be ported without hand-
+// placed hint_* macros. Single accesses hint the pages of the object (picking
+// the cheapest hint for the type, see far_internal::hinter) and iteration
+// hints a window of pages ahead. Accessing an object through a pointer or
+// container to const hints a read, anything else hints a write. Pointers
+// outside of remote memory are never hinted.
+
+#pragma once
+
+extern "C" {
+#include <base/stddef.h>
+#include <rmem/api.h>
+#include <runtime/preempt.h>
+}
+
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "pgfault.h"
+
+namespace rt {
+namespace far_internal {
+
+// Pages hinted ahead of sequential scans.
+constexpr unsigned long kSeqReadahead = 15;
+
+// Hints the pages of [p, p + size), with as few hints as read-ahead allows.
+inline void hint_range(const void *p, size_t size, bool write) {
+  unsigned long addr = PAGE_ID(p);
+  unsigned long end = (unsigned long)p + size;
+  unsigned long rd;
+
+  if (!size || !is_rmem_ptr(p)) return;
+  while (addr < end) {
+    rd = std::min<unsigned long>((end - 1 - addr) >> EDEN_PAGE_SHIFT,
+                                 EDEN_MAX_READAHEAD);
+    if (write) {
+      hint_write_fault_rdahead((void *)addr, (int)rd);
+    } else {
+      hint_read_fault_rdahead((void *)addr, (int)rd);
+    }
+    addr += (rd + 1) << EDEN_PAGE_SHIFT;
+  }
+}
+
+// How an object is hinted, from its size and alignment. An object no larger
+// than its alignment cannot cross a page so it takes a single check, other
+// objects up to a page may straddle two and larger ones span several.
+enum class HintKind { kOnePage, kTwoPages, kSpan };
+
+template <size_t Size, size_t Align>
+struct hint_kind {
+  static constexpr HintKind value =
+      Size > EDEN_PAGE_SIZE ? HintKind::kSpan
+                            : Size <= Align ? HintKind::kOnePage
+                                            : HintKind::kTwoPages;
+};
+
+template <typename T,
+          HintKind K = hint_kind<sizeof(T), alignof(T)>::value>
+struct hinter;
+
+template <typename T>
+struct hinter<T, HintKind::kOnePage> {
+  static void read(const T *p) {
+    if (is_rmem_ptr(p)) {
+      hint_read_fault((void *)p);
+    }
+  }
+  static void write(const T *p) {
+    if (is_rmem_ptr(p)) {
+      hint_write_fault((void *)p);
+    }
+  }
+};
+
+template <typename T>
+struct hinter<T, HintKind::kTwoPages> {
+  static void read(const T *p) {
+    if (is_rmem_ptr(p)) {
+      hint_read_fault_pb_safe((void *)p, sizeof(T))
+    }
+  }
+  static void write(const T *p) {
+    if (is_rmem_ptr(p)) {
+      hint_write_fault_pb_safe((void *)p, sizeof(T))
+    }
+  }
+};
+
+template <typename T>
+struct hinter<T, HintKind::kSpan> {
+  static void read(const T *p) { hint_range(p, sizeof(T), false); }
+  static void write(const T *p) { hint_range(p, sizeof(T), true); }
+};
+
+// Hints an access to an object: a read if it is const, a write otherwise.
+template <typename T>
+inline void hint_access(T *p) {
+  typedef typename std::remove_const<T>::type U;
+  if (std::is_const<T>::value)
+    hinter<U>::read(p);
+  else
+    hinter<U>::write(p);
+}
+
+// Hints a forward scan over [.., limit), kSeqReadahead pages at a time.
+class seq_hint {
+ public:
+  seq_hint() : start_(0), end_(0) {}
+
+  void access(const void *p, size_t size, const void *limit, bool write) {
+    unsigned long addr = (unsigned long)p;
+    size_t len;
+
+    if (likely(addr >= start_ && addr + size <= end_)) return;
+    len = std::max<size_t>(size, std::min<size_t>(
+        (unsigned long)limit - addr,
+        (kSeqReadahead + 1) * EDEN_PAGE_SIZE - (addr - PAGE_ID(addr))));
+    hint_range(p, len, write);
+    start_ = PAGE_ID(addr);
+    end_ = addr + len;
+  }
+
+ private:
+  unsigned long start_;
+  unsigned long end_;
+};
+
+// Random-access iterator over contiguous objects that hints sequentially.
+template <typename T>
+class seq_iterator {
+ public:
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef typename std::remove_const<T>::type value_type;
+  typedef ptrdiff_t difference_type;
+  typedef T *pointer;
+  typedef T &reference;
+
+  seq_iterator() : p_(nullptr), limit_(nullptr) {}
+  seq_iterator(T *p, T *limit) : p_(p), limit_(limit) {}
+  template <typename U, typename = typename std::enable_if<
+                            std::is_convertible<U *, T *>::value>::type>
+  seq_iterator(const seq_iterator<U> &o) : p_(o.p_), limit_(o.limit_) {}
+
+  reference operator*() const { hint(); return *p_; }
+  pointer operator->() const { hint(); return p_; }
+  reference operator[](difference_type n) const { return *(*this + n); }
+
+  seq_iterator &operator++() { ++p_; return *this; }
+  seq_iterator operator++(int) { seq_iterator it = *this; ++p_; return it; }
+  seq_iterator &operator--() { --p_; return *this; }
+  seq_iterator operator--(int) { seq_iterator it = *this; --p_; return it; }
+  seq_iterator &operator+=(difference_type n) { p_ += n; return *this; }
+  seq_iterator &operator-=(difference_type n) { p_ -= n; return *this; }
+  seq_iterator operator+(difference_type n) const {
+    return seq_iterator(p_ + n, limit_);
+  }
+  seq_iterator operator-(difference_type n) const {
+    return seq_iterator(p_ - n, limit_);
+  }
+  difference_type operator-(const seq_iterator &o) const { return p_ - o.p_; }
+
+  bool operator==(const seq_iterator &o) const { return p_ == o.p_; }
+  bool operator!=(const seq_iterator &o) const { return p_ != o.p_; }
+  bool operator<(const seq_iterator &o) const { return p_ < o.p_; }
+  bool operator>(const seq_iterator &o) const { return p_ > o.p_; }
+  bool operator<=(const seq_iterator &o) const { return p_ <= o.p_; }
+  bool operator>=(const seq_iterator &o) const { return p_ >= o.p_; }
+
+ private:
+  template <typename>
+  friend class seq_iterator;
+
+  void hint() const {
+    hint_.access(p_, sizeof(T), limit_, !std::is_const<T>::value);
+  }
+
+  T *p_;
+  T *limit_;
+  mutable seq_hint hint_;
+};
+
+}  // namespace far_internal
+
+// Allocates from remote memory with rmalloc(). Allocations take whole pages
+// and their addresses are not reused, so it suits large, long-lived storage.
+template <typename T>
+class rmem_allocator {
+ public:
+  typedef T value_type;
+
+  rmem_allocator() noexcept {}
+  template <typename U>
+  rmem_allocator(const rmem_allocator<U> &) noexcept {}
+
+  T *allocate(size_t n) {
+    void *p;
+
+    preempt_disable();
+    p = rmalloc(n * sizeof(T));
+    preempt_enable();
+    if (unlikely(!p)) throw std::bad_alloc();
+    return static_cast<T *>(p);
+  }
+
+  void deallocate(T *p, size_t n) noexcept {
+    preempt_disable();
+    rmunmap(p, align_up(n * sizeof(T), EDEN_PAGE_SIZE));
+    preempt_enable();
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const rmem_allocator<T> &, const rmem_allocator<U> &) {
+  return true;
+}
+template <typename T, typename U>
+bool operator!=(const rmem_allocator<T> &, const rmem_allocator<U> &) {
+  return false;
+}
+
+// A pointer to an object in remote memory that hints the object's pages on
+// dereference: a read for far_ptr<const T>, a write for far_ptr<T>. Use
+// read() to only hint a read through a far_ptr<T>.
+template <typename T>
+class far_ptr {
+ public:
+  typedef T element_type;
+
+  far_ptr() : p_(nullptr) {}
+  far_ptr(std::nullptr_t) : p_(nullptr) {}
+  explicit far_ptr(T *p) : p_(p) {}
+  template <typename U,
+            typename = typename std::enable_if<
+                std::is_convertible<U *, T *>::value>::type>
+  far_ptr(const far_ptr<U> &o) : p_(o.get()) {}
+
+  // Gets the raw pointer, without hinting.
+  T *get() const { return p_; }
+
+  // Hints a read and returns the object.
+  const T &read() const {
+    far_internal::hinter<typename std::remove_const<T>::type>::read(p_);
+    return *p_;
+  }
+
+  // Hints a write and returns the object.
+  T &write() const {
+    far_internal::hinter<typename std::remove_const<T>::type>::write(p_);
+    return *p_;
+  }
+
+  T &operator*() const { far_internal::hint_access(p_); return *p_; }
+  T *operator->() const { far_internal::hint_access(p_); return p_; }
+  T &operator[](ptrdiff_t i) const { return *(*this + i); }
+  explicit operator bool() const { return p_ != nullptr; }
+
+  far_ptr &operator++() { ++p_; return *this; }
+  far_ptr operator++(int) { far_ptr o = *this; ++p_; return o; }
+  far_ptr &operator--() { --p_; return *this; }
+  far_ptr operator--(int) { far_ptr o = *this; --p_; return o; }
+  far_ptr &operator+=(ptrdiff_t n) { p_ += n; return *this; }
+  far_ptr &operator-=(ptrdiff_t n) { p_ -= n; return *this; }
+  far_ptr operator+(ptrdiff_t n) const { return far_ptr(p_ + n); }
+  far_ptr operator-(ptrdiff_t n) const { return far_ptr(p_ - n); }
+  ptrdiff_t operator-(const far_ptr &o) const { return p_ - o.p_; }
+
+  bool operator==(const far_ptr &o) const { return p_ == o.p_; }
+  bool operator!=(const far_ptr &o) const { return p_ != o.p_; }
+  bool operator<(const far_ptr &o) const { return p_ < o.p_; }
+
+ private:
+  T *p_;
+};
+
+// A vector in remote memory (by default) that hints its element accesses.
+// Element storage is contiguous so iteration hints pages well ahead.
+template <typename T, typename Alloc = rmem_allocator<T>>
+class far_vector {
+ public:
+  typedef T value_type;
+  typedef size_t size_type;
+  typedef T &reference;
+  typedef const T &const_reference;
+  typedef far_internal::seq_iterator<T> iterator;
+  typedef far_internal::seq_iterator<const T> const_iterator;
+
+  far_vector() : begin_(nullptr), end_(nullptr), cap_(nullptr) {}
+  explicit far_vector(size_t n) : far_vector() { resize(n); }
+  far_vector(size_t n, const T &value) : far_vector() { resize(n, value); }
+  far_vector(std::initializer_list<T> init) : far_vector() {
+    reserve(init.size());
+    for (const T &v : init) push_back(v);
+  }
+  far_vector(const far_vector &o) : far_vector() {
+    reserve(o.size());
+    for (const T &v : o) push_back(v);
+  }
+  far_vector(far_vector &&o) noexcept
+      : alloc_(std::move(o.alloc_)), begin_(o.begin_), end_(o.end_),
+        cap_(o.cap_) {
+    o.begin_ = o.end_ = o.cap_ = nullptr;
+  }
+  ~far_vector() { release(); }
+
+  far_vector &operator=(const far_vector &o) {
+    if (this != &o) {
+      far_vector tmp(o);
+      swap(tmp);
+    }
+    return *this;
+  }
+  far_vector &operator=(far_vector &&o) noexcept {
+    far_vector tmp(std::move(o));
+    swap(tmp);
+    return *this;
+  }
+
+  void swap(far_vector &o) noexcept {
+    std::swap(alloc_, o.alloc_);
+    std::swap(begin_, o.begin_);
+    std::swap(end_, o.end_);
+    std::swap(cap_, o.cap_);
+  }
+
+  size_t size() const { return end_ - begin_; }
+  size_t capacity() const { return cap_ - begin_; }
+  bool empty() const { return begin_ == end_; }
+
+  // Raw storage, without hinting.
+  T *data() { return begin_; }
+  const T *data() const { return begin_; }
+
+  reference operator[](size_t i) {
+    assert(i < size());
+    far_internal::hinter<T>::write(begin_ + i);
+    return begin_[i];
+  }
+  const_reference operator[](size_t i) const {
+    assert(i < size());
+    far_internal::hinter<T>::read(begin_ + i);
+    return begin_[i];
+  }
+  reference front() { return (*this)[0]; }
+  const_reference front() const { return (*this)[0]; }
+  reference back() { return (*this)[size() - 1]; }
+  const_reference back() const { return (*this)[size() - 1]; }
+
+  iterator begin() { return iterator(begin_, end_); }
+  iterator end() { return iterator(end_, end_); }
+  const_iterator begin() const { return const_iterator(begin_, end_); }
+  const_iterator end() const { return const_iterator(end_, end_); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  void reserve(size_t n) {
+    if (n > capacity()) grow(n);
+  }
+
+  void resize(size_t n) { resize(n, T()); }
+  void resize(size_t n, const T &value) {
+    if (n < size()) {
+      destroy(begin_ + n, end_);
+      end_ = begin_ + n;
+      return;
+    }
+    reserve(n);
+    far_internal::hint_range(end_, (n - size()) * sizeof(T), true);
+    for (; end_ < begin_ + n; ++end_) new (end_) T(value);
+  }
+
+  void push_back(const T &value) { emplace_back(value); }
+  void push_back(T &&value) { emplace_back(std::move(value)); }
+
+  template <typename... Args>
+  reference emplace_back(Args &&...args) {
+    if (unlikely(end_ == cap_)) {
+      // args may refer to an element, which is moved by grow()
+      T tmp(std::forward<Args>(args)...);
+      grow(std::max<size_t>(2 * capacity(), min_capacity()));
+      far_internal::hinter<T>::write(end_);
+      new (end_) T(std::move(tmp));
+      return *end_++;
+    }
+    far_internal::hinter<T>::write(end_);
+    new (end_) T(std::forward<Args>(args)...);
+    return *end_++;
+  }
+
+  void pop_back() {
+    assert(!empty());
+    (--end_)->~T();
+  }
+
+  void clear() {
+    destroy(begin_, end_);
+    end_ = begin_;
+  }
+
+ private:
+  typedef std::allocator_traits<Alloc> traits;
+
+  // at least a page worth of elements, as allocations take whole pages
+  static size_t min_capacity() {
+    return std::max<size_t>(1, EDEN_PAGE_SIZE / sizeof(T));
+  }
+
+  void grow(size_t n) {
+    T *p = traits::allocate(alloc_, n);
+    T *q = p;
+
+    far_internal::hint_range(begin_, size() * sizeof(T), false);
+    far_internal::hint_range(p, size() * sizeof(T), true);
+    for (T *o = begin_; o < end_; ++o, ++q) new (q) T(std::move_if_noexcept(*o));
+    release();
+    begin_ = p;
+    end_ = q;
+    cap_ = p + n;
+  }
+
+  void destroy(T *first, T *last) {
+    if (std::is_trivially_destructible<T>::value) return;
+    far_internal::hint_range(first, (last - first) * sizeof(T), true);
+    for (; first < last; ++first) first->~T();
+  }
+
+  void release() {
+    if (!begin_) return;
+    destroy(begin_, end_);
+    traits::deallocate(alloc_, begin_, capacity());
+    begin_ = end_ = cap_ = nullptr;
+  }
+
+  Alloc alloc_;
+  T *begin_;
+  T *end_;
+  T *cap_;
+};
+
+// An open-addressing (linear probing) hash map in remote memory (by default)
+// that hints the slots it probes. Probes stay within a page or two, so each
+// lookup takes about one hint. Iterators and references are invalidated by
+// insertions and erasures.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>,
+          typename Alloc = rmem_allocator<std::pair<const K, V>>>
+class far_hash_map {
+  struct slot;
+
+ public:
+  typedef K key_type;
+  typedef V mapped_type;
+  typedef std::pair<const K, V> value_type;
+
+  // Forward iterator over the entries, in slot order, hinting sequentially.
+  template <bool Const>
+  class iter {
+    typedef typename std::conditional<Const, const slot, slot>::type slot_t;
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename far_hash_map::value_type value_type;
+    typedef ptrdiff_t difference_type;
+    typedef typename std::conditional<Const, const value_type,
+                                      value_type>::type &reference;
+    typedef typename std::conditional<Const, const value_type,
+                                      value_type>::type *pointer;
+
+    iter() : s_(nullptr), limit_(nullptr) {}
+    template <bool C, typename = typename std::enable_if<Const || !C>::type>
+    iter(const iter<C> &o) : s_(o.s_), limit_(o.limit_) {}
+
+    reference operator*() const { return *s_->kv(); }
+    pointer operator->() const { return s_->kv(); }
+    iter &operator++() { ++s_; skip(); return *this; }
+    iter operator++(int) { iter it = *this; ++*this; return it; }
+    bool operator==(const iter &o) const { return s_ == o.s_; }
+    bool operator!=(const iter &o) const { return s_ != o.s_; }
+
+   private:
+    friend class far_hash_map;
+    template <bool>
+    friend class iter;
+
+    // at the first used slot from s, or at s itself (e.g., found by a lookup)
+    iter(slot_t *s, slot_t *limit, bool skip_unused) : s_(s), limit_(limit) {
+      if (skip_unused) skip();
+    }
+
+    // moves to the next used slot, hinting the pages on the way
+    void skip() {
+      for (; s_ < limit_; ++s_) {
+        hint_.access(s_, sizeof(slot), limit_, !Const);
+        if (s_->used) break;
+      }
+    }
+
+    slot_t *s_;
+    slot_t *limit_;
+    far_internal::seq_hint hint_;
+  };
+  typedef iter<false> iterator;
+  typedef iter<true> const_iterator;
+
+  far_hash_map() : slots_(nullptr), mask_(0), size_(0) {}
+  explicit far_hash_map(size_t n) : far_hash_map() { reserve(n); }
+  far_hash_map(const far_hash_map &o) : far_hash_map() {
+    reserve(o.size());
+    for (const value_type &kv : o) insert(kv);
+  }
+  far_hash_map(far_hash_map &&o) noexcept : far_hash_map() { swap(o); }
+  ~far_hash_map() { release(); }
+
+  far_hash_map &operator=(const far_hash_map &o) {
+    if (this != &o) {
+      far_hash_map tmp(o);
+      swap(tmp);
+    }
+    return *this;
+  }
+  far_hash_map &operator=(far_hash_map &&o) noexcept {
+    far_hash_map tmp(std::move(o));
+    swap(tmp);
+    return *this;
+  }
+
+  void swap(far_hash_map &o) noexcept {
+    std::swap(alloc_, o.alloc_);
+    std::swap(hash_, o.hash_);
+    std::swap(eq_, o.eq_);
+    std::swap(slots_, o.slots_);
+    std::swap(mask_, o.mask_);
+    std::swap(size_, o.size_);
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t bucket_count() const { return slots_ ? mask_ + 1 : 0; }
+
+  iterator begin() { return at(slots_, true); }
+  iterator end() { return at(slots_ + bucket_count(), false); }
+  const_iterator begin() const { return at(slots_, true); }
+  const_iterator end() const { return at(slots_ + bucket_count(), false); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  iterator find(const K &key) {
+    slot *s = lookup(key, true);
+    return s && s->used ? at(s, false) : end();
+  }
+  const_iterator find(const K &key) const {
+    const slot *s = const_cast<far_hash_map *>(this)->lookup(key, false);
+    return s && s->used ? at(s, false) : end();
+  }
+  size_t count(const K &key) const { return find(key) != end(); }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(const K &key, Args &&...args) {
+    slot *s;
+
+    reserve(size_ + 1);
+    s = lookup(key, true);
+    if (s->used) return std::make_pair(at(s, false), false);
+    new (s->kv()) value_type(std::piecewise_construct,
+                             std::forward_as_tuple(key),
+                             std::forward_as_tuple(std::forward<Args>(args)...));
+    s->used = true;
+    size_++;
+    return std::make_pair(at(s, false), true);
+  }
+
+  std::pair<iterator, bool> insert(const value_type &kv) {
+    return emplace(kv.first, kv.second);
+  }
+
+  V &operator[](const K &key) { return emplace(key).first->second; }
+
+  // Erases the entry of a key, if any, returning the number erased.
+  size_t erase(const K &key) {
+    slot *s = lookup(key, true);
+    slot *n;
+    size_t i, j, home;
+
+    if (!s || !s->used) return 0;
+
+    // shift later entries of the probe sequence back over the hole
+    // (backward-shift deletion, so there are no tombstones)
+    i = s - slots_;
+    for (j = (i + 1) & mask_;; j = (j + 1) & mask_) {
+      n = &slots_[j];
+      far_internal::hinter<slot>::write(n);
+      if (!n->used) break;
+      home = home_slot(n->kv()->first);
+      if (((j - home) & mask_) < ((j - i) & mask_)) continue;
+      slots_[i].kv()->~value_type();
+      new (slots_[i].kv()) value_type(std::move(*n->kv()));
+      i = j;
+    }
+    slots_[i].kv()->~value_type();
+    slots_[i].used = false;
+    size_--;
+    return 1;
+  }
+
+  void clear() {
+    size_t i;
+
+    if (!slots_) return;
+    far_internal::hint_range(slots_, bucket_count() * sizeof(slot), true);
+    for (i = 0; i <= mask_; i++) {
+      if (!slots_[i].used) continue;
+      slots_[i].kv()->~value_type();
+      slots_[i].used = false;
+    }
+    size_ = 0;
+  }
+
+  // Makes room for n entries without rehashing.
+  void reserve(size_t n) {
+    size_t nslots = 16;
+
+    if (slots_ && n * kMaxLoadDen <= bucket_count() * kMaxLoadNum) return;
+    while (n * kMaxLoadDen > nslots * kMaxLoadNum) nslots *= 2;
+    if (nslots < 2 * bucket_count()) nslots = 2 * bucket_count();
+    rehash(nslots);
+  }
+
+ private:
+  typedef typename std::allocator_traits<Alloc>::template rebind_alloc<slot>
+      slot_alloc;
+  typedef std::allocator_traits<slot_alloc> traits;
+
+  // at most 3/4 full
+  static constexpr size_t kMaxLoadNum = 3;
+  static constexpr size_t kMaxLoadDen = 4;
+
+  struct slot {
+    bool used;
+    typename std::aligned_storage<sizeof(value_type),
+                                  alignof(value_type)>::type storage;
+
+    value_type *kv() { return reinterpret_cast<value_type *>(&storage); }
+    const value_type *kv() const {
+      return reinterpret_cast<const value_type *>(&storage);
+    }
+  };
+
+  iterator at(slot *s, bool skip_unused) {
+    return iterator(s, slots_ + bucket_count(), skip_unused);
+  }
+  const_iterator at(const slot *s, bool skip_unused) const {
+    return const_iterator(s, slots_ + bucket_count(), skip_unused);
+  }
+
+  // scrambles the hash first, as std::hash is the identity for integers
+  size_t home_slot(const K &key) const {
+    size_t h = hash_(key) * 0x9e3779b97f4a7c15UL;
+    return (h ^ (h >> 32)) & mask_;
+  }
+
+  // Finds the slot of a key, or the free slot where it would go. Hints each
+  // page the probe sequence touches. Returns null if the map has no slots.
+  slot *lookup(const K &key, bool write) {
+    unsigned long page = 0;
+    size_t i;
+    slot *s;
+
+    if (!slots_) return nullptr;
+    for (i = home_slot(key);; i = (i + 1) & mask_) {
+      s = &slots_[i];
+      if (PAGE_ID(s) != page || PAGE_ID((char *)(s + 1) - 1) != page) {
+        if (write)
+          far_internal::hinter<slot>::write(s);
+        else
+          far_internal::hinter<slot>::read(s);
+        page = PAGE_ID((char *)(s + 1) - 1);
+      }
+      if (!s->used || eq_(s->kv()->first, key)) return s;
+    }
+  }
+
+  void rehash(size_t nslots) {
+    slot *old = slots_;
+    size_t oldn = bucket_count();
+    size_t i;
+    slot *s;
+
+    slots_ = traits::allocate(alloc_, nslots);
+    mask_ = nslots - 1;
+    far_internal::hint_range(slots_, nslots * sizeof(slot), true);
+    for (i = 0; i < nslots; i++) slots_[i].used = false;
+    if (!old) return;
+
+    far_internal::hint_range(old, oldn * sizeof(slot), false);
+    for (i = 0; i < oldn; i++) {
+      if (!old[i].used) continue;
+      s = lookup(old[i].kv()->first, true);
+      new (s->kv()) value_type(std::move(*old[i].kv()));
+      s->used = true;
+      old[i].kv()->~value_type();
+    }
+    traits::deallocate(alloc_, old, oldn);
+  }
+
+  void release() {
+    if (!slots_) return;
+    clear();
+    traits::deallocate(alloc_, slots_, bucket_count());
+    slots_ = nullptr;
+    mask_ = 0;
+  }
+
+  slot_alloc alloc_;
+  Hash hash_;
+  KeyEqual eq_;
+  slot *slots_;
+  size_t mask_;
+  size_t size_;
+};
+
+}  // namespace rt
@@ -55,6 +55,11 @@ class UdpConn : public NetConn {
     return udp_read_from(c_, buf, len, raddr);
   }
 
+  // Reads a datagram without blocking, or returns -EAGAIN if there is none.
+  ssize_t TryReadFrom(void *buf, size_t len, netaddr *raddr) {
+    return udp_try_read_from(c_, buf, len, raddr);
+  }
+
   // Writes a datagram and sets to remote address.
   ssize_t WriteTo(const void *buf, size_t len, const netaddr *raddr) {
     return udp_write_to(c_, buf, len, raddr);
@@ -113,6 +118,14 @@ class TcpConn : public NetConn {
   ssize_t Write(const void *buf, size_t len) {
     return tcp_write(c_, buf, len);
   }
+  // Reads from the TCP stream without blocking (-EAGAIN if no data).
+  ssize_t TryRead(void *buf, size_t len) {
+    return tcp_try_read(c_, buf, len);
+  }
+  // Writes to the TCP stream without blocking (-EAGAIN if no window).
+  ssize_t TryWrite(const void *buf, size_t len) {
+    return tcp_try_write(c_, buf, len);
+  }
   // Reads a vector from the TCP stream.
   ssize_t Readv(const iovec *iov, int iovcnt) {
     return tcp_readv(c_, iov, iovcnt);
@@ -0,0 +1,223 @@
+// parallel.h - fork-join parallel algorithms over uthreads
+//
+// The algorithms split their range in halves until the pieces are at most
+// grain elements, forking a uthread for each split, so idle kthreads pick up
+// the pieces by stealing uthreads. A grain of 0 picks one that makes about
+// kDefaultChunks pieces.
+//
+// The forms that take pointers know where their data lives: each piece hints
+// its pages before touching them, which parks the uthread on a fault instead
+// of blocking the core, and prefetches the pages of the next piece from a
+// helper uthread so they arrive while this one is processed.
+
+#pragma once
+
+extern "C" {
+#include <base/stddef.h>
+#include <rmem/api.h>
+}
+
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include "far_memory.h"
+#include "pgfault.h"
+#include "thread.h"
+
+namespace rt {
+namespace parallel_internal {
+
+// Pieces per range when no grain is given.
+constexpr size_t kDefaultChunks = 256;
+
+inline size_t grain_for(size_t n, size_t grain) {
+  return grain ? grain : std::max<size_t>(1, div_up(n, kDefaultChunks));
+}
+
+// Calls fn(lo, hi) for pieces of [begin, end) of at most grain elements.
+template <typename F>
+void fork_join(size_t begin, size_t end, size_t grain, const F &fn) {
+  size_t mid;
+
+  if (end - begin <= grain) {
+    if (begin < end) fn(begin, end);
+    return;
+  }
+  mid = begin + (end - begin) / 2;
+  Thread th([&] { fork_join(mid, end, grain, fn); });
+  fork_join(begin, mid, grain, fn);
+  th.Join();
+}
+
+// Hints a piece [lo, hi) about to be processed and prefetches the next piece
+// of the same size (up to limit) if its first page is not there yet.
+template <typename T>
+void hint_piece(const T *lo, const T *hi, const T *limit, bool write) {
+  far_internal::hint_range(lo, (hi - lo) * sizeof(T), write);
+#if defined(REMOTE_MEMORY_HINTS) || defined(EDEN_HINTS)
+  const T *next = hi;
+  const T *next_end = std::min(limit, hi + (hi - lo));
+
+  if (next < next_end && is_rmem_ptr(next) &&
+      __is_fault_pending((void *)next, false, false)) {
+    Spawn([next, next_end] {
+      far_internal::hint_range(next, (next_end - next) * sizeof(T), false);
+    });
+  }
+#endif
+}
+
+template <typename T, typename Compare>
+void sort(T *first, T *last, T *limit, const Compare &comp, size_t grain) {
+  T *mid;
+
+  if ((size_t)(last - first) <= grain) {
+    hint_piece(first, last, limit, true);
+    std::sort(first, last, comp);
+    return;
+  }
+  mid = first + (last - first) / 2;
+  Thread th([&] { sort(mid, last, limit, comp, grain); });
+  sort(first, mid, limit, comp, grain);
+  th.Join();
+  std::inplace_merge(first, mid, last, comp);
+}
+
+}  // namespace parallel_internal
+
+// Calls fn(i) for each i in [begin, end).
+template <typename F>
+void parallel_for(size_t begin, size_t end, const F &fn, size_t grain = 0) {
+  if (begin >= end) return;
+  grain = parallel_internal::grain_for(end - begin, grain);
+  parallel_internal::fork_join(begin, end, grain,
+                               [&](size_t lo, size_t hi) {
+                                 for (size_t i = lo; i < hi; i++) fn(i);
+                               });
+}
+
+// Calls fn(x) for each element x of [first, last).
+template <typename T, typename F>
+void parallel_for(T *first, T *last, const F &fn, size_t grain = 0) {
+  size_t n = last - first;
+
+  if (!n) return;
+  grain = parallel_internal::grain_for(n, grain);
+  parallel_internal::fork_join(0, n, grain, [&](size_t lo, size_t hi) {
+    parallel_internal::hint_piece(first + lo, first + hi, last,
+                                  !std::is_const<T>::value);
+    for (T *p = first + lo; p < first + hi; p++) fn(*p);
+  });
+}
+
+// Combines identity and the results of map(i) for each i in [begin, end)
+// with op, which must be associative.
+template <typename R, typename Map, typename Op>
+R parallel_reduce(size_t begin, size_t end, R identity, const Map &map,
+                  const Op &op, size_t grain = 0) {
+  std::vector<R> partial;
+  size_t n = end - begin;
+  R r = identity;
+
+  if (begin >= end) return identity;
+  grain = parallel_internal::grain_for(n, grain);
+  partial.assign(div_up(n, grain), identity);
+  parallel_for(0, partial.size(), [&](size_t c) {
+    size_t hi = std::min(end, begin + (c + 1) * grain);
+    R s = identity;
+    for (size_t i = begin + c * grain; i < hi; i++) s = op(s, map(i));
+    partial[c] = s;
+  }, 1);
+  for (const R &s : partial) r = op(r, s);
+  return r;
+}
+
+// Combines identity and the elements of [first, last) with op, which must be
+// associative.
+template <typename T, typename R, typename Op>
+R parallel_reduce(const T *first, const T *last, R identity, const Op &op,
+                  size_t grain = 0) {
+  std::vector<R> partial;
+  size_t n = last - first;
+  R r = identity;
+
+  if (!n) return identity;
+  grain = parallel_internal::grain_for(n, grain);
+  partial.assign(div_up(n, grain), identity);
+  parallel_for(0, partial.size(), [&](size_t c) {
+    const T *lo = first + c * grain;
+    const T *hi = std::min(last, lo + grain);
+    R s = identity;
+    parallel_internal::hint_piece(lo, hi, last, false);
+    for (const T *p = lo; p < hi; p++) s = op(s, *p);
+    partial[c] = s;
+  }, 1);
+  for (const R &s : partial) r = op(r, s);
+  return r;
+}
+
+// Sorts [first, last) with comp: sorts pieces of at most grain elements in
+// parallel and merges them up. Not stable.
+template <typename T, typename Compare,
+          typename = typename std::enable_if<
+              !std::is_integral<Compare>::value>::type>
+void parallel_sort(T *first, T *last, const Compare &comp, size_t grain = 0) {
+  size_t n = last - first;
+
+  if (n < 2) return;
+  grain = parallel_internal::grain_for(n, grain);
+  parallel_internal::sort(first, last, last, comp, grain);
+}
+
+template <typename T>
+void parallel_sort(T *first, T *last, size_t grain = 0) {
+  parallel_sort(first, last, std::less<T>(), grain);
+}
+
+// Writes the inclusive scan of [first, last) with op (which must be
+// associative) to out, which may be first. Scans the pieces for their
+// totals, adds the totals up and then scans the pieces again from there.
+template <typename T, typename Op>
+void parallel_scan(const T *first, const T *last, T *out, T identity,
+                   const Op &op, size_t grain = 0) {
+  std::vector<T> carry;
+  size_t n = last - first;
+  size_t c;
+  T sum, s;
+
+  if (!n) return;
+  grain = parallel_internal::grain_for(n, grain);
+  carry.assign(div_up(n, grain), identity);
+  parallel_for(0, carry.size(), [&](size_t c) {
+    const T *lo = first + c * grain;
+    const T *hi = std::min(last, lo + grain);
+    T s = identity;
+    parallel_internal::hint_piece(lo, hi, last, false);
+    for (const T *p = lo; p < hi; p++) s = op(s, *p);
+    carry[c] = s;
+  }, 1);
+
+  sum = identity;
+  for (c = 0; c < carry.size(); c++) {
+    s = carry[c];
+    carry[c] = sum;
+    sum = op(sum, s);
+  }
+
+  parallel_for(0, carry.size(), [&](size_t c) {
+    size_t lo = c * grain;
+    size_t hi = std::min(n, lo + grain);
+    T s = carry[c];
+    if (out != first)
+      parallel_internal::hint_piece(first + lo, first + hi, last, false);
+    parallel_internal::hint_piece(out + lo, out + hi, out + n, true);
+    for (size_t i = lo; i < hi; i++) {
+      s = op(s, first[i]);
+      out[i] = s;
+    }
+  }, 1);
+}
+
+}  // namespace rt
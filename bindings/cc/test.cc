@@ -3,7 +3,11 @@ extern "C" {
 #include <base/log.h>
 }
 
+#include <algorithm>
 #include <string>
+#include <vector>
+#include "far_memory.h"
+#include "parallel.h"
 #include "pgfault.h"
 #include "thread.h"
 #include "timer.h"
@@ -17,6 +21,45 @@ void foo(int arg) {
   if (arg != kTestValue) BUG();
 }
 
+void TestParallel() {
+  constexpr size_t n = 10000;
+  std::vector<long> v(n), out(n);
+  std::vector<int> hits(n, 0);
+
+  rt::parallel_for(0, n, [&](size_t i) { hits[i]++; });
+  for (int h : hits)
+    if (h != 1) BUG();
+
+  for (size_t i = 0; i < n; i++) v[i] = i;
+  rt::parallel_for(v.data(), v.data() + n, [](long &x) { x *= 2; }, 7);
+  for (size_t i = 0; i < n; i++)
+    if (v[i] != (long)(2 * i)) BUG();
+
+  long sum = rt::parallel_reduce(0, n, 0L, [](size_t i) { return (long)i; },
+                                 [](long a, long b) { return a + b; });
+  if (sum != (long)(n * (n - 1) / 2)) BUG();
+  sum = rt::parallel_reduce((const long *)v.data(),
+                            (const long *)v.data() + n, 0L,
+                            [](long a, long b) { return a + b; });
+  if (sum != (long)(n * (n - 1))) BUG();
+
+  for (size_t i = 0; i < n; i++) v[i] = (i * 7919) % n;
+  rt::parallel_sort(v.data(), v.data() + n);
+  if (!std::is_sorted(v.begin(), v.end())) BUG();
+  rt::parallel_sort(v.data(), v.data() + n, std::greater<long>(), 100);
+  if (!std::is_sorted(v.begin(), v.end(), std::greater<long>())) BUG();
+
+  // scan into another buffer and in place
+  for (size_t i = 0; i < n; i++) v[i] = 1;
+  rt::parallel_scan((const long *)v.data(), (const long *)v.data() + n,
+                    out.data(), 0L, [](long a, long b) { return a + b; });
+  for (size_t i = 0; i < n; i++)
+    if (v[i] != 1 || out[i] != (long)(i + 1)) BUG();
+  rt::parallel_scan((const long *)v.data(), (const long *)v.data() + n,
+                    v.data(), 0L, [](long a, long b) { return a + b; }, 64);
+  if (v != out) BUG();
+}
+
 void MainHandler(void *arg) {
   std::string str = "captured!";
   int i = kTestValue;
@@ -43,6 +86,19 @@ void MainHandler(void *arg) {
     foo(i);
   });
   th.Join();
+
+  rt::far_vector<int> v;
+  rt::far_hash_map<int, int> m;
+  for (int k = 0; k < kTestValue; k++) {
+    v.push_back(k);
+    m[k] = k;
+  }
+  for (int k : v)
+    if (m.find(k)->second != k) BUG();
+  m.erase(0);
+  if (m.size() != v.size() - 1 || m.count(0)) BUG();
+
+  TestParallel();
 }
 
 } // anonymous namespace
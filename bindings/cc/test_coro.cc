@@ -0,0 +1,90 @@
+extern "C" {
+#include <base/stddef.h>
+#include <base/log.h>
+}
+
+#include <stdexcept>
+
+#include "coro.h"
+#include "thread.h"
+#include "timer.h"
+
+namespace {
+
+constexpr int kTestValue = 10;
+constexpr int kNumTasks = 100;
+
+rt::Task<int> Double(int x) { co_return x * 2; }
+
+rt::Task<int> Nested(int x) {
+  int y = co_await Double(x);
+  co_return co_await Double(y);
+}
+
+rt::Task<void> Throws() {
+  co_await rt::RunBlocking([] { rt::Yield(); });
+  throw std::runtime_error("thrown");
+}
+
+// Built to check the I/O awaiters; needs a peer so it is not run.
+[[maybe_unused]] rt::Task<void> Echo(rt::TcpConn *c) {
+  char buf[64];
+  ssize_t n;
+
+  while ((n = co_await rt::TcpRead(c, buf, sizeof(buf))) > 0)
+    if (co_await rt::TcpWrite(c, buf, n) != n) break;
+}
+
+rt::Task<void> Worker(int *done) {
+  int v = co_await Nested(kTestValue);
+  if (v != kTestValue * 4) BUG();
+
+  // a blocking call on a helper uthread, with and without a result
+  int r = co_await rt::RunBlocking([] {
+    rt::Sleep(1 * rt::kMilliseconds);
+    return kTestValue;
+  });
+  if (r != kTestValue) BUG();
+  co_await rt::RunBlocking([] { rt::Yield(); });
+
+  // local memory never faults
+  co_await rt::Fault(&v, true, 0);
+
+  bool caught = false;
+  try {
+    co_await Throws();
+  } catch (const std::runtime_error &) {
+    caught = true;
+  }
+  if (!caught) BUG();
+
+  (*done)++;
+}
+
+void MainHandler(void *arg) {
+  rt::CoScheduler sched;
+  int done = 0;
+
+  for (int i = 0; i < kNumTasks; i++) sched.Spawn(Worker(&done));
+  sched.Run();
+  if (done != kNumTasks) BUG();
+  log_info("coroutine test done");
+}
+
+}  // anonymous namespace
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    printf("arg must be config file\n");
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], MainHandler, NULL);
+  if (ret) {
+    log_err("failed to start runtime");
+    return ret;
+  }
+  return 0;
+}
@@ -8,6 +8,9 @@
 #include <base/slab.h>
 #include <base/tcache.h>
 
+#include <rmem/api.h>
+
+#include <runtime/pgfault.h>
 #include <runtime/preempt.h>
 #include <runtime/smalloc.h>
 #include <runtime/sync.h>
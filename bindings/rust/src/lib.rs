@@ -8,6 +8,7 @@
 #![feature(get_mut_unchecked)]
 
 extern crate byteorder;
+extern crate libc;
 
 use std::cell::UnsafeCell;
 use std::ffi::CString;
@@ -22,6 +23,7 @@ pub mod ffi {
 }
 
 mod asm;
+pub mod rmem;
 pub mod tcp;
 pub mod thread;
 pub mod udp;
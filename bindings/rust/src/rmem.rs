@@ -0,0 +1,472 @@
+//! Far memory: page fault hints, prefetching and advice, and far-memory
+//! allocations with hinted access (`FarBox`, `FarVec`).
+//!
+//! Hints check whether a page of remote memory is locally present and, if
+//! not, park the calling uthread until it is, instead of taking the fault in
+//! the kernel (see `runtime/pgfault.h`). Addresses outside remote memory are
+//! never hinted, so all of this is safe to use on local memory.
+
+#[cfg(feature = "shim")]
+use std::alloc::{GlobalAlloc, Layout};
+use std::mem;
+use std::ops::{Deref, DerefMut, Index, IndexMut};
+use std::os::raw::{c_int, c_void};
+
+use super::*;
+
+pub const PAGE_SHIFT: usize = 12;
+pub const PAGE_SIZE: usize = 1 << PAGE_SHIFT;
+pub const MAX_READAHEAD: usize = 63;
+
+/// Pages hinted ahead of sequential scans.
+const SEQ_READAHEAD: usize = 15;
+
+extern "C" {
+    static rmem_hints_enabled: bool;
+}
+
+/// Whether `ptr` points into remote memory (one range compare).
+#[inline]
+pub fn is_rmem_ptr<T>(ptr: *const T) -> bool {
+    unsafe { (ptr as usize).wrapping_sub(ffi::rmem_va_start as usize) < ffi::rmem_va_size as usize }
+}
+
+#[inline]
+fn page_id(addr: usize) -> usize {
+    addr & !(PAGE_SIZE - 1)
+}
+
+/// Hints an access to the page of `addr`, reading ahead `rdahead` pages
+/// and giving the pages eviction priority `prio` (higher is evicted sooner).
+#[inline]
+pub fn hint_fault<T>(addr: *const T, write: bool, rdahead: usize, prio: usize) {
+    if !is_rmem_ptr(addr) || unsafe { !rmem_hints_enabled } {
+        return;
+    }
+    debug_assert!(rdahead <= MAX_READAHEAD);
+    unsafe {
+        let addr = addr as *mut c_void;
+        if ffi::__is_fault_pending(addr, write, true) {
+            ffi::thread_park_on_fault(addr, write, rdahead as c_int, prio as c_int);
+        }
+    }
+}
+
+#[inline]
+pub fn hint_read_fault<T>(addr: *const T) {
+    hint_fault(addr, false, 0, 0)
+}
+
+#[inline]
+pub fn hint_write_fault<T>(addr: *const T) {
+    hint_fault(addr, true, 0, 0)
+}
+
+/// Hints the pages of `[addr, addr + len)`, with as few hints as read-ahead
+/// allows.
+pub fn hint_range<T>(addr: *const T, len: usize, write: bool) {
+    let end = addr as usize + len;
+    let mut page = page_id(addr as usize);
+
+    if len == 0 || !is_rmem_ptr(addr) {
+        return;
+    }
+    while page < end {
+        let rd = ((end - 1 - page) >> PAGE_SHIFT).min(MAX_READAHEAD);
+        hint_fault(page as *const u8, write, rd, 0);
+        page += (rd + 1) << PAGE_SHIFT;
+    }
+}
+
+/// Hints an access to one object, picking the cheapest hint for its type:
+/// objects no larger than their alignment never cross a page, others up to
+/// a page may straddle two and larger ones span several.
+#[inline]
+pub fn hint_object<T>(ptr: *const T, write: bool) {
+    let size = mem::size_of::<T>();
+    let addr = ptr as usize;
+
+    if size > PAGE_SIZE {
+        hint_range(ptr, size, write);
+    } else if size <= mem::align_of::<T>() || page_id(addr) == page_id(addr + size - 1) {
+        hint_fault(ptr, write, 0, 0);
+    } else {
+        hint_fault(ptr, write, 1, 0);
+        hint_fault((addr + size - 1) as *const u8, write, 0, 0);
+    }
+}
+
+/// Brings the pages of `[addr, addr + len)` in from a separate uthread, so
+/// that the caller carries on while they are read.
+pub fn prefetch<T>(addr: *const T, len: usize) {
+    let addr = addr as usize;
+
+    if len == 0 || !is_rmem_ptr(addr as *const u8) {
+        return;
+    }
+    thread::spawn_detached(move || hint_range(addr as *const u8, len, false));
+}
+
+/// Advice for `advise()`.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Advice {
+    /// The pages are dropped now and read back as zero.
+    DontNeed,
+    /// The pages may be dropped whenever memory is needed.
+    Free,
+    /// The pages are read once, in order: they are read ahead aggressively
+    /// and evicted soon after the scan moves past them.
+    Sequential,
+    /// Undoes `Sequential`.
+    Normal,
+}
+
+/// Gives advice on pages of remote memory allocated with `rmalloc()`, like
+/// `madvise()`. Unsafe as `DontNeed` and `Free` lose the contents of the
+/// pages.
+pub unsafe fn advise<T>(addr: *mut T, len: usize, advice: Advice) -> Result<(), i32> {
+    let advice = match advice {
+        Advice::DontNeed => libc::MADV_DONTNEED,
+        Advice::Free => libc::MADV_FREE,
+        Advice::Sequential => libc::MADV_SEQUENTIAL,
+        Advice::Normal => libc::MADV_NORMAL,
+    };
+    preempt_disable();
+    let ret = ffi::rmadvise(addr as *mut c_void, len, advice);
+    preempt_enable();
+    convert_error(ret)
+}
+
+/// Maps the pages of a fresh allocation from `rmalloc()` ahead of their first
+/// access, instead of faulting them in one at a time (see `rmpopulate()`).
+/// Returns the number of pages mapped, or `-EINVAL` for a range outside remote
+/// memory.
+pub fn populate<T>(addr: *mut T, len: usize, write: bool) -> Result<usize, i32> {
+    preempt_disable();
+    let ret = unsafe { ffi::rmpopulate(addr as *mut c_void, len, write) };
+    preempt_enable();
+    if ret < 0 {
+        Err(ret as i32)
+    } else {
+        Ok(ret as usize)
+    }
+}
+
+/// Has the runtime save the pages in local memory to `rmem_hotset_file`, for
+/// the next run to read back at start (see `rmcheckpoint()`). Does not wait
+/// for the save.
+pub fn checkpoint() -> Result<(), i32> {
+    preempt_disable();
+    let ret = unsafe { ffi::rmcheckpoint() };
+    preempt_enable();
+    convert_error(ret)
+}
+
+/// Allocates `size` bytes (rounded up to pages) of remote memory. Addresses
+/// are not reused, so this is meant for large, long-lived buffers.
+pub fn rmalloc(size: usize) -> *mut u8 {
+    preempt_disable();
+    let ptr = unsafe { ffi::rmalloc(size) };
+    preempt_enable();
+    ptr as *mut u8
+}
+
+/// Returns memory from `rmalloc()`.
+pub unsafe fn rmfree(ptr: *mut u8, size: usize) {
+    preempt_disable();
+    ffi::rmunmap(ptr as *mut c_void, size);
+    preempt_enable();
+}
+
+/// A global allocator for applications linked with the rmem shim, whose
+/// allocations go to remote memory. The class decides how eviction treats
+/// their pages: `RmemAlloc::HOT` keeps them in local memory (as long as there
+/// is room for hot pages) and `RmemAlloc::COLD` evicts them first.
+///
+/// ```ignore
+/// #[global_allocator]
+/// static ALLOC: shenango::rmem::RmemAlloc = shenango::rmem::RmemAlloc::DEFAULT;
+/// ```
+#[cfg(feature = "shim")]
+pub struct RmemAlloc(c_int);
+
+#[cfg(feature = "shim")]
+impl RmemAlloc {
+    pub const DEFAULT: RmemAlloc = RmemAlloc(ffi::RMEM_CLASS_DEFAULT as c_int);
+    pub const HOT: RmemAlloc = RmemAlloc(ffi::RMEM_CLASS_HOT as c_int);
+    pub const COLD: RmemAlloc = RmemAlloc(ffi::RMEM_CLASS_COLD as c_int);
+}
+
+#[cfg(feature = "shim")]
+unsafe impl GlobalAlloc for RmemAlloc {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        // the shim's class allocations have malloc's alignment
+        if layout.align() <= 16 {
+            if self.0 == ffi::RMEM_CLASS_HOT as c_int {
+                return ffi::rmalloc_hot(layout.size()) as *mut u8;
+            }
+            if self.0 == ffi::RMEM_CLASS_COLD as c_int {
+                return ffi::rmalloc_cold(layout.size()) as *mut u8;
+            }
+            return libc::malloc(layout.size()) as *mut u8;
+        }
+        libc::aligned_alloc(layout.align(), layout.size()) as *mut u8
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, _layout: Layout) {
+        libc::free(ptr as *mut c_void)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        // realloc keeps the class of the memory
+        if layout.align() <= 16 {
+            return libc::realloc(ptr as *mut c_void, new_size) as *mut u8;
+        }
+        let new = self.alloc(Layout::from_size_align_unchecked(new_size, layout.align()));
+        if !new.is_null() {
+            std::ptr::copy_nonoverlapping(ptr, new, layout.size().min(new_size));
+            self.dealloc(ptr, layout);
+        }
+        new
+    }
+}
+
+/// A `Box` whose dereferences hint the pages of the object: a read for
+/// shared references, a write for mutable ones.
+pub struct FarBox<T>(Box<T>);
+
+impl<T> FarBox<T> {
+    pub fn new(value: T) -> Self {
+        FarBox(Box::new(value))
+    }
+
+    pub fn into_inner(b: Self) -> T {
+        *b.0
+    }
+
+    /// The object, without hinting.
+    pub fn as_ptr(b: &Self) -> *const T {
+        &*b.0 as *const T
+    }
+}
+
+impl<T> Deref for FarBox<T> {
+    type Target = T;
+
+    #[inline]
+    fn deref(&self) -> &T {
+        hint_object(&*self.0 as *const T, false);
+        &self.0
+    }
+}
+
+impl<T> DerefMut for FarBox<T> {
+    #[inline]
+    fn deref_mut(&mut self) -> &mut T {
+        hint_object(&*self.0 as *const T, true);
+        &mut self.0
+    }
+}
+
+/// A `Vec` whose element accesses are hinted. Iteration hints a window of
+/// pages ahead, never past the end.
+pub struct FarVec<T>(Vec<T>);
+
+impl<T> FarVec<T> {
+    pub fn new() -> Self {
+        FarVec(Vec::new())
+    }
+
+    pub fn with_capacity(capacity: usize) -> Self {
+        FarVec(Vec::with_capacity(capacity))
+    }
+
+    pub fn len(&self) -> usize {
+        self.0.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.0.is_empty()
+    }
+
+    pub fn capacity(&self) -> usize {
+        self.0.capacity()
+    }
+
+    pub fn reserve(&mut self, additional: usize) {
+        self.0.reserve(additional)
+    }
+
+    pub fn push(&mut self, value: T) {
+        if self.0.len() == self.0.capacity() {
+            self.0.reserve(1);
+        }
+        hint_object(self.0.as_ptr().wrapping_add(self.0.len()), true);
+        self.0.push(value)
+    }
+
+    pub fn pop(&mut self) -> Option<T> {
+        if let Some(last) = self.0.last() {
+            hint_object(last as *const T, true);
+        }
+        self.0.pop()
+    }
+
+    pub fn get(&self, i: usize) -> Option<&T> {
+        self.0.get(i).map(|x| {
+            hint_object(x as *const T, false);
+            x
+        })
+    }
+
+    pub fn get_mut(&mut self, i: usize) -> Option<&mut T> {
+        self.0.get_mut(i).map(|x| {
+            hint_object(x as *const T, true);
+            x
+        })
+    }
+
+    pub fn iter(&self) -> Iter<'_, T> {
+        Iter::new(&self.0)
+    }
+
+    pub fn iter_mut(&mut self) -> IterMut<'_, T> {
+        IterMut::new(&mut self.0)
+    }
+
+    /// The elements, without hinting.
+    pub fn as_slice(&self) -> &[T] {
+        &self.0
+    }
+
+    pub fn into_vec(self) -> Vec<T> {
+        self.0
+    }
+}
+
+impl<T: Clone> FarVec<T> {
+    pub fn resize(&mut self, len: usize, value: T) {
+        if len > self.0.len() {
+            self.0.reserve(len - self.0.len());
+            let end = self.0.as_ptr().wrapping_add(self.0.len());
+            hint_range(end, (len - self.0.len()) * mem::size_of::<T>(), true);
+        }
+        self.0.resize(len, value)
+    }
+}
+
+impl<T> From<Vec<T>> for FarVec<T> {
+    fn from(v: Vec<T>) -> Self {
+        FarVec(v)
+    }
+}
+
+impl<T> Index<usize> for FarVec<T> {
+    type Output = T;
+
+    #[inline]
+    fn index(&self, i: usize) -> &T {
+        let x = &self.0[i];
+        hint_object(x as *const T, false);
+        x
+    }
+}
+
+impl<T> IndexMut<usize> for FarVec<T> {
+    #[inline]
+    fn index_mut(&mut self, i: usize) -> &mut T {
+        let x = &mut self.0[i];
+        hint_object(x as *const T, true);
+        x
+    }
+}
+
+/// Hints a forward scan over `[.., limit)`, SEQ_READAHEAD pages at a time.
+struct SeqHint {
+    start: usize,
+    end: usize,
+    limit: usize,
+    write: bool,
+}
+
+impl SeqHint {
+    fn new(limit: usize, write: bool) -> Self {
+        SeqHint { start: 0, end: 0, limit: limit, write: write }
+    }
+
+    #[inline]
+    fn access(&mut self, ptr: usize, size: usize) {
+        if ptr >= self.start && ptr + size <= self.end {
+            return;
+        }
+        let window = (SEQ_READAHEAD + 1) * PAGE_SIZE - (ptr - page_id(ptr));
+        let len = size.max(window.min(self.limit - ptr));
+        hint_range(ptr as *const u8, len, self.write);
+        self.start = page_id(ptr);
+        self.end = ptr + len;
+    }
+}
+
+pub struct Iter<'a, T: 'a> {
+    inner: std::slice::Iter<'a, T>,
+    hint: SeqHint,
+}
+
+impl<'a, T> Iter<'a, T> {
+    fn new(v: &'a [T]) -> Self {
+        let limit = v.as_ptr().wrapping_add(v.len()) as usize;
+        Iter { inner: v.iter(), hint: SeqHint::new(limit, false) }
+    }
+}
+
+impl<'a, T> Iterator for Iter<'a, T> {
+    type Item = &'a T;
+
+    #[inline]
+    fn next(&mut self) -> Option<&'a T> {
+        let x = self.inner.next()?;
+        self.hint.access(x as *const T as usize, mem::size_of::<T>());
+        Some(x)
+    }
+}
+
+pub struct IterMut<'a, T: 'a> {
+    inner: std::slice::IterMut<'a, T>,
+    hint: SeqHint,
+}
+
+impl<'a, T> IterMut<'a, T> {
+    fn new(v: &'a mut [T]) -> Self {
+        let limit = v.as_ptr().wrapping_add(v.len()) as usize;
+        IterMut { inner: v.iter_mut(), hint: SeqHint::new(limit, true) }
+    }
+}
+
+impl<'a, T> Iterator for IterMut<'a, T> {
+    type Item = &'a mut T;
+
+    #[inline]
+    fn next(&mut self) -> Option<&'a mut T> {
+        let x = self.inner.next()?;
+        self.hint.access(x as *mut T as usize, mem::size_of::<T>());
+        Some(x)
+    }
+}
+
+impl<'a, T> IntoIterator for &'a FarVec<T> {
+    type Item = &'a T;
+    type IntoIter = Iter<'a, T>;
+
+    fn into_iter(self) -> Iter<'a, T> {
+        self.iter()
+    }
+}
+
+impl<'a, T> IntoIterator for &'a mut FarVec<T> {
+    type Item = &'a mut T;
+    type IntoIter = IterMut<'a, T>;
+
+    fn into_iter(self) -> IterMut<'a, T> {
+        self.iter_mut()
+    }
+}
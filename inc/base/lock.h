@@ -11,6 +11,34 @@
 #define DEFINE_SPINLOCK(name) spinlock_t name = SPINLOCK_INITIALIZER
 #define DECLARE_SPINLOCK(name) extern spinlock_t name
 
+#ifdef LOCK_PROFILER
+/*
+ * Lock profiling: every place that takes a spin lock gets a static site that
+ * counts acquisitions, contended acquisitions, cycles spent spinning and hold
+ * times per kthread (see base/lock_prof.c).
+ */
+struct lock_site {
+	const char	*file;
+	int		line;
+	int		id;		/* 0 until first taken */
+};
+
+extern void __lock_prof_acquired(spinlock_t *l, struct lock_site *site,
+				 uint64_t spin_cycles);
+extern void __lock_prof_released(spinlock_t *l);
+extern void lock_prof_dump(void);
+
+#define LOCK_SITE_ARG	, struct lock_site *site
+#define LOCK_SITE_PASS	, site
+#define LOCK_SITE_HERE	, ({						\
+	static struct lock_site __lock_site = {__FILE__, __LINE__, 0};	\
+	&__lock_site; })
+#else
+#define LOCK_SITE_ARG
+#define LOCK_SITE_PASS
+#define LOCK_SITE_HERE
+#endif
+
 /**
  * spin_lock_init - prepares a spin lock for use
  * @l: the spin lock
@@ -44,12 +72,25 @@ static inline void assert_spin_lock_held(spinlock_t *l)
  * spin_lock - takes a spin lock
  * @l: the spin lock
  */
-static inline void spin_lock(spinlock_t *l)
+#define spin_lock(l) __spin_lock(l LOCK_SITE_HERE)
+static inline void __spin_lock(spinlock_t *l LOCK_SITE_ARG)
 {
+#ifdef LOCK_PROFILER
+	uint64_t start = 0;
+#endif
+
 	while (__sync_lock_test_and_set(&l->locked, 1)) {
+#ifdef LOCK_PROFILER
+		if (!start)
+			start = rdtsc();
+#endif
 		while (l->locked)
 			cpu_relax();
 	}
+
+#ifdef LOCK_PROFILER
+	__lock_prof_acquired(l, site, start ? rdtsc() - start : 0);
+#endif
 }
 
 /**
@@ -58,10 +99,15 @@ static inline void spin_lock(spinlock_t *l)
  *
  * Returns 1 if successful, otherwise 0
  */
-static inline bool spin_try_lock(spinlock_t *l)
+#define spin_try_lock(l) __spin_try_lock(l LOCK_SITE_HERE)
+static inline bool __spin_try_lock(spinlock_t *l LOCK_SITE_ARG)
 {
-	if (!__sync_lock_test_and_set(&l->locked, 1))
+	if (!__sync_lock_test_and_set(&l->locked, 1)) {
+#ifdef LOCK_PROFILER
+		__lock_prof_acquired(l, site, 0);
+#endif
 		return true;
+	}
 	return false;
 }
 
@@ -72,5 +118,8 @@ static inline bool spin_try_lock(spinlock_t *l)
 static inline void spin_unlock(spinlock_t *l)
 {
 	assert_spin_lock_held(l);
+#ifdef LOCK_PROFILER
+	__lock_prof_released(l);
+#endif
 	__sync_lock_release(&l->locked);
 }
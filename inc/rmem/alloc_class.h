@@ -0,0 +1,60 @@
+/*
+ * alloc_class.h - memory class policy for allocation sites
+ */
+
+#ifndef __ALLOC_CLASS_H__
+#define __ALLOC_CLASS_H__
+
+#include "base/stddef.h"
+#include "rmem/api.h"
+#include "rmem/config.h"
+
+/**
+ * The shim allocator can route allocations from chosen call sites to the hot,
+ * cold or stream memory class without changing the application. A site is 
+ * the return address of the allocation call, i.e., the first frame of a site 
+ * in the ALLOC_PROFILER report; the policy is read from the file given by 
+ * rmem_alloc_class_sites, with one "<hex address> <hot|cold|stream|default>"
+ * per line. Addresses are only stable for non-PIE binaries.
+ */
+struct alloc_class_site {
+    unsigned long ip;       /* 0 marks a free entry */
+    int memclass;
+};
+
+/* state */
+extern struct alloc_class_site alloc_class_sites[ALLOC_CLASS_MAX_SITES];
+extern int alloc_class_nsites;
+
+/* functions */
+int alloc_class_init(void);
+
+static inline unsigned int alloc_class_hash(unsigned long ip)
+{
+    return (unsigned int) ((ip * 0x9e3779b97f4a7c15UL) >> 32) 
+        & (ALLOC_CLASS_MAX_SITES - 1);
+}
+
+/**
+ * alloc_class_of_site - returns the memory class for allocations made from a
+ * return address (RMEM_CLASS_DEFAULT when the site is not in the policy)
+ */
+static inline int alloc_class_of_site(unsigned long ip)
+{
+    unsigned int i, n;
+
+    if (likely(!alloc_class_nsites))
+        return RMEM_CLASS_DEFAULT;
+
+    i = alloc_class_hash(ip);
+    for (n = 0; n < ALLOC_CLASS_MAX_SITES; n++, 
+            i = (i + 1) & (ALLOC_CLASS_MAX_SITES - 1)) {
+        if (alloc_class_sites[i].ip == ip)
+            return alloc_class_sites[i].memclass;
+        if (!alloc_class_sites[i].ip)
+            break;
+    }
+    return RMEM_CLASS_DEFAULT;
+}
+
+#endif  // __ALLOC_CLASS_H__
@@ -0,0 +1,90 @@
+/*
+ * alloc_prof.h - residency and fault accounting per allocation site
+ */
+
+#ifndef __ALLOC_PROF_H__
+#define __ALLOC_PROF_H__
+
+#include <stdio.h>
+
+#include "base/stddef.h"
+#include "rmem/config.h"
+#include "rmem/page.h"
+
+/**
+ * With ALLOC_PROFILER, the allocator shims sample about one allocation every
+ * ALLOC_PROF_SAMPLE_BYTES and attribute it to a site, i.e., the hash of its
+ * call stack. The site is written into the metadata of each page the sampled
+ * allocation spans, which then attributes the faults, remote reads,
+ * evictions and residency of those pages to the site. Attribution is by page
+ * so a page goes to the site of the last sampled allocation on it, and stays
+ * with it until the page is unmapped or another sampled allocation lands.
+ */
+enum {
+    APROF_ALLOCS = 0,       /* sampled allocations */
+    APROF_ALLOC_BYTES,      /* bytes in sampled allocations */
+    APROF_PAGES,            /* pages attributed to the site */
+    APROF_RESIDENT,         /* of those, pages locally present */
+    APROF_FAULTS,           /* faults on the pages */
+    APROF_READS,            /* pages read from remote memory */
+    APROF_EVICTIONS,        /* pages evicted */
+    APROF_NR
+};
+
+struct alloc_site {
+    unsigned long hash;     /* 0 marks a free entry */
+    int nframes;
+    void* frames[ALLOC_PROF_DEPTH];
+    long counters[APROF_NR];
+};
+
+/* state */
+extern __thread long alloc_prof_countdown;
+extern struct alloc_site alloc_sites[ALLOC_PROF_MAX_SITES];
+
+/* functions */
+void __alloc_prof_sample(void* ptr, size_t size);
+int alloc_prof_write(FILE* fp);
+void alloc_prof_dump(void);
+
+/**
+ * alloc_prof_sample - counts an allocation from the application, sampling
+ * one every ALLOC_PROF_SAMPLE_BYTES on average. Call it from the allocator
+ * interface function itself, as the first two frames are not recorded.
+ */
+static inline void alloc_prof_sample(void* ptr, size_t size)
+{
+    if (unlikely(!ptr))
+        return;
+    alloc_prof_countdown -= size;
+    if (unlikely(alloc_prof_countdown <= 0))
+        __alloc_prof_sample(ptr, size);
+}
+
+/**
+ * alloc_prof_count - adds to a counter of the site of a page, if any
+ */
+static inline void alloc_prof_count(struct region_t* mr, unsigned long addr,
+    int counter, long delta)
+{
+    unsigned int site;
+
+    assert(counter >= 0 && counter < APROF_NR);
+    site = get_site_from_pginfo(get_page_info(mr, addr));
+    if (site)
+        __sync_fetch_and_add(&alloc_sites[site].counters[counter], delta);
+}
+
+/**
+ * alloc_prof_count_range - adds to a counter of the sites of a range of pages
+ */
+static inline void alloc_prof_count_range(struct region_t* mr,
+    unsigned long addr, size_t size, int counter, long delta)
+{
+    unsigned long offset;
+
+    for (offset = 0; offset < size; offset += CHUNK_SIZE)
+        alloc_prof_count(mr, addr + offset, counter, delta);
+}
+
+#endif  // __ALLOC_PROF_H__
@@ -8,16 +8,46 @@
 #include <stddef.h>
 #include "base/types.h"
 
+/* memory classes, for keeping pages of hot and cold objects apart */
+enum {
+    RMEM_CLASS_DEFAULT = 0,
+    RMEM_CLASS_HOT,         /* pinned in local memory (up to rmem_hot_memory) */
+    RMEM_CLASS_COLD,        /* evicted before the other classes */
+    RMEM_CLASS_STREAM,      /* scanned once, evicted behind the scan */
+    RMEM_CLASS_NR
+};
+
+/* address space reserved for all remote memory (see region_reserve_va()) */
+extern unsigned long rmem_va_start;
+extern unsigned long rmem_va_size;
+
+/**
+ * is_rmem_ptr - checks if a pointer belongs to remote memory. All regions
+ * are carved out of a single reserved range so this is one compare, with no
+ * locks, and is cheap enough for every free(). False before rmem is set up.
+ */
+static inline bool is_rmem_ptr(const void *ptr)
+{
+    return (unsigned long) ptr - rmem_va_start < rmem_va_size;
+}
+
 /*** Supported ***/
 void *rmalloc(size_t size);
+void *rmalloc_class(size_t size, int memclass);
 void *rmrealloc(void *ptr, size_t size, size_t old_size);
 int rmunmap(void *addr, size_t length);
 int rmadvise(void *addr, size_t length, int advice);
+int rmpopulate(void *addr, size_t length, bool write);
+int rmcheckpoint(void);
 
 /*** Unsupported ***/
 int rmfree(void *ptr);
 int rmpin(void *addr, size_t size);
 int rmflush(void *addr, size_t size, bool evict);
 
+/*** Object allocation by memory class (shim only, release with free()) ***/
+void *rmalloc_hot(size_t size);
+void *rmalloc_cold(size_t size);
+
 
 #endif  // __RMEM_API_H__
\ No newline at end of file
@@ -8,10 +8,11 @@
 #include "base/thread.h"
 #include "rmem/config.h"
 #include "rmem/fault.h"
+#include "rmem/numa_pool.h"
 #include "rmem/region.h"
 
 /* accounting for resource allocation limits */
-#define MAX_CONNECTIONS         RMEM_MAX_REGIONS         
+#define MAX_CONNECTIONS         1   /* regions share server connections */
 #define MAX_R_REQS_PER_CONN_CHAN 32
 #define MAX_W_REQS_PER_CONN_CHAN 32
 
@@ -33,6 +34,13 @@ struct region_t;
 struct fault;
 struct bkend_completion_cbs;
 
+/* a page range to write back (see post_write_batch) */
+struct bkend_write_range {
+    struct region_t* mr;
+    unsigned long addr;
+    size_t size;
+};
+
 /**
  * Backend suppported ops
  * Provides read/write page ops on multiple channels, each of which can be
@@ -75,7 +83,9 @@ struct rmem_backend_ops {
     
     /**
      * post_read - post read request for the pages needed by the fault from 
-     * the backend. returns 0 if posted, EAGAIN if busy
+     * the backend. returns 0 if posted, EAGAIN if busy. The same fault may 
+     * be posted more than once (hedged reads) so the data buffer is only 
+     * handed to the fault on completion, with fault_read_claim().
      */
     int (*post_read)(int chan_id, struct fault* f);
 
@@ -86,17 +96,42 @@ struct rmem_backend_ops {
     int (*post_write)(int chan_id, struct region_t* mr, unsigned long addr, 
         size_t size);
 
+    /**
+     * post_read_batch - post reads for a vector of faults, letting the 
+     * backend submit them together (e.g., with one doorbell). Faults are 
+     * posted in order; returns the number posted, which is less than nfaults 
+     * if the channel got busy (the rest should be posted again later).
+     */
+    int (*post_read_batch)(int chan_id, struct fault** faults, int nfaults);
+
+    /**
+     * post_write_batch - post writes for a vector of page ranges, submitted 
+     * together like post_read_batch. Returns the number of ranges posted.
+     */
+    int (*post_write_batch)(int chan_id, struct bkend_write_range* ranges, 
+        int nranges);
+
     /**
      * check_for_completions - check with backend for read/write completions
      * for the posted ones. One can also specify max events it is allowed to
      * check before. Returns the number of events addressed (including the 
-     * read/write split if required) or -1 on error.
+     * read/write split if required) or -1 on error. Read completions that 
+     * lose to a duplicate (fault_read_claim() fails) are not passed to the 
+     * callbacks or counted in the read split.
      * NOTE: This function is expected to be thread-safe for each channel to 
      * allow completion stealing. Naturally, the thread-safety expectations 
      * extend to the callbacks too.
      */
     int (*check_for_completions)(int chan_id, struct bkend_completion_cbs* cbs,
         int max_cqe, int* nread, int* nwrite);
+
+    /**
+     * persistent - set if the remote memory outlives the application, i.e., 
+     * a restart gets the same backing memory with the pages written back in 
+     * the last run. Lets the hot pages of the last run be read back at 
+     * start (see hotset.h).
+     */
+    bool persistent;
 };
 
 /* available backends */
@@ -131,10 +166,19 @@ struct bkend_completion_cbs {
 extern atomic_int nchans_bkend;
 int backend_get_data_channel();
 
+/**
+ * Per-channel flow control. Backends take a credit before posting a request
+ * and return it on completion with the time it was posted; the number of 
+ * credits adapts to the observed latency (see backend.c)
+ */
+bool bkend_credit_take(int chan_id, bool is_write);
+void bkend_credit_return(int chan_id, bool is_write, unsigned long posted_tsc);
+
 /**
  * Backend data buffer pool (tcache) support
  */
-DECLARE_PERTHREAD(struct tcache_perthread, bkend_buf_pt);
+DECLARE_PERTHREAD(numa_pool_perthread_t, bkend_buf_pt);
+extern struct numa_pool bkend_buf_pool;
 
 int bkend_buf_tcache_init(void);
 void bkend_buf_tcache_init_thread(void);
@@ -144,14 +188,13 @@ bool bkend_is_buf_valid(void* buf);
 /* bkend_buf_alloc - allocates a buf from pool */
 static inline void *bkend_buf_alloc(void)
 {
-    return tcache_alloc(&perthread_get(bkend_buf_pt));
+    return numa_pool_alloc(&perthread_get(bkend_buf_pt));
 }
 
 /* bkend_buf_free - frees a fault */
 static inline void bkend_buf_free(void *buf)
 {
-    assert(bkend_is_buf_valid(buf));
-    tcache_free(&perthread_get(bkend_buf_pt), buf);
+    numa_pool_free(&bkend_buf_pool, &perthread_get(bkend_buf_pt), buf);
 }
 
 #endif    // __BACKEND_H__
\ No newline at end of file
@@ -6,6 +6,7 @@
 #ifndef __RMEM_COMMON_H__
 #define __RMEM_COMMON_H__
 
+#include <limits.h>
 #include <stddef.h>
 #include "base/types.h"
 #include "rmem/handler.h"
@@ -19,6 +20,12 @@ extern int evict_batch_size;
 extern int evict_ngens;
 extern int evict_nprio;
 extern int fsampler_samples_per_sec;
+extern unsigned long rmem_grow_slabs;
+extern int rmem_hedge_pct;
+extern unsigned long rmem_trace_records;
+extern uint64_t rmem_hot_memory;
+extern char alloc_class_sites_path[PATH_MAX];
+extern char hotset_path[PATH_MAX];
 
 /* global state */
 extern int nhandlers;
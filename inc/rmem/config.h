@@ -12,8 +12,10 @@
 
 /* Default configs */
 #define TRACK_DIRTY             /* not available for kernels v < 5.7 */
-#define NO_DYNAMIC_REGIONS      /* regions added/deleted only at startup/exit */
+#define NO_DYNAMIC_REGIONS      /* regions deleted only at exit (but may be added) */
 // #define RMEM_STANDALONE      /* Eden with pure userfaultfd, decoupled from Shenango */
+// #define HINT_PROFILER        /* hint outcomes per callsite (see hint_prof.h) */
+// #define ALLOC_PROFILER       /* faults per allocation site (see alloc_prof.h) */
 
 /* memory backend */
 typedef enum {
@@ -24,7 +26,9 @@ typedef enum {
 #define RMEM_SLAB_SIZE          (128 * 1024L)
 #define RMEM_MAX_CHANNELS       32
 #define RMEM_MAX_CHUNKS_PER_OP  64
+#define RMEM_POPULATE_CHUNKS    512 /* pages mapped at a time by rmpopulate() */
 #define RMEM_MAX_COMP_PER_OP    16
+#define RMEM_MAX_POST_BATCH     16  /* ops submitted together to the backend */
 #define RMEM_MAX_LOCAL_MEM      (64 * 1024L * 1024 * 1024)
 
 /********* Cluster *******************************************/
@@ -130,16 +134,69 @@ BUILD_ASSERT(EVICTION_MAX_BATCH_SIZE <= RMEM_MAX_CHUNKS_PER_OP);
 #define HANDLER_WAIT_BEFORE_STEAL_US    100
 BUILD_ASSERT((1 + FAULT_MAX_RDAHEAD_SIZE) <= RMEM_MAX_CHUNKS_PER_OP);
 
+/* streamed (MADV_SEQUENTIAL) memory, see RMEM_CLASS_STREAM */
+#define RMEM_STREAM_MAX_PAGES           2048    /* local pages kept for it */
+#define RMEM_STREAM_MIN_RDAHEAD         3       /* doubles on sequential faults */
+BUILD_ASSERT(RMEM_STREAM_MAX_PAGES > FAULT_MAX_RDAHEAD_SIZE);
+
+/* fault latency histograms (log-linear, in cycles; see fault_hist.h) */
+#define FAULT_HIST_SUB_BITS         3       /* 8 buckets per power of 2 */
+#define FAULT_HIST_MAX_BITS         40      /* larger values saturate */
+#define FAULT_HIST_MAX_THREADS      (NCPU + MAX_HANDLER_CORES)
+
+/* binary fault trace rings (see fault_trace.h) */
+#define FAULT_TRACE_MAX_THREADS     (NCPU + MAX_HANDLER_CORES)
+
+/* hedged reads */
+#define HEDGE_MAX_TRACKED           1024
+#define HEDGE_TRACK_PROBES          8
+#define HEDGE_LAT_SAMPLES           512     /* must be a power of 2 */
+#define HEDGE_MIN_SAMPLES           64
+#define HEDGE_MIN_TIMEOUT_US        10
+#define HEDGE_SCAN_INTERVAL_US      5
+#define HEDGE_UPDATE_INTERVAL_US    1000
+BUILD_ASSERT((HEDGE_LAT_SAMPLES & (HEDGE_LAT_SAMPLES - 1)) == 0);
+
+/* backend flow control (per-channel credits, see backend.c) */
+#define BKEND_CREDITS_MIN           4
+#define BKEND_CREDITS_STEP          2       /* additive increase */
+#define BKEND_CREDITS_LAT_SLACK     50      /* % over base latency */
+#define BKEND_CREDITS_WINDOW_US     100
+#define BKEND_CREDITS_MIN_SAMPLES   16
+#define BKEND_CREDITS_READ_IDLE_US  50      /* writes borrow after this */
+
 /* fault sampling */
 #define MAX_FAULT_SAMPLERS          (MAX_HANDLER_CORES)
 #define FAULT_TRACE_STEPS           50
 
+/* hint profiling */
+#define HINT_PROF_MAX_SITES         1024    /* per thread; power of 2 */
+#define HINT_PROF_MAX_THREADS       (NCPU + MAX_HANDLER_CORES)
+#define HINT_PROF_TOP_N             50      /* sites listed in reports */
+BUILD_ASSERT((HINT_PROF_MAX_SITES & (HINT_PROF_MAX_SITES - 1)) == 0);
+
+/* allocation site profiling */
+#define ALLOC_PROF_SAMPLE_BYTES     (512 * 1024)    /* mean bytes per sample */
+#define ALLOC_PROF_MAX_SITES        4096    /* power of 2, fits in page info */
+#define ALLOC_PROF_DEPTH            6       /* stack frames per site */
+#define ALLOC_PROF_TOP_N            50      /* sites listed in reports */
+BUILD_ASSERT((ALLOC_PROF_MAX_SITES & (ALLOC_PROF_MAX_SITES - 1)) == 0);
+
+/* memory classes (see rmalloc_class()) */
+#define RMEM_HOT_MEMORY_FRAC        0.25    /* default cap on pinned hot pages */
+#define ALLOC_CLASS_MAX_SITES       1024    /* site policy entries; power of 2 */
+BUILD_ASSERT((ALLOC_CLASS_MAX_SITES & (ALLOC_CLASS_MAX_SITES - 1)) == 0);
+
 /* Region settings  */
-#define RMEM_MAX_REGIONS            1
+#define RMEM_MAX_REGIONS            64
+#define RMEM_VA_RESERVE_SIZE        (1UL << 44) /* address space for regions */
+#define RMEM_GROW_THRESHOLD         0.9     /* add region when this full */
+#define PAGE_INFO_LEAF_SHIFT        12      /* pages per metadata leaf (log) */
 
 /* Do-not-evict region defaults (per priority level) */
 #define RMEM_DNE_SIZE_MB            100
 #define RMEM_DNE_MAX_PAGES          (RMEM_DNE_SIZE_MB * 1024 * 1024 / PAGE_SIZE)
 BUILD_ASSERT(RMEM_DNE_MAX_PAGES >= RMEM_MAX_CHUNKS_PER_OP);
+BUILD_ASSERT(RMEM_DNE_MAX_PAGES >= RMEM_POPULATE_CHUNKS);
 
 #endif  // __CONFIG_H__
\ No newline at end of file
@@ -20,18 +20,39 @@ int stealer_write_back_completed(struct region_t* mr, unsigned long addr, size_t
  * Page LRU lists support
  */
 
+/* list of page nodes linked by their index (see rmpage_list_* in pgnode.h) */
+struct rmpage_list {
+    pgidx_t head;
+    pgidx_t tail;
+};
+
 struct page_list {
-    struct list_head pages[EVICTION_MAX_PRIO];
+    struct rmpage_list pages[EVICTION_MAX_PRIO];
     size_t npages;
     spinlock_t lock;
 };
 struct page_list_per_prio {
-    struct list_head pages[EVICTION_MAX_PRIO];
+    struct rmpage_list pages[EVICTION_MAX_PRIO];
     size_t npages[EVICTION_MAX_PRIO];
     spinlock_t locks[EVICTION_MAX_PRIO];
 };
 extern struct page_list evict_gens[EVICTION_MAX_GENS];
 struct page_list_per_prio dne_pages;
+
+/* pages of the hot memory class are kept off the eviction lists, in 
+ * pinned_pages.pages[0], up to rmem_hot_memory. Their nodes are marked 
+ * with this evict prio. */
+#define EVICTION_PRIO_PINNED    UINT8_MAX
+BUILD_ASSERT(EVICTION_MAX_PRIO < EVICTION_PRIO_PINNED);
+extern struct page_list pinned_pages;
+
+/* pages of the stream memory class are kept off the eviction lists too, in 
+ * stream_pages.pages[0] in the order they came in. Beyond 
+ * RMEM_STREAM_MAX_PAGES, the oldest move to the front of the eviction lists 
+ * (see stream_add_pages()). */
+#define EVICTION_PRIO_STREAM    (UINT8_MAX - 1)
+BUILD_ASSERT(EVICTION_MAX_PRIO < EVICTION_PRIO_STREAM);
+extern struct page_list stream_pages;
 extern int evict_gen_mask;
 extern int evict_gen_now;
 extern unsigned long evict_epoch_now;
@@ -16,6 +16,7 @@
 #include "runtime/thread.h"
 #include "rmem/backend.h"
 #include "rmem/config.h"
+#include "rmem/numa_pool.h"
 
 /*
  * Fault object 
@@ -30,23 +31,38 @@ typedef struct fault {
     uint8_t locked_pages:1;         /* if the fault locked any pages */
     uint8_t stolen_from_cq:1;       /* stole this fault from other's cq */
     uint8_t uffd_explicit_wake:1;   /* need to issue uffd_wake() after done */
-    uint8_t unused1:1;
+    uint8_t hedge_tracked:1;        /* read tracked for hedging (see hedge.c) */
+    uint8_t from_handler:1;         /* posted by a handler on its own (see 
+                                     * hotset.c), no thread waits on it */
 
     uint8_t rdahead_max;        /* suggested max read-ahead */
     uint8_t rdahead;            /* actual read-ahead locked for this fault */
     uint8_t evict_prio;         /* suggested eviction priority for the page */
     uint8_t posted_chan_id;
-    uint8_t unused2[3];
+    uint8_t hedge_refs;         /* refs held by in-flight reads and tracker */
+    uint8_t hedge_claimed;      /* one of the reads completed */
+    uint8_t hedged;             /* duplicate read was sent */
 
     /* associated resources */
     unsigned long page;
     struct region_t* mr;
     thread_t* thread;
     void* bkend_buf;
-    unsigned long tstamp_tsc;
+    unsigned long tstamp_tsc;   /* time added to wait (or posted if hedged) */
 
 	struct list_node link;
-} fault_t;
+
+    /* phase timestamps for latency histograms (see fault_hist.h) */
+    unsigned long start_tsc;
+    unsigned long post_tsc;
+    unsigned long comp_tsc;
+    unsigned long copy_tsc;
+
+    /* faulting callsite and thread for tracing (see fault_trace.h): the 
+     * kernel tid for faults from the kernel, the uthread id otherwise */
+    unsigned long ip;
+    unsigned int tid;
+} __aligned(CACHE_LINE_SIZE) fault_t;
 BUILD_ASSERT(sizeof(fault_t) % CACHE_LINE_SIZE == 0);
 BUILD_ASSERT(FAULT_MAX_RDAHEAD_SIZE <= UINT8_MAX);   /* due to rdahead */
 BUILD_ASSERT(RMEM_MAX_CHANNELS <= UINT8_MAX);   /* due to posted_chan_id */
@@ -68,7 +84,8 @@ static inline char* fault_to_str(fault_t* f) {
 /*
  * Fault object tcache support
  */
-DECLARE_PERTHREAD(struct tcache_perthread, fault_pt);
+DECLARE_PERTHREAD(numa_pool_perthread_t, fault_pt);
+extern struct numa_pool fault_pool;
 
 /* inits */
 int fault_tcache_init(); 
@@ -79,13 +96,38 @@ void fault_tcache_destroy(void);
 /* fault_alloc - allocates a fault object */
 static inline fault_t *fault_alloc(void)
 {
-    return tcache_alloc(&perthread_get(fault_pt));
+    return numa_pool_alloc(&perthread_get(fault_pt));
 }
 
 /* fault_free - frees a fault */
 static inline void fault_free(struct fault *f)
 {
-    tcache_free(&perthread_get(fault_pt), (void *)f);
+    numa_pool_free(&fault_pool, &perthread_get(fault_pt), (void *)f);
+}
+
+/* fault_put - frees a fault unless it is still referenced by an in-flight 
+ * (hedged) read or the hedge tracker; the last one to let go frees it */
+static inline void fault_put(struct fault *f)
+{
+    if (unlikely(f->hedge_tracked) &&
+            __atomic_sub_fetch(&f->hedge_refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    fault_free(f);
+}
+
+/* fault_read_claim - called by the backend on a read completion, before 
+ * the completion callback. Saves the buffer with the data in the fault and 
+ * returns true if this is the completion that serves the fault; with hedged
+ * reads, the late one releases its buffer and returns false. */
+bool hedge_read_claim(struct fault* f, void* buf);
+static inline bool fault_read_claim(struct fault *f, void* buf)
+{
+    if (likely(!f->hedge_tracked)) {
+        f->bkend_buf = buf;
+        f->comp_tsc = rdtsc();
+        return true;
+    }
+    return hedge_read_claim(f, buf);
 }
 
 /*
@@ -119,5 +161,9 @@ enum fault_status handle_page_fault(int chan_id, fault_t* fault, int* nevicts,
     struct bkend_completion_cbs* cbs);
 int fault_read_done(fault_t* f);
 void fault_done(fault_t* fault);
+void alloc_page_nodes(struct region_t* mr, unsigned long page, int npages, 
+    int prio);
+void fault_read_batch_enable(void);
+int fault_read_batch_flush(int chan_id, struct bkend_completion_cbs* cbs);
 
 #endif    // __FAULT_H__
\ No newline at end of file
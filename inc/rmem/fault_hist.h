@@ -0,0 +1,81 @@
+/*
+ * fault_hist.h - per-phase fault latency histograms
+ */
+
+#ifndef __FAULT_HIST_H__
+#define __FAULT_HIST_H__
+
+#include <stdint.h>
+
+#include "base/stddef.h"
+#include "rmem/config.h"
+
+/**
+ * Faults are timestamped as they move along (see fault_t) and, when done,
+ * the time spent in each phase is recorded in histograms of the thread that
+ * finished the fault. Histograms are log-linear (HDR-style): values below
+ * 2^FAULT_HIST_SUB_BITS cycles get a bucket each, and every power of 2 above
+ * that is split into 2^FAULT_HIST_SUB_BITS buckets.
+ */
+enum {
+    FHIST_POST = 0,     /* fault start to read posted */
+    FHIST_BACKEND,      /* read posted to read completed */
+    FHIST_COPY,         /* read completed to pages mapped */
+    FHIST_WAKE,         /* pages mapped to faulting thread ready */
+    FHIST_TOTAL,        /* fault start to faulting thread ready */
+    FHIST_NR
+};
+
+#define FHIST_SUB           (1 << FAULT_HIST_SUB_BITS)
+#define FHIST_NBUCKETS      \
+    ((FAULT_HIST_MAX_BITS - FAULT_HIST_SUB_BITS + 1) * FHIST_SUB)
+
+struct fault_hist {
+    uint64_t counts[FHIST_NR][FHIST_NBUCKETS];
+};
+
+/* state */
+extern const char* fault_hist_names[];
+extern __thread struct fault_hist* fault_hist_ptr;
+
+/* functions */
+void fault_hist_init_thread(void);
+void fault_hist_merge(struct fault_hist* out);
+uint64_t fault_hist_percentile(uint64_t* counts, uint64_t total, double pct);
+int fault_hist_write_buf(char* buf, size_t len, struct fault_hist* prev);
+
+/* fault_hist_bucket - histogram bucket for a latency value */
+static inline int fault_hist_bucket(uint64_t val)
+{
+    int msb, shift;
+
+    if (val < FHIST_SUB)
+        return val;
+    msb = 63 - __builtin_clzl(val);
+    if (msb >= FAULT_HIST_MAX_BITS)
+        return FHIST_NBUCKETS - 1;
+    shift = msb - FAULT_HIST_SUB_BITS;
+    return ((shift + 1) << FAULT_HIST_SUB_BITS) +
+        ((val >> shift) & (FHIST_SUB - 1));
+}
+
+/* fault_hist_bucket_low - smallest value that goes in a bucket */
+static inline uint64_t fault_hist_bucket_low(int bucket)
+{
+    int shift;
+
+    if (bucket < FHIST_SUB)
+        return bucket;
+    shift = (bucket >> FAULT_HIST_SUB_BITS) - 1;
+    return (uint64_t)(FHIST_SUB + (bucket & (FHIST_SUB - 1))) << shift;
+}
+
+/* fault_hist_record - adds a latency sample for the phase */
+static inline void fault_hist_record(int phase, uint64_t cycles)
+{
+    assert(phase >= 0 && phase < FHIST_NR);
+    if (likely(fault_hist_ptr))
+        fault_hist_ptr->counts[phase][fault_hist_bucket(cycles)]++;
+}
+
+#endif  // __FAULT_HIST_H__
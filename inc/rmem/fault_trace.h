@@ -0,0 +1,104 @@
+/*
+ * fault_trace.h - binary per-thread fault trace rings
+ */
+
+#ifndef __FAULT_TRACE_H__
+#define __FAULT_TRACE_H__
+
+#include <stdint.h>
+
+#include "asm/atomic.h"
+#include "asm/cpu.h"
+#include "base/stddef.h"
+
+/**
+ * When enabled (rmem_trace_records > 0), every fault is recorded, unsampled,
+ * when done in a ring owned by the thread that finished it. The rings live
+ * in a shared file (FAULT_TRACE_PATH) that outside readers can mmap while
+ * we run, or read after we exit (the file is left behind). Layout:
+ *   [struct fault_trace_hdr]
+ *   [struct fault_trace_ring x max_rings]      at rings_off
+ *   [struct fault_trace_rec x ring_nrecs]      at recs_off, for each ring
+ * Each ring has a single writer (uthreads writing to their kthread's ring 
+ * keep preemption off while at it) that fills in the slot at (head %
+ * ring_nrecs) before publishing it by bumping head. Readers snapshot head,
+ * copy records and check head again: records older than (head - ring_nrecs)
+ * may have been overwritten in between. Hinted accesses to pages that are
+ * already present are recorded too (FTRACE_HINT) so that the trace has all
+ * the accesses that eviction sees, e.g., for replaying it (tools/ftsim).
+ */
+#define FAULT_TRACE_PATH        "/dev/shm/eden-ftrace-%d"   /* pid */
+#define FAULT_TRACE_MAGIC       0x65666c7472616365UL        /* "efltrace" */
+#define FAULT_TRACE_VERSION     1
+
+/* record flags */
+enum {
+    FTRACE_READ = (1 << 0),
+    FTRACE_WRITE = (1 << 1),
+    FTRACE_WP = (1 << 2),
+    FTRACE_KERNEL = (1 << 3),       /* from the kernel (uffd) */
+    FTRACE_NOREAD = (1 << 4),       /* served without a backend read */
+    FTRACE_HEDGED = (1 << 5),       /* a duplicate read was sent */
+    FTRACE_HINT = (1 << 6),         /* hinted access that did not fault */
+};
+
+struct fault_trace_rec {
+    uint64_t tsc;           /* fault start */
+    uint64_t addr;          /* faulting page */
+    uint64_t ip;            /* faulting callsite, if known (else 0) */
+    uint32_t tid;           /* faulting thread (kernel tid or uthread id) */
+    uint32_t lat;           /* start to done in cycles; saturates */
+    uint16_t flags;
+    uint16_t npages;        /* pages served incl. read-ahead */
+    uint32_t unused;
+};
+BUILD_ASSERT(sizeof(struct fault_trace_rec) == 40);
+
+struct fault_trace_ring {
+    uint64_t head;          /* records written so far */
+    uint32_t tid;           /* owner thread */
+    uint32_t unused;
+} __aligned(CACHE_LINE_SIZE);
+
+struct fault_trace_hdr {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t rec_size;
+    uint32_t nrings;        /* rings claimed so far */
+    uint32_t max_rings;
+    uint64_t ring_nrecs;    /* power of 2 */
+    uint64_t rings_off;
+    uint64_t recs_off;
+    uint64_t cycles_per_us;
+    uint64_t start_tsc;
+    uint64_t start_time;    /* unix time (s) at start_tsc */
+} __aligned(CACHE_LINE_SIZE);
+
+struct fault;
+
+/* state */
+extern __thread struct fault_trace_ring* fault_trace_ring;
+
+/* functions */
+int fault_trace_init(void);
+void fault_trace_init_thread(void);
+void fault_trace_destroy(void);
+void __fault_trace_record(struct fault* f, unsigned long now_tsc);
+void __fault_trace_touch(unsigned long addr, bool write, unsigned int tid);
+
+/* fault_trace_record - adds a finished fault to the thread's ring */
+static inline void fault_trace_record(struct fault* f, unsigned long now_tsc)
+{
+    if (unlikely(fault_trace_ring))
+        __fault_trace_record(f, now_tsc);
+}
+
+/* fault_trace_touch - adds a hinted access that did not fault */
+static inline void fault_trace_touch(unsigned long addr, bool write,
+    unsigned int tid)
+{
+    if (unlikely(fault_trace_ring))
+        __fault_trace_touch(addr, write, tid);
+}
+
+#endif  // __FAULT_TRACE_H__
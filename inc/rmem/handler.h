@@ -20,6 +20,7 @@
 typedef struct hthread {
     volatile bool stop;
     pthread_t thread;
+    int pincore_id;
     int bkend_chan_id;
     struct list_head fault_wait_q;
     int n_wait_q;
@@ -34,5 +35,6 @@ hthread_t* new_rmem_handler_thread(int pincore_id);
 int stop_rmem_handler_thread(hthread_t* hthr);
 extern struct bkend_completion_cbs hthr_cbs;
 extern struct bkend_completion_cbs hthr_stealer_cbs;
+extern struct bkend_completion_cbs hthr_hedge_cbs;
 
 #endif  // __HANDLER_H__
\ No newline at end of file
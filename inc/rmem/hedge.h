@@ -0,0 +1,20 @@
+/*
+ * hedge.h - hedged backend reads
+ */
+
+#ifndef __HEDGE_H__
+#define __HEDGE_H__
+
+#include "rmem/backend.h"
+#include "rmem/fault.h"
+
+/* state */
+extern int hedge_chan_id;
+
+/* functions */
+int hedge_init(void);
+bool hedge_track(fault_t* f);
+int hedge_scan(unsigned long now_tsc);
+int hedge_check_for_completions(struct bkend_completion_cbs* cbs);
+
+#endif  // __HEDGE_H__
@@ -0,0 +1,109 @@
+/*
+ * hint_prof.h - hint efficacy profiling per callsite
+ */
+
+#ifndef __HINT_PROF_H__
+#define __HINT_PROF_H__
+
+#include <stdio.h>
+
+#include "base/stddef.h"
+#include "rmem/config.h"
+
+/**
+ * With HINT_PROFILER, every hint check is counted against its callsite
+ * (return address) along with whether the page was missing and whether the
+ * thread was parked on the fault, so we can tell the useful hints from the
+ * ones that always find the page present. Kernel faults are counted against
+ * the faulting ip to find the code paths that still need hints; the kernel
+ * only reports it with kernel/uffd-include-ip.patch (otherwise they all
+ * show up as unknown). Counters are kept per thread in small open-addressing
+ * tables, and sites that don't fit are only counted as dropped.
+ */
+#define HPROF_IP_UNKNOWN    1UL
+
+enum {
+    HPROF_HINTS = 0,    /* hint callsites */
+    HPROF_KFAULTS,      /* kernel faults by faulting ip */
+    HPROF_NR
+};
+
+struct hint_site {
+    unsigned long ip;
+    unsigned long checked;  /* hint checks or kernel faults */
+    unsigned long missing;  /* checks that found a fault pending */
+    unsigned long parked;   /* checks that parked the thread */
+};
+
+struct hint_prof {
+    struct hint_site sites[HPROF_NR][HINT_PROF_MAX_SITES];
+    unsigned long dropped[HPROF_NR];
+};
+
+/* state */
+extern __thread struct hint_prof* hint_prof_ptr;
+extern __thread unsigned long hint_prof_last_ip;
+
+/* functions */
+void hint_prof_init_thread(void);
+int hint_prof_write(FILE* fp);
+void hint_prof_dump(void);
+
+/* hint_prof_site - finds or adds the entry for a callsite */
+static inline struct hint_site* hint_prof_site(int type, unsigned long ip)
+{
+    struct hint_site* sites;
+    unsigned int i, n;
+
+    assert(type >= 0 && type < HPROF_NR);
+    if (unlikely(!hint_prof_ptr))
+        return NULL;
+
+    if (!ip)
+        ip = HPROF_IP_UNKNOWN;  /* 0 marks free entries */
+    sites = hint_prof_ptr->sites[type];
+    i = (ip ^ (ip >> 12)) & (HINT_PROF_MAX_SITES - 1);
+    for (n = 0; n < HINT_PROF_MAX_SITES; n++) {
+        if (likely(sites[i].ip == ip))
+            return &sites[i];
+        if (sites[i].ip == 0) {
+            store_release(&sites[i].ip, ip);
+            return &sites[i];
+        }
+        i = (i + 1) & (HINT_PROF_MAX_SITES - 1);
+    }
+    hint_prof_ptr->dropped[type]++;
+    return NULL;
+}
+
+/* hint_prof_check - counts a hint check at a callsite */
+static inline void hint_prof_check(unsigned long ip, bool missing)
+{
+    struct hint_site* site = hint_prof_site(HPROF_HINTS, ip);
+
+    hint_prof_last_ip = ip;
+    if (site) {
+        site->checked++;
+        site->missing += missing;
+    }
+}
+
+/* hint_prof_park - counts a thread parked on a fault by the last check */
+static inline void hint_prof_park(void)
+{
+    struct hint_site* site = hint_prof_site(HPROF_HINTS, hint_prof_last_ip);
+
+    if (site)
+        site->parked++;
+}
+
+/* hint_prof_kfault - counts a kernel fault at a faulting ip */
+static inline void hint_prof_kfault(unsigned long ip)
+{
+    struct hint_site* site = hint_prof_site(HPROF_KFAULTS, ip);
+
+    if (site)
+        site->checked++;
+}
+
+#endif  // __HINT_PROF_H__
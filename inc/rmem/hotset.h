@@ -0,0 +1,38 @@
+/*
+ * hotset.h - saving the hot pages and reading them back on a restart
+ */
+
+#ifndef __HOTSET_H__
+#define __HOTSET_H__
+
+#include "base/stddef.h"
+
+/**
+ * The pages in local memory at shutdown (or at a checkpoint, see
+ * rmcheckpoint()) are written to the file given by rmem_hotset_file,
+ * hottest first (hot class, then the LRU generations from the newest).
+ * Pages are saved as runs of "<hex offset> <npages>", one per line, with
+ * offsets from the start of remote memory (rmem_va_start), which does not
+ * move between runs with the same backing memory.
+ *
+ * On the next start, if the backend kept the remote memory (see
+ * rmem_backend_ops.persistent), the handlers read the runs back in large
+ * batches, until local memory reaches the eviction threshold, and init
+ * waits for them before letting the application in.
+ */
+struct hotset_run {
+    unsigned long offset;
+    int npages;
+};
+
+/* state */
+extern bool hotset_save_pending;
+
+/* functions */
+int hotset_init(void);
+void hotset_replay(int chan_id);
+void hotset_replay_wait(void);
+int hotset_save(void);
+void hotset_destroy(void);
+
+#endif  // __HOTSET_H__
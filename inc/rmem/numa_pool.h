@@ -0,0 +1,114 @@
+/*
+ * numa_pool.h - object pools partitioned across NUMA nodes
+ */
+
+#ifndef __RMEM_NUMA_POOL_H__
+#define __RMEM_NUMA_POOL_H__
+
+#include <stdatomic.h>
+
+#include "base/limits.h"
+#include "base/lock.h"
+#include "base/tcache.h"
+#include "base/thread.h"
+
+/**
+ * A pool of fixed-size objects backed by one contiguous region (so objects
+ * can still be referred to by their index) that is split into a partition
+ * per NUMA node, each bound to its node. Threads allocate from their local
+ * partition (falling back to others when it runs out) through a per-thread
+ * magazine cache per partition, and objects always go back to the partition
+ * they came from. Threads exchange full magazines through a lock-free depot
+ * in each partition; the partition lock is only taken to carve out new 
+ * objects.
+ */
+struct numa_pool;
+struct numa_pool_part {
+    spinlock_t lock;
+    struct numa_pool* pool;
+    int id;
+    size_t start;           /* first object in the partition */
+    size_t count;           /* objects handed out so far */
+    size_t nfree;
+    void** free;
+    struct tcache* tc;
+
+    /* depot of full magazines: a stack with the top tagged against ABA */
+    atomic_ulong depot __aligned(CACHE_LINE_SIZE);
+};
+
+struct numa_pool {
+    const char* name;
+    void* base;
+    size_t len;
+    size_t item_size;
+    size_t nitems;
+    size_t nitems_per_part;
+    int nparts;
+    struct numa_pool_part parts[NNUMA];
+};
+
+/* per-thread caches, one for each partition */
+typedef struct tcache_perthread numa_pool_perthread_t[NNUMA];
+
+/* state */
+extern int rmem_nnodes;
+extern __thread int rmem_thread_node;
+
+/* API */
+void rmem_numa_init(void);
+void rmem_numa_init_thread(void);
+int numa_pool_create(struct numa_pool* p, const char* name, size_t item_size,
+    size_t nitems, unsigned int mag_size, size_t pgsize);
+void numa_pool_init_thread(struct numa_pool* p, numa_pool_perthread_t* pts);
+void numa_pool_destroy(struct numa_pool* p);
+void* __numa_pool_alloc(struct tcache_perthread* ltc);
+void __numa_pool_free(struct tcache_perthread* ltc, void* item);
+
+/* numa_pool_is_valid - checks if an address points to an object in the pool */
+static inline bool numa_pool_is_valid(struct numa_pool* p, void* item)
+{
+    assert(p->base);  /* check inited */
+    return item >= p->base
+        && (unsigned long)(item - p->base) < p->nitems * p->item_size
+        && (unsigned long)(item - p->base) % p->item_size == 0;
+}
+
+/* numa_pool_part_of - partition that an object belongs to */
+static inline int numa_pool_part_of(struct numa_pool* p, void* item)
+{
+    return (unsigned long)(item - p->base) / p->item_size / p->nitems_per_part;
+}
+
+/* numa_pool_alloc - allocates an object, from the local node if possible */
+static inline void* numa_pool_alloc(numa_pool_perthread_t* pts)
+{
+    struct tcache_perthread* ltc = &(*pts)[rmem_thread_node];
+    void* item = (void*) ltc->loaded;
+
+    if (ltc->rounds == 0)
+        return __numa_pool_alloc(ltc);
+
+    ltc->rounds--;
+    ltc->loaded = ltc->loaded->next_item;
+    return item;
+}
+
+/* numa_pool_free - frees an object back to its own node's partition */
+static inline void numa_pool_free(struct numa_pool* p,
+    numa_pool_perthread_t* pts, void* item)
+{
+    struct tcache_perthread* ltc;
+    struct tcache_hdr* hdr = (struct tcache_hdr*) item;
+
+    assert(numa_pool_is_valid(p, item));
+    ltc = &(*pts)[numa_pool_part_of(p, item)];
+    if (ltc->rounds >= ltc->capacity)
+        return __numa_pool_free(ltc, item);
+
+    ltc->rounds++;
+    hdr->next_item = ltc->loaded;
+    ltc->loaded = hdr;
+}
+
+#endif  // __RMEM_NUMA_POOL_H__
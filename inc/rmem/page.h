@@ -8,6 +8,7 @@
 #include <stdatomic.h>
 #include "base/list.h"
 #include "base/tcache.h"
+#include "rmem/api.h"
 #include "rmem/eviction.h"
 #include "rmem/region.h"
 
@@ -18,6 +19,8 @@
  * 1. Page flags
  * 2. Page thread id
  * 3. Page node index
+ * 4. Page allocation site (ALLOC_PROFILER)
+ * 5. Page memory class (see rmalloc_class())
  */
 
 /* 1. Page flags (mask) */
@@ -55,13 +58,60 @@ BUILD_ASSERT(PAGE_THREAD_MASK > 0);
 #define PAGE_INDEX_MASK     (PAGE_INDEX_MAX << PAGE_INDEX_SHIFT)
 BUILD_ASSERT(PAGE_INDEX_MASK > 0);
 
+/* 4. Allocation site (see alloc_prof.h) */
+#define PAGE_SITE_SHIFT     (PAGE_INDEX_SHIFT + PAGE_INDEX_LEN)
+#define PAGE_SITE_LEN       14
+#define PAGE_SITE_MAX       ((1ULL << PAGE_SITE_LEN) - 1)
+#define PAGE_SITE_MASK      (PAGE_SITE_MAX << PAGE_SITE_SHIFT)
+BUILD_ASSERT(PAGE_SITE_MAX >= ALLOC_PROF_MAX_SITES - 1);
+
+/* 5. Memory class (in the remaining bits) */
+#define PAGE_CLASS_SHIFT    (PAGE_SITE_SHIFT + PAGE_SITE_LEN)
+#define PAGE_CLASS_LEN      (sizeof(pginfo_t) * 8 - PAGE_CLASS_SHIFT)
+#define PAGE_CLASS_MAX      ((1ULL << PAGE_CLASS_LEN) - 1)
+#define PAGE_CLASS_MASK     (PAGE_CLASS_MAX << PAGE_CLASS_SHIFT)
+BUILD_ASSERT(PAGE_CLASS_MAX >= RMEM_CLASS_NR - 1);
+
 /**
- * Gets page metadata pointer
+ * Page metadata is kept in a two-level table: a directory per region that 
+ * points to leaves of (1 << PAGE_INFO_LEAF_SHIFT) entries, which are only 
+ * allocated when a page in them is first updated. Pages in missing leaves 
+ * have all-zero metadata.
+ */
+#define PAGE_INFO_LEAF_SIZE     (1UL << PAGE_INFO_LEAF_SHIFT)
+#define PAGE_INFO_LEAF_MASK     (PAGE_INFO_LEAF_SIZE - 1)
+
+/**
+ * Gets page metadata pointer, or NULL if its leaf was never allocated
+ */
+static inline atomic_pginfo_t *__page_ptr(struct region_t *mr, 
+    unsigned long addr)
+{
+    unsigned long offset = ((addr - mr->addr) >> CHUNK_SHIFT);
+    unsigned long leaf = offset >> PAGE_INFO_LEAF_SHIFT;
+    atomic_pginfo_t *leafptr;
+
+    assert(leaf < mr->page_info_nleaves);
+    leafptr = load_acquire(&mr->page_info[leaf]);
+    if (unlikely(!leafptr))
+        return NULL;
+    return &leafptr[offset & PAGE_INFO_LEAF_MASK];
+}
+
+/**
+ * Gets page metadata pointer, allocating the leaf if necessary
  */
 static inline atomic_pginfo_t *page_ptr(struct region_t *mr, unsigned long addr)
 {
-    int offset = ((addr - mr->addr) >> CHUNK_SHIFT);
-    return &mr->page_info[offset];
+    atomic_pginfo_t *ptr = __page_ptr(mr, addr);
+    unsigned long offset;
+
+    if (unlikely(!ptr)) {
+        offset = ((addr - mr->addr) >> CHUNK_SHIFT);
+        ptr = region_alloc_page_info_leaf(mr, offset >> PAGE_INFO_LEAF_SHIFT);
+        ptr = &ptr[offset & PAGE_INFO_LEAF_MASK];
+    }
+    return ptr;
 }
 
 /**
@@ -69,8 +119,9 @@ static inline atomic_pginfo_t *page_ptr(struct region_t *mr, unsigned long addr)
  */
 static inline pginfo_t get_page_info(struct region_t *mr, unsigned long addr)
 {
-    atomic_pginfo_t *ptr = page_ptr(mr, addr);
-    return *ptr;
+    atomic_pginfo_t *ptr = __page_ptr(mr, addr);
+    /* never-touched pages have no metadata */
+    return ptr ? *ptr : 0;
 }
 
 /**
@@ -111,11 +162,12 @@ static inline pgflags_t __clear_page_info(struct region_t *mr,
     pginfo_t oldinfo, clrmask, newinfo;
     atomic_pginfo_t *ptr;
     
-    ptr = page_ptr(mr, addr);
+    /* nothing to clear on never-touched pages */
+    ptr = __page_ptr(mr, addr);
     clrmask = ~flags_to_clear;
     if (clear_thread)   clrmask &= (~PAGE_THREAD_MASK);
     if (clear_idx)      clrmask &= (~PAGE_INDEX_MASK);
-    oldinfo = atomic_fetch_and(ptr, clrmask);
+    oldinfo = ptr ? atomic_fetch_and(ptr, clrmask) : 0;
     if (oldinfo_out)
         *oldinfo_out = oldinfo;
     newinfo = oldinfo & clrmask;
@@ -417,4 +469,77 @@ static inline pgidx_t clear_page_index(struct region_t *mr, unsigned long addr)
     return set_page_index(mr, addr, 0);
 }
 
-#endif    // __RMEM_PAGE_H_
\ No newline at end of file
+/* ***********************************************************
+ * Page allocation site in metadata - definition and helpers
+ * Only used with ALLOC_PROFILER, for the site of the last sampled allocation 
+ * that landed on the page (0 for none).
+ */
+
+/**
+ * Gets page allocation site from pginfo
+ */
+static inline unsigned int get_site_from_pginfo(pginfo_t pginfo)
+{
+    return (unsigned int) ((pginfo & PAGE_SITE_MASK) >> PAGE_SITE_SHIFT);
+}
+
+/**
+ * Sets allocation site on a page and returns the old pginfo. Unlike the 
+ * thread and index, this does not require the page lock.
+ */
+static inline pginfo_t set_page_site(struct region_t *mr, unsigned long addr, 
+    unsigned int site)
+{
+    pginfo_t pginfo, newinfo;
+    atomic_pginfo_t *ptr;
+
+    assert(site <= PAGE_SITE_MAX);
+    ptr = page_ptr(mr, addr);
+    pginfo = atomic_load(ptr);
+    do {
+        newinfo = (pginfo & ~PAGE_SITE_MASK);   /*keep non-site bits*/
+        newinfo |= (((pginfo_t) site) << PAGE_SITE_SHIFT);
+    } while(!atomic_compare_exchange_weak(ptr, &pginfo, newinfo));
+    return pginfo;
+}
+
+/* ***********************************************************
+ * Page memory class in metadata - definition and helpers
+ * Set when the memory is allocated (see rmalloc_class()) and decides how the
+ * page is treated by eviction (RMEM_CLASS_DEFAULT for most pages). It stays 
+ * through madvise and munmap, as jemalloc reuses purged memory for the same 
+ * arena and unmapped addresses are never handed out again.
+ */
+
+/**
+ * Gets page memory class from pginfo
+ */
+static inline int get_class_from_pginfo(pginfo_t pginfo)
+{
+    return (int) ((pginfo & PAGE_CLASS_MASK) >> PAGE_CLASS_SHIFT);
+}
+
+/**
+ * Sets memory class on a range of pages. Like the site, this does not require
+ * the page lock.
+ */
+static inline void set_page_class_range(struct region_t *mr,
+    unsigned long addr, size_t size, int memclass)
+{
+    pginfo_t pginfo, newinfo;
+    atomic_pginfo_t *ptr;
+    unsigned long page, end;
+
+    assert(memclass >= 0 && memclass < RMEM_CLASS_NR);
+    end = align_up(addr + size, CHUNK_SIZE);
+    for (page = addr & ~CHUNK_MASK; page < end; page += CHUNK_SIZE) {
+        ptr = page_ptr(mr, page);
+        pginfo = atomic_load(ptr);
+        do {
+            newinfo = (pginfo & ~PAGE_CLASS_MASK);  /*keep non-class bits*/
+            newinfo |= (((pginfo_t) memclass) << PAGE_CLASS_SHIFT);
+        } while(!atomic_compare_exchange_weak(ptr, &pginfo, newinfo));
+    }
+}
+
+#endif    // __RMEM_PAGE_H_
@@ -7,36 +7,38 @@
 #ifndef __RMEM_PAGE_NODE_H__
 #define __RMEM_PAGE_NODE_H__
 
-#include "base/list.h"
 #include "base/tcache.h"
-#include "rmem/eviction.h"
+#include "rmem/numa_pool.h"
 #include "rmem/page.h"
 #include "rmem/region.h"
 
 /**
- * Page node definition
+ * Page node definition. There is a node for every locally present page so
+ * they are kept compact: nodes link to each other with 32-bit indices 
+ * instead of pointers and refer to their page with the region id and the 
+ * page offset in the region (see rmpage_node_addr()).
  */
 struct rmpage_node {
-    struct region_t *mr;
-    unsigned long addr;
-    struct list_node link;
+    pgidx_t next;           /* links in page lists (struct rmpage_list) */
+    pgidx_t prev;
+    uint32_t pgoff;         /* page offset in region, in CHUNK_SIZE units */
+    uint8_t mr_id;          /* region id (see region_table) */
     uint8_t evict_prio;
-
-    /* time epoch when page was last accessed. this is set by hints and consumed 
-     * by the eviction routines to make smarter eviction choices. we treat it 
-     * merely as a performance hint that can be inaccurate to avoid the overhead
-     * of locking the page node or ensuring the node is valid. that means, in 
-     * rare cases, this field can be set when the page node does not exist for 
-     * a page or is associated with a different page. */
-    unsigned long epoch;
+    uint16_t unused;
 };
 typedef struct rmpage_node rmpage_node_t;
+BUILD_ASSERT(sizeof(rmpage_node_t) == TCACHE_MIN_ITEM_SIZE);
 BUILD_ASSERT(EVICTION_MAX_PRIO <= UINT8_MAX);   /* due to evict_prio */
+BUILD_ASSERT(RMEM_MAX_REGIONS <= UINT8_MAX);    /* due to mr_id */
+
+#define RMPAGE_NODE_NONE    ((pgidx_t) PAGE_INDEX_MAX)
 
 /* Page node pool (tcache) support */
-DECLARE_PERTHREAD(struct tcache_perthread, rmpage_node_pt);
+DECLARE_PERTHREAD(numa_pool_perthread_t, rmpage_node_pt);
+extern struct numa_pool rmpage_node_pool;
 extern rmpage_node_t* rmpage_nodes;
 extern size_t rmpage_node_count;
+extern uint32_t* rmpage_epochs;
 
 /* pgnode tcache API */
 int rmpage_node_tcache_init(void);
@@ -48,12 +50,13 @@ int rmpage_node_tcache_destroy(void);
 static inline rmpage_node_t* rmpage_node_alloc(void)
 {
     rmpage_node_t* pgnode;
-    pgnode = (rmpage_node_t*) tcache_alloc(&perthread_get(rmpage_node_pt));
+    pgnode = (rmpage_node_t*) numa_pool_alloc(&perthread_get(rmpage_node_pt));
     if (unlikely(!pgnode)) {
         log_err("out of page nodes!");
         BUG();
     }
     memset(pgnode, 0, sizeof(rmpage_node_t));
+    rmpage_epochs[pgnode - rmpage_nodes] = 0;
     return pgnode;
 }
 
@@ -61,7 +64,7 @@ static inline rmpage_node_t* rmpage_node_alloc(void)
 static inline void rmpage_node_free(rmpage_node_t* node)
 {
     assert(rmpage_is_node_valid(node));
-    tcache_free(&perthread_get(rmpage_node_pt), node);
+    numa_pool_free(&rmpage_node_pool, &perthread_get(rmpage_node_pt), node);
 }
 
 /* rmpage_get_node_id - gets a shortened index to a page node that can be saved 
@@ -78,6 +81,170 @@ static inline rmpage_node_t* rmpage_get_node_by_id(pgidx_t id)
     return &rmpage_nodes[id];
 }
 
+/* rmpage_node_set_page - points a page node to a page */
+static inline void rmpage_node_set_page(rmpage_node_t* node, 
+    struct region_t* mr, unsigned long addr)
+{
+    assert(region_table[mr->id] == mr);
+    assert(addr >= mr->addr && addr < mr->addr + mr->size);
+    node->mr_id = mr->id;
+    node->pgoff = (uint32_t) ((addr - mr->addr) >> CHUNK_SHIFT);
+}
+
+/* rmpage_node_mr - gets the region of the page */
+static inline struct region_t* rmpage_node_mr(rmpage_node_t* node)
+{
+    return region_table[node->mr_id];
+}
+
+/* rmpage_node_addr - gets the address of the page */
+static inline unsigned long rmpage_node_addr(rmpage_node_t* node)
+{
+    return rmpage_node_mr(node)->addr + 
+        ((unsigned long) node->pgoff << CHUNK_SHIFT);
+}
+
+/**
+ * Page access epochs, kept apart from the nodes. The epoch is the time when 
+ * the page was last accessed. This is set by hints and consumed by the 
+ * eviction routines to make smarter eviction choices. We treat it merely as 
+ * a performance hint that can be inaccurate to avoid the overhead of locking
+ * the page node or ensuring the node is valid. That means, in rare cases, 
+ * this field can be set when the page node does not exist for a page or is 
+ * associated with a different page. It is also compressed to 32 bits, with 
+ * 0 meaning not set, so only differences between recent epochs matter.
+ */
+static inline uint32_t rmpage_get_epoch(pgidx_t id)
+{
+    assert(id < rmpage_node_count);
+    return ACCESS_ONCE(rmpage_epochs[id]);
+}
+
+static inline void rmpage_set_epoch(pgidx_t id, unsigned long epoch)
+{
+    assert(id < rmpage_node_count);
+    rmpage_epochs[id] = (uint32_t) epoch ?: 1;
+}
+
+static inline void rmpage_clear_epoch(pgidx_t id)
+{
+    assert(id < rmpage_node_count);
+    rmpage_epochs[id] = 0;
+}
+
+/**
+ * Page lists - doubly-linked lists of page nodes that use the node indices 
+ * as links. Not thread-safe, callers must hold the lock of the list.
+ */
+static inline rmpage_node_t* __rmpage_node_or_null(pgidx_t id)
+{
+    return (id == RMPAGE_NODE_NONE) ? NULL : rmpage_get_node_by_id(id);
+}
+
+static inline void rmpage_list_init(struct rmpage_list* l)
+{
+    l->head = l->tail = RMPAGE_NODE_NONE;
+}
+
+static inline bool rmpage_list_empty(struct rmpage_list* l)
+{
+    return l->head == RMPAGE_NODE_NONE;
+}
+
+static inline rmpage_node_t* rmpage_list_top(struct rmpage_list* l)
+{
+    return __rmpage_node_or_null(l->head);
+}
+
+static inline rmpage_node_t* rmpage_list_next(rmpage_node_t* node)
+{
+    return __rmpage_node_or_null(node->next);
+}
+
+static inline void rmpage_list_add_tail(struct rmpage_list* l, 
+    rmpage_node_t* node)
+{
+    pgidx_t id = rmpage_get_node_id(node);
+
+    node->next = RMPAGE_NODE_NONE;
+    node->prev = l->tail;
+    if (l->tail != RMPAGE_NODE_NONE)
+        rmpage_nodes[l->tail].next = id;
+    else
+        l->head = id;
+    l->tail = id;
+}
+
+/* rmpage_list_del - removes a node from its list. The list is only needed 
+ * (and may be NULL otherwise) if the node is at either end of it */
+static inline void rmpage_list_del(struct rmpage_list* l, rmpage_node_t* node)
+{
+    pgidx_t id = rmpage_get_node_id(node);
+
+    if (node->prev != RMPAGE_NODE_NONE)
+        rmpage_nodes[node->prev].next = node->next;
+    else {
+        assert(l && l->head == id);
+        l->head = node->next;
+    }
+    if (node->next != RMPAGE_NODE_NONE)
+        rmpage_nodes[node->next].prev = node->prev;
+    else {
+        assert(l && l->tail == id);
+        l->tail = node->prev;
+    }
+    node->next = node->prev = RMPAGE_NODE_NONE;
+}
+
+static inline rmpage_node_t* rmpage_list_pop(struct rmpage_list* l)
+{
+    rmpage_node_t* node = rmpage_list_top(l);
+    if (node)
+        rmpage_list_del(l, node);
+    return node;
+}
+
+/* rmpage_list_append_list - moves all nodes in src to the end of dst */
+static inline void rmpage_list_append_list(struct rmpage_list* dst, 
+    struct rmpage_list* src)
+{
+    if (rmpage_list_empty(src))
+        return;
+    if (rmpage_list_empty(dst))
+        *dst = *src;
+    else {
+        rmpage_nodes[dst->tail].next = src->head;
+        rmpage_nodes[src->head].prev = dst->tail;
+        dst->tail = src->tail;
+    }
+    rmpage_list_init(src);
+}
+
+/* rmpage_list_prepend_list - moves all nodes in src to the front of dst */
+static inline void rmpage_list_prepend_list(struct rmpage_list* dst, 
+    struct rmpage_list* src)
+{
+    if (rmpage_list_empty(src))
+        return;
+    if (rmpage_list_empty(dst))
+        *dst = *src;
+    else {
+        rmpage_nodes[src->tail].next = dst->head;
+        rmpage_nodes[dst->head].prev = src->tail;
+        dst->head = src->head;
+    }
+    rmpage_list_init(src);
+}
+
+#define rmpage_list_for_each(l, node)                                       \
+    for (node = rmpage_list_top(l); node; node = rmpage_list_next(node))
+
+#define rmpage_list_for_each_safe(l, node, nxt)                             \
+    for (node = rmpage_list_top(l),                                         \
+            nxt = node ? rmpage_list_next(node) : NULL;                     \
+        node;                                                               \
+        node = nxt, nxt = node ? rmpage_list_next(node) : NULL)
+
 /**
  * To-be-freed page nodes support - for properly releasing page nodes from
  * threads that do not have the tcache support, and hence cannot use
@@ -111,6 +111,7 @@ struct request {
     unsigned int lkey;
     unsigned int rkey;
     unsigned long size;
+    unsigned long posted_tsc;
     rw_mode_t mode;
 };
 typedef struct request request_t;
@@ -121,5 +122,6 @@ void post_receives(struct connection *conn);
 void send_message(struct connection *conn);
 void do_rdma_op(request_t *req, bool signal_completion);
 void do_rdma_op_linked(request_t *reqs, unsigned n_reqs, bool signal_completion);
+void do_rdma_op_batch(request_t **reqs, unsigned n_reqs);
 
 #endif    // __RDMA_H__
@@ -11,6 +11,7 @@
 
 #include "base/assert.h"
 #include "base/lock.h"
+#include "rmem/api.h"
 #include "rmem/config.h"
 #include "rmem/rdma.h"
 
@@ -35,12 +36,17 @@ struct region_t {
     unsigned long remote_addr;
     atomic_ullong current_offset;
 
-    /* page metadata */
-    atomic_pginfo_t *page_info;
+    /* page metadata: a directory of leaves that are allocated on first use
+     * (see page_ptr()) */
+    atomic_pginfo_t **page_info;
+    size_t page_info_nleaves;
 
     /* RDMA-specific data. TODO: move into rdma backend */
     struct server_conn_t *server;
 
+    /* slot in region_table, which lets page nodes refer to the region */
+    int id;
+
     /* ref counter for each local page and ongoing fault */
     atomic_int ref_cnt;
     CIRCLEQ_ENTRY(region_t) link;
@@ -51,17 +57,36 @@ CIRCLEQ_HEAD(region_listhead, region_t);
 extern struct region_listhead region_list;
 extern struct region_t* last_evicted;
 extern int nregions;
+extern struct region_t* region_table[RMEM_MAX_REGIONS];
 DECLARE_SPINLOCK(regions_lock);
 
+/* region growth state */
+extern atomic_ulong region_grow_req;
+extern bool region_grow_exhausted;
+
 /* functions */
+int region_reserve_va(void);
+void region_release_va(void);
 int register_memory_region(struct region_t *mr, int writeable);
+atomic_pginfo_t* region_alloc_page_info_leaf(struct region_t *mr, 
+    unsigned long leaf);
 void remove_memory_region(struct region_t *mr);
+void region_request_growth(size_t size);
+int region_grow(void);
+
+/* Checks if more regions were asked for and not yet added */
+static inline bool region_grow_pending(void)
+{
+    return atomic_load_explicit(&region_grow_req, memory_order_relaxed) != 0;
+}
 
 /* 
  * Memory region utils 
- * NOTE: Region safety only required when dynamically adding regions during 
+ * NOTE: Region safety only required when dynamically deleting regions during 
  * application execution. Currently not supported (NO_DYNAMIC_REGIONS) but 
- * keeping the current code open to the future design.
+ * keeping the current code open to the future design. Regions may still be 
+ * added at runtime (see region_grow()); they are only published at the list 
+ * head after being fully initialized so lock-free walks remain safe.
  */
 
 /* Adds a reference to region
@@ -98,22 +123,11 @@ static inline bool is_in_memory_region_unsafe(struct region_t *mr,
     return addr >= mr->addr && addr < mr->addr + mr->size;
 }
 
-/* Checks if given pointer falls in any of the active memory regions */
+/* Checks if given pointer falls in any of the memory regions. Nothing else 
+ * is mapped in the reserved range so this needs neither the lock nor a walk */
 static inline bool within_memory_region(void *ptr) 
 {
-    if (ptr == NULL)
-        return false;
-
-    struct region_t *mr = NULL;
-    acquire_region_lock();
-    CIRCLEQ_FOREACH(mr, &region_list, link) {
-        if (is_in_memory_region_unsafe(mr, (unsigned long)ptr)) {
-            release_region_lock();
-            return true;
-        }
-    }
-    release_region_lock();
-    return false;
+    return is_rmem_ptr(ptr);
 }
 
 /* Finds a region with available memory of given size. It returns a deletion-safe 
@@ -17,12 +17,14 @@ enum {
     RSTAT_FAULTS_WP,
     RSTAT_FAULTS_ZP,
     RSTAT_FAULTS_P0,
+    RSTAT_FAULTS_PINNED,        /* pages pinned for the hot memory class */
     RSTAT_FAULTS_DONE,
     RSTAT_WP_UPGRADES,
     RSTAT_UFFD_NOTIF,
     RSTAT_UFFD_RETRIES,
     RSTAT_RDAHEADS,
     RSTAT_RDAHEAD_PAGES,
+    RSTAT_HOTSET_PAGES,         /* hot pages of the last run read back */
 
     /* eviction stats */
     RSTAT_EVICTS,
@@ -34,10 +36,14 @@ enum {
     RSTAT_EVICT_MADV,
     RSTAT_EVICT_DONE,
     RSTAT_EVICT_PAGES_DONE,
+    RSTAT_EVICT_STREAM,         /* stream pages queued for eviction */
 
     /* network read/writes */
     RSTAT_NET_READ,
     RSTAT_NET_WRITE,
+    RSTAT_HEDGES,               /* duplicate reads sent for slow reads */
+    RSTAT_HEDGE_WINS,           /* duplicate reads that completed first */
+    RSTAT_NET_NO_CREDITS,       /* posts turned away by flow control */
 
     /* work stealing */
     RSTAT_READY_STEALS,
@@ -48,6 +54,8 @@ enum {
     RSTAT_MALLOC_SIZE,
     RSTAT_MUNMAP_SIZE,
     RSTAT_MADV_SIZE,
+    RSTAT_REGIONS_ADDED,
+    RSTAT_POOL_DEPOT_RETRIES,   /* lost races on object pool depots */
 
     /* time accounting */
     RSTAT_TOTAL_CYCLES,
@@ -5,6 +5,10 @@
 #ifndef __UFFD_H__
 #define __UFFD_H__
 
+#include <linux/userfaultfd.h>
+#include <stdint.h>
+#include <string.h>
+
 /**
  * Control Ops 
  */
@@ -47,6 +51,19 @@ int uffd_wp_remove_vec(int fd, struct iovec* iov, int iov_len, bool no_wake,
  */
 int uffd_wake(int fd, unsigned long addr, size_t size);
 
+/**
+ * uffd_msg_ip - the faulting ip of a page fault message if the kernel has
+ * kernel/uffd-include-ip.patch, or 0. The patch puts it in the otherwise
+ * reserved (zeroed) bytes after the event so read those directly to work 
+ * with either version of the uapi header.
+ */
+static inline unsigned long uffd_msg_ip(struct uffd_msg* msg)
+{
+    uint64_t word;
+    memcpy(&word, msg, sizeof(word));
+    return word >> 16;
+}
+
 /* uffd state */
 extern int userfault_fd;
 
@@ -0,0 +1,98 @@
+/*
+ * stat_shm.h - layout of the shared-memory stats segment
+ *
+ * The stats worker copies the raw per-kthread and per-handler counters into
+ * /dev/shm/eden-stats-<pid> every runtime_stats_shm_us, so that readers
+ * (see tools/statshm) can sample them at any rate without asking the runtime.
+ * Readers take a consistent snapshot with the seqlock in the header.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <asm/atomic.h>
+#include <asm/ops.h>
+
+#define STAT_SHM_PATH		"/dev/shm/eden-stats-%d"
+#define STAT_SHM_MAGIC		0x45444e5354415453UL	/* "EDNSTATS" */
+#define STAT_SHM_VERSION	1
+#define STAT_SHM_NAME_LEN	32
+
+struct stat_shm_hdr {
+	uint64_t	magic;			/* set last, when ready */
+	uint32_t	version;
+	uint32_t	name_len;
+	uint32_t	nstats;			/* scheduler counters per kthread */
+	uint32_t	nrstats;		/* rmem counters per kthread/handler */
+	uint32_t	nglobals;		/* process-wide counters */
+	uint32_t	max_kthreads;
+	uint32_t	max_handlers;
+	uint32_t	pad;
+	uint64_t	names_off;		/* nstats + nrstats + nglobals names */
+	uint64_t	data_off;
+	uint64_t	cycles_per_us;
+	uint64_t	interval_us;
+
+	/* updated with every snapshot */
+	uint64_t	seq;			/* odd while being written */
+	uint64_t	tsc;			/* when the snapshot was taken */
+	uint64_t	nkthreads;
+	uint64_t	nhandlers;
+};
+
+/*
+ * Data layout after data_off, all uint64_t:
+ *  max_kthreads x (nstats scheduler counters, nrstats rmem counters)
+ *  max_handlers x (nrstats rmem counters)
+ *  nglobals counters
+ */
+static inline uint64_t *stat_shm_kthread(struct stat_shm_hdr *h, int k)
+{
+	return (void *)h + h->data_off +
+		k * (h->nstats + h->nrstats) * sizeof(uint64_t);
+}
+
+static inline uint64_t *stat_shm_handler(struct stat_shm_hdr *h, int i)
+{
+	return stat_shm_kthread(h, h->max_kthreads) +
+		i * h->nrstats;
+}
+
+static inline uint64_t *stat_shm_globals(struct stat_shm_hdr *h)
+{
+	return stat_shm_handler(h, h->max_handlers);
+}
+
+/* names are ordered like the counters: scheduler, rmem, then globals */
+static inline const char *stat_shm_name(struct stat_shm_hdr *h, int i)
+{
+	return (const char *)h + h->names_off + i * h->name_len;
+}
+
+static inline size_t stat_shm_size(struct stat_shm_hdr *h)
+{
+	return (void *)(stat_shm_globals(h) + h->nglobals) - (void *)h;
+}
+
+/**
+ * stat_shm_read_begin - starts reading a snapshot, returns the sequence to
+ * pass to stat_shm_read_retry()
+ */
+static inline uint64_t stat_shm_read_begin(struct stat_shm_hdr *h)
+{
+	uint64_t seq;
+
+	while ((seq = load_acquire(&h->seq)) & 1)
+		cpu_relax();
+	return seq;
+}
+
+/**
+ * stat_shm_read_retry - returns true if the snapshot changed while reading
+ */
+static inline bool stat_shm_read_retry(struct stat_shm_hdr *h, uint64_t seq)
+{
+	rmb();
+	return ACCESS_ONCE(h->seq) != seq;
+}
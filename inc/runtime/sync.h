@@ -98,10 +98,11 @@ static inline void waitgroup_done(waitgroup_t *wg)
  * spin_lock_np - takes a spin lock and disables preemption
  * @l: the spin lock
  */
-static inline void spin_lock_np(spinlock_t *l)
+#define spin_lock_np(l) __spin_lock_np(l LOCK_SITE_HERE)
+static inline void __spin_lock_np(spinlock_t *l LOCK_SITE_ARG)
 {
 	preempt_disable();
-	spin_lock(l);
+	__spin_lock(l LOCK_SITE_PASS);
 }
 
 /**
@@ -110,10 +111,11 @@ static inline void spin_lock_np(spinlock_t *l)
  *
  * Returns true if successful, otherwise fail.
  */
-static inline bool spin_try_lock_np(spinlock_t *l)
+#define spin_try_lock_np(l) __spin_try_lock_np(l LOCK_SITE_HERE)
+static inline bool __spin_try_lock_np(spinlock_t *l LOCK_SITE_ARG)
 {
 	preempt_disable();
-	if (spin_try_lock(l))
+	if (__spin_try_lock(l LOCK_SITE_PASS))
 		return true;
 
 	preempt_enable();
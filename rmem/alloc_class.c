@@ -0,0 +1,95 @@
+/*
+ * alloc_class.c - memory class policy for allocation sites
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "base/log.h"
+#include "rmem/alloc_class.h"
+#include "rmem/common.h"
+
+/* state (read-only after init) */
+struct alloc_class_site alloc_class_sites[ALLOC_CLASS_MAX_SITES];
+int alloc_class_nsites = 0;
+
+static int alloc_class_parse(const char* name)
+{
+    if (!strcmp(name, "hot"))
+        return RMEM_CLASS_HOT;
+    if (!strcmp(name, "cold"))
+        return RMEM_CLASS_COLD;
+    if (!strcmp(name, "stream"))
+        return RMEM_CLASS_STREAM;
+    if (!strcmp(name, "default"))
+        return RMEM_CLASS_DEFAULT;
+    return -1;
+}
+
+static int alloc_class_add(unsigned long ip, int memclass)
+{
+    unsigned int i;
+
+    /* keep the table sparse so lookups of unknown sites end early */
+    if (alloc_class_nsites >= ALLOC_CLASS_MAX_SITES / 2)
+        return -ENOSPC;
+
+    i = alloc_class_hash(ip);
+    while (alloc_class_sites[i].ip && alloc_class_sites[i].ip != ip)
+        i = (i + 1) & (ALLOC_CLASS_MAX_SITES - 1);
+    if (!alloc_class_sites[i].ip)
+        alloc_class_nsites++;
+    alloc_class_sites[i].ip = ip;
+    alloc_class_sites[i].memclass = memclass;
+    return 0;
+}
+
+/**
+ * alloc_class_init - reads the site policy from rmem_alloc_class_sites, if 
+ * given. Must run before the application allocates.
+ */
+int alloc_class_init(void)
+{
+    char line[256], name[16];
+    unsigned long ip;
+    int memclass, lineno, ret;
+    FILE* fp;
+
+    if (!alloc_class_sites_path[0])
+        return 0;
+
+    fp = fopen(alloc_class_sites_path, "r");
+    if (!fp) {
+        log_err("couldn't open allocation class sites %s", 
+            alloc_class_sites_path);
+        return -ENOENT;
+    }
+
+    ret = 0;
+    lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%lx %15s", &ip, name) != 2 || !ip
+                || (memclass = alloc_class_parse(name)) < 0) {
+            log_err("%s:%d: expecting \"<hex address> "
+                "<hot|cold|stream|default>\"", alloc_class_sites_path, lineno);
+            ret = -EINVAL;
+            break;
+        }
+        ret = alloc_class_add(ip, memclass);
+        if (ret) {
+            log_err("%s: more than %d sites", alloc_class_sites_path, 
+                ALLOC_CLASS_MAX_SITES / 2);
+            break;
+        }
+    }
+    fclose(fp);
+
+    if (!ret)
+        log_info("read memory classes for %d allocation sites from %s", 
+            alloc_class_nsites, alloc_class_sites_path);
+    return ret;
+}
@@ -0,0 +1,210 @@
+/*
+ * alloc_prof.c - residency and fault accounting per allocation site
+ */
+
+#include <execinfo.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base/lock.h"
+#include "base/log.h"
+#include "rmem/alloc_prof.h"
+#include "rmem/region.h"
+
+#define SKIP_FRAMES     2   /* __alloc_prof_sample and the allocator */
+
+/* state */
+__thread long alloc_prof_countdown = 0;
+static __thread unsigned long alloc_prof_rand = 0;
+struct alloc_site alloc_sites[ALLOC_PROF_MAX_SITES];
+static unsigned long alloc_sites_dropped = 0;
+static DEFINE_SPINLOCK(alloc_sites_lock);
+
+/* bytes until the next sample, uniform in [0.5, 1.5) x the sampling rate */
+static long alloc_prof_next(void)
+{
+    if (unlikely(!alloc_prof_rand))
+        alloc_prof_rand = rdtsc() | 1;
+
+    /* xorshift */
+    alloc_prof_rand ^= alloc_prof_rand << 13;
+    alloc_prof_rand ^= alloc_prof_rand >> 7;
+    alloc_prof_rand ^= alloc_prof_rand << 17;
+    return ALLOC_PROF_SAMPLE_BYTES / 2 +
+        alloc_prof_rand % ALLOC_PROF_SAMPLE_BYTES;
+}
+
+/* finds or adds the site for a stack, returns its id or 0 if out of room */
+static unsigned int alloc_prof_site(void** frames, int nframes)
+{
+    struct alloc_site* site;
+    unsigned long hash;
+    unsigned int i, n;
+    int j;
+
+    hash = 0xcbf29ce484222325UL;
+    for (j = 0; j < nframes; j++)
+        hash = (hash ^ (unsigned long) frames[j]) * 0x100000001b3UL;
+    hash |= 1;      /* 0 marks free entries */
+
+    /* index 0 stands for no site */
+    i = hash & (ALLOC_PROF_MAX_SITES - 1);
+    for (n = 0; n < ALLOC_PROF_MAX_SITES; n++,
+            i = (i + 1) & (ALLOC_PROF_MAX_SITES - 1)) {
+        if (i == 0)
+            continue;
+        site = &alloc_sites[i];
+        if (likely(load_acquire(&site->hash) == hash))
+            return i;
+        if (site->hash)
+            continue;
+
+        /* free entry, add the site unless someone else did */
+        spin_lock(&alloc_sites_lock);
+        if (site->hash) {
+            spin_unlock(&alloc_sites_lock);
+            if (site->hash == hash)
+                return i;
+            continue;
+        }
+        site->nframes = nframes;
+        memcpy(site->frames, frames, nframes * sizeof(void*));
+        store_release(&site->hash, hash);
+        spin_unlock(&alloc_sites_lock);
+        return i;
+    }
+    return 0;
+}
+
+/**
+ * __alloc_prof_sample - attributes a sampled allocation (and the pages it
+ * spans) to the call stack of the allocation
+ */
+void __alloc_prof_sample(void* ptr, size_t size)
+{
+    void* frames[ALLOC_PROF_DEPTH + SKIP_FRAMES];
+    struct alloc_site* site;
+    struct region_t* mr;
+    unsigned long addr, end;
+    unsigned int id, oldid;
+    pginfo_t oldinfo;
+    bool present;
+    int n;
+
+    alloc_prof_countdown = alloc_prof_next();
+
+    mr = get_region_by_addr_safe((unsigned long) ptr);
+    if (!mr)
+        return;
+
+    /* may call malloc the first time, which is fine as we're in the
+     * runtime and it goes to libc */
+    n = backtrace(frames, ALLOC_PROF_DEPTH + SKIP_FRAMES) - SKIP_FRAMES;
+    id = alloc_prof_site(frames + SKIP_FRAMES, n > 0 ? n : 0);
+    if (!id) {
+        __sync_fetch_and_add(&alloc_sites_dropped, 1);
+        goto out;
+    }
+    site = &alloc_sites[id];
+    __sync_fetch_and_add(&site->counters[APROF_ALLOCS], 1);
+    __sync_fetch_and_add(&site->counters[APROF_ALLOC_BYTES], size);
+
+    /* take over the pages it spans */
+    addr = ((unsigned long) ptr) & ~CHUNK_MASK;
+    end = MIN((unsigned long) ptr + size, mr->addr + mr->size);
+    for (; addr < end; addr += CHUNK_SIZE) {
+        oldinfo = set_page_site(mr, addr, id);
+        oldid = get_site_from_pginfo(oldinfo);
+        if (oldid == id)
+            continue;
+
+        present = !!(get_flags_from_pginfo(oldinfo) & PFLAG_PRESENT);
+        if (oldid) {
+            __sync_fetch_and_sub(&alloc_sites[oldid].counters[APROF_PAGES], 1);
+            if (present)
+                __sync_fetch_and_sub(
+                    &alloc_sites[oldid].counters[APROF_RESIDENT], 1);
+        }
+        __sync_fetch_and_add(&site->counters[APROF_PAGES], 1);
+        if (present)
+            __sync_fetch_and_add(&site->counters[APROF_RESIDENT], 1);
+    }
+
+out:
+    put_mr(mr);
+}
+
+/* faults per MB of pages attributed to the site */
+static double faults_per_mb(struct alloc_site* site)
+{
+    long pages = site->counters[APROF_PAGES];
+    if (pages <= 0)
+        return 0;
+    return (double) site->counters[APROF_FAULTS] *
+        ((1 << 20) / CHUNK_SIZE) / pages;
+}
+
+static int cmp_site_faults_per_mb(const void* a, const void* b)
+{
+    double fa = faults_per_mb((struct alloc_site*) a);
+    double fb = faults_per_mb((struct alloc_site*) b);
+    return fa < fb ? 1 : fa > fb ? -1 : 0;
+}
+
+/**
+ * alloc_prof_write - writes the allocation sites ranked by faults per MB of
+ * the pages attributed to them, with their sampled allocations, pages and
+ * stacks (return addresses, innermost first). Counters are read while they
+ * are being updated so the report is approximate. Meant for a single stats
+ * thread.
+ */
+int alloc_prof_write(FILE* fp)
+{
+    static struct alloc_site sites[ALLOC_PROF_MAX_SITES];
+    long* c;
+    int i, j, n;
+
+    for (i = 0, n = 0; i < ALLOC_PROF_MAX_SITES; i++) {
+        if (!load_acquire(&alloc_sites[i].hash))
+            continue;
+        sites[n++] = alloc_sites[i];
+    }
+    qsort(sites, n, sizeof(struct alloc_site), cmp_site_faults_per_mb);
+
+    fprintf(fp, "# allocation sites by faults per MB (%d sites, %lu dropped, "
+        "sampling every %d B)\n", n, ACCESS_ONCE(alloc_sites_dropped),
+        ALLOC_PROF_SAMPLE_BYTES);
+    fprintf(fp, "faults_per_mb,faults,reads,evictions,pages,resident_pages,"
+        "sampled_allocs,sampled_bytes,stack\n");
+    for (i = 0; i < n && i < ALLOC_PROF_TOP_N; i++) {
+        c = sites[i].counters;
+        fprintf(fp, "%.2f,%ld,%ld,%ld,%ld,%ld,%ld,%ld,",
+            faults_per_mb(&sites[i]), c[APROF_FAULTS], c[APROF_READS],
+            c[APROF_EVICTIONS], c[APROF_PAGES], c[APROF_RESIDENT],
+            c[APROF_ALLOCS], c[APROF_ALLOC_BYTES]);
+        for (j = 0; j < sites[i].nframes; j++)
+            fprintf(fp, "%s%lx", j ? ";" : "",
+                (unsigned long) sites[i].frames[j]);
+        fprintf(fp, "\n");
+    }
+    return 0;
+}
+
+/**
+ * alloc_prof_dump - writes the latest report to allocprof-<pid>
+ */
+void alloc_prof_dump(void)
+{
+    char fname[32];
+    FILE* fp;
+
+    snprintf(fname, sizeof(fname), "allocprof-%d", getpid());
+    fp = fopen(fname, "w");
+    if (!fp) {
+        log_err("couldn't open %s for allocation profile", fname);
+        return;
+    }
+    alloc_prof_write(fp);
+    fclose(fp);
+}
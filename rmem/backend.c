@@ -5,19 +5,15 @@
 
 #include <stdatomic.h>
 #include "rmem/backend.h"
+#include "rmem/stats.h"
 
 #define BACKEND_BUF_PTR_SIZE    (BACKEND_BUF_SIZE / sizeof(uintptr_t))
 BUILD_ASSERT(BACKEND_BUF_SIZE % sizeof(uintptr_t) == 0);
 
 /* common state */
 atomic_int nchans_bkend = ATOMIC_VAR_INIT(0);
-static struct tcache *bkend_buf_tcache;
-DEFINE_PERTHREAD(struct tcache_perthread, bkend_buf_pt);
-static DEFINE_SPINLOCK(bkend_buf_lock);
-static int bkend_buf_count = 0, free_bkend_buf_count = 0;
-static void* free_bkend_bufs[MAX_BACKEND_BUFS];
-static void* backend_buf_region = NULL;
-static size_t backend_region_size = 0;
+struct numa_pool bkend_buf_pool;
+DEFINE_PERTHREAD(numa_pool_perthread_t, bkend_buf_pt);
 
 /**
  * Returns the next available channel (id) for datapath communication
@@ -38,64 +34,147 @@ int backend_get_data_channel()
 }
 
 /**
- * Tcache for allocating backend data bufs (exchanged with backend and between
- * threads)
+ * Per-channel flow control with adaptive credits. A channel may have up to 
+ * `limit` requests in flight. Every window, we compare the average latency 
+ * of completed requests against the lowest latency seen (the backend's 
+ * latency without queueing): if it is close, the backend keeps up and we 
+ * add credits; otherwise, requests are just queueing up so we shrink to the 
+ * depth that sustains the observed throughput at the base latency (Little's 
+ * law). Half the credits are reserved for reads, which matter more to the 
+ * application; writes may borrow them when there were no reads recently.
+ * Taking credits is done by the (single) poster on the channel, returning 
+ * them by whoever handles the completion.
  */
-static void bkend_buf_tcache_free(struct tcache *tc, int nr, void **items)
+struct bkend_credits {
+    /* poster state */
+    int limit;
+    unsigned long window_start_tsc;
+    unsigned long last_read_tsc;
+    unsigned long base_lat_tsc;
+
+    /* updated on completions */
+    atomic_int r_inflight;
+    atomic_int w_inflight;
+    atomic_ulong ncompleted;
+    atomic_ulong lat_sum_tsc;
+} __aligned(CACHE_LINE_SIZE);
+static struct bkend_credits credits[RMEM_MAX_CHANNELS];
+
+/* recompute the channel's credit limit from the last window */
+static void bkend_credit_adapt(struct bkend_credits* c, unsigned long now_tsc)
 {
-	/* save for reallocation */
-	int i;
-	spin_lock(&bkend_buf_lock);
-	for (i = 0; i < nr; i++) {
-		/* make sure the items returned are proper */
-		BUG_ON(free_bkend_buf_count >= MAX_BACKEND_BUFS);
-		assert(bkend_is_buf_valid(items[i]));
-		free_bkend_bufs[free_bkend_buf_count++] = items[i];
-	}
-	spin_unlock(&bkend_buf_lock);
+    unsigned long n, lat_sum, lat, window, target;
+
+    n = atomic_load_explicit(&c->ncompleted, memory_order_relaxed);
+    if (n < BKEND_CREDITS_MIN_SAMPLES)
+        return;
+    lat_sum = atomic_load_explicit(&c->lat_sum_tsc, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&c->ncompleted, n, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&c->lat_sum_tsc, lat_sum, memory_order_relaxed);
+    window = now_tsc - c->window_start_tsc;
+    c->window_start_tsc = now_tsc;
+
+    /* base latency is the lowest we have seen, aged slowly so that we can 
+     * follow changes in the backend */
+    lat = lat_sum / n;
+    if (!c->base_lat_tsc || lat < c->base_lat_tsc)
+        c->base_lat_tsc = lat;
+    else
+        c->base_lat_tsc += (lat - c->base_lat_tsc) >> 6;
+
+    if (lat * 100 <= c->base_lat_tsc * (100 + BKEND_CREDITS_LAT_SLACK)) {
+        /* no queueing; we may be under-pipelined */
+        c->limit += BKEND_CREDITS_STEP;
+    } else {
+        /* queueing; depth = throughput x base latency (plus slack) */
+        target = n * c->base_lat_tsc * (100 + BKEND_CREDITS_LAT_SLACK) / 
+            (window * 100);
+        c->limit = target < c->limit ? target : c->limit;
+    }
+    if (c->limit < BKEND_CREDITS_MIN)
+        c->limit = BKEND_CREDITS_MIN;
+    if (c->limit > MAX_REQS_PER_CHAN)
+        c->limit = MAX_REQS_PER_CHAN;
+    log_debug("backend credits now %d, latency %lu base %lu cycles", 
+        c->limit, lat, c->base_lat_tsc);
 }
 
-static int bkend_buf_tcache_alloc(struct tcache *tc, int nr, void **items)
+/**
+ * bkend_credit_take - takes a credit for posting a read or write on the 
+ * channel. Returns false if the channel is at its limit.
+ */
+bool bkend_credit_take(int chan_id, bool is_write)
+{
+    struct bkend_credits* c;
+    unsigned long now_tsc;
+    int r, w, reserve;
+
+    assert(chan_id >= 0 && chan_id < RMEM_MAX_CHANNELS);
+    c = &credits[chan_id];
+    now_tsc = rdtsc();
+    if (unlikely(!c->limit)) {
+        /* start wide open */
+        c->limit = MAX_REQS_PER_CHAN;
+        c->window_start_tsc = now_tsc;
+    }
+    if (now_tsc - c->window_start_tsc > BKEND_CREDITS_WINDOW_US * cycles_per_us)
+        bkend_credit_adapt(c, now_tsc);
+
+    r = atomic_load_explicit(&c->r_inflight, memory_order_relaxed);
+    w = atomic_load_explicit(&c->w_inflight, memory_order_relaxed);
+    if (!is_write) {
+        /* reads can always use their half, even if writes borrowed it */
+        c->last_read_tsc = now_tsc;
+        if (r + w >= c->limit && r >= c->limit / 2)
+            goto no_credit;
+        atomic_fetch_add_explicit(&c->r_inflight, 1, memory_order_relaxed);
+        return true;
+    }
+
+    /* writes leave the read half alone unless reads are idle */
+    reserve = 0;
+    if (now_tsc - c->last_read_tsc < 
+            BKEND_CREDITS_READ_IDLE_US * cycles_per_us)
+        reserve = c->limit / 2;
+    if (w + (r > reserve ? r : reserve) >= c->limit)
+        goto no_credit;
+    atomic_fetch_add_explicit(&c->w_inflight, 1, memory_order_relaxed);
+    return true;
+
+no_credit:
+    RSTAT(NET_NO_CREDITS)++;
+    return false;
+}
+
+/**
+ * bkend_credit_return - returns the credit of a completed request
+ */
+void bkend_credit_return(int chan_id, bool is_write, unsigned long posted_tsc)
 {
-	int i = 0;
-
-	spin_lock(&bkend_buf_lock);
-	while (free_bkend_buf_count && i < nr) {
-		items[i++] = free_bkend_bufs[--free_bkend_buf_count];
-	}
-
-	for (; i < nr; i++) {
-        /* allocate new */
-		log_debug("allocing new bkend buf: %d", bkend_buf_count);
-        if(bkend_buf_count >= MAX_BACKEND_BUFS){
-    		log_err_ratelimited("too many bkend_bufs, cannot allocate more");
-			goto fail;
-		}
-		items[i] = (void*)((unsigned long) backend_buf_region + 
-            bkend_buf_count * BACKEND_BUF_SIZE);
-		bkend_buf_count++;
-	}
-	spin_unlock(&bkend_buf_lock);
-	return 0;
-fail:
-	spin_unlock(&bkend_buf_lock);
-	bkend_buf_tcache_free(tc, i, items);
-	return -ENOMEM;
+    struct bkend_credits* c;
+
+    assert(chan_id >= 0 && chan_id < RMEM_MAX_CHANNELS);
+    c = &credits[chan_id];
+    atomic_fetch_sub_explicit(is_write ? &c->w_inflight : &c->r_inflight, 1, 
+        memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->ncompleted, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->lat_sum_tsc, rdtsc() - posted_tsc, 
+        memory_order_relaxed);
 }
 
-static const struct tcache_ops bkend_buf_tcache_ops = {
-	.alloc	= bkend_buf_tcache_alloc,
-	.free	= bkend_buf_tcache_free,
-};
+/**
+ * Pool for allocating backend data bufs (exchanged with backend and between
+ * threads), with a partition on each NUMA node
+ */
 
 /**
  * bkend_buf_get_backing_region - gets the backing region for the pool
  */
 void bkend_buf_get_backing_region(void** start, size_t* len)
 {
-    assert(backend_buf_region && backend_region_size);  /* check inited */
-	*start = backend_buf_region;
-    *len = backend_region_size;
+    assert(bkend_buf_pool.base && bkend_buf_pool.len);  /* check inited */
+    *start = bkend_buf_pool.base;
+    *len = bkend_buf_pool.len;
 }
 
 /**
@@ -103,12 +182,7 @@ void bkend_buf_get_backing_region(void** start, size_t* len)
  */
 bool bkend_is_buf_valid(void* buf)
 {
-	unsigned long region_end;
-    assert(backend_buf_region && backend_region_size);  /* check inited */
-	region_end = (unsigned long) backend_buf_region + backend_region_size;
-	return buf >= backend_buf_region 
-		&& buf < (void*) region_end 
-		&& (unsigned long) (buf - backend_buf_region) % BACKEND_BUF_SIZE == 0;
+    return numa_pool_is_valid(&bkend_buf_pool, buf);
 }
 
 /**
@@ -117,7 +191,7 @@ bool bkend_is_buf_valid(void* buf)
  */
 void bkend_buf_tcache_init_thread(void)
 {
-	tcache_init_perthread(bkend_buf_tcache, &perthread_get(bkend_buf_pt));
+    numa_pool_init_thread(&bkend_buf_pool, &perthread_get(bkend_buf_pt));
 }
 
 /**
@@ -126,34 +200,17 @@ void bkend_buf_tcache_init_thread(void)
  */
 int bkend_buf_tcache_init(void)
 {
-	int pgsize;
-
-    /* create backing region */
-    backend_region_size = MAX_BACKEND_BUFS * BACKEND_BUF_SIZE;
-	BUILD_ASSERT(is_power_of_two(BACKEND_BUF_SIZE));
+    int pgsize;
+    BUILD_ASSERT(is_power_of_two(BACKEND_BUF_SIZE));
 
-	/* determine page size */
+    /* determine page size */
     pgsize = PGSIZE_2MB;
 #ifdef RMEM_STANDALONE
     /* avoid huge-page dependency when running without Shenango */
     pgsize = PGSIZE_4KB;
 #endif
 
-	backend_buf_region = 
-		mem_map_anom(NULL, backend_region_size, pgsize, NUMA_NODE);
-	if (backend_buf_region == MAP_FAILED) {
-        log_err("out of huge pages for backend_buf_region");
-        return -ENOMEM;
-	}
-	BUG_ON((unsigned long) backend_buf_region % pgsize != 0);
-
-    /* create pool */
-	bkend_buf_tcache = tcache_create("bkend_bufs_tcache", &bkend_buf_tcache_ops, 
-		BACKEND_BUF_MAG_SIZE, BACKEND_BUF_SIZE);
-	if (!bkend_buf_tcache)
-		return -ENOMEM;
-
-	log_info("inited backend buffer pool - start %p, size %lu",
-		backend_buf_region, backend_region_size);
-	return 0;
+    /* create pool with huge pages on each NUMA node */
+    return numa_pool_create(&bkend_buf_pool, "bkend_bufs", BACKEND_BUF_SIZE,
+        MAX_BACKEND_BUFS, BACKEND_BUF_MAG_SIZE, pgsize);
 }
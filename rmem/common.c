@@ -12,8 +12,14 @@
 #include "rmem/common.h"
 #include "rmem/config.h"
 #include "rmem/fault.h"
+#include "rmem/fault_hist.h"
+#include "rmem/fault_trace.h"
 #include "rmem/fsampler.h"
 #include "rmem/handler.h"
+#include "rmem/hint_prof.h"
+#include "rmem/hedge.h"
+#include "rmem/hotset.h"
+#include "rmem/numa_pool.h"
 #include "rmem/pgnode.h"
 #include "rmem/region.h"
 #include "rmem/uffd.h"
@@ -27,6 +33,12 @@ uint64_t local_memory = LOCAL_MEMORY_SIZE;
 double eviction_threshold = EVICTION_THRESHOLD;
 int evict_batch_size = 1;
 int fsampler_samples_per_sec = -1;  /* dump every record by default */
+unsigned long rmem_grow_slabs = 0;  /* no region growth by default */
+int rmem_hedge_pct = 0;              /* no hedged reads by default */
+unsigned long rmem_trace_records = 0;   /* no fault tracing by default */
+uint64_t rmem_hot_memory = 0;       /* RMEM_HOT_MEMORY_FRAC by default */
+char alloc_class_sites_path[PATH_MAX] = "";  /* no site policy by default */
+char hotset_path[PATH_MAX] = "";    /* no hot set saved by default */
 
 /* common global state for remote memory */
 struct rmem_backend_ops* rmbackend = NULL;
@@ -66,11 +78,15 @@ int rmem_common_init(
     log_info("rmem_init with: ");
     log_info("local memory - %lu B", local_memory);
     log_info("(initial) backing memory - %lu B", nslabs * RMEM_SLAB_SIZE);
+    log_info("backing memory growth - %lu B", rmem_grow_slabs * RMEM_SLAB_SIZE);
     log_info("evict thr %.2lf, batch %d", eviction_threshold, evict_batch_size);
     BUG_ON(!rmem_enabled);
 
     /* init global data structures */
     CIRCLEQ_INIT(&region_list);
+    ret = region_reserve_va();
+    BUG_ON(ret);
+    rmem_numa_init();
 
     /* init userfaultfd */
     userfault_fd = uffd_init();
@@ -98,6 +114,14 @@ int rmem_common_init(
     ret = rmbackend->add_memory(NULL, nslabs);
     assert(ret > 0);
 
+    /* channel for hedged reads, if enabled */
+    ret = hedge_init();
+    assertz(ret);
+
+    /* fault trace rings, if enabled */
+    ret = fault_trace_init();
+    assertz(ret);
+
     /* assign tcaches for faults */
     ret = fault_tcache_init();
     assertz(ret);
@@ -109,6 +133,12 @@ int rmem_common_init(
     /* init lru lists and other eviction state */
     eviction_init();
 
+    /* hot pages saved by the last run, if any */
+    ret = hotset_init();
+    if (ret)
+        log_warn("couldn't read the saved hot set (%d), continuing without "
+            "it", ret);
+
 #ifdef FAULT_SAMPLER
     /* init fault samplers */
     fsampler_init(fsampler_samples_per_sec);
@@ -131,6 +161,8 @@ int rmem_common_init(
             coreid--;
     }
 
+    /* let the handlers bring the hot pages in before the application */
+    hotset_replay_wait();
     return 0;
 }
 
@@ -150,11 +182,17 @@ int rmem_common_init_thread(int* new_chan_id, uint64_t* stats_ptr,
     /* save kthread id. 0 means current thread is not a shenango kthread */
     current_kthread_id = kthr_id;
 
-    /* init per-thread data */
+    /* init per-thread data (from the thread's local numa node) */
+    rmem_numa_init_thread();
     fault_tcache_init_thread();
     bkend_buf_tcache_init_thread();
     rmpage_node_tcache_init_thread();
     zero_page_init_thread();
+    fault_hist_init_thread();
+    fault_trace_init_thread();
+#ifdef HINT_PROFILER
+    hint_prof_init_thread();
+#endif
     eviction_init_thread();
 
     /* get a dedicated backend channel */
@@ -189,6 +227,10 @@ int rmem_common_destroy()
     }
     free(handlers);
 
+    /* save the pages that are still local for the next run */
+    hotset_save();
+    hotset_destroy();
+
     /* eviction free */
     eviction_exit();
 
@@ -198,6 +240,9 @@ int rmem_common_destroy()
     /* destroy fault tcache pool */
     fault_tcache_destroy();
 
+    /* unmap fault trace rings */
+    fault_trace_destroy();
+
 #ifdef FAULT_SAMPLER
     /* free fault sampler resources */
     fsampler_destroy();
@@ -208,6 +253,7 @@ int rmem_common_destroy()
         mr = CIRCLEQ_FIRST(&region_list);
         remove_memory_region(mr);
     }
+    region_release_va();
 
     /* destroy backend */
     if (rmbackend != NULL) {
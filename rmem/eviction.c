@@ -14,6 +14,7 @@
 #include "base/sampler.h"
 #include "base/qestimator.h"
 
+#include "rmem/alloc_prof.h"
 #include "rmem/backend.h"
 #include "rmem/common.h"
 #include "rmem/config.h"
@@ -32,11 +33,14 @@ __thread struct iovec madv_iov[EVICTION_MAX_BATCH_SIZE];
 __thread struct page_list tmp_evict_gens[EVICTION_MAX_GENS];
 __thread struct iovec mprotect_iov[EVICTION_MAX_BATCH_SIZE];
 __thread struct region_t* mprotect_mr[EVICTION_MAX_BATCH_SIZE];
+__thread struct bkend_write_range wb_ranges[EVICTION_MAX_BATCH_SIZE];
 int madv_pidfd = -1;
 
 /* lru state */
 struct page_list evict_gens[EVICTION_MAX_GENS];
 struct page_list_per_prio dne_pages;
+struct page_list pinned_pages;
+struct page_list stream_pages;
 int evict_ngens = 1;
 int evict_gen_mask = 0;
 int evict_nprio = 1;
@@ -154,20 +158,23 @@ static __always_inline void update_evict_epoch_now(void)
 static __always_inline int get_page_next_gen_lru(struct rmpage_node* page)
 {
     long int next_gen_id, slope;
-    unsigned long pgepoch, pgepoch_gap;
+    uint32_t pgepoch;
+    unsigned long pgepoch_gap;
     unsigned long pgepoch_quantile;
+    pgidx_t pgidx;
 
     /* check and sort pages */
     assert(evict_gen_mask);
 
-    /* get page's epoch; may get updated concurrently so just read it once */
-    pgepoch = ACCESS_ONCE(page->epoch);
-    assert(pgepoch == 0 || pgepoch <= evict_epoch_now);
-    pgepoch_gap = evict_epoch_now - pgepoch;
+    /* get page's epoch; may get updated concurrently so just read it once. 
+     * epochs are saved in 32 bits so only the gap is meaningful */
+    pgidx = rmpage_get_node_id(page);
+    pgepoch = rmpage_get_epoch(pgidx);
+    pgepoch_gap = (uint32_t) ((uint32_t) evict_epoch_now - pgepoch);
 
     /* reset the page's access epoch. we're either gonna evict it or 
      * bump it to higher list, either of which require resetting it */
-    page->epoch = 0;
+    rmpage_clear_epoch(pgidx);
 
     next_gen_id = 0;
     if (pgepoch)
@@ -198,8 +205,8 @@ static __always_inline int get_page_next_gen_lru(struct rmpage_node* page)
     return 0;
 #endif
 
-    log_debug("page %lx had epoch %lu, epoch now: %lu, next gen: %ld", 
-        page->addr, pgepoch, evict_epoch_now, next_gen_id);
+    log_debug("page %lx had epoch %u, epoch now: %lu, next gen: %ld", 
+        rmpage_node_addr(page), pgepoch, evict_epoch_now, next_gen_id);
     return next_gen_id;
 }
 
@@ -207,21 +214,23 @@ static __always_inline int get_page_next_gen_lru(struct rmpage_node* page)
 static int __always_inline get_page_next_gen_sc(struct rmpage_node* page)
 {
     pgflags_t flags;
+    struct region_t* mr = rmpage_node_mr(page);
+    unsigned long addr = rmpage_node_addr(page);
 
     /* check page accessed bit */
-    flags = get_page_flags(page->mr, page->addr);
+    flags = get_page_flags(mr, addr);
     if (!!(flags & PFLAG_ACCESSED)) {
         /* reset the access bit. we're either gonna evict it or bump it
          * to higher list, either of which require resetting it */
-        clear_page_flags(page->mr, page->addr, PFLAG_ACCESSED, NULL);
+        clear_page_flags(mr, addr, PFLAG_ACCESSED, NULL);
 
         /* bump it to the next list 
          * (we only maintain two lists in second-chance eviction) */
-        log_debug("page %lx had accessed bit set, bumping up", page->addr);
+        log_debug("page %lx had accessed bit set, bumping up", addr);
         return 1;
     }
 
-    log_debug("page %lx had accessed bit clear, evicting", page->addr);
+    log_debug("page %lx had accessed bit clear, evicting", addr);
     return 0;
 }
 
@@ -242,9 +251,33 @@ static int __always_inline get_page_next_gen(struct rmpage_node* page)
     return 0;
 }
 
+/* prefetch what the next pop from the list (and the destiny check after it)
+ * will touch: the node after the head, which gets unlinked then, and the
+ * head page's epoch or metadata */
+static __always_inline void prefetch_next_pages(struct rmpage_list* list)
+{
+    rmpage_node_t* head = rmpage_list_top(list);
+#ifdef SC_EVICTION
+    atomic_pginfo_t* ptr;
+#endif
+
+    if (!head)
+        return;
+    if (head->next != RMPAGE_NODE_NONE)
+        prefetch(&rmpage_nodes[head->next]);
+#ifdef LRU_EVICTION
+    prefetch(&rmpage_epochs[list->head]);
+#endif
+#ifdef SC_EVICTION
+    ptr = __page_ptr(rmpage_node_mr(head), rmpage_node_addr(head));
+    if (ptr)
+        prefetch(ptr);
+#endif
+}
+
 /* drain some of the pages reserved for bumping to higher lists into the 
  * the eviction lists (because we ran out of pages in the original lists) */
-int drain_tmp_lists(struct list_head* evict_list, int max_drain,
+int drain_tmp_lists(struct rmpage_list* evict_list, int max_drain,
     bitmap_ptr tmplist_nonzero)
 {
     int npages, gen_id, prio;
@@ -253,7 +286,7 @@ int drain_tmp_lists(struct list_head* evict_list, int max_drain,
     assert(evict_ngens > 0);
     /* we don't use tmplist 0 */
     for (prio = 0; prio < evict_nprio; prio++)
-        assert(list_empty(&tmp_evict_gens[0].pages[prio]));
+        assert(rmpage_list_empty(&tmp_evict_gens[0].pages[prio]));
 
     /* drain from the bottom gen, lowest priority */
     log_debug("draining tmp lists");
@@ -269,8 +302,9 @@ int drain_tmp_lists(struct list_head* evict_list, int max_drain,
         if (tmp_evict_gens[gen_id].npages <= (max_drain - npages)) {
             /* move all pages in one go */
             for (prio = evict_nprio - 1; prio >= 0; prio--) {
-                list_append_list(evict_list, &tmp_evict_gens[gen_id].pages[prio]);
-                assert(list_empty(&tmp_evict_gens[gen_id].pages[prio]));
+                rmpage_list_append_list(evict_list, 
+                    &tmp_evict_gens[gen_id].pages[prio]);
+                assert(rmpage_list_empty(&tmp_evict_gens[gen_id].pages[prio]));
             }
             npages += tmp_evict_gens[gen_id].npages;
             tmp_evict_gens[gen_id].npages = 0;
@@ -280,11 +314,10 @@ int drain_tmp_lists(struct list_head* evict_list, int max_drain,
             /* move as many as needed one-by-one */
             for (prio = evict_nprio - 1; prio && npages < max_drain; prio--) {
                 while(npages < max_drain) {
-                    page = list_pop(&tmp_evict_gens[gen_id].pages[prio], 
-                        rmpage_node_t, link);
+                    page = rmpage_list_pop(&tmp_evict_gens[gen_id].pages[prio]);
                     if (!page)
                         break;
-                    list_add_tail(evict_list, &page->link);
+                    rmpage_list_add_tail(evict_list, page);
                     npages++;
                     assert(tmp_evict_gens[gen_id].npages > 0);
                     tmp_evict_gens[gen_id].npages--;
@@ -298,7 +331,7 @@ int drain_tmp_lists(struct list_head* evict_list, int max_drain,
 
 /* finds eviction candidates - returns the number of candidates found and 
  * sends out the list of page nodes */
-static inline int find_candidate_pages(struct list_head* evict_list,
+static inline int find_candidate_pages(struct rmpage_list* evict_list,
     int batch_size)
 {
     int npages, npopped, prio, prio_quota_left;
@@ -347,7 +380,7 @@ static inline int find_candidate_pages(struct list_head* evict_list,
                 break;
 
             /* try popping a page from current prio */
-            page = list_pop(&evict_gen->pages[prio], rmpage_node_t, link);
+            page = rmpage_list_pop(&evict_gen->pages[prio]);
             if (unlikely(page == NULL)) {
                 /* if out of prio, move to next gen */
                 if (unlikely(prio == 0))
@@ -355,10 +388,11 @@ static inline int find_candidate_pages(struct list_head* evict_list,
                 prio--;
                 continue;
             }
+            prefetch_next_pages(&evict_gen->pages[prio]);
 
             /* popped a page */
             log_debug("popped page %lx from gen %d prio %d", 
-                page->addr, gen_id, prio);
+                rmpage_node_addr(page), gen_id, prio);
             assert(evict_gen->npages > 0);
             evict_gen->npages--;
             npopped++;
@@ -373,7 +407,7 @@ static inline int find_candidate_pages(struct list_head* evict_list,
                 page->evict_prio = prio;
 
                 /* add it to evict list */
-                list_add_tail(evict_list, &page->link);
+                rmpage_list_add_tail(evict_list, page);
                 npages++;
             }
             else {
@@ -382,8 +416,8 @@ static inline int find_candidate_pages(struct list_head* evict_list,
                 assert(bitmap_test(tmplist_used, pg_next_gen)
                     || tmp_evict_gens[pg_next_gen].npages == 0);
 
-                list_add_tail(&tmp_evict_gens[pg_next_gen].pages[prio],
-                    &page->link);
+                rmpage_list_add_tail(&tmp_evict_gens[pg_next_gen].pages[prio],
+                    page);
                 tmp_evict_gens[pg_next_gen].npages++;
                 bitmap_set(tmplist_used, pg_next_gen);
             }
@@ -411,7 +445,7 @@ static inline int find_candidate_pages(struct list_head* evict_list,
             goto found_enough;
 
         /* not enough candidates in this list, move to next list */
-        assert(list_empty(&evict_gen->pages[0]) && !evict_gen->npages);
+        assert(rmpage_list_empty(&evict_gen->pages[0]) && !evict_gen->npages);
         evict_gen_now = (gen_id + 1) % evict_ngens;
         evict_prio_now = evict_nprio - 1;
         evict_prio_quota_left = get_evict_prio_quota(prio);
@@ -479,7 +513,7 @@ found_enough:
         evict_gen = &evict_gens[(evict_gen_now + gen_id) & evict_gen_mask];
         spin_lock(&evict_gen->lock);
         for (prio = 0; prio < evict_nprio; prio++)
-            list_append_list(&evict_gen->pages[prio], 
+            rmpage_list_append_list(&evict_gen->pages[prio], 
                 &tmp_evict_gens[gen_id].pages[prio]);
         evict_gen->npages += tmp_evict_gens[gen_id].npages;
         spin_unlock(&evict_gen->lock);
@@ -490,7 +524,7 @@ found_enough:
     /* check that we didn't leak any pages */
     bitmap_for_each_cleared(tmplist_used, evict_ngens, gen_id) {
         for (prio = 0; prio < evict_nprio; prio++)
-            assert(list_empty(&tmp_evict_gens[gen_id].pages[prio]));
+            assert(rmpage_list_empty(&tmp_evict_gens[gen_id].pages[prio]));
         assert(tmp_evict_gens[gen_id].npages == 0);
     }
 #endif
@@ -503,16 +537,17 @@ found_enough:
      * aside to add them back to the evict lists - we reuse tmp_evict_gens[0] 
      * as the temporary holding buffer */
     assert(tmp_evict_gens[0].npages == 0);
-    list_for_each_safe(evict_list, page, next, link)
+    rmpage_list_for_each_safe(evict_list, page, next)
     {
-        flags = set_page_flags(page->mr, page->addr,
+        flags = set_page_flags(rmpage_node_mr(page), rmpage_node_addr(page),
             PFLAG_WORK_ONGOING, &oldflags);
         if (unlikely(!!(oldflags & PFLAG_WORK_ONGOING))) {
             /* page was locked by someone (presumbly for write-protect fault 
              * handling), add it the locked list so we can put it back */
-            list_del_from(evict_list, &page->link);
+            rmpage_list_del(evict_list, page);
             assert(page->evict_prio >= 0 && page->evict_prio < evict_nprio);
-            list_add_tail(&tmp_evict_gens[0].pages[page->evict_prio], &page->link);
+            rmpage_list_add_tail(&tmp_evict_gens[0].pages[page->evict_prio], 
+                page);
             tmp_evict_gens[0].npages++;
             page->evict_prio = 0;   /* reset prio */
             npages--;
@@ -522,8 +557,10 @@ found_enough:
             assert(!!(flags & PFLAG_PRESENT));
             assert(!!(flags & PFLAG_REGISTERED));
             assert(!(flags & PFLAG_EVICT_ONGOING));
-            assert(is_in_memory_region_unsafe(page->mr, page->addr));
-            assertz(get_page_thread(page->mr, page->addr));
+            assert(is_in_memory_region_unsafe(rmpage_node_mr(page), 
+                rmpage_node_addr(page)));
+            assertz(get_page_thread(rmpage_node_mr(page), 
+                rmpage_node_addr(page)));
         }
     }
 
@@ -535,9 +572,9 @@ found_enough:
         evict_gen = &evict_gens[gen_id];
         spin_lock(&evict_gen->lock);
         for (prio = 0; prio < evict_nprio; prio++) {
-            list_append_list(&evict_gen->pages[prio], 
+            rmpage_list_append_list(&evict_gen->pages[prio], 
                 &tmp_evict_gens[0].pages[prio]);
-            assert(list_empty(&tmp_evict_gens[0].pages[prio]));
+            assert(rmpage_list_empty(&tmp_evict_gens[0].pages[prio]));
         }
         evict_gen->npages += tmp_evict_gens[0].npages;
         spin_unlock(&evict_gen->lock);
@@ -548,12 +585,13 @@ found_enough:
 }
 
 /* remove pages from virtual memory using madvise */
-static inline int remove_pages(struct list_head* pglist, int npages,
+static inline int remove_pages(struct rmpage_list* pglist, int npages,
     bool wrprotected) 
 {
     int r, i;
     ssize_t ret;
     struct rmpage_node *page;
+    unsigned long addr;
     bool vectored_madv = false;
 
 #ifdef REGISTER_MADVISE_REMOVE
@@ -575,18 +613,19 @@ static inline int remove_pages(struct list_head* pglist, int npages,
 
     i = 0;
     log_debug("removing %d pages (vectored: %d)", npages, vectored_madv);
-    list_for_each(pglist, page, link)
+    rmpage_list_for_each(pglist, page)
     {
+        addr = rmpage_node_addr(page);
         if (vectored_madv) {
             /* prepare the io vector */
-            log_debug("adding page %p to iovec", (void*) page->addr);
-            madv_iov[i].iov_base = (void*) page->addr;
+            log_debug("adding page %p to iovec", (void*) addr);
+            madv_iov[i].iov_base = (void*) addr;
             madv_iov[i].iov_len = CHUNK_SIZE;
         }
         else {
             /* or issue madvise once per page */
-            log_debug("madvise dont_need on page %p", (void*) page->addr);
-            r = madvise((void*)page->addr, CHUNK_SIZE, MADV_DONTNEED);
+            log_debug("madvise dont_need on page %p", (void*) addr);
+            r = madvise((void*) addr, CHUNK_SIZE, MADV_DONTNEED);
             if (r != 0) {
                 log_err("madvise for chunk %d failed: %s", i, strerror(errno));
                 BUG();
@@ -626,35 +665,38 @@ static inline bool needs_write_back(pgflags_t flags)
     return true;
 }
 
-/* write-back a region to the backend */
-static unsigned int write_region_to_backend(int chan_id, struct region_t *mr, 
-    unsigned long addr, size_t size, struct bkend_completion_cbs* cbs) 
+/* write-back page ranges to the backend, posting them together */
+static unsigned int write_ranges_to_backend(int chan_id, 
+    struct bkend_write_range* ranges, int nranges, 
+    struct bkend_completion_cbs* cbs) 
 {
-    int r;
-    int ncompletions, nwrites_done;
+    int r, nposted;
+    int ncompletions;
     uint64_t start_tsc, duration;
-    log_debug("writing back contiguous region at [%lx, %lu)", addr, size);
+    log_debug("writing back %d contiguous ranges", nranges);
 
-    /* post the write-back */
+    /* post the write-backs */
     start_tsc = 0;
     ncompletions = 0;
-    nwrites_done = -1;
-    do {
-        r = rmbackend->post_write(chan_id, mr, addr, size);
-        if (r == EAGAIN) {
+    nposted = 0;
+    while (nposted < nranges) {
+        r = rmbackend->post_write_batch(chan_id, &ranges[nposted], 
+            nranges - nposted);
+        assert(r >= 0 && r <= nranges - nposted);
+        nposted += r;
+        if (nposted < nranges) {
             /* start the timer the first time we are here */
             if (!start_tsc)
                 start_tsc = rdtsc();
 
-            /* write queue is full, nothing to do but repeat and keep 
-             * checking for completions to free request slots; raising error
-             * if we handled some write completions but still cannot post */
-            assert(nwrites_done != 0);
+            /* write queue is full (or out of credits), nothing to do but 
+             * repeat and keep checking for completions to free request 
+             * slots; writes may also be waiting on reads to return credits 
+             * so no write completions is not an error */
             ncompletions += rmbackend->check_for_completions(chan_id, cbs, 
-                RMEM_MAX_COMP_PER_OP, NULL, &nwrites_done);
+                RMEM_MAX_COMP_PER_OP, NULL, NULL);
         }
-    } while(r == EAGAIN);
-    assertz(r);
+    }
 
     /* save wait time if any */
     if (start_tsc) {
@@ -668,11 +710,12 @@ static unsigned int write_region_to_backend(int chan_id, struct region_t *mr,
 /* flush pages (with write-back if necessary). 
  * Returns whether any of the pages were written to backend and should be 
  * monitored for completions */
-static bool flush_pages(int chan_id, struct list_head* pglist, int npages,
+static bool flush_pages(int chan_id, struct rmpage_list* pglist, int npages,
     pgflags_t* pflags, bitmap_ptr write_map, struct bkend_completion_cbs* cbs)
 {
-    int i, r, niov;
+    int i, r, niov, nranges;
     int nretries;
+    unsigned long addr;
     struct rmpage_node *page;
     bool vectored_mprotect = false;
     size_t wpbytes;
@@ -689,7 +732,7 @@ static bool flush_pages(int chan_id, struct list_head* pglist, int npages,
     i = 0;
     niov = 0;
     bitmap_init(write_map, npages, false);
-    list_for_each(pglist, page, link)
+    rmpage_list_for_each(pglist, page)
     {
         /* check dirty */
         if (!needs_write_back(pflags[i])) {
@@ -698,8 +741,8 @@ static bool flush_pages(int chan_id, struct list_head* pglist, int npages,
         }
 
         /* prepare the io vector */
-        mprotect_mr[niov] = page->mr;
-        mprotect_iov[niov].iov_base = (void*) page->addr;
+        mprotect_mr[niov] = rmpage_node_mr(page);
+        mprotect_iov[niov].iov_base = (void*) rmpage_node_addr(page);
         mprotect_iov[niov].iov_len = CHUNK_SIZE;
         niov++;
         assert(niov <= EVICTION_MAX_BATCH_SIZE);
@@ -723,6 +766,7 @@ static bool flush_pages(int chan_id, struct list_head* pglist, int npages,
         }
        
         /* for each page */
+        nranges = 0;
         for (i = 0; i < niov; i++) {
             if (!vectored_mprotect && uffd_is_wp_supported(userfault_fd)) {
                 /* batch mprotect is not available, mprotect individually */
@@ -734,13 +778,25 @@ static bool flush_pages(int chan_id, struct list_head* pglist, int npages,
                 RSTAT(EVICT_WP_RETRIES) += nretries;
             }
 
-            /* write-back. TODO: there is an optimization here we can do 
-             * using backend scatter-gather op to write all at once */
-            write_region_to_backend(chan_id, mprotect_mr[i], 
-                (unsigned long) mprotect_iov[i].iov_base, 
-                mprotect_iov[i].iov_len, cbs);
+            /* add to the write-back, merging with the previous range if 
+             * contiguous (it fits in one backend buf as the eviction batch 
+             * is no bigger than RMEM_MAX_CHUNKS_PER_OP) */
+            addr = (unsigned long) mprotect_iov[i].iov_base;
+            if (nranges > 0 && wb_ranges[nranges - 1].mr == mprotect_mr[i] &&
+                    wb_ranges[nranges - 1].addr + 
+                        wb_ranges[nranges - 1].size == addr) {
+                wb_ranges[nranges - 1].size += mprotect_iov[i].iov_len;
+            } else {
+                wb_ranges[nranges].mr = mprotect_mr[i];
+                wb_ranges[nranges].addr = addr;
+                wb_ranges[nranges].size = mprotect_iov[i].iov_len;
+                nranges++;
+            }
             RSTAT(EVICT_WBACK)++;
         }
+
+        /* write-back */
+        write_ranges_to_backend(chan_id, wb_ranges, nranges, cbs);
     }
 
     /* remove pages from UFFD */
@@ -776,6 +832,10 @@ static inline void evict_page_done(struct region_t* mr, unsigned long pgaddr,
         clear_page_flags_and_thread(mr, pgaddr, 
             clrbits | PFLAG_WORK_ONGOING, &oldflags, &owner_kthr);
         assert(!!(oldflags & PFLAG_PRESENT));
+#ifdef ALLOC_PROFILER
+        alloc_prof_count(mr, pgaddr, APROF_RESIDENT, -1);
+        alloc_prof_count(mr, pgaddr, APROF_EVICTIONS, 1);
+#endif
         goto evict_done;
     }
     else {
@@ -789,6 +849,12 @@ static inline void evict_page_done(struct region_t* mr, unsigned long pgaddr,
          * and determine who went later than the other using the 
          * PFLAG_EVICT_ONGOING flag and clear the lock then */
         clear_page_flags(mr, pgaddr, clrbits, &oldflags);
+#ifdef ALLOC_PROFILER
+        if (!!(oldflags & PFLAG_PRESENT)) {
+            alloc_prof_count(mr, pgaddr, APROF_RESIDENT, -1);
+            alloc_prof_count(mr, pgaddr, APROF_EVICTIONS, 1);
+        }
+#endif
         if (!!(oldflags & PFLAG_EVICT_ONGOING)) {
             /* first to get here, do not release */
             assert(!!(oldflags & PFLAG_PRESENT));
@@ -868,8 +934,8 @@ int do_eviction(int chan_id, struct bkend_completion_cbs* cbs,
     pgflags_t flags[batch_size];
     DEFINE_BITMAP(write_map, batch_size);
     unsigned long long pressure;
-    struct rmpage_node *page;
-    struct list_head evict_list;
+    struct rmpage_node *page, *next;
+    struct rmpage_list evict_list;
     bool discarded;
     struct region_t* mr;
     unsigned long addr;
@@ -879,7 +945,7 @@ int do_eviction(int chan_id, struct bkend_completion_cbs* cbs,
 
     /* get eviction candidates */
     npages = 0;
-    list_head_init(&evict_list);
+    rmpage_list_init(&evict_list);
     assert(batch_size > 0 && batch_size <= EVICTION_MAX_BATCH_SIZE);
     do {
         /* TODO: error out if we are stuck here */
@@ -890,18 +956,19 @@ int do_eviction(int chan_id, struct bkend_completion_cbs* cbs,
     } while(!npages);
 
     /* found page(s) */
-    assert(list_empty(&evict_list) || (npages > 0));
+    assert(rmpage_list_empty(&evict_list) || (npages > 0));
 
     /* flag them as evicting */
     assert(npages <= EVICTION_MAX_BATCH_SIZE);
     i = 0;
-    list_for_each(&evict_list, page, link) {
-        flags[i] = set_page_flags_and_thread(page->mr, page->addr, 
+    rmpage_list_for_each(&evict_list, page) {
+        mr = rmpage_node_mr(page);
+        addr = rmpage_node_addr(page);
+        flags[i] = set_page_flags_and_thread(mr, addr, 
             PFLAG_EVICT_ONGOING, current_kthread_id, &oldflags, &oldthread);
         assert(!(oldflags & PFLAG_EVICT_ONGOING));
         assertz(oldthread);
-        log_debug("evicting page %lx from mr start %lx", 
-            page->addr, page->mr->addr);
+        log_debug("evicting page %lx from mr start %lx", addr, mr->addr);
         i++;
     }
     assert(i == npages);
@@ -922,15 +989,15 @@ int do_eviction(int chan_id, struct bkend_completion_cbs* cbs,
     {
         /* work for each removed page */
         i = 0;
-        list_for_each(&evict_list, page, link)
+        rmpage_list_for_each_safe(&evict_list, page, next)
         {
             /* clear the page index and release the page node */
-            mr = page->mr;
-            addr = page->addr;
-            pgidx = clear_page_index(page->mr, page->addr);
+            mr = rmpage_node_mr(page);
+            addr = rmpage_node_addr(page);
+            pgidx = clear_page_index(mr, addr);
             assert(pgidx == rmpage_get_node_id(page));
             rmpage_node_free(page); /* don't use page after this point */
-            log_debug("cleared index bits and page node for %lx", page->addr);
+            log_debug("cleared index bits and page node for %lx", addr);
 
             /* eviction done */
             discarded = !bitmap_test(write_map, i);
@@ -993,18 +1060,32 @@ int eviction_init(void)
     evict_gen_mask = evict_ngens - 1;
     for(i = 0; i < evict_ngens; i++) {
         for (j = 0; j < evict_nprio; j++)
-            list_head_init(&evict_gens[i].pages[j]);
+            rmpage_list_init(&evict_gens[i].pages[j]);
         evict_gens[i].npages = 0;
         spin_lock_init(&evict_gens[i].lock);
     }
     log_info("inited %s eviction with %d gens. gen mask: %x", 
         policy, evict_ngens, evict_gen_mask);
 
+    /* init pinned list for the hot memory class */
+    if (!rmem_hot_memory)
+        rmem_hot_memory = local_memory * RMEM_HOT_MEMORY_FRAC;
+    BUG_ON(rmem_hot_memory > local_memory);
+    rmpage_list_init(&pinned_pages.pages[0]);
+    pinned_pages.npages = 0;
+    spin_lock_init(&pinned_pages.lock);
+    log_info("hot memory class pins up to %lu MB", rmem_hot_memory >> 20);
+
+    /* init list for the stream memory class */
+    rmpage_list_init(&stream_pages.pages[0]);
+    stream_pages.npages = 0;
+    spin_lock_init(&stream_pages.lock);
+
 #ifdef EVICTION_DNE_ON
     /* init do-not-evict list */
     log_info("do-not-evict size per prio: %d MB", RMEM_DNE_SIZE_MB);
     for (j = 0; j < evict_nprio; j++) {
-        list_head_init(&dne_pages.pages[j]);
+        rmpage_list_init(&dne_pages.pages[j]);
         dne_pages.npages[j] = 0;
         spin_lock_init(&dne_pages.locks[j]);
     }
@@ -1067,7 +1148,7 @@ int eviction_init_thread(void)
 
     for(i = 0; i < evict_ngens; i++) {
         for (j = 0; j < evict_nprio; j++)
-            list_head_init(&tmp_evict_gens[i].pages[j]);
+            rmpage_list_init(&tmp_evict_gens[i].pages[j]);
         tmp_evict_gens[i].npages = 0;
         spin_lock_init(&tmp_evict_gens[i].lock);
     }
@@ -11,9 +11,13 @@
 #include <unistd.h>
 
 #include "base/list.h"
+#include "rmem/alloc_prof.h"
 #include "rmem/backend.h"
 #include "rmem/common.h"
 #include "rmem/fault.h"
+#include "rmem/fault_hist.h"
+#include "rmem/fault_trace.h"
+#include "rmem/hedge.h"
 #include "rmem/page.h"
 #include "rmem/pgnode.h"
 #include "rmem/stats.h"
@@ -26,6 +30,20 @@ __thread char fstr[__FAULT_STR_LEN];
 __thread unsigned int n_wait_q;
 __thread struct list_head fault_wait_q;
 
+/* per-thread state of the last stream (see stream_rdahead()) */
+static __thread struct {
+    unsigned long next;     /* page after the last fault */
+    int rdahead;
+} last_stream;
+
+/* per-thread batch of reads waiting to be posted together */
+static __thread struct {
+    bool enabled;
+    int n;
+    fault_t* faults[RMEM_MAX_POST_BATCH];
+    bool hedged[RMEM_MAX_POST_BATCH];
+} read_batch;
+
 /**
  * Per-thread zero page support
  */
@@ -114,70 +132,182 @@ int __always_inline get_highest_evict_gen(void)
     return 0;
 }
 
-/* after the faulting page (and read-ahead) has been uffd-copied into the 
- * address space, we must allocate new page nodes to track them and add the 
- * nodes to the eviction lists */
-static inline void fault_alloc_page_nodes(fault_t* f)
+/* reserves room for pages of the hot memory class on the pinned list, 
+ * returns false if that would go over rmem_hot_memory */
+static inline bool fault_reserve_pinned(int npages)
+{
+    bool reserved = false;
+
+    spin_lock(&pinned_pages.lock);
+    if ((pinned_pages.npages + npages) * CHUNK_SIZE <= rmem_hot_memory) {
+        pinned_pages.npages += npages;
+        reserved = true;
+    }
+    spin_unlock(&pinned_pages.lock);
+    return reserved;
+}
+
+/* adds page nodes of the stream memory class to the end of the stream list 
+ * and moves the oldest ones beyond RMEM_STREAM_MAX_PAGES, which the scan has
+ * moved past, to the front of the eviction lists so they go next */
+static inline void stream_add_pages(struct rmpage_list* new, int npages)
 {
-    int i, prio;
     struct rmpage_node* pgnode;
-    struct list_head new;
+    struct rmpage_list behind;
+    struct page_list* evict_gen;
+    int n, prio;
+
+    prio = evict_nprio - 1;
+    rmpage_list_init(&behind);
+    spin_lock(&stream_pages.lock);
+    rmpage_list_append_list(&stream_pages.pages[0], new);
+    stream_pages.npages += npages;
+    for (n = 0; stream_pages.npages > RMEM_STREAM_MAX_PAGES; n++) {
+        pgnode = rmpage_list_pop(&stream_pages.pages[0]);
+        assert(pgnode);
+        stream_pages.npages--;
+
+        /* accesses before the scan got past the page don't count */
+        clear_page_flags(rmpage_node_mr(pgnode), rmpage_node_addr(pgnode), 
+            PFLAG_ACCESSED, NULL);
+        rmpage_clear_epoch(rmpage_get_node_id(pgnode));
+        pgnode->evict_prio = prio;
+        rmpage_list_add_tail(&behind, pgnode);
+    }
+
+    /* move them with the stream list still locked, so that they are always 
+     * on some list for rmunmap() */
+    if (n > 0) {
+        evict_gen = &evict_gens[ACCESS_ONCE(evict_gen_now)];
+        spin_lock(&evict_gen->lock);
+        rmpage_list_prepend_list(&evict_gen->pages[prio], &behind);
+        evict_gen->npages += n;
+        spin_unlock(&evict_gen->lock);
+        RSTAT(EVICT_STREAM) += n;
+    }
+    spin_unlock(&stream_pages.lock);
+}
+
+/* read-ahead for a fault on a stream page: doubles with every fault that 
+ * picks up where the last one left off, starts over otherwise */
+static inline int stream_rdahead(unsigned long page)
+{
+    if (page == last_stream.next)
+        last_stream.rdahead = MIN(2 * last_stream.rdahead + 1, 
+            FAULT_MAX_RDAHEAD_SIZE);
+    else
+        last_stream.rdahead = RMEM_STREAM_MIN_RDAHEAD;
+    return last_stream.rdahead;
+}
+
+/**
+ * alloc_page_nodes - allocates page nodes to track npages pages that were 
+ * just mapped at page and adds them to the eviction lists with priority 
+ * prio, all in one go. The pages must be locked.
+ */
+void alloc_page_nodes(struct region_t* mr, unsigned long page, int npages, 
+    int prio)
+{
+    int i, memclass, node_prio;
+    bool pinned = false;
+    struct rmpage_node* pgnode;
+    struct rmpage_list new;
     struct page_list* evict_gen;
     pgidx_t pgidx;
 
     /* prio level */
-    prio = f->evict_prio;
     assert(prio >= 0 && prio < evict_nprio);
-
-    /* newly fetched pages - alloc page nodes (for both the base page and 
-     * the read-ahead) */
-    list_head_init(&new);
-    for (i = 0; i <= f->rdahead; i++) { 
+    assert(npages > 0);
+
+    /* memory class of the first page; the rest go with it. Hot pages are 
+     * pinned while there is room and are evicted last otherwise, cold pages 
+     * are evicted first */
+    memclass = get_class_from_pginfo(get_page_info(mr, page));
+    if (memclass == RMEM_CLASS_HOT) {
+        pinned = fault_reserve_pinned(npages);
+        prio = 0;
+    }
+    else if (memclass == RMEM_CLASS_COLD || memclass == RMEM_CLASS_STREAM)
+        prio = evict_nprio - 1;
+
+    node_prio = prio;
+    if (pinned)
+        node_prio = EVICTION_PRIO_PINNED;
+    else if (memclass == RMEM_CLASS_STREAM)
+        node_prio = EVICTION_PRIO_STREAM;
+
+    /* newly mapped pages - alloc page nodes */
+    rmpage_list_init(&new);
+    for (i = 0; i < npages; i++) { 
         /* get a page node */
         pgnode = rmpage_node_alloc();
         assert(pgnode);
 
         /* each page node gets an MR reference too which gets removed 
          * when the page is evicted out */
-        __get_mr(f->mr);
-        pgnode->mr = f->mr;
-        pgnode->addr = f->page + i * CHUNK_SIZE;
-        pgnode->evict_prio = prio;
-        list_add_tail(&new, &pgnode->link);
+        __get_mr(mr);
+        rmpage_node_set_page(pgnode, mr, page + i * CHUNK_SIZE);
+        pgnode->evict_prio = node_prio;
+        rmpage_list_add_tail(&new, pgnode);
 
         pgidx = rmpage_get_node_id(pgnode);
-        pgidx = set_page_index(pgnode->mr, pgnode->addr, pgidx);
+        pgidx = set_page_index(mr, page + i * CHUNK_SIZE, pgidx);
         assertz(pgidx); /* old index must be 0 */
     }
 
+    /* pinned pages never go on the eviction lists (room already taken) */
+    if (pinned) {
+        spin_lock(&pinned_pages.lock);
+        rmpage_list_append_list(&pinned_pages.pages[0], &new);
+        spin_unlock(&pinned_pages.lock);
+        RSTAT(FAULTS_PINNED) += npages;
+        return;
+    }
+
+    /* stream pages wait on their own list until the scan is past them */
+    if (memclass == RMEM_CLASS_STREAM) {
+        stream_add_pages(&new, npages);
+        return;
+    }
+
+    /* cold pages skip ahead to the front of the list evicted next */
+    if (memclass == RMEM_CLASS_COLD) {
+        evict_gen = &evict_gens[ACCESS_ONCE(evict_gen_now)];
+        spin_lock(&evict_gen->lock);
+        rmpage_list_prepend_list(&evict_gen->pages[prio], &new);
+        evict_gen->npages += npages;
+        spin_unlock(&evict_gen->lock);
+        return;
+    }
+
 #ifdef EVICTION_DNE_ON
     int popped;
-    struct list_head popped;
+    struct rmpage_list popped;
 
     /* check for space in DNE list or make space otherwise */
-    BUILD_ASSERT(RMEM_DNE_MAX_PAGES >= (1 + FAULT_MAX_RDAHEAD_SIZE));
-    list_head_init(&popped);
+    BUILD_ASSERT(RMEM_DNE_MAX_PAGES >= RMEM_POPULATE_CHUNKS);
+    rmpage_list_init(&popped);
     spin_lock(&dne_pages.locks[prio]);
-    overhead = ((int) dne_pages.npages[prio] + (1 + f->rdahead)) - RMEM_DNE_MAX_PAGES;
+    overhead = ((int) dne_pages.npages[prio] + npages) - RMEM_DNE_MAX_PAGES;
     for (i = 0; i < overhead; i++) {
-        pgnode = list_pop(&dne_pages.pages[prio], struct rmpage_node, link);
+        pgnode = rmpage_list_pop(&dne_pages.pages[prio]);
         assert(pgnode);
         dne_pages.npages[prio]--;
-        list_add_tail(&popped, &pgnode->link);
+        rmpage_list_add_tail(&popped, pgnode);
     }
 
     /* add new pages to DNE list */
-    list_append_list(&dne_pages.pages[prio], &new);
-    dne_pages.npages[prio] += (1 + f->rdahead);
+    rmpage_list_append_list(&dne_pages.pages[prio], &new);
+    dne_pages.npages[prio] += npages;
     assert(dne_pages.npages[prio] <= RMEM_DNE_MAX_PAGES);
     spin_unlock(&dne_pages.locks[prio]);
 
     /* add any DNE popped pages to highest evict list */
     if(overhead > 0) {
-        assert(!list_empty(&popped));
+        assert(!rmpage_list_empty(&popped));
         evict_gen = &evict_gens[get_highest_evict_gen()];
         spin_lock(&evict_gen->lock);
-        list_append_list(&evict_gen->pages[prio], &popped);
+        rmpage_list_append_list(&evict_gen->pages[prio], &popped);
         evict_gen->npages += overhead;
         spin_unlock(&evict_gen->lock);
     }
@@ -185,12 +315,20 @@ static inline void fault_alloc_page_nodes(fault_t* f)
     /* add new pages to highest evict list */
     evict_gen = &evict_gens[get_highest_evict_gen()];
     spin_lock(&evict_gen->lock);
-    list_append_list(&evict_gen->pages[prio], &new);
-    evict_gen->npages += (1 + f->rdahead);
+    rmpage_list_append_list(&evict_gen->pages[prio], &new);
+    evict_gen->npages += npages;
     spin_unlock(&evict_gen->lock);
 #endif
 }
 
+/* after the faulting page (and read-ahead) has been uffd-copied into the 
+ * address space, we must allocate new page nodes to track them and add the 
+ * nodes to the eviction lists */
+static inline void fault_alloc_page_nodes(fault_t* f)
+{
+    alloc_page_nodes(f->mr, f->page, 1 + f->rdahead, f->evict_prio);
+}
+
 /* serve zero pages for first-time faults without going to the backend */
 static inline void fault_serve_zero_pages(fault_t* f, int nchunks)
 {
@@ -221,6 +359,10 @@ static inline void fault_serve_zero_pages(fault_t* f, int nchunks)
     if (!wrprotect) flags |= PFLAG_DIRTY;
     ret = set_page_flags_range(f->mr, f->page, nchunks * CHUNK_SIZE, flags);
     assert(ret == nchunks);
+#ifdef ALLOC_PROFILER
+    alloc_prof_count_range(f->mr, f->page, nchunks * CHUNK_SIZE, 
+        APROF_RESIDENT, 1);
+#endif
 
     /* alloc page nodes */
     fault_alloc_page_nodes(f);
@@ -256,10 +398,15 @@ int fault_read_done(fault_t* f)
     flags = PFLAG_PRESENT;
     if (!wrprotect) flags |= PFLAG_DIRTY;
     set_page_flags_range(f->mr, f->page, size, flags);
+#ifdef ALLOC_PROFILER
+    alloc_prof_count_range(f->mr, f->page, size, APROF_RESIDENT, 1);
+    alloc_prof_count_range(f->mr, f->page, size, APROF_READS, 1);
+#endif
 
     /* add page nodes for the pages */
     fault_alloc_page_nodes(f);
 
+    f->copy_tsc = rdtsc();
     return 0;
 }
 
@@ -270,6 +417,7 @@ void fault_done(fault_t* f)
     int i, r;
     pgthread_t owner_kthr;
     pgflags_t oldflags;
+    unsigned long now_tsc;
 
     /* remove lock (in ascending order) */
     if (f->locked_pages) {
@@ -301,9 +449,90 @@ void fault_done(fault_t* f)
     RSTAT(FAULTS_DONE)++;
     log_debug("%s - fault done", FSTR(f));
 
+    /* record phase latencies; faults that did not go to the backend only 
+     * count towards the total */
+    now_tsc = rdtsc();
+    if (f->copy_tsc) {
+        assert(f->post_tsc && f->comp_tsc);
+        fault_hist_record(FHIST_POST, f->post_tsc - f->start_tsc);
+        fault_hist_record(FHIST_BACKEND, f->comp_tsc - f->post_tsc);
+        fault_hist_record(FHIST_COPY, f->copy_tsc - f->comp_tsc);
+        fault_hist_record(FHIST_WAKE, now_tsc - f->copy_tsc);
+    }
+    if (f->start_tsc)
+        fault_hist_record(FHIST_TOTAL, now_tsc - f->start_tsc);
+    fault_trace_record(f, now_tsc);
+#ifdef ALLOC_PROFILER
+    alloc_prof_count(f->mr, f->page, APROF_FAULTS, 1);
+#endif
+
     /* free */
     put_mr(f->mr);
-    fault_free(f);
+    fault_put(f);
+}
+
+/**
+ * Batched reads: threads that handle many faults at a time (handler threads)
+ * can enable this to have handle_page_fault() collect the reads instead of 
+ * posting each of them, and then post them all at once with 
+ * fault_read_batch_flush(). The faults are still reported as 
+ * FAULT_READ_POSTED so the caller must flush before waiting on completions.
+ */
+void fault_read_batch_enable(void)
+{
+    read_batch.enabled = true;
+    read_batch.n = 0;
+}
+
+int fault_read_batch_flush(int chan_id, struct bkend_completion_cbs* cbs)
+{
+    int i, nposted, ret;
+    uint64_t start_tsc, duration, now_tsc;
+
+    if (read_batch.n == 0)
+        return 0;
+
+    start_tsc = 0;
+    nposted = 0;
+    while (nposted < read_batch.n) {
+        /* reads may complete (elsewhere) as soon as they are posted */
+        now_tsc = rdtsc();
+        for (i = nposted; i < read_batch.n; i++)
+            read_batch.faults[i]->post_tsc = now_tsc;
+
+        ret = rmbackend->post_read_batch(chan_id, 
+            &read_batch.faults[nposted], read_batch.n - nposted);
+        assert(ret >= 0 && ret <= read_batch.n - nposted);
+
+        /* start the clock for the hedged ones */
+        if (rmem_hedge_pct > 0) {
+            now_tsc = rdtsc();
+            for (i = nposted; i < nposted + ret; i++)
+                if (read_batch.hedged[i])
+                    store_release(&read_batch.faults[i]->tstamp_tsc, now_tsc);
+        }
+        nposted += ret;
+
+        if (nposted < read_batch.n) {
+            /* read queue is full, keep checking for completions to free 
+             * request slots */
+            if (!start_tsc)
+                start_tsc = rdtsc();
+            rmbackend->check_for_completions(chan_id, cbs, 
+                RMEM_MAX_COMP_PER_OP, NULL, NULL);
+            cpu_relax();
+        }
+    }
+
+    /* save wait time if any */
+    if (start_tsc) {
+        duration = rdtscp(NULL) - start_tsc;
+        RSTAT(BACKEND_WAIT_CYCLES) += duration;
+    }
+
+    log_debug("posted a batch of %d reads on chan %d", nposted, chan_id);
+    read_batch.n = 0;
+    return nposted;
 }
 
 /* Gateway to common fault handling for shenango or handler cores after 
@@ -312,8 +541,8 @@ enum fault_status handle_page_fault(int chan_id, fault_t* fault,
     int* nevicts_needed, struct bkend_completion_cbs* cbs)
 {
     struct region_t* mr;
-    bool page_present, was_locked, no_wake, wrprotect;
-    int i, ret, n_retries, nchunks, noverflow;
+    bool page_present, was_locked, no_wake, wrprotect, hedged;
+    int i, ret, n_retries, nchunks, noverflow, memclass;
     pgflags_t pflags, rflags, oldflags;
     unsigned long addr;
     unsigned long long pressure;
@@ -322,6 +551,7 @@ enum fault_status handle_page_fault(int chan_id, fault_t* fault,
 
     assert(nevicts_needed);
     *nevicts_needed = 0;
+    memclass = RMEM_CLASS_DEFAULT;
 
     /* see if this fault needs to be acted upon, because some other fault 
      * on the same page might have handled it by now */
@@ -357,6 +587,12 @@ enum fault_status handle_page_fault(int chan_id, fault_t* fault,
                 return FAULT_DONE;
             }
 
+            /* streams read ahead more and more as long as they keep going */
+            memclass = get_class_from_pginfo(get_page_info(mr, fault->page));
+            if (memclass == RMEM_CLASS_STREAM)
+                fault->rdahead_max = MAX(fault->rdahead_max, 
+                    stream_rdahead(fault->page));
+
             /* at this point, we can check for read-ahead. see if we can get 
              * a lock on the next few pages that have similar requirements 
              * as the current page so we can make the same choices for them 
@@ -395,6 +631,8 @@ enum fault_status handle_page_fault(int chan_id, fault_t* fault,
                 RSTAT(RDAHEADS)++;
                 RSTAT(RDAHEAD_PAGES) += fault->rdahead;
             }
+            if (memclass == RMEM_CLASS_STREAM)
+                last_stream.next = fault->page + nchunks * CHUNK_SIZE;
 
             /* page present bit might have been updated just before we 
              * locked - we should check it again after taking the lock 
@@ -462,10 +700,28 @@ enum fault_status handle_page_fault(int chan_id, fault_t* fault,
                     nchunks * CHUNK_SIZE, current_kthread_id);
                 assert(ret == nchunks);
             }
+
+            /* register the read for hedging before it can complete. faults 
+             * the handlers post on their own are not hedged as there is no 
+             * kthread (in the page metadata) to hand a duplicate's 
+             * completion to */
+            hedged = (rmem_hedge_pct > 0) && !fault->from_handler 
+                && hedge_track(fault);
             store_release(&fault->posted_chan_id, chan_id);
 
+            /* add to the batch if batching, it is posted later */
+            if (read_batch.enabled) {
+                if (read_batch.n == RMEM_MAX_POST_BATCH)
+                    fault_read_batch_flush(chan_id, cbs);
+                read_batch.hedged[read_batch.n] = hedged;
+                read_batch.faults[read_batch.n++] = fault;
+                status = FAULT_READ_POSTED;
+                goto pages_added_out;
+            }
+
             /* send off page read */
             start_tsc = 0;
+            fault->post_tsc = rdtsc();
             do {
                 ret = rmbackend->post_read(chan_id, fault);
                 if (ret == EAGAIN) {
@@ -483,6 +739,11 @@ enum fault_status handle_page_fault(int chan_id, fault_t* fault,
             } while(ret == EAGAIN);
             assertz(ret);
 
+            /* start the clock for the hedge (the fault is still ours to touch 
+             * as the tracker holds a ref) */
+            if (hedged)
+                store_release(&fault->tstamp_tsc, rdtsc());
+
             /* save wait time if any */
             if (start_tsc) {
                 duration = rdtscp(NULL) - start_tsc;
@@ -505,6 +766,13 @@ pages_added_out:
         *nevicts_needed = (noverflow < nchunks) ? noverflow : nchunks;
     }
 
+    /* evict behind streams: once they take up their share of local memory,
+     * every stream fault evicts as many pages as it brings in, which are the
+     * ones the scan left behind (at the front of the eviction lists) */
+    if (memclass == RMEM_CLASS_STREAM && 
+            ACCESS_ONCE(stream_pages.npages) >= RMEM_STREAM_MAX_PAGES)
+        *nevicts_needed = nchunks;
+
     /* update maximum memory usage counter. FIXME: should use CAS! */
     if (pressure > atomic64_read(&max_memory_used))
         atomic64_write(&max_memory_used, pressure);
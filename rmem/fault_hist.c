@@ -0,0 +1,152 @@
+/*
+ * fault_hist.c - per-phase fault latency histograms
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base/limits.h"
+#include "base/lock.h"
+#include "base/log.h"
+#include "base/time.h"
+#include "rmem/fault_hist.h"
+
+/* state */
+const char* fault_hist_names[] = {
+    "post",
+    "backend",
+    "copy",
+    "wake",
+    "total",
+};
+BUILD_ASSERT(ARRAY_SIZE(fault_hist_names) == FHIST_NR);
+
+__thread struct fault_hist* fault_hist_ptr = NULL;
+static struct fault_hist* fault_hists[FAULT_HIST_MAX_THREADS];
+static int fault_hists_n = 0;
+static DEFINE_SPINLOCK(fault_hists_lock);
+
+/**
+ * fault_hist_init_thread - sets up histograms for the current thread. Faults
+ * finished on the thread are not recorded if this fails.
+ */
+void fault_hist_init_thread(void)
+{
+    struct fault_hist* h;
+
+    assert(!fault_hist_ptr);
+    h = aligned_alloc(CACHE_LINE_SIZE,
+        align_up(sizeof(struct fault_hist), CACHE_LINE_SIZE));
+    if (!h) {
+        log_warn("out of memory for fault histograms, skipping");
+        return;
+    }
+    memset(h, 0, sizeof(struct fault_hist));
+
+    spin_lock(&fault_hists_lock);
+    if (fault_hists_n >= FAULT_HIST_MAX_THREADS) {
+        spin_unlock(&fault_hists_lock);
+        log_warn("too many threads for fault histograms, skipping");
+        free(h);
+        return;
+    }
+    fault_hists[fault_hists_n] = h;
+    store_release(&fault_hists_n, fault_hists_n + 1);
+    spin_unlock(&fault_hists_lock);
+
+    fault_hist_ptr = h;
+}
+
+/**
+ * fault_hist_merge - sums up histograms from all threads. Counters are read
+ * while they are being updated so the result is only approximately a
+ * snapshot.
+ */
+void fault_hist_merge(struct fault_hist* out)
+{
+    int i, j, k, n;
+
+    memset(out, 0, sizeof(struct fault_hist));
+    n = load_acquire(&fault_hists_n);
+    for (i = 0; i < n; i++)
+        for (j = 0; j < FHIST_NR; j++)
+            for (k = 0; k < FHIST_NBUCKETS; k++)
+                out->counts[j][k] += ACCESS_ONCE(fault_hists[i]->counts[j][k]);
+}
+
+/**
+ * fault_hist_percentile - the latency (in cycles, to bucket precision)
+ * below which pct percent of the total samples in the histogram fall
+ */
+uint64_t fault_hist_percentile(uint64_t* counts, uint64_t total, double pct)
+{
+    uint64_t target, seen;
+    int i;
+
+    if (total == 0)
+        return 0;
+
+    target = (uint64_t)(total * pct / 100.0);
+    if (target >= total)
+        target = total - 1;
+
+    seen = 0;
+    for (i = 0; i < FHIST_NBUCKETS; i++) {
+        seen += counts[i];
+        if (seen > target)
+            return fault_hist_bucket_low(i);
+    }
+    return fault_hist_bucket_low(FHIST_NBUCKETS - 1);
+}
+
+/**
+ * fault_hist_write_buf - writes out the sample count and latency percentiles
+ * (in ns) of each phase for the faults done since the last call; prev holds
+ * the merged histograms from then and is updated. Meant for a single stats
+ * thread. Returns 0 if successful, or -EINVAL/-E2BIG.
+ */
+int fault_hist_write_buf(char* buf, size_t len, struct fault_hist* prev)
+{
+    static struct fault_hist now, diff;
+    static const double pcts[] = {50, 90, 99, 99.9};
+    static const char* pct_names[] = {"p50", "p90", "p99", "p999"};
+    char *pos = buf, *end = buf + len;
+    uint64_t total, val;
+    int i, j, ret;
+
+    fault_hist_merge(&now);
+    for (i = 0; i < FHIST_NR; i++)
+        for (j = 0; j < FHIST_NBUCKETS; j++)
+            diff.counts[i][j] = now.counts[i][j] - prev->counts[i][j];
+    memcpy(prev, &now, sizeof(struct fault_hist));
+
+    for (i = 0; i < FHIST_NR; i++) {
+        total = 0;
+        for (j = 0; j < FHIST_NBUCKETS; j++)
+            total += diff.counts[i][j];
+
+        ret = snprintf(pos, end - pos, "%s_n:%lu,", fault_hist_names[i], 
+            total);
+        if (ret < 0)
+            return -EINVAL;
+        else if (ret >= end - pos)
+            return -E2BIG;
+        pos += ret;
+
+        for (j = 0; j < ARRAY_SIZE(pcts); j++) {
+            val = fault_hist_percentile(diff.counts[i], total, pcts[j]);
+            ret = snprintf(pos, end - pos, "%s_%s:%lu,", fault_hist_names[i],
+                pct_names[j], val * 1000 / cycles_per_us);
+            if (ret < 0)
+                return -EINVAL;
+            else if (ret >= end - pos)
+                return -E2BIG;
+            pos += ret;
+        }
+    }
+
+    if (pos > buf)
+        pos[-1] = '\0';     /* clip off last ',' */
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * fault_trace.c - binary per-thread fault trace rings
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "base/assert.h"
+#include "base/log.h"
+#include "base/mem.h"
+#include "base/time.h"
+#include "rmem/common.h"
+#include "rmem/config.h"
+#include "rmem/fault.h"
+#include "rmem/fault_trace.h"
+#include "runtime/preempt.h"
+
+/* state */
+__thread struct fault_trace_ring* fault_trace_ring = NULL;
+static __thread struct fault_trace_rec* fault_trace_recs = NULL;
+static struct fault_trace_hdr* ftrace_hdr = NULL;
+static size_t ftrace_len = 0;
+static unsigned long ftrace_nrecs = 0;
+
+/**
+ * fault_trace_init - creates and maps the trace file if tracing is enabled
+ */
+int fault_trace_init(void)
+{
+    struct fault_trace_hdr* hdr;
+    char path[64];
+    unsigned long nrecs;
+    size_t rings_off, recs_off, len;
+    int fd;
+
+    if (rmem_trace_records == 0)
+        return 0;
+
+    /* round ring size up to a power of 2 */
+    nrecs = 1UL << (64 - __builtin_clzl((rmem_trace_records - 1) | 1));
+    rings_off = align_up(sizeof(struct fault_trace_hdr), PGSIZE_4KB);
+    recs_off = align_up(rings_off + FAULT_TRACE_MAX_THREADS *
+        sizeof(struct fault_trace_ring), PGSIZE_4KB);
+    len = recs_off + FAULT_TRACE_MAX_THREADS * nrecs *
+        sizeof(struct fault_trace_rec);
+
+    /* the file is sparse, so rings only take up memory as they fill up */
+    snprintf(path, sizeof(path), FAULT_TRACE_PATH, getpid());
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        log_err("failed to create fault trace file %s", path);
+        return 1;
+    }
+    if (ftruncate(fd, len)) {
+        log_err("failed to size fault trace file %s to %lu B", path, len);
+        close(fd);
+        return 1;
+    }
+    hdr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        log_err("failed to map fault trace file %s", path);
+        return 1;
+    }
+
+    hdr->version = FAULT_TRACE_VERSION;
+    hdr->rec_size = sizeof(struct fault_trace_rec);
+    hdr->nrings = 0;
+    hdr->max_rings = FAULT_TRACE_MAX_THREADS;
+    hdr->ring_nrecs = nrecs;
+    hdr->rings_off = rings_off;
+    hdr->recs_off = recs_off;
+    hdr->cycles_per_us = cycles_per_us;
+    hdr->start_tsc = rdtsc();
+    hdr->start_time = time(NULL);
+    store_release(&hdr->magic, FAULT_TRACE_MAGIC);   /* header is ready */
+
+    ftrace_hdr = hdr;
+    ftrace_len = len;
+    ftrace_nrecs = nrecs;
+    log_info("tracing faults to %s (%lu records per thread)", path, nrecs);
+    return 0;
+}
+
+/**
+ * fault_trace_init_thread - claims a ring for the current thread. Faults
+ * finished on the thread are not traced if we are out of rings.
+ */
+void fault_trace_init_thread(void)
+{
+    struct fault_trace_ring* ring;
+    uint32_t id;
+
+    if (!ftrace_hdr)
+        return;
+
+    assert(!fault_trace_ring);
+    id = __sync_fetch_and_add(&ftrace_hdr->nrings, 1);
+    if (id >= FAULT_TRACE_MAX_THREADS) {
+        log_warn("too many threads for fault tracing, skipping");
+        return;
+    }
+
+    ring = (void*) ftrace_hdr + ftrace_hdr->rings_off +
+        id * sizeof(struct fault_trace_ring);
+    ring->tid = syscall(SYS_gettid);
+    fault_trace_recs = (void*) ftrace_hdr + ftrace_hdr->recs_off +
+        id * ftrace_nrecs * sizeof(struct fault_trace_rec);
+    fault_trace_ring = ring;
+}
+
+/**
+ * fault_trace_destroy - unmaps the trace file (but leaves it around for
+ * offline analysis)
+ */
+void fault_trace_destroy(void)
+{
+    if (!ftrace_hdr)
+        return;
+    munmap(ftrace_hdr, ftrace_len);
+    ftrace_hdr = NULL;
+}
+
+/**
+ * __fault_trace_record - writes a finished fault to the thread's ring
+ */
+void __fault_trace_record(struct fault* f, unsigned long now_tsc)
+{
+    struct fault_trace_rec* rec;
+    uint64_t head, lat;
+
+    assert(fault_trace_ring && fault_trace_recs);
+    head = fault_trace_ring->head;
+    rec = &fault_trace_recs[head & (ftrace_nrecs - 1)];
+
+    lat = f->start_tsc ? now_tsc - f->start_tsc : 0;
+    rec->tsc = f->start_tsc;
+    rec->addr = f->page;
+    rec->ip = f->ip;
+    rec->tid = f->tid;
+    rec->lat = lat > UINT32_MAX ? UINT32_MAX : lat;
+    rec->flags = (f->is_read ? FTRACE_READ : 0)
+        | (f->is_write ? FTRACE_WRITE : 0)
+        | (f->is_wrprotect ? FTRACE_WP : 0)
+        | (f->from_kernel ? FTRACE_KERNEL : 0)
+        | (f->copy_tsc ? 0 : FTRACE_NOREAD)
+        | (f->hedged ? FTRACE_HEDGED : 0);
+    rec->npages = 1 + f->rdahead;
+
+    /* publish */
+    store_release(&fault_trace_ring->head, head + 1);
+}
+
+/**
+ * __fault_trace_touch - writes a hinted access that did not fault. Called 
+ * from uthreads, so it keeps preemption off to stay on the kthread (and the 
+ * ring) it started on until the record is published.
+ */
+void __fault_trace_touch(unsigned long addr, bool write, unsigned int tid)
+{
+    struct fault_trace_rec* rec;
+    uint64_t head;
+
+    preempt_disable();
+    /* may have moved to another kthread since the caller looked */
+    if (unlikely(!fault_trace_ring)) {
+        preempt_enable();
+        return;
+    }
+    assert(fault_trace_recs);
+    head = fault_trace_ring->head;
+    rec = &fault_trace_recs[head & (ftrace_nrecs - 1)];
+
+    rec->tsc = rdtsc();
+    rec->addr = addr & ~CHUNK_MASK;
+    rec->ip = 0;
+    rec->tid = tid;
+    rec->lat = 0;
+    rec->flags = FTRACE_HINT | (write ? FTRACE_WRITE : FTRACE_READ);
+    rec->npages = 1;
+
+    /* publish */
+    store_release(&fault_trace_ring->head, head + 1);
+    preempt_enable();
+}
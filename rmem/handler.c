@@ -20,6 +20,9 @@
 #include "rmem/fault.h"
 #include "rmem/fsampler.h"
 #include "rmem/handler.h"
+#include "rmem/hedge.h"
+#include "rmem/hint_prof.h"
+#include "rmem/hotset.h"
 #include "rmem/page.h"
 #include "rmem/pgnode.h"
 #include "rmem/region.h"
@@ -58,6 +61,46 @@ int hthr_fault_read_done(fault_t* f)
     return 0;
 }
 
+/* called when a duplicate read (see hedge.c) completes before the original. 
+ * the fault may belong to this or another handler or to a shenango kthread */
+int hthr_fault_read_hedge_done(fault_t* f)
+{
+    int r;
+
+    log_debug("%s - served by hedged read", FSTR(f));
+    RSTAT(HEDGE_WINS)++;
+
+    /* finish servicing the fault */
+    r = fault_read_done(f);
+    assertz(r);
+
+#ifndef RMEM_STANDALONE
+    if (!f->from_kernel) {
+        /* the page lock carries the kthread that posted the original read; 
+         * wake up the thread there and take the fault off its books */
+        struct kthread* owner;
+        pgthread_t kthr_id;
+
+        assert(!f->from_handler);   /* not hedged, see handle_page_fault() */
+        kthr_id = get_page_thread(f->mr, f->page);
+        BUG_ON(!kthr_id);
+        owner = allks[kthr_id - 1];
+        assert(owner);
+        f->stolen_from_cq = 1;
+
+        assert(f->thread);
+        thread_ready_safe(owner, f->thread);
+        spin_lock(&owner->pf_lock);
+        owner->pf_pending--;
+        spin_unlock(&owner->pf_lock);
+    }
+#endif
+
+    /* release fault */
+    fault_done(f);
+    return 0;
+}
+
 #ifndef RMEM_STANDALONE
 
 /** 
@@ -224,6 +267,7 @@ static inline fault_t* read_uffd_fault()
     
         /* populate it */
         memset(fault, 0, sizeof(fault_t));
+        fault->start_tsc = rdtsc();
         fault->page = addr & ~CHUNK_MASK;
         fault->is_wrprotect = !!(flags & UFFD_PAGEFAULT_FLAG_WP);
         fault->is_write = !!(flags & UFFD_PAGEFAULT_FLAG_WRITE);
@@ -232,6 +276,13 @@ static inline fault_t* read_uffd_fault()
         fault->rdahead_max = 0;   /*no readaheads for kernel faults*/
         fault->rdahead  = 0;
         fault->evict_prio = evict_nprio - 1;
+        fault->ip = uffd_msg_ip(&message);
+#ifdef UFFD_FEATURE_THREAD_ID
+        fault->tid = message.arg.pagefault.feat.ptid;
+#endif
+#ifdef HINT_PROFILER
+        hint_prof_kfault(fault->ip);
+#endif
 
         /* find associated region */
         mr = get_region_by_addr_safe(fault->page);
@@ -271,21 +322,31 @@ static void* rmem_handler(void *arg)
     bool need_eviction, work_done;
     unsigned long long pressure;
     fault_t *fault, *next;
-    int nevicts, nevicts_needed, batch, r;
+    int nevicts, nevicts_needed, batch, r, i;
     enum fault_status fstatus;
     assert(arg != NULL);        /* expecting a hthread_t */
     my_hthr = (hthread_t*) arg; /* save our hthread_t */
     unsigned long now_tsc, last_tsc;
 
+    /* pin thread first so that per-thread resources come from its node */
+    if (my_hthr->pincore_id >= 0) {
+        r = cpu_pin_thread(pthread_self(), my_hthr->pincore_id);
+        assertz(r);
+    }
+
     /* init per-thread resources */
     r = thread_init_perthread(); assertz(r); /* for tcache support */
     rmem_common_init_thread(&my_hthr->bkend_chan_id, my_hthr->rstats, 0);
     list_head_init(&my_hthr->fault_wait_q);
     my_hthr->n_wait_q = 0;
+    fault_read_batch_enable();
 #ifdef FAULT_SAMPLER
     my_hthr->fsampler_id = fsampler_get_sampler();
 #endif
 
+    /* read back the hot pages from the last run, if any */
+    hotset_replay(my_hthr->bkend_chan_id);
+
     /* do work */
     last_tsc = 0;
     while(!my_hthr->stop)
@@ -358,9 +419,13 @@ static void* rmem_handler(void *arg)
             fault = next;
         }
 
-        /* check for incoming uffd faults */
-        fault = read_uffd_fault();
-        if (fault) {
+        /* check for incoming uffd faults; take a few at a time so that 
+         * their reads can be posted together */
+        for (i = 0; i < RMEM_MAX_POST_BATCH && nevicts_needed == 0; i++) {
+            fault = read_uffd_fault();
+            if (!fault)
+                break;
+
             /* accounting */
             RSTAT(FAULTS)++;
             if (fault->is_read)         RSTAT(FAULTS_R)++;
@@ -398,6 +463,10 @@ static void* rmem_handler(void *arg)
         }
 
 eviction:
+        /* post the reads collected so far */
+        if (fault_read_batch_flush(my_hthr->bkend_chan_id, &hthr_cbs) > 0)
+            work_done = true;
+
         /*  do eviction if needed */
         need_eviction = (nevicts_needed > 0);
         if (!need_eviction) {
@@ -426,6 +495,24 @@ eviction:
         if (r > 0)
             work_done = true;
 
+        /* send duplicates for slow reads and check on them */
+        if (rmem_hedge_pct > 0) {
+            if (hedge_scan(now_tsc) > 0)
+                work_done = true;
+            if (hedge_check_for_completions(&hthr_hedge_cbs) > 0)
+                work_done = true;
+        }
+
+        /* add more backing memory if allocations are running out */
+        if (unlikely(region_grow_pending()))
+            if (region_grow() > 0)
+                work_done = true;
+
+        /* save the hot pages if asked to (see rmcheckpoint()) */
+        if (unlikely(ACCESS_ONCE(hotset_save_pending)) && 
+                __sync_bool_compare_and_swap(&hotset_save_pending, true, false))
+            hotset_save();
+
         /* check for remote memory dump */
         if (unlikely(dump_rmem_state_and_exit)) {
             dump_rmem_state();
@@ -458,18 +545,13 @@ hthread_t* new_rmem_handler_thread(int pincore_id)
     /* create thread */
     hthr->stop = false;
     hthr->fsampler_id = -1;
+    hthr->pincore_id = pincore_id;  /* thread pins itself */
     r = pthread_create(&hthr->thread, NULL, rmem_handler, (void*)hthr);
     if (r < 0) {
         log_err("pthread_create for rmem handler failed: %d", errno);
         return NULL;
     }
 
-    /* pin thread */
-    if (pincore_id >= 0) {
-        r = cpu_pin_thread(hthr->thread, pincore_id);
-        assertz(r);
-    }
-
     return hthr;
 }
 
@@ -492,6 +574,12 @@ struct bkend_completion_cbs hthr_cbs = {
     .write_completion = owner_write_back_completed
 };
 
+/* handler thread backend read/write completion ops for hedged reads */
+struct bkend_completion_cbs hthr_hedge_cbs = {
+    .read_completion = hthr_fault_read_hedge_done,
+    .write_completion = owner_write_back_completed
+};
+
 #ifndef RMEM_STANDALONE
 /* handler thread backend read/write completion ops when stealing */
 struct bkend_completion_cbs hthr_stealer_cbs = {
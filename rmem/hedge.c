@@ -0,0 +1,248 @@
+/*
+ * hedge.c - hedged backend reads
+ *
+ * A single slow read (e.g., a congested memory server or an RDMA retry)
+ * stalls the faulting thread for as long as it takes. When enabled
+ * (rmem_hedge_pct), posted reads are tracked and the ones that have been in
+ * flight longer than the given percentile of recent read latency are sent
+ * again on a separate channel; the first of the two completions serves the
+ * fault. Faults with tracked reads are reference-counted (fault_put()) so
+ * that the late completion and the tracker can safely let go of them.
+ */
+
+#include <stdlib.h>
+
+#include "base/time.h"
+#include "rmem/backend.h"
+#include "rmem/common.h"
+#include "rmem/fault.h"
+#include "rmem/hedge.h"
+#include "rmem/stats.h"
+
+/* state */
+int hedge_chan_id = -1;
+static fault_t* _Atomic hedge_slots[HEDGE_MAX_TRACKED];
+static atomic_int hedge_nslots = ATOMIC_VAR_INIT(0);    /* high-water mark */
+static __thread int hedge_slot_hint = 0;
+static unsigned long hedge_lat_samples[HEDGE_LAT_SAMPLES];
+static atomic_ulong hedge_lat_idx = ATOMIC_VAR_INIT(0);
+static unsigned long hedge_timeout_tsc = 0;     /* 0 until enough samples */
+static unsigned long hedge_last_scan_tsc = 0;
+static unsigned long hedge_last_update_tsc = 0;
+static DEFINE_SPINLOCK(hedge_lock);
+
+/**
+ * hedge_init - sets up a dedicated backend channel for duplicate reads
+ */
+int hedge_init(void)
+{
+    if (rmem_hedge_pct <= 0)
+        return 0;
+    if (rmem_hedge_pct >= 100) {
+        log_err("hedge percentile must be below 100, got %d", rmem_hedge_pct);
+        return 1;
+    }
+
+#ifdef BLOCKING_HINTS
+    /* completing faults of a blocked kthread elsewhere is not supported */
+    log_warn("hedged reads not supported with BLOCKING_HINTS; disabling");
+    rmem_hedge_pct = 0;
+    return 0;
+#endif
+
+    hedge_chan_id = rmbackend->get_new_data_channel();
+    if (hedge_chan_id < 0) {
+        log_err("no backend channel left for hedged reads");
+        return 1;
+    }
+    log_info("hedged reads at p%d read latency on chan %d",
+        rmem_hedge_pct, hedge_chan_id);
+    return 0;
+}
+
+/**
+ * hedge_track - registers a fault whose read is about to be posted. Must be
+ * called before posting as the read may complete any time after. Returns
+ * false if we couldn't track it, in which case the read is not hedged.
+ */
+bool hedge_track(fault_t* f)
+{
+    int i, slot, nslots;
+    fault_t* expected;
+
+    /* one ref for the read we are posting and one for the tracker. the read
+     * clock starts after posting (tstamp_tsc) */
+    f->hedge_tracked = 1;
+    f->hedge_refs = 2;
+    f->hedge_claimed = 0;
+    f->hedged = 0;
+    f->tstamp_tsc = 0;
+
+    for (i = 0; i < HEDGE_TRACK_PROBES; i++) {
+        slot = (hedge_slot_hint + i) % HEDGE_MAX_TRACKED;
+        expected = NULL;
+        if (atomic_load_explicit(&hedge_slots[slot], memory_order_relaxed))
+            continue;
+        if (!atomic_compare_exchange_strong(&hedge_slots[slot], &expected, f))
+            continue;
+
+        /* got a slot; make sure the tracker scans that far */
+        hedge_slot_hint = slot + 1;
+        nslots = atomic_load(&hedge_nslots);
+        while (nslots <= slot)
+            if (atomic_compare_exchange_weak(&hedge_nslots, &nslots, slot + 1))
+                break;
+        return true;
+    }
+
+    /* too many reads in flight; this one goes without a hedge */
+    f->hedge_tracked = 0;
+    f->hedge_refs = 0;
+    return false;
+}
+
+/**
+ * hedge_read_claim - slow path of fault_read_claim() for tracked faults.
+ * Only the first of the (possibly duplicate) read completions gets to serve
+ * the fault, others release their buffer and their ref on the fault.
+ */
+bool hedge_read_claim(fault_t* f, void* buf)
+{
+    unsigned long posted_tsc, now_tsc, idx;
+
+    if (__atomic_exchange_n(&f->hedge_claimed, 1, __ATOMIC_ACQ_REL)) {
+        /* lost to the other read */
+        log_debug("%s - dropping late read completion", FSTR(f));
+        bkend_buf_free(buf);
+        fault_put(f);
+        return false;
+    }
+    f->bkend_buf = buf;
+    now_tsc = rdtsc();
+    f->comp_tsc = now_tsc;
+
+    /* sample read latency (as seen by the fault) */
+    posted_tsc = load_acquire(&f->tstamp_tsc);
+    if (posted_tsc) {
+        idx = atomic_fetch_add_explicit(&hedge_lat_idx, 1,
+            memory_order_relaxed);
+        hedge_lat_samples[idx & (HEDGE_LAT_SAMPLES - 1)] =
+            now_tsc - posted_tsc;
+    }
+    return true;
+}
+
+static int hedge_cmp_tsc(const void* a, const void* b)
+{
+    unsigned long x = *(const unsigned long*) a;
+    unsigned long y = *(const unsigned long*) b;
+    return (x > y) - (x < y);
+}
+
+/* recompute the hedging timeout from recent read latency samples */
+static void hedge_update_timeout(void)
+{
+    unsigned long samples[HEDGE_LAT_SAMPLES];
+    unsigned long n, timeout, min_timeout;
+
+    n = atomic_load_explicit(&hedge_lat_idx, memory_order_relaxed);
+    if (n < HEDGE_MIN_SAMPLES)
+        return;
+    if (n > HEDGE_LAT_SAMPLES)
+        n = HEDGE_LAT_SAMPLES;
+
+    /* samples may get overwritten while we copy; that's fine */
+    memcpy(samples, hedge_lat_samples, n * sizeof(unsigned long));
+    qsort(samples, n, sizeof(unsigned long), hedge_cmp_tsc);
+    timeout = samples[(n - 1) * rmem_hedge_pct / 100];
+
+    min_timeout = HEDGE_MIN_TIMEOUT_US * cycles_per_us;
+    if (timeout < min_timeout)
+        timeout = min_timeout;
+    hedge_timeout_tsc = timeout;
+    log_debug("hedge timeout now %lu cycles", timeout);
+}
+
+/* stop tracking the fault in the slot */
+static inline void hedge_untrack(int slot, fault_t* f)
+{
+    atomic_store_explicit(&hedge_slots[slot], NULL, memory_order_release);
+    fault_put(f);
+}
+
+/**
+ * hedge_scan - goes over tracked reads, letting go of completed ones and
+ * posting a duplicate read for the ones that have waited too long. Meant to
+ * be called by handler threads; only one of them scans at a time.
+ * Returns the number of duplicate reads posted.
+ */
+int hedge_scan(unsigned long now_tsc)
+{
+    int i, nslots, nhedged, ret;
+    unsigned long posted_tsc;
+    fault_t* f;
+
+    if (now_tsc - hedge_last_scan_tsc < HEDGE_SCAN_INTERVAL_US * cycles_per_us)
+        return 0;
+    if (!spin_try_lock(&hedge_lock))
+        return 0;
+    hedge_last_scan_tsc = now_tsc;
+
+    if (now_tsc - hedge_last_update_tsc >
+            HEDGE_UPDATE_INTERVAL_US * cycles_per_us) {
+        hedge_update_timeout();
+        hedge_last_update_tsc = now_tsc;
+    }
+
+    nhedged = 0;
+    nslots = atomic_load(&hedge_nslots);
+    for (i = 0; i < nslots; i++) {
+        f = atomic_load_explicit(&hedge_slots[i], memory_order_acquire);
+        if (f == NULL)
+            continue;
+
+        /* read completed, nothing to do */
+        if (load_acquire(&f->hedge_claimed)) {
+            hedge_untrack(i, f);
+            continue;
+        }
+
+        /* still within the expected latency (or not posted yet) */
+        posted_tsc = load_acquire(&f->tstamp_tsc);
+        if (!hedge_timeout_tsc || !posted_tsc ||
+                now_tsc - posted_tsc < hedge_timeout_tsc)
+            continue;
+
+        /* send a duplicate read, which gets its own ref on the fault */
+        __atomic_add_fetch(&f->hedge_refs, 1, __ATOMIC_ACQ_REL);
+        f->hedged = 1;
+        ret = rmbackend->post_read(hedge_chan_id, f);
+        if (ret == EAGAIN) {
+            /* hedge channel busy, try again next time */
+            f->hedged = 0;
+            __atomic_sub_fetch(&f->hedge_refs, 1, __ATOMIC_ACQ_REL);
+            break;
+        }
+        assertz(ret);
+        log_debug("%s - posted hedged read after %lu cycles", FSTR(f),
+            now_tsc - posted_tsc);
+        RSTAT(HEDGES)++;
+        nhedged++;
+
+        /* only one duplicate per read */
+        hedge_untrack(i, f);
+    }
+
+    spin_unlock(&hedge_lock);
+    return nhedged;
+}
+
+/**
+ * hedge_check_for_completions - checks for duplicate read completions
+ */
+int hedge_check_for_completions(struct bkend_completion_cbs* cbs)
+{
+    assert(hedge_chan_id >= 0);
+    return rmbackend->check_for_completions(hedge_chan_id, cbs,
+        RMEM_MAX_COMP_PER_OP, NULL, NULL);
+}
@@ -0,0 +1,196 @@
+/*
+ * hint_prof.c - hint efficacy profiling per callsite
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base/limits.h"
+#include "base/lock.h"
+#include "base/log.h"
+#include "rmem/hint_prof.h"
+
+#define MERGED_SITES    (4 * HINT_PROF_MAX_SITES)
+
+/* state */
+__thread struct hint_prof* hint_prof_ptr = NULL;
+__thread unsigned long hint_prof_last_ip = 0;
+static struct hint_prof* hint_profs[HINT_PROF_MAX_THREADS];
+static int hint_profs_n = 0;
+static DEFINE_SPINLOCK(hint_profs_lock);
+
+/**
+ * hint_prof_init_thread - sets up the profile for the current thread. Hints
+ * and faults on the thread are not counted if this fails.
+ */
+void hint_prof_init_thread(void)
+{
+    struct hint_prof* p;
+
+    assert(!hint_prof_ptr);
+    p = aligned_alloc(CACHE_LINE_SIZE,
+        align_up(sizeof(struct hint_prof), CACHE_LINE_SIZE));
+    if (!p) {
+        log_warn("out of memory for hint profile, skipping");
+        return;
+    }
+    memset(p, 0, sizeof(struct hint_prof));
+
+    spin_lock(&hint_profs_lock);
+    if (hint_profs_n >= HINT_PROF_MAX_THREADS) {
+        spin_unlock(&hint_profs_lock);
+        log_warn("too many threads for hint profiles, skipping");
+        free(p);
+        return;
+    }
+    hint_profs[hint_profs_n] = p;
+    store_release(&hint_profs_n, hint_profs_n + 1);
+    spin_unlock(&hint_profs_lock);
+
+    hint_prof_ptr = p;
+}
+
+/* merges the sites of a type from all threads, returns the number of sites */
+static int hint_prof_merge(int type, struct hint_site* out,
+    unsigned long* dropped)
+{
+    struct hint_site* site;
+    unsigned long ip;
+    int i, j, k, n, nsites;
+
+    memset(out, 0, MERGED_SITES * sizeof(struct hint_site));
+    *dropped = 0;
+    nsites = 0;
+    n = load_acquire(&hint_profs_n);
+    for (i = 0; i < n; i++) {
+        *dropped += ACCESS_ONCE(hint_profs[i]->dropped[type]);
+        for (j = 0; j < HINT_PROF_MAX_SITES; j++) {
+            site = &hint_profs[i]->sites[type][j];
+            ip = load_acquire(&site->ip);
+            if (!ip)
+                continue;
+
+            /* find its slot in the merged table */
+            k = (ip ^ (ip >> 12)) & (MERGED_SITES - 1);
+            while (out[k].ip && out[k].ip != ip)
+                k = (k + 1) & (MERGED_SITES - 1);
+            if (!out[k].ip) {
+                if (nsites == MERGED_SITES - 1) {
+                    (*dropped)++;
+                    continue;
+                }
+                out[k].ip = ip;
+                nsites++;
+            }
+            out[k].checked += ACCESS_ONCE(site->checked);
+            out[k].missing += ACCESS_ONCE(site->missing);
+            out[k].parked += ACCESS_ONCE(site->parked);
+        }
+    }
+
+    /* compact */
+    for (i = 0, j = 0; i < MERGED_SITES; i++)
+        if (out[i].ip)
+            out[j++] = out[i];
+    assert(j == nsites);
+    return nsites;
+}
+
+static int cmp_site_parked(const void* a, const void* b)
+{
+    const struct hint_site *sa = a, *sb = b;
+    if (sa->parked != sb->parked)
+        return sa->parked < sb->parked ? 1 : -1;
+    return sa->checked < sb->checked ? -1 : sa->checked > sb->checked;
+}
+
+static int cmp_site_checked(const void* a, const void* b)
+{
+    const struct hint_site *sa = a, *sb = b;
+    return sa->checked < sb->checked ? 1 : sa->checked > sb->checked ? -1 : 0;
+}
+
+static void print_ip(FILE* fp, unsigned long ip)
+{
+    if (ip == HPROF_IP_UNKNOWN)
+        fprintf(fp, "unknown");
+    else
+        fprintf(fp, "%lx", ip);
+}
+
+/**
+ * hint_prof_write - writes a report of the hint sites ranked by benefit
+ * (faults taken in userspace instead of the kernel), the hint sites that
+ * never found a fault pending ranked by cost (checks), and the kernel
+ * faulting ips where hints may help. Counters are read while they are being
+ * updated so the report is approximate. Meant for a single stats thread.
+ * Returns 0 if successful.
+ */
+int hint_prof_write(FILE* fp)
+{
+    static struct hint_site sites[MERGED_SITES];
+    unsigned long dropped, total;
+    int i, n, shown;
+
+    /* hint sites by benefit */
+    n = hint_prof_merge(HPROF_HINTS, sites, &dropped);
+    qsort(sites, n, sizeof(struct hint_site), cmp_site_parked);
+    fprintf(fp, "# hint sites by faults caught (%d sites, %lu dropped)\n",
+        n, dropped);
+    fprintf(fp, "ip,checked,missing,parked,missing_pct\n");
+    for (i = 0, shown = 0; i < n && shown < HINT_PROF_TOP_N; i++) {
+        if (!sites[i].missing)
+            continue;
+        print_ip(fp, sites[i].ip);
+        fprintf(fp, ",%lu,%lu,%lu,%.2f\n", sites[i].checked,
+            sites[i].missing, sites[i].parked,
+            100.0 * sites[i].missing / sites[i].checked);
+        shown++;
+    }
+
+    /* useless hint sites */
+    qsort(sites, n, sizeof(struct hint_site), cmp_site_checked);
+    fprintf(fp, "# hint sites that never found a fault pending, by checks\n");
+    fprintf(fp, "ip,checked\n");
+    for (i = 0, shown = 0; i < n && shown < HINT_PROF_TOP_N; i++) {
+        if (sites[i].missing)
+            continue;
+        print_ip(fp, sites[i].ip);
+        fprintf(fp, ",%lu\n", sites[i].checked);
+        shown++;
+    }
+
+    /* un-hinted kernel faults */
+    n = hint_prof_merge(HPROF_KFAULTS, sites, &dropped);
+    qsort(sites, n, sizeof(struct hint_site), cmp_site_checked);
+    total = 0;
+    for (i = 0; i < n; i++)
+        total += sites[i].checked;
+    fprintf(fp, "# kernel faults by ip (%d ips, %lu dropped)\n", n, dropped);
+    fprintf(fp, "ip,faults,pct\n");
+    for (i = 0; i < n && i < HINT_PROF_TOP_N; i++) {
+        print_ip(fp, sites[i].ip);
+        fprintf(fp, ",%lu,%.2f\n", sites[i].checked,
+            100.0 * sites[i].checked / total);
+    }
+    return 0;
+}
+
+/**
+ * hint_prof_dump - writes the latest report to hintprof-<pid>
+ */
+void hint_prof_dump(void)
+{
+    char fname[32];
+    FILE* fp;
+
+    snprintf(fname, sizeof(fname), "hintprof-%d", getpid());
+    fp = fopen(fname, "w");
+    if (!fp) {
+        log_err("couldn't open %s for hint profile", fname);
+        return;
+    }
+    hint_prof_write(fp);
+    fclose(fp);
+}
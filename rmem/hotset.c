@@ -0,0 +1,347 @@
+/*
+ * hotset.c - saving the hot pages and reading them back on a restart
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base/atomic.h"
+#include "base/log.h"
+#include "base/time.h"
+#include "rmem/backend.h"
+#include "rmem/common.h"
+#include "rmem/eviction.h"
+#include "rmem/fault.h"
+#include "rmem/handler.h"
+#include "rmem/hotset.h"
+#include "rmem/page.h"
+#include "rmem/pgnode.h"
+#include "rmem/region.h"
+#include "rmem/stats.h"
+
+/* runs are read back with one fault each */
+#define HOTSET_MAX_RUN      (1 + FAULT_MAX_RDAHEAD_SIZE)
+/* page nodes saved per hold of a page list lock */
+#define HOTSET_SAVE_CHUNK   1024
+
+/* state */
+bool hotset_save_pending = false;
+static struct hotset_run* hotset_runs = NULL;
+static int hotset_nruns = 0;
+static atomic_t hotset_next = ATOMIC_INIT(0);     /* next run to read back */
+static atomic_t hotset_nposted = ATOMIC_INIT(0);  /* handlers done posting */
+static unsigned long* hotset_pages = NULL;
+static size_t hotset_max_pages = 0;
+static DEFINE_SPINLOCK(hotset_save_lock);
+
+/**
+ * hotset_init - reads the saved runs, if there are any and the backend kept
+ * their contents. Must run before the handlers start.
+ */
+int hotset_init(void)
+{
+    struct hotset_run* runs;
+    unsigned long offset;
+    char line[64];
+    int npages, lineno, max, ret;
+    FILE* fp;
+
+    if (!hotset_path[0])
+        return 0;
+
+    fp = fopen(hotset_path, "r");
+    if (!fp) {
+        log_info("no hot set saved at %s yet", hotset_path);
+        return 0;
+    }
+    if (!rmbackend->persistent) {
+        log_info("backend does not keep remote memory across restarts, "
+            "not reading back the hot set");
+        fclose(fp);
+        return 0;
+    }
+
+    ret = 0;
+    max = 0;
+    lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%lx %d", &offset, &npages) != 2
+                || (offset & CHUNK_MASK) || npages <= 0
+                || npages > HOTSET_MAX_RUN) {
+            log_err("%s:%d: expecting \"<hex offset> <npages>\"",
+                hotset_path, lineno);
+            ret = -EINVAL;
+            break;
+        }
+        if (hotset_nruns == max) {
+            max = max ? 2 * max : 1024;
+            runs = realloc(hotset_runs, max * sizeof(struct hotset_run));
+            if (!runs) {
+                ret = -ENOMEM;
+                break;
+            }
+            hotset_runs = runs;
+        }
+        hotset_runs[hotset_nruns].offset = offset;
+        hotset_runs[hotset_nruns].npages = npages;
+        hotset_nruns++;
+    }
+    fclose(fp);
+
+    if (ret) {
+        hotset_destroy();
+        return ret;
+    }
+    log_info("read %d hot page runs from %s", hotset_nruns, hotset_path);
+    return 0;
+}
+
+/**
+ * hotset_replay - reads back the saved runs, hottest first, until they run
+ * out or local memory reaches the eviction threshold. Each handler calls it
+ * before taking faults and they share the runs; the reads complete in the
+ * handler loop.
+ */
+void hotset_replay(int chan_id)
+{
+    struct hotset_run* run;
+    struct region_t* mr;
+    unsigned long addr;
+    long limit;
+    int idx, nevicts_needed;
+    fault_t* f;
+
+    if (!hotset_nruns)
+        return;
+
+    limit = local_memory * eviction_threshold;
+    while ((idx = atomic_fetch_and_add(&hotset_next, 1)) < hotset_nruns) {
+        run = &hotset_runs[idx];
+        if (atomic64_read(&memory_used) + run->npages * CHUNK_SIZE > limit) {
+            /* out of room, the rest stay remote for everyone */
+            atomic_write(&hotset_next, hotset_nruns);
+            break;
+        }
+
+        addr = rmem_va_start + run->offset;
+        mr = get_region_by_addr_safe(addr);
+        if (!mr)
+            continue;
+        if (!is_in_memory_region_unsafe(mr,
+                addr + (run->npages - 1) * CHUNK_SIZE)) {
+            put_mr(mr);
+            continue;
+        }
+
+        f = fault_alloc();
+        if (unlikely(!f)) {
+            log_warn("out of faults, not reading back the rest of hot set");
+            put_mr(mr);
+            break;
+        }
+        memset(f, 0, sizeof(fault_t));
+        f->start_tsc = rdtsc();
+        f->page = addr;
+        f->is_read = true;
+        f->from_kernel = false;
+        f->from_handler = true;
+        f->rdahead_max = run->npages - 1;
+        f->evict_prio = evict_nprio - 1;
+        f->mr = mr;
+
+        /* the backend has these pages from the last run */
+        set_page_flags_range(mr, addr, run->npages * CHUNK_SIZE,
+            PFLAG_REGISTERED);
+
+        /* reads are batched so f is still ours until the flush */
+        if (handle_page_fault(chan_id, f, &nevicts_needed, &hthr_cbs)
+                == FAULT_READ_POSTED)
+            RSTAT(HOTSET_PAGES) += 1 + f->rdahead;
+        else
+            fault_done(f);
+
+        /* keep the faults in flight coming back */
+        rmbackend->check_for_completions(chan_id, &hthr_cbs,
+            RMEM_MAX_COMP_PER_OP, NULL, NULL);
+    }
+
+    fault_read_batch_flush(chan_id, &hthr_cbs);
+    atomic_inc(&hotset_nposted);
+}
+
+/**
+ * hotset_replay_wait - waits for the handlers to read back the hot set
+ */
+void hotset_replay_wait(void)
+{
+    struct hotset_run* run;
+    struct region_t* mr;
+    unsigned long addr, start_tsc;
+    int i, j, nruns;
+
+    if (!hotset_nruns)
+        return;
+
+    start_tsc = rdtsc();
+    while (atomic_read(&hotset_nposted) < nhandlers)
+        cpu_relax();
+
+    /* pages stay locked until their reads are done */
+    nruns = MIN(atomic_read(&hotset_next), hotset_nruns);
+    for (i = 0; i < nruns; i++) {
+        run = &hotset_runs[i];
+        addr = rmem_va_start + run->offset;
+        mr = get_region_by_addr_safe(addr);
+        if (!mr)
+            continue;
+        for (j = 0; j < run->npages; j++) {
+            if (!is_in_memory_region_unsafe(mr, addr + j * CHUNK_SIZE))
+                break;
+            while (get_page_flags(mr, addr + j * CHUNK_SIZE)
+                    & PFLAG_WORK_ONGOING)
+                cpu_relax();
+        }
+        put_mr(mr);
+    }
+
+    log_info("read back the hot set in %lu us, memory used %ld B",
+        (rdtsc() - start_tsc) / cycles_per_us, atomic64_read(&memory_used));
+}
+
+/* adds the pages of a list to the buffer, most recently added first. Takes 
+ * the list lock for HOTSET_SAVE_CHUNK nodes at a time and, after dropping it, 
+ * picks up at the next node only if its page still points to it; otherwise 
+ * the rest of the list is left out. Pages moving between lists meanwhile may 
+ * be saved twice or missed, which only makes the hot set less accurate. */
+static size_t hotset_add_list(struct rmpage_list* l, spinlock_t* lock, 
+    size_t n)
+{
+    rmpage_node_t* node;
+    struct region_t* mr;
+    unsigned long addr;
+    pgidx_t id;
+    int i;
+
+    spin_lock(lock);
+    id = l->tail;
+    while (id != RMPAGE_NODE_NONE && n < hotset_max_pages) {
+        for (i = 0; i < HOTSET_SAVE_CHUNK && id != RMPAGE_NODE_NONE
+                && n < hotset_max_pages; i++) {
+            node = rmpage_get_node_by_id(id);
+            hotset_pages[n++] = rmpage_node_addr(node) - rmem_va_start;
+            id = node->prev;
+        }
+        if (id == RMPAGE_NODE_NONE || n == hotset_max_pages)
+            break;
+
+        /* let eviction in before going on; the region lookup happens 
+         * outside the lock too */
+        addr = rmpage_node_addr(rmpage_get_node_by_id(id));
+        spin_unlock(lock);
+        mr = get_region_by_addr_safe(addr);
+        if (!mr)
+            return n;
+        spin_lock(lock);
+        if (get_index_from_pginfo_unsafe(get_page_info(mr, addr)) != id) {
+            put_mr(mr);
+            break;
+        }
+        put_mr(mr);
+    }
+    spin_unlock(lock);
+    return n;
+}
+
+/**
+ * hotset_save - writes the pages in local memory to rmem_hotset_file,
+ * hottest first. Walks each page list a chunk at a time under its lock.
+ * Returns the number of pages saved.
+ */
+int hotset_save(void)
+{
+    struct page_list* gen;
+    unsigned long lo, hi, page;
+    size_t i, n;
+    int g, gen_now, prio, len, nruns;
+    FILE* fp;
+
+    if (!hotset_path[0])
+        return 0;
+
+    spin_lock(&hotset_save_lock);
+    if (!hotset_pages) {
+        hotset_max_pages = local_memory / CHUNK_SIZE;
+        hotset_pages = malloc(hotset_max_pages * sizeof(unsigned long));
+        if (!hotset_pages) {
+            spin_unlock(&hotset_save_lock);
+            log_err("no memory to save the hot set");
+            return -ENOMEM;
+        }
+    }
+
+    /* the hot class first */
+    n = hotset_add_list(&pinned_pages.pages[0], &pinned_pages.lock, 0);
+
+#ifdef EVICTION_DNE_ON
+    for (prio = 0; prio < evict_nprio; prio++)
+        n = hotset_add_list(&dne_pages.pages[prio], &dne_pages.locks[prio],
+            n);
+#endif
+
+    /* then the generations from the newest, with the pages evicted later
+     * (lower prio) first in each */
+    gen_now = ACCESS_ONCE(evict_gen_now);
+    for (g = evict_ngens - 1; g >= 0; g--) {
+        gen = &evict_gens[(gen_now + g) & evict_gen_mask];
+        for (prio = 0; prio < evict_nprio; prio++)
+            n = hotset_add_list(&gen->pages[prio], &gen->lock, n);
+    }
+
+    fp = fopen(hotset_path, "w");
+    if (!fp) {
+        spin_unlock(&hotset_save_lock);
+        log_err("couldn't open %s for the hot set", hotset_path);
+        return -ENOENT;
+    }
+
+    /* pages of a fault come in together, in either order */
+    fprintf(fp, "# hot set: %lu pages, offsets from the start of remote "
+        "memory\n", n);
+    nruns = 0;
+    for (i = 0; i < n; i += len) {
+        lo = hi = hotset_pages[i];
+        for (len = 1; i + len < n && len < HOTSET_MAX_RUN; len++) {
+            page = hotset_pages[i + len];
+            if (page == hi + CHUNK_SIZE)
+                hi = page;
+            else if (page == lo - CHUNK_SIZE)
+                lo = page;
+            else
+                break;
+        }
+        fprintf(fp, "%lx %d\n", lo, len);
+        nruns++;
+    }
+    fclose(fp);
+    spin_unlock(&hotset_save_lock);
+
+    log_info("saved %lu hot pages (%d runs) to %s", n, nruns, hotset_path);
+    return n;
+}
+
+/**
+ * hotset_destroy - frees the hot set state
+ */
+void hotset_destroy(void)
+{
+    free(hotset_runs);
+    hotset_runs = NULL;
+    hotset_nruns = 0;
+    free(hotset_pages);
+    hotset_pages = NULL;
+}
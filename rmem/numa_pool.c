@@ -0,0 +1,429 @@
+/*
+ * numa_pool.c - object pools partitioned across NUMA nodes
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "base/cpu.h"
+#include "base/log.h"
+#include "base/mem.h"
+#include "rmem/numa_pool.h"
+#include "rmem/stats.h"
+
+/* state */
+int rmem_nnodes = 1;                    /* numa nodes the pools span */
+__thread int rmem_thread_node = 0;      /* local node of current thread */
+
+/* numa node of a pool partition */
+static inline int numa_part_node(int part)
+{
+    return (rmem_nnodes == 1) ? NUMA_NODE : part;
+}
+
+/**
+ * rmem_numa_init - figures out the nodes to spread the pools over. Falls
+ * back to a single partition (on NUMA_NODE) when the cpu topology is not
+ * known (e.g., without Shenango)
+ */
+void rmem_numa_init(void)
+{
+    rmem_nnodes = (numa_count > 1) ? numa_count : 1;
+    assert(rmem_nnodes <= NNUMA);
+    log_info("rmem pools spread over %d numa node(s)", rmem_nnodes);
+}
+
+/**
+ * rmem_numa_init_thread - saves the local node of the current thread. Must
+ * be called after the thread is pinned to its core.
+ */
+void rmem_numa_init_thread(void)
+{
+    int cpu;
+
+    rmem_thread_node = 0;
+    if (rmem_nnodes == 1)
+        return;
+
+    cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= NCPU || cpu_info_tbl[cpu].package >= rmem_nnodes) {
+        log_warn("couldn't find numa node for cpu %d, using node %d",
+            cpu, NUMA_NODE);
+        rmem_thread_node = NUMA_NODE;
+        return;
+    }
+    rmem_thread_node = cpu_info_tbl[cpu].package;
+    log_debug("thread on cpu %d using numa node %d", cpu, rmem_thread_node);
+}
+
+/* checks that the (populated) range actually landed on the node */
+static bool numa_check_placement(void* addr, size_t len, size_t pgsize,
+    int node)
+{
+    void* pages[2];
+    int status[2];
+    long ret;
+
+    pages[0] = addr;
+    pages[1] = addr + len - pgsize;
+    ret = syscall(__NR_move_pages, 0, 2, pages, NULL, status, 0);
+    if (ret) {
+        log_warn("couldn't query numa placement, errno %d", errno);
+        return true;
+    }
+    return status[0] == node && status[1] == node;
+}
+
+/* takes up to nr objects from a partition, returns the number taken */
+static int numa_pool_part_take(struct numa_pool* p, struct numa_pool_part* part,
+    int nr, void **items)
+{
+    int i = 0;
+
+    spin_lock(&part->lock);
+    while (part->nfree && i < nr)
+        items[i++] = part->free[--part->nfree];
+
+    for (; i < nr && part->count < p->nitems_per_part; i++) {
+        /* allocate new */
+        items[i] = p->base + (part->start + part->count) * p->item_size;
+        part->count++;
+    }
+    spin_unlock(&part->lock);
+    return i;
+}
+
+static void numa_pool_tcache_free(struct tcache *tc, int nr, void **items)
+{
+    struct numa_pool_part* part = (struct numa_pool_part*) tc->data;
+    struct numa_pool* p = part->pool;
+    struct numa_pool_part* locked = NULL;
+    int i;
+
+    /* save for reallocation, in the partition they belong to */
+    for (i = 0; i < nr; i++) {
+        assert(numa_pool_is_valid(p, items[i]));
+        part = &p->parts[numa_pool_part_of(p, items[i])];
+        if (part != locked) {
+            if (locked)
+                spin_unlock(&locked->lock);
+            spin_lock(&part->lock);
+            locked = part;
+        }
+        BUG_ON(part->nfree >= part->count);
+        part->free[part->nfree++] = items[i];
+    }
+    if (locked)
+        spin_unlock(&locked->lock);
+}
+
+static int numa_pool_tcache_alloc(struct tcache *tc, int nr, void **items)
+{
+    struct numa_pool_part* part = (struct numa_pool_part*) tc->data;
+    struct numa_pool* p = part->pool;
+    int i, j;
+
+    /* local partition first, then borrow from the others */
+    i = 0;
+    for (j = 0; j < p->nparts && i < nr; j++)
+        i += numa_pool_part_take(p, &p->parts[(part->id + j) % p->nparts],
+            nr - i, &items[i]);
+
+    if (i < nr) {
+        log_err_ratelimited("too many %s, cannot allocate more", p->name);
+        numa_pool_tcache_free(tc, i, items);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+static const struct tcache_ops numa_pool_tcache_ops = {
+    .alloc	= numa_pool_tcache_alloc,
+    .free	= numa_pool_tcache_free,
+};
+
+/**
+ * Magazine depot. The per-thread caches work like tcache's (a loaded and a 
+ * previous magazine) but exchange full magazines through a lock-free stack
+ * in the partition rather than behind a lock shared by all cores. The top 
+ * of the stack carries a counter in its (unused) upper address bits that 
+ * fails the CAS if the top was popped and pushed back in between; reading 
+ * the next link of a magazine that was popped meanwhile is safe as pool 
+ * memory stays mapped.
+ */
+#define DEPOT_TAG_SHIFT     48
+#define DEPOT_PTR_MASK      ((1UL << DEPOT_TAG_SHIFT) - 1)
+
+static inline struct tcache_hdr* depot_ptr(unsigned long top)
+{
+    return (struct tcache_hdr*) (top & DEPOT_PTR_MASK);
+}
+
+/* new top for the depot, with the tag bumped from the old top. The link 
+ * read by depot_pop() may be garbage until its CAS succeeds so it is only 
+ * masked here */
+static inline unsigned long __depot_top(struct tcache_hdr* mag, 
+    unsigned long old)
+{
+    return ((unsigned long) mag & DEPOT_PTR_MASK) | 
+        (((old >> DEPOT_TAG_SHIFT) + 1) << DEPOT_TAG_SHIFT);
+}
+
+static inline unsigned long depot_top(struct tcache_hdr* mag, unsigned long old)
+{
+    assert(((unsigned long) mag & ~DEPOT_PTR_MASK) == 0);
+    return __depot_top(mag, old);
+}
+
+static void depot_push(struct numa_pool_part* part, struct tcache_hdr* mag)
+{
+    unsigned long top;
+    int retries = 0;
+
+    top = atomic_load_explicit(&part->depot, memory_order_relaxed);
+    do {
+        mag->next_mag = depot_ptr(top);
+        if (atomic_compare_exchange_strong_explicit(&part->depot, &top,
+                depot_top(mag, top), memory_order_release, 
+                memory_order_relaxed))
+            break;
+        retries++;
+    } while (true);
+
+    if (unlikely(retries))
+        RSTAT(POOL_DEPOT_RETRIES) += retries;
+}
+
+static struct tcache_hdr* depot_pop(struct numa_pool_part* part)
+{
+    unsigned long top;
+    struct tcache_hdr *mag, *next;
+    int retries = 0;
+
+    top = atomic_load_explicit(&part->depot, memory_order_acquire);
+    while ((mag = depot_ptr(top)) != NULL) {
+        next = ACCESS_ONCE(mag->next_mag);
+        if (atomic_compare_exchange_strong_explicit(&part->depot, &top,
+                __depot_top(next, top), memory_order_acquire, 
+                memory_order_acquire)) {
+            /* the top did not move so the link was good */
+            assert(((unsigned long) next & ~DEPOT_PTR_MASK) == 0);
+            break;
+        }
+        retries++;
+    }
+
+    if (unlikely(retries))
+        RSTAT(POOL_DEPOT_RETRIES) += retries;
+    return mag;
+}
+
+/* carve out a new magazine (partition lock taken here) */
+static struct tcache_hdr* numa_pool_alloc_mag(struct tcache* tc)
+{
+    void* items[TCACHE_MAX_MAG_SIZE];
+    struct tcache_hdr *head, **pos;
+    int i;
+
+    if (numa_pool_tcache_alloc(tc, tc->mag_size, items))
+        return NULL;
+
+    head = (struct tcache_hdr*) items[0];
+    pos = &head->next_item;
+    for (i = 1; i < tc->mag_size; i++) {
+        *pos = (struct tcache_hdr*) items[i];
+        pos = &(*pos)->next_item;
+    }
+    *pos = NULL;
+    atomic64_inc(&tc->mags_allocated);
+    return head;
+}
+
+/**
+ * __numa_pool_alloc - allocation slow path, when the loaded magazine is empty
+ */
+void* __numa_pool_alloc(struct tcache_perthread* ltc)
+{
+    struct numa_pool_part* part = (struct numa_pool_part*) ltc->tc->data;
+    struct numa_pool* p = part->pool;
+    void* item;
+    int i;
+
+    assert(ltc->rounds == 0);
+    assert(ltc->loaded == NULL);
+
+    /* CASE 1: exchange empty loaded mag with full previous mag */
+    if (ltc->previous) {
+        ltc->loaded = ltc->previous;
+        ltc->previous = NULL;
+        goto alloc;
+    }
+
+    /* CASE 2: grab a magazine from the partition's depot */
+    ltc->loaded = depot_pop(part);
+    if (ltc->loaded)
+        goto alloc;
+
+    /* CASE 3: allocate a new magazine */
+    ltc->loaded = numa_pool_alloc_mag(ltc->tc);
+    if (ltc->loaded)
+        goto alloc;
+
+    /* CASE 4: out of objects, take what's left in other depots */
+    for (i = 1; i < p->nparts && !ltc->loaded; i++)
+        ltc->loaded = depot_pop(&p->parts[(part->id + i) % p->nparts]);
+    if (unlikely(!ltc->loaded))
+        return NULL;
+
+alloc:
+    ltc->rounds = ltc->capacity - 1;
+    item = (void*) ltc->loaded;
+    ltc->loaded = ltc->loaded->next_item;
+    return item;
+}
+
+/**
+ * __numa_pool_free - free slow path, when the loaded magazine is full
+ */
+void __numa_pool_free(struct tcache_perthread* ltc, void* item)
+{
+    struct numa_pool_part* part = (struct numa_pool_part*) ltc->tc->data;
+    struct tcache_hdr* hdr = (struct tcache_hdr*) item;
+
+    assert(ltc->rounds == ltc->capacity);
+    assert(ltc->loaded != NULL);
+
+    /* CASE 1: exchange empty previous mag with full loaded mag */
+    if (!ltc->previous) {
+        ltc->previous = ltc->loaded;
+        goto free;
+    }
+
+    /* CASE 2: return a magazine to the partition's depot */
+    depot_push(part, ltc->previous);
+    ltc->previous = ltc->loaded;
+
+free:
+    ltc->rounds = 1;
+    ltc->loaded = hdr;
+    hdr->next_item = NULL;
+}
+
+static size_t gcd(size_t a, size_t b)
+{
+    size_t t;
+    while (b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/**
+ * numa_pool_create - creates a pool of (at least) nitems objects, split
+ * evenly across the nodes. Partitions are sized to a whole number of pages
+ * so that each of them can be bound to its node.
+ * Returns 0 if successful, or -ENOMEM if out of memory.
+ */
+int numa_pool_create(struct numa_pool* p, const char* name, size_t item_size,
+    size_t nitems, unsigned int mag_size, size_t pgsize)
+{
+    struct numa_pool_part* part;
+    size_t unit, part_len;
+    void* reserved;
+    int i, node;
+
+    memset(p, 0, sizeof(*p));
+    p->name = name;
+    p->item_size = item_size;
+    p->nparts = rmem_nnodes;
+    unit = pgsize / gcd(pgsize, item_size);
+    p->nitems_per_part = align_up(div_up(nitems, p->nparts), unit);
+    p->nitems = p->nitems_per_part * p->nparts;
+    part_len = p->nitems_per_part * item_size;
+    assert(part_len % pgsize == 0);
+    p->len = part_len * p->nparts;
+
+    /* reserve a contiguous range (aligned to the page size) */
+    reserved = mmap(NULL, p->len + pgsize, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        log_err("couldn't reserve %lu bytes for %s", p->len, name);
+        return -ENOMEM;
+    }
+    p->base = (void*) align_up((unsigned long) reserved, pgsize);
+    if (p->base > reserved)
+        munmap(reserved, p->base - reserved);
+    if (reserved + pgsize > p->base)
+        munmap(p->base + p->len, reserved + pgsize - p->base);
+
+    for (i = 0; i < p->nparts; i++) {
+        node = numa_part_node(i);
+        part = &p->parts[i];
+
+        /* map partition on its node */
+        if (mem_map_anom(p->base + i * part_len, part_len, pgsize, node)
+                == MAP_FAILED) {
+            log_err("out of %s memory on node %d for %s",
+                pgsize == PGSIZE_4KB ? "" : "huge page", node, name);
+            return -ENOMEM;
+        }
+        if (!numa_check_placement(p->base + i * part_len, part_len, pgsize,
+                node)) {
+            log_err("%s partition not placed on node %d", name, node);
+            return -ENOMEM;
+        }
+
+        /* free object tracker */
+        part->free = mem_map_anom(NULL, p->nitems_per_part * sizeof(void*),
+            pgsize, node);
+        if (part->free == MAP_FAILED) {
+            log_err("out of memory for %s free list on node %d", name, node);
+            return -ENOMEM;
+        }
+
+        spin_lock_init(&part->lock);
+        part->pool = p;
+        part->id = i;
+        part->start = i * p->nitems_per_part;
+        part->count = part->nfree = 0;
+        atomic_init(&part->depot, 0);
+        part->tc = tcache_create(name, &numa_pool_tcache_ops, mag_size,
+            item_size);
+        if (!part->tc)
+            return -ENOMEM;
+        part->tc->data = (unsigned long) part;
+    }
+
+    log_info("inited %s pool - start %p, %lu objects on %d node(s)",
+        name, p->base, p->nitems, p->nparts);
+    return 0;
+}
+
+/**
+ * numa_pool_init_thread - inits per-thread caches for the pool
+ */
+void numa_pool_init_thread(struct numa_pool* p, numa_pool_perthread_t* pts)
+{
+    int i;
+    for (i = 0; i < p->nparts; i++)
+        tcache_init_perthread(p->parts[i].tc, &(*pts)[i]);
+}
+
+/**
+ * numa_pool_destroy - releases pool memory
+ */
+void numa_pool_destroy(struct numa_pool* p)
+{
+    int i;
+    for (i = 0; i < p->nparts; i++)
+        munmap(p->parts[i].free, p->nitems_per_part * sizeof(void*));
+    munmap(p->base, p->len);
+}
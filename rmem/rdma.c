@@ -93,6 +93,43 @@ void do_rdma_op_linked(request_t *reqs, unsigned n_reqs, bool signal_completion)
     }
 }
 
+/* posts a batch of requests on the same QP with a single doorbell; unlike 
+ * do_rdma_op_linked, the requests need not be contiguous and each of them 
+ * gets its own completion */
+void do_rdma_op_batch(request_t **reqs, unsigned n_reqs)
+{
+    struct ibv_send_wr *bad_wr = NULL;
+    static __thread struct ibv_send_wr wrs[RMEM_MAX_POST_BATCH];
+    static __thread struct ibv_sge sges[RMEM_MAX_POST_BATCH];
+    unsigned i;
+
+    assert(n_reqs > 0 && n_reqs <= RMEM_MAX_POST_BATCH);
+    for (i = 0; i < n_reqs; i++) {
+        assert(reqs[i]->conn->qp == reqs[0]->conn->qp);
+        memset(&sges[i], 0, sizeof(sges[i]));
+        sges[i].addr = reqs[i]->local_addr;
+        sges[i].length = reqs[i]->size;
+        sges[i].lkey = reqs[i]->lkey;
+
+        memset(&wrs[i], 0, sizeof(wrs[i]));
+        wrs[i].wr_id = (uintptr_t) reqs[i];
+        wrs[i].opcode =
+                (reqs[i]->mode == M_WRITE) ? IBV_WR_RDMA_WRITE : IBV_WR_RDMA_READ;
+        wrs[i].sg_list = &sges[i];
+        wrs[i].num_sge = 1;
+        wrs[i].send_flags = IBV_SEND_SIGNALED;
+        wrs[i].wr.rdma.remote_addr = reqs[i]->remote_addr;
+        wrs[i].wr.rdma.rkey = reqs[i]->rkey;
+        wrs[i].next = (i + 1 < n_reqs) ? &wrs[i + 1] : NULL;
+    }
+
+    int r = ibv_post_send(reqs[0]->conn->qp, &wrs[0], &bad_wr);
+    if (r != 0) {
+        log_err("ibv_post_send batch of %u errno=%d\n", n_reqs, r);
+        BUG();
+    }
+}
+
 void post_receives(struct connection *conn) {
     struct ibv_recv_wr wr, *bad_wr = NULL;
     struct ibv_sge sge;
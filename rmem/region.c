@@ -6,35 +6,139 @@
 #define _GNU_SOURCE
 #endif
 
+#include <errno.h>
 #include <sys/mman.h>
 
 #include "base/stddef.h"
 #include "rmem/backend.h"
+#include "rmem/common.h"
 #include "rmem/page.h"
 #include "rmem/region.h"
+#include "rmem/stats.h"
 #include "rmem/uffd.h"
 
 /* region data */
 struct region_listhead region_list;
 struct region_t* last_evicted = NULL;
 int nregions = 0;
+struct region_t* region_table[RMEM_MAX_REGIONS] = {NULL};
 DEFINE_SPINLOCK(regions_lock);
 
+/* reserved address space, regions are carved out of it in order */
+unsigned long rmem_va_start = 0;
+unsigned long rmem_va_size = 0;
+static unsigned long rmem_va_next = 0;
+
+/* region growth state */
+atomic_ulong region_grow_req = ATOMIC_VAR_INIT(0);
+bool region_grow_exhausted = false;
+DEFINE_SPINLOCK(region_grow_lock);
+
+/**
+ * region_alloc_page_info_leaf - allocates a page metadata leaf on first use. 
+ * Racing threads may both allocate one but only one of them gets installed.
+ */
+atomic_pginfo_t* region_alloc_page_info_leaf(struct region_t *mr, 
+    unsigned long leaf)
+{
+    atomic_pginfo_t *leafptr, *expected;
+    size_t leaf_size = PAGE_INFO_LEAF_SIZE * sizeof(atomic_pginfo_t);
+
+    assert(leaf < mr->page_info_nleaves);
+    leafptr = (atomic_pginfo_t*) mmap(NULL, leaf_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    BUG_ON(leafptr == MAP_FAILED);
+
+    expected = NULL;
+    if (!__atomic_compare_exchange_n(&mr->page_info[leaf], &expected, leafptr,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* someone else got there first */
+        munmap(leafptr, leaf_size);
+        return expected;
+    }
+    log_debug("allocated page metadata leaf %lu for region %p", leaf, mr);
+    return leafptr;
+}
+
+/**
+ * region_reserve_va - reserves the address space for all regions so that
+ * telling remote memory apart (is_rmem_ptr()) is a range check. Only
+ * reserves it (PROT_NONE, no backing); regions map their part on register.
+ */
+int region_reserve_va(void)
+{
+    void *ptr;
+
+    BUG_ON(rmem_va_size);
+    ptr = mmap(NULL, RMEM_VA_RESERVE_SIZE, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED) {
+        log_err("failed to reserve %lu B of address space", 
+            RMEM_VA_RESERVE_SIZE);
+        return -ENOMEM;
+    }
+    rmem_va_start = (unsigned long) ptr;
+    rmem_va_next = rmem_va_start;
+    store_release(&rmem_va_size, RMEM_VA_RESERVE_SIZE);
+    log_info("reserved address space at %p, size %lu", ptr, 
+        RMEM_VA_RESERVE_SIZE);
+    return 0;
+}
+
+/**
+ * region_release_va - gives the reserved address space back (once all 
+ * regions are gone)
+ */
+void region_release_va(void)
+{
+    unsigned long size = rmem_va_size;
+
+    if (!size)
+        return;
+    BUG_ON(!CIRCLEQ_EMPTY(&region_list));
+    store_release(&rmem_va_size, 0);
+    munmap((void *) rmem_va_start, size);
+    rmem_va_start = rmem_va_next = 0;
+}
+
+/* takes the next part of the reserved address space for a region. Addresses 
+ * are not reused, like for the allocations within regions */
+static unsigned long region_alloc_va(size_t size)
+{
+    unsigned long addr = 0;
+
+    size = align_up(size, PGSIZE_2MB);
+    spin_lock(&regions_lock);
+    if (rmem_va_next + size <= rmem_va_start + rmem_va_size) {
+        addr = rmem_va_next;
+        rmem_va_next += size;
+    }
+    spin_unlock(&regions_lock);
+    return addr;
+}
+
 void deregister_memory_region(struct region_t *mr)
 {
     int r;
-    size_t pginfo_size, npages;
+    size_t i;
 
     log_debug("deregistering region %p", mr);
     if (mr->addr != 0) {
         uffd_unregister(userfault_fd, mr->addr, mr->size);
-        r = munmap((void *)mr->addr, mr->size);
-        if (r < 0) log_warn("munmap failed");
-
-        npages = (mr->size >> CHUNK_SHIFT);
-        pginfo_size = align_up(npages, 8) * sizeof(atomic_pginfo_t);
-        r = munmap(mr->page_info, pginfo_size);
+        /* drop the pages but keep the range reserved */
+        r = (mmap((void *)mr->addr, mr->size, PROT_NONE, MAP_PRIVATE | 
+            MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED);
+        if (r) log_warn("mmap (release) failed");
+    }
+    if (mr->page_info != NULL) {
+        for (i = 0; i < mr->page_info_nleaves; i++)
+            if (mr->page_info[i])
+                munmap(mr->page_info[i], 
+                    PAGE_INFO_LEAF_SIZE * sizeof(atomic_pginfo_t));
+        r = munmap(mr->page_info, 
+            mr->page_info_nleaves * sizeof(atomic_pginfo_t*));
         if (r < 0) log_warn("munmap page_flags failed");
+        mr->page_info = NULL;
     }
     mr->addr = 0;
 }
@@ -42,16 +146,27 @@ void deregister_memory_region(struct region_t *mr)
 int register_memory_region(struct region_t *mr, int writeable)
 {
     void *ptr = NULL;
-    size_t pginfo_size, npages;
-    int r;
+    size_t npages;
+    int r, id;
 
     log_debug("registering region %p", mr);
 
-    /* mmap virt addr space*/
-    int mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    /* page nodes save page offsets in 32 bits */
+    if ((mr->size >> CHUNK_SHIFT) > (1ULL << 32)) {
+        log_err("region too large: %lu bytes", mr->size);
+        goto error;
+    }
+
+    /* mmap virt addr space, out of the reserved range */
+    ptr = (void *) region_alloc_va(mr->size);
+    if (ptr == NULL) {
+        log_err("out of reserved address space for %lu bytes", mr->size);
+        goto error;
+    }
+    int mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
     int prot = PROT_READ;
     if (writeable)  prot |= PROT_WRITE;
-    ptr = mmap(NULL, mr->size, prot, mmap_flags, -1, 0);
+    ptr = mmap(ptr, mr->size, prot, mmap_flags, -1, 0);
     if (ptr == MAP_FAILED) {
         log_err("mmap failed");
         goto error;
@@ -64,23 +179,40 @@ int register_memory_region(struct region_t *mr, int writeable)
     r = uffd_register(userfault_fd, mr->addr, mr->size, writeable);
     if (r < 0) goto error;
 
-    /* initalize metadata */
+    /* initalize metadata directory; leaves are allocated on first use */
     npages = (mr->size >> CHUNK_SHIFT);
-    pginfo_size = align_up(npages, 8) * sizeof(atomic_pginfo_t);
-    mr->page_info = (atomic_pginfo_t*) mmap(NULL, pginfo_size, 
+    mr->page_info_nleaves = div_up(npages, PAGE_INFO_LEAF_SIZE);
+    mr->page_info = (atomic_pginfo_t**) mmap(NULL, 
+        mr->page_info_nleaves * sizeof(atomic_pginfo_t*), 
         PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-    if (mr->page_info == NULL) 
+    if (mr->page_info == MAP_FAILED) {
+        mr->page_info = NULL;
         goto error;
+    }
     mr->ref_cnt = ATOMIC_VAR_INIT(0);
     mr->current_offset = ATOMIC_VAR_INIT(0);
 
     /* add it to the list. TODO: this should be done in rmem.c after adding 
-     * a region */
-    acquire_region_lock();
-    CIRCLEQ_INSERT_HEAD(&region_list, mr, link);
+     * a region. Regions can be added at runtime while others walk the list 
+     * without the lock (NO_DYNAMIC_REGIONS) so this is CIRCLEQ_INSERT_HEAD 
+     * with the final store that publishes the region ordered after the rest */
+    spin_lock(&regions_lock);
+    BUG_ON(nregions >= RMEM_MAX_REGIONS);
+    for (id = 0; id < RMEM_MAX_REGIONS; id++)
+        if (region_table[id] == NULL)
+            break;
+    BUG_ON(id == RMEM_MAX_REGIONS);
+    mr->id = id;
+    store_release(&region_table[id], mr);
+    mr->link.cqe_next = region_list.cqh_first;
+    mr->link.cqe_prev = (void *)&region_list;
+    if (region_list.cqh_last == (void *)&region_list)
+        region_list.cqh_last = mr;
+    else
+        region_list.cqh_first->link.cqe_prev = mr;
+    store_release(&region_list.cqh_first, mr);
     nregions++;
-    BUG_ON(nregions > RMEM_MAX_REGIONS);
-    release_region_lock();
+    spin_unlock(&regions_lock);
     return 0;
 error:
     deregister_memory_region(mr);
@@ -95,6 +227,8 @@ void remove_memory_region(struct region_t *mr) {
     acquire_region_lock();
     CIRCLEQ_REMOVE(&region_list, mr, link);
     nregions--;
+    assert(region_table[mr->id] == mr);
+    region_table[mr->id] = NULL;
     last_evicted = CIRCLEQ_FIRST(&region_list); /* reset */
     release_region_lock();
 
@@ -108,3 +242,72 @@ void remove_memory_region(struct region_t *mr) {
     
     munmap(mr, sizeof(struct region_t));
 }
+
+/**
+ * region_request_growth - asks the handler threads to add backing memory 
+ * for an allocation of (at least) the given size. Cheap enough to be called 
+ * from the allocation path; the actual work happens in region_grow().
+ */
+void region_request_growth(size_t size)
+{
+    unsigned long req;
+
+    if (rmem_grow_slabs == 0 || region_grow_exhausted)
+        return;
+
+    /* keep the largest outstanding request */
+    req = atomic_load_explicit(&region_grow_req, memory_order_relaxed);
+    while (req < size) {
+        if (atomic_compare_exchange_weak(&region_grow_req, &req, size)) {
+            log_debug("requested region growth for size %lu", size);
+            break;
+        }
+    }
+}
+
+/**
+ * region_grow - adds more backing memory (a new region registered with 
+ * userfaultfd) if requested. Meant to be called off the allocation path 
+ * (from handler threads); only one thread does the work at a time.
+ * Returns the number of regions added.
+ */
+int region_grow(void)
+{
+    unsigned long req, nslabs;
+    int nadded;
+
+    if (!spin_try_lock(&region_grow_lock))
+        return 0;
+
+    nadded = 0;
+    req = atomic_exchange(&region_grow_req, 0);
+    if (req == 0)
+        goto out;
+
+    /* out of regions; any waiting allocations will fail */
+    if (load_acquire(&nregions) >= RMEM_MAX_REGIONS) {
+        log_err("cannot add more than %d regions", RMEM_MAX_REGIONS);
+        store_release(&region_grow_exhausted, true);
+        goto out;
+    }
+
+    /* add at least the configured slabs but enough for the request */
+    nslabs = div_up(req, RMEM_SLAB_SIZE);
+    if (nslabs < rmem_grow_slabs)
+        nslabs = rmem_grow_slabs;
+    log_info("adding backing memory - %lu B", nslabs * RMEM_SLAB_SIZE);
+    assert(rmbackend != NULL);
+    nadded = rmbackend->add_memory(NULL, nslabs);
+    if (nadded <= 0) {
+        /* backend cannot give us more; any waiting allocations will fail */
+        log_err("backend failed to add more memory");
+        store_release(&region_grow_exhausted, true);
+        nadded = 0;
+        goto out;
+    }
+    RSTAT(REGIONS_ADDED) += nadded;
+
+out:
+    spin_unlock(&region_grow_lock);
+    return nadded;
+}
@@ -12,14 +12,22 @@
 #include "base/log.h"
 #include "base/mem.h"
 #include "base/realmem.h"
+#include "rmem/alloc_prof.h"
 #include "rmem/api.h"
 #include "rmem/common.h"
 #include "rmem/eviction.h"
+#include "rmem/fault.h"
+#include "rmem/hotset.h"
 #include "rmem/page.h"
 #include "rmem/pgnode.h"
 #include "rmem/region.h"
+#include "rmem/uffd.h"
 #include "runtime/preempt.h"
 
+#ifndef RMEM_STANDALONE
+#include "../runtime/defs.h"
+#endif
+
 /**
  * Internal methods
  */
@@ -27,16 +35,23 @@
 static inline void* __alloc_new(struct region_t *mr, size_t size)
 {
     bool booked = false;
-    unsigned long long offset;
+    unsigned long long offset, grow_thr;
     void *retptr = NULL;
 
     do {
         offset = atomic_load(&mr->current_offset);
-        BUG_ON(offset + size > mr->size);	/* out of memory */
+        if (offset + size > mr->size)
+            return NULL;	/* out of memory */
         booked = atomic_compare_exchange_weak(&mr->current_offset, &offset, 
             offset + size);
     } while(!booked);
 
+    /* ask for more memory in the background if this allocation pushed the 
+     * region over the growth threshold (only one allocation can do that) */
+    grow_thr = mr->size * RMEM_GROW_THRESHOLD;
+    if (unlikely(offset < grow_thr && offset + size >= grow_thr))
+        region_request_growth(size);
+
     /* found */
     log_debug("rmalloc allocation: addr: %llx, end=%llx, length=%ld",
         mr->addr + offset, mr->addr + offset + size, size);
@@ -81,13 +96,15 @@ static inline void __unlock_page_range(struct region_t *mr,
 static inline void __remove_and_unlock_page_range(struct region_t *mr,
     void* start, size_t length, bool unregister)
 {
-    int evicted, i;
+    int evicted, i, j;
     unsigned long offset, page;
     pgflags_t clrflags, flags;
     pgidx_t pgidx;
     pginfo_t pginfo, oldinfo;
     struct rmpage_node *pgnode;
+    struct rmpage_list *pglist, *l;
     unsigned long pressure;
+    bool on_evict_list;
 
     /* unlock all pages while also setting them unregistered and freeing the 
      * page nodes for pages that were locally present (if munmap worked) */
@@ -110,17 +127,54 @@ static inline void __remove_and_unlock_page_range(struct region_t *mr,
         if (!!(flags & PFLAG_PRESENT)) {
             pgidx = get_index_from_pginfo(pginfo);
             pgnode = rmpage_get_node_by_id(pgidx);
-            assert(pgnode->addr == page);
+            assert(rmpage_node_addr(pgnode) == page);
 
             /* remove the node from eviction lists. we need a lock on the 
              * list before removing but can't get the list information from
-             * the node. So I lock all the gens and remove the node without 
-             * using the list_head; this can be costly so just supporting 
-             * for 2 gens that SC_EVICTION, our most common use-case, needs. */
+             * the node. So I lock all the gens and look for the list among 
+             * them, which is only needed if the node is at either end of it;
+             * this can be costly so just supporting for 2 gens that 
+             * SC_EVICTION, our most common use-case, needs. */
             BUG_ON(evict_ngens > 2);
-            for (i = 0; i < evict_ngens; i++) spin_lock(&evict_gens[i].lock);
-            list_del(&pgnode->link);
-            for (i = 0; i < evict_ngens; i++) spin_unlock(&evict_gens[i].lock);
+            on_evict_list = true;
+            if (pgnode->evict_prio == EVICTION_PRIO_PINNED) {
+                /* hot pages are on their own list */
+                spin_lock(&pinned_pages.lock);
+                rmpage_list_del(&pinned_pages.pages[0], pgnode);
+                pinned_pages.npages--;
+                spin_unlock(&pinned_pages.lock);
+                pgnode->evict_prio = 0;
+                on_evict_list = false;
+            } else if (pgnode->evict_prio == EVICTION_PRIO_STREAM) {
+                /* so are stream pages, until they move to the eviction 
+                 * lists (which happens with the stream list locked) */
+                spin_lock(&stream_pages.lock);
+                if (pgnode->evict_prio == EVICTION_PRIO_STREAM) {
+                    rmpage_list_del(&stream_pages.pages[0], pgnode);
+                    stream_pages.npages--;
+                    pgnode->evict_prio = 0;
+                    on_evict_list = false;
+                }
+                spin_unlock(&stream_pages.lock);
+            }
+            if (on_evict_list) {
+                for (i = 0; i < evict_ngens; i++)
+                    spin_lock(&evict_gens[i].lock);
+                pglist = NULL;
+                if (pgnode->prev == RMPAGE_NODE_NONE 
+                        || pgnode->next == RMPAGE_NODE_NONE) {
+                    for (i = 0; i < evict_ngens; i++) {
+                        for (j = 0; j < evict_nprio; j++) {
+                            l = &evict_gens[i].pages[j];
+                            if (l->head == pgidx || l->tail == pgidx)
+                                pglist = l;
+                        }
+                    }
+                }
+                rmpage_list_del(pglist, pgnode);
+                for (i = 0; i < evict_ngens; i++)
+                    spin_unlock(&evict_gens[i].lock);
+            }
 
             /* free the page node */
 #ifndef RMEM_STANDALONE
@@ -137,8 +191,19 @@ static inline void __remove_and_unlock_page_range(struct region_t *mr,
 
             evicted++;
             clrflags |= (PFLAG_PRESENT | PFLAG_DIRTY);
+#ifdef ALLOC_PROFILER
+            alloc_prof_count(mr, page, APROF_RESIDENT, -1);
+#endif
         }
 
+#ifdef ALLOC_PROFILER
+        /* unmapped pages no longer belong to their allocation site */
+        if (unregister && get_site_from_pginfo(pginfo)) {
+            alloc_prof_count(mr, page, APROF_PAGES, -1);
+            set_page_site(mr, page, 0);
+        }
+#endif
+
         /* unlock the page */
         __clear_page_info(mr, page, clrflags, true, true, &oldinfo);
         log_debug("unlocked page for unmap %lx", page);
@@ -171,20 +236,51 @@ void *rmalloc(size_t size)
     size = align_up(size, CHUNK_SIZE);
 
     /* find available region and atomically grab memory */
-    mr = get_available_region(size);
-    if (mr == NULL) {
-        log_err("ERROR! out of remote memory for alloc; add more");
-        BUG();
-    }
-
-    retptr = __alloc_new(mr, size);
+    do {
+        mr = get_available_region(size);
+        if (unlikely(mr == NULL)) {
+            /* all regions are full; wait for a handler to add more */
+            if (rmem_grow_slabs == 0 || load_acquire(&region_grow_exhausted)) {
+                log_err("ERROR! out of remote memory for alloc; add more");
+                BUG();
+            }
+            region_request_growth(size);
+            cpu_relax();
+            continue;
+        }
 
-    put_mr(mr);
+        /* may lose the race for the last bit of memory in the region */
+        retptr = __alloc_new(mr, size);
+        put_mr(mr);
+    } while (retptr == NULL);
 OUT:
     log_debug("rmalloc done, ptr %p", retptr);
     return retptr;
 }
 
+/**
+ * rmalloc_class - like rmalloc, but the pages are of the given memory class,
+ * which decides how eviction treats them (see RMEM_CLASS_*)
+ */
+void *rmalloc_class(size_t size, int memclass)
+{
+    struct region_t *mr;
+    void* retptr;
+
+    assert(memclass >= 0 && memclass < RMEM_CLASS_NR);
+    retptr = rmalloc(size);
+    if (retptr == NULL || memclass == RMEM_CLASS_DEFAULT)
+        return retptr;
+
+    log_debug("rmalloc for class %d at %p", memclass, retptr);
+    mr = get_region_by_addr_safe((unsigned long) retptr);
+    BUG_ON(!mr);
+    set_page_class_range(mr, (unsigned long) retptr, 
+        align_up(size, CHUNK_SIZE), memclass);
+    put_mr(mr);
+    return retptr;
+}
+
 /**
  * Support for realloc
  */
@@ -194,6 +290,7 @@ void *rmrealloc(void *ptr, size_t size, size_t oldsize)
     struct region_t *mr;
     unsigned long long ptr_offset, offset;
     bool resized;
+    int memclass;
 
     if (ptr == NULL || oldsize <= 0)
         return rmalloc(size);
@@ -222,13 +319,15 @@ void *rmrealloc(void *ptr, size_t size, size_t oldsize)
         goto OUT_MR;
     }
 
+    /* new pages keep the memory class */
+    memclass = get_class_from_pginfo(get_page_info(mr, (unsigned long) ptr));
+
     /* try resizing in-place */
     offset = atomic_load_explicit(&mr->current_offset, memory_order_acquire);
     ptr_offset = (unsigned long)ptr - mr->addr;
     resized = false;
-    if (offset == ptr_offset + oldsize) {
+    if (offset == ptr_offset + oldsize && ptr_offset + size <= mr->size) {
         /* can resize in place */
-        BUG_ON(ptr_offset + size > mr->size);	/* out of memory */
         resized = atomic_compare_exchange_strong(&mr->current_offset,
             &offset, ptr_offset + size);
     }
@@ -237,11 +336,19 @@ void *rmrealloc(void *ptr, size_t size, size_t oldsize)
         /* resized in place */
         retptr = ptr;
         atomic64_add_and_fetch(&memory_allocd, (size - oldsize));
+        if (memclass != RMEM_CLASS_DEFAULT)
+            set_page_class_range(mr, (unsigned long) ptr + oldsize, 
+                size - oldsize, memclass);
         goto OUT_MR;
     }
     else {
         /* cannot resize in-place, alloc new space and move */
         retptr = __alloc_new(mr, size);
+        if (retptr != NULL && memclass != RMEM_CLASS_DEFAULT)
+            set_page_class_range(mr, (unsigned long) retptr, size, memclass);
+        if (retptr == NULL)
+            /* region is full, move to another one */
+            retptr = rmalloc_class(size, memclass);
         assert(retptr);
         memmove(retptr, ptr, oldsize);
 
@@ -320,7 +427,8 @@ int rmadvise(void *addr, size_t length, int advice)
         goto OUT;
 
     /* we don't know how to deal with other advices yet */
-    if (advice != MADV_FREE && advice != MADV_DONTNEED) {
+    if (advice != MADV_FREE && advice != MADV_DONTNEED && 
+            advice != MADV_SEQUENTIAL && advice != MADV_NORMAL) {
         log_warn("rmadvise: advice %d not supported", advice);
         goto OUT;
     }
@@ -336,6 +444,16 @@ int rmadvise(void *addr, size_t length, int advice)
     max_addr = mr->addr + atomic_load(&mr->current_offset);
     BUG_ON((unsigned long) addr + length > max_addr);
 
+    /* access pattern advice just sets the memory class: MADV_SEQUENTIAL 
+     * makes the pages stream pages (see RMEM_CLASS_STREAM) from their next 
+     * fault on, MADV_NORMAL puts them back in the default class */
+    if (advice == MADV_SEQUENTIAL || advice == MADV_NORMAL) {
+        set_page_class_range(mr, (unsigned long) addr, length, 
+            advice == MADV_SEQUENTIAL ? RMEM_CLASS_STREAM : RMEM_CLASS_DEFAULT);
+        put_mr(mr);
+        goto OUT;
+    }
+
     /* lock pages */
     __lock_page_range(mr, addr, length);
 
@@ -354,6 +472,162 @@ OUT:
     return ret;
 }
 
+/* locks up to max pages from start that were never mapped, stopping at the 
+ * first page that was or that someone else is working on; returns how many */
+static inline int __lock_unmapped_pages(struct region_t *mr, 
+    unsigned long start, int max)
+{
+    pgflags_t flags, oldflags;
+    unsigned long page;
+    int n;
+
+    for (n = 0; n < max; n++) {
+        page = start + n * CHUNK_SIZE;
+        if (get_page_flags(mr, page) & PFLAG_REGISTERED)
+            break;
+        flags = set_page_flags(mr, page, PFLAG_WORK_ONGOING, &oldflags);
+        if (oldflags & PFLAG_WORK_ONGOING)
+            break;
+        if (flags & PFLAG_REGISTERED) {
+            /* faulted in just before we locked */
+            clear_page_flags(mr, page, PFLAG_WORK_ONGOING, &oldflags);
+            break;
+        }
+    }
+    return n;
+}
+
+/* maps zero pages on a locked range of never-mapped pages */
+static inline void __populate_locked_pages(struct region_t *mr, 
+    unsigned long start, int npages, bool write)
+{
+    unsigned long addr, end, len;
+    unsigned long long pressure;
+    int nretries, ret;
+
+    end = start + npages * CHUNK_SIZE;
+    if (write && zero_page) {
+        /* copy zeros now so the writes to come don't fault again */
+        for (addr = start; addr < end; addr += len) {
+            len = MIN(end - addr, CHUNK_SIZE * RMEM_MAX_CHUNKS_PER_OP);
+            ret = uffd_copy(userfault_fd, addr, (unsigned long) zero_page, 
+                len, false, true, true, &nretries);
+            assertz(ret);
+        }
+    } else {
+        /* the shared zero page, in one go; writes to it later take a minor 
+         * fault in the kernel that we don't see, so the pages count as 
+         * dirty from the start */
+        ret = uffd_zero(userfault_fd, start, end - start, true, true, 
+            &nretries);
+        assertz(ret);
+    }
+
+    ret = set_page_flags_range(mr, start, end - start, PFLAG_REGISTERED | 
+        PFLAG_PRESENT | PFLAG_PRESENT_ZERO_PAGED | PFLAG_DIRTY);
+    assert(ret == npages);
+#ifdef ALLOC_PROFILER
+    alloc_prof_count_range(mr, start, end - start, APROF_RESIDENT, 1);
+#endif
+    alloc_page_nodes(mr, start, npages, 0);
+
+    pressure = atomic64_add_and_fetch(&memory_used, end - start);
+    if (pressure > atomic64_read(&max_memory_used))
+        atomic64_write(&max_memory_used, pressure);
+}
+
+/**
+ * rmpopulate - maps the pages of a fresh allocation ahead of their first 
+ * access, many at a time, instead of taking a zero-page fault for each of 
+ * them. Pages that were already mapped (or are being faulted in) are left 
+ * alone. Makes room before going over the eviction threshold, evicting on 
+ * this kthread (or, without shenango, waiting for the handlers to), so 
+ * ranges larger than local memory are fine. If write is set, the pages get 
+ * their own zero-filled memory right away (for data about to be loaded); 
+ * otherwise they map the shared zero page until written.
+ * Returns the number of pages mapped, or -EINVAL if the range is not in 
+ * remote memory or runs past the end of its region.
+ */
+int rmpopulate(void *addr, size_t length, bool write)
+{
+    struct region_t *mr;
+    unsigned long page, end, max_addr;
+    long limit, room;
+    int n, max, total = 0;
+
+    assert_preempt_disabled();
+
+    log_debug("rmpopulate at %p size %ld write %d", addr, length, write);
+    if (!addr || !length)
+        return 0;
+
+    /* find associated region */
+    mr = get_region_by_addr_safe((unsigned long) addr);
+    if (mr == NULL) {
+        log_warn("rmpopulate: cannot find the region with ptr");
+        return -EINVAL;
+    }
+
+    max_addr = mr->addr + atomic_load(&mr->current_offset);
+    page = ((unsigned long) addr) & ~CHUNK_MASK;
+    end = align_up((unsigned long) addr + length, CHUNK_SIZE);
+    if (end > max_addr) {
+        log_warn("rmpopulate: range at %p runs past its region", addr);
+        put_mr(mr);
+        return -EINVAL;
+    }
+
+    limit = local_memory * eviction_threshold;
+    while (page < end) {
+        /* evict behind: once over the eviction threshold, make room before 
+         * adding more, like a fault would */
+        while ((room = limit - atomic64_read(&memory_used)) < 0) {
+#ifndef RMEM_STANDALONE
+            do_eviction(myk()->bkend_chan_id, &kthr_owner_cbs, 
+                evict_batch_size);
+#else
+            /* the handlers evict over the threshold */
+            usleep(10);
+#endif
+        }
+
+        /* and add what fits under it, at least a page */
+        max = MIN((end - page) / CHUNK_SIZE, RMEM_POPULATE_CHUNKS);
+        max = MIN(max, MAX(room / CHUNK_SIZE, 1));
+
+        n = __lock_unmapped_pages(mr, page, max);
+        if (n == 0) {
+            page += CHUNK_SIZE;
+            continue;
+        }
+        __populate_locked_pages(mr, page, n, write);
+        __unlock_page_range(mr, (void *) page, n * CHUNK_SIZE);
+        page += n * CHUNK_SIZE;
+        total += n;
+    }
+
+    put_mr(mr);
+    log_debug("rmpopulate done at %p, %d pages", addr, total);
+    return total;
+}
+
+/**
+ * rmcheckpoint - has a handler save the pages in local memory (the hot set)
+ * to rmem_hotset_file, for a restart to read them back; they are also saved
+ * on a clean shutdown. Returns without waiting for the save, or -1 if no
+ * rmem_hotset_file is set.
+ */
+int rmcheckpoint(void)
+{
+    assert_preempt_disabled();
+
+    log_debug("rmcheckpoint");
+    if (!hotset_path[0])
+        return -1;
+    store_release(&hotset_save_pending, true);
+    return 0;
+}
+
 /*** Unsupported (but potentially required or useful) functions ***/
 
 /**
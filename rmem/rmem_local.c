@@ -197,6 +197,8 @@ int local_post_read(int chan_id, fault_t* f)
     if (load_acquire(&chan->read_reqs[req_id].busy))
         /* all slots busy, try again */
         return EAGAIN;
+    if (!bkend_credit_take(chan_id, false))
+        return EAGAIN;
 
     /* infer remote addr */
     offset = f->page - f->mr->addr;
@@ -207,7 +209,6 @@ int local_post_read(int chan_id, fault_t* f)
     /* alloc data buf */
     local_addr = bkend_buf_alloc();
     BUG_ON(local_addr == NULL);     /* not enough bufs */
-    f->bkend_buf = local_addr;
     assert(size <= BACKEND_BUF_SIZE);
 
     /* take this slot */
@@ -280,6 +281,8 @@ int local_post_write(int chan_id, struct region_t* mr, unsigned long addr,
     if (load_acquire(&chan->write_reqs[req_id].busy))
         /* all slots busy, try again */
         return EAGAIN;
+    if (!bkend_credit_take(chan_id, true))
+        return EAGAIN;
 
     /* infer remote addr */
     offset = addr - mr->addr;
@@ -350,6 +353,29 @@ int local_post_write(int chan_id, struct region_t* mr, unsigned long addr,
     return 0;
 }
 
+/* post a batch of reads on a channel. there is no submission cost to 
+ * amortize for the local backend so we just post them one by one */
+int local_post_read_batch(int chan_id, fault_t** faults, int nfaults)
+{
+    int i;
+    for (i = 0; i < nfaults; i++)
+        if (local_post_read(chan_id, faults[i]) == EAGAIN)
+            break;
+    return i;
+}
+
+/* post a batch of writes on a channel */
+int local_post_write_batch(int chan_id, struct bkend_write_range* ranges, 
+    int nranges)
+{
+    int i;
+    for (i = 0; i < nranges; i++)
+        if (local_post_write(chan_id, ranges[i].mr, ranges[i].addr, 
+                ranges[i].size) == EAGAIN)
+            break;
+    return i;
+}
+
 /* backend check for read & write completions on a channel */
 int local_check_cq(int chan_id, struct bkend_completion_cbs* cbs, int max_cqe, 
     int* nread, int* nwrite)
@@ -357,11 +383,11 @@ int local_check_cq(int chan_id, struct bkend_completion_cbs* cbs, int max_cqe,
     struct local_request* req;
     struct local_completion *cq;
     struct local_channel* chan;
-    int ncqe, r, i, cq_id, req_id;
+    int ncqe, nlost, r, i, cq_id, req_id;
     spinlock_t* cq_lock;
     unsigned long long duration_tsc;
     
-    ncqe = 0;
+    ncqe = nlost = 0;
     if(nread)   *nread = 0;
     if(nwrite)  *nwrite = 0;
     assert(max_cqe > 0 && max_cqe <= RMEM_MAX_COMP_PER_OP);
@@ -415,18 +441,23 @@ int local_check_cq(int chan_id, struct bkend_completion_cbs* cbs, int max_cqe,
             assert(req_id < MAX_R_REQS_PER_CHAN);
             req = &(channels[chan_id]->read_reqs[req_id]);
             assert(req->busy);
-            assert(req->fault && req->fault->bkend_buf);
+            assert(req->fault);
             assert(req->size == (1 + req->fault->rdahead) * CHUNK_SIZE);
             log_debug("%s - RDMA READ done, qid: %d", FSTR(req->fault), req_id);
-           
-            /* call completion hook */
-            r = cbs->read_completion(req->fault);
-            assertz(r);
+
+            /* call completion hook, unless a duplicate read beat us to it */
+            if (fault_read_claim(req->fault, (void*)req->local_addr)) {
+                r = cbs->read_completion(req->fault);
+                assertz(r);
+                if (nread)  (*nread)++;
+            }
+            else
+                nlost++;
 
             /* release request slot */
+            bkend_credit_return(chan_id, false, wc[i].posted_tsc);
             store_release(&req->busy, 0);
             RSTAT(NET_READ)++;
-            if (nread)  (*nread)++;
         }
         else {
             /* handle write completion */
@@ -446,13 +477,14 @@ int local_check_cq(int chan_id, struct bkend_completion_cbs* cbs, int max_cqe,
             bkend_buf_free((void*)req->local_addr);
 
             /* release request slot */
+            bkend_credit_return(chan_id, true, wc[i].posted_tsc);
             store_release(&req->busy, 0);
             RSTAT(NET_WRITE)++;
             if (nwrite)  (*nwrite)++;
         }
     }
 
-    assert(!(nread && nwrite) || (*nread + *nwrite == ncqe));
+    assert(!(nread && nwrite) || (*nread + *nwrite + nlost == ncqe));
     return ncqe;
 }
 
@@ -465,5 +497,7 @@ struct rmem_backend_ops local_backend_ops = {
     .remove_region = local_free_region,
     .post_read = local_post_read,
     .post_write = local_post_write,
+    .post_read_batch = local_post_read_batch,
+    .post_write_batch = local_post_write_batch,
     .check_for_completions = local_check_cq,
 };
\ No newline at end of file
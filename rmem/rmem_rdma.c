@@ -615,6 +615,13 @@ int rdma_add_regions(struct region_t **reg, int nslabs) {
      * but just importing code from kona for now - we only support one 
      * region with single MSG_SLAB_ADD_PARTIAL response. We also don't return 
      * the regions but directly add them to regions_list */
+    if (load_acquire(&nregions) > 0) {
+        /* servers and regions are still one-to-one (see on_recv_done_slab_add)
+         * so we cannot add more regions after startup */
+        log_err("rdma backend does not support adding more regions");
+        return 0;
+    }
+
     struct region_t *region = (struct region_t *)mmap(
         NULL, sizeof(struct region_t), PROT_READ | PROT_WRITE,
         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
@@ -630,27 +637,24 @@ int rdma_free_region(struct region_t *reg) {
     return 0;
 }
 
-/* post read on a channel */
-int rdma_post_read(int chan_id, fault_t* f) 
+/* take a read slot (and a credit) on the connection and prepare the request
+ * for the fault. returns NULL if all slots are busy */
+static request_t* rdma_prep_read(int chan_id, struct connection* conn, 
+    fault_t* f)
 {
-    struct connection *conn;
     unsigned long remote_addr, offset;
     void* local_addr;
     size_t size;
     int req_id;
-    
-    /* get connection */
-    log_debug("%s - posting read", FSTR(f));
-    assert(chan_id >= 0 && chan_id < nchans_bkend);
-    conn = &(f->mr->server->dp[chan_id]);
-    assert(conn->datapath);
 
     /* do we have a free slot? */
     req_id = conn->read_req_idx;
     assert(req_id >= 0 && req_id < MAX_R_REQS_PER_CONN_CHAN);
     if (load_acquire(&conn->read_reqs[req_id].busy))
         /* all slots busy, try again later */
-        return EAGAIN;
+        return NULL;
+    if (!bkend_credit_take(chan_id, false))
+        return NULL;
 
     /* infer remote addr */
     offset = f->page - f->mr->addr;
@@ -661,7 +665,6 @@ int rdma_post_read(int chan_id, fault_t* f)
     /* alloc data buf */
     local_addr = bkend_buf_alloc();
     BUG_ON(local_addr == NULL);     /* not enough bufs */
-    f->bkend_buf = local_addr;
     assert(size <= BACKEND_BUF_SIZE);
 
     /* take this slot */
@@ -677,11 +680,9 @@ int rdma_post_read(int chan_id, fault_t* f)
     conn->read_reqs[req_id].mode = M_READ;
     conn->read_reqs[req_id].conn = conn;
     conn->read_reqs[req_id].fault = f;
-
-    /* post read */
+    conn->read_reqs[req_id].posted_tsc = rdtsc();
     log_debug("%s - READ remote_addr %lx into local_addr %p, size %lu", FSTR(f), 
         remote_addr, local_addr, size);
-    do_rdma_op(&conn->read_reqs[req_id], true);
 
     /* increment req_id */
     conn->read_req_idx++;
@@ -689,30 +690,27 @@ int rdma_post_read(int chan_id, fault_t* f)
     if (conn->read_req_idx >= MAX_R_REQS_PER_CONN_CHAN) 
         conn->read_req_idx = 0;
 
-    /* success */
-    return 0;
+    return &conn->read_reqs[req_id];
 }
 
-/* post write on a channel */
-int rdma_post_write(int chan_id, struct region_t* mr, unsigned long addr, 
-    size_t size) 
+/* take a write slot (and a credit) on the connection, copy the pages into a
+ * registered buffer and prepare the request. returns NULL if all slots are 
+ * busy */
+static request_t* rdma_prep_write(int chan_id, struct connection* conn, 
+    struct region_t* mr, unsigned long addr, size_t size)
 {
-    struct connection *conn;
     unsigned long remote_addr, offset;
     void* local_addr;
     int req_id;
-    
-    /* get connection */
-    assert(chan_id >= 0 && chan_id < nchans_bkend);
-    conn = &(mr->server->dp[chan_id]);
-    assert(conn->datapath);
 
     /* do we have a free slot? */
     req_id = conn->write_req_idx;
     assert(req_id >= 0 && req_id < MAX_W_REQS_PER_CONN_CHAN);
     if (load_acquire(&conn->write_reqs[req_id].busy))
         /* all slots busy, try again */
-        return EAGAIN;
+        return NULL;
+    if (!bkend_credit_take(chan_id, true))
+        return NULL;
 
     /* infer remote addr */
     offset = addr - mr->addr;
@@ -736,15 +734,12 @@ int rdma_post_write(int chan_id, struct region_t* mr, unsigned long addr,
     conn->write_reqs[req_id].size = size;
     conn->write_reqs[req_id].mode = M_WRITE;
     conn->write_reqs[req_id].conn = conn;
+    conn->write_reqs[req_id].posted_tsc = rdtsc();
 
     /* copy page into rdma-registered local buf */
-    assert(size <= BACKEND_BUF_SIZE);
     memcpy(local_addr, (void *)addr, size);
-
-    /* post write */
     log_debug("WRITE remote_addr %lx from local_addr %p, size %lu", 
         remote_addr, local_addr, size);
-    do_rdma_op(&conn->write_reqs[req_id], true);
 
     /* increment req_id */
     conn->write_req_idx++;
@@ -752,19 +747,129 @@ int rdma_post_write(int chan_id, struct region_t* mr, unsigned long addr,
     if (conn->write_req_idx >= MAX_W_REQS_PER_CONN_CHAN) 
         conn->write_req_idx = 0;
 
-    /* success */
+    return &conn->write_reqs[req_id];
+}
+
+/* post read on a channel */
+int rdma_post_read(int chan_id, fault_t* f) 
+{
+    struct connection *conn;
+    request_t* req;
+    
+    /* get connection */
+    log_debug("%s - posting read", FSTR(f));
+    assert(chan_id >= 0 && chan_id < nchans_bkend);
+    conn = &(f->mr->server->dp[chan_id]);
+    assert(conn->datapath);
+
+    req = rdma_prep_read(chan_id, conn, f);
+    if (!req)
+        return EAGAIN;
+
+    /* post read */
+    do_rdma_op(req, true);
+    return 0;
+}
+
+/* post write on a channel */
+int rdma_post_write(int chan_id, struct region_t* mr, unsigned long addr, 
+    size_t size) 
+{
+    struct connection *conn;
+    request_t* req;
+    
+    /* get connection */
+    assert(chan_id >= 0 && chan_id < nchans_bkend);
+    conn = &(mr->server->dp[chan_id]);
+    assert(conn->datapath);
+
+    req = rdma_prep_write(chan_id, conn, mr, addr, size);
+    if (!req)
+        return EAGAIN;
+
+    /* post write */
+    do_rdma_op(req, true);
     return 0;
 }
 
+/* post a batch of reads on a channel, chaining the work requests that go to 
+ * the same connection so they are submitted with a single doorbell */
+int rdma_post_read_batch(int chan_id, fault_t** faults, int nfaults)
+{
+    struct connection *conn, *batch_conn;
+    request_t* batch[RMEM_MAX_POST_BATCH];
+    request_t* req;
+    int i, n;
+
+    assert(chan_id >= 0 && chan_id < nchans_bkend);
+    n = 0;
+    batch_conn = NULL;
+    for (i = 0; i < nfaults; i++) {
+        conn = &(faults[i]->mr->server->dp[chan_id]);
+        assert(conn->datapath);
+
+        /* submit what we have if switching connections or full */
+        if (n > 0 && (conn != batch_conn || n == RMEM_MAX_POST_BATCH)) {
+            do_rdma_op_batch(batch, n);
+            n = 0;
+        }
+
+        log_debug("%s - posting read in batch", FSTR(faults[i]));
+        req = rdma_prep_read(chan_id, conn, faults[i]);
+        if (!req)
+            break;
+        batch[n++] = req;
+        batch_conn = conn;
+    }
+    if (n > 0)
+        do_rdma_op_batch(batch, n);
+    return i;
+}
+
+/* post a batch of writes on a channel, see rdma_post_read_batch() */
+int rdma_post_write_batch(int chan_id, struct bkend_write_range* ranges, 
+    int nranges)
+{
+    struct connection *conn, *batch_conn;
+    request_t* batch[RMEM_MAX_POST_BATCH];
+    request_t* req;
+    int i, n;
+
+    assert(chan_id >= 0 && chan_id < nchans_bkend);
+    n = 0;
+    batch_conn = NULL;
+    for (i = 0; i < nranges; i++) {
+        conn = &(ranges[i].mr->server->dp[chan_id]);
+        assert(conn->datapath);
+
+        /* submit what we have if switching connections or full */
+        if (n > 0 && (conn != batch_conn || n == RMEM_MAX_POST_BATCH)) {
+            do_rdma_op_batch(batch, n);
+            n = 0;
+        }
+
+        req = rdma_prep_write(chan_id, conn, ranges[i].mr, ranges[i].addr, 
+            ranges[i].size);
+        if (!req)
+            break;
+        batch[n++] = req;
+        batch_conn = conn;
+    }
+    if (n > 0)
+        do_rdma_op_batch(batch, n);
+    return i;
+}
+
 /* backend check for read & write completions on a channel */
 int rdma_check_cq(int chan_id, struct bkend_completion_cbs* cbs, int max_cqe, 
     int* nread, int* nwrite)
 {
     struct request* req;
     struct ibv_cq *cq;
-    int ncqe, r, i;
+    int ncqe, nlost, r, i;
     enum ibv_wc_opcode opcode;
     
+    nlost = 0;
     assert(max_cqe > 0 && max_cqe <= RMEM_MAX_COMP_PER_OP);
     assert(chan_id >= 0 && chan_id < nchans_bkend);
     if(nread)   *nread = 0;
@@ -794,19 +899,24 @@ int rdma_check_cq(int chan_id, struct bkend_completion_cbs* cbs, int max_cqe,
         else if (opcode == IBV_WC_RDMA_READ) {
             /* handle read completion */
             req = (struct request*)(uintptr_t) wc[i].wr_id;
-            assert(req && req->fault && req->fault->bkend_buf);
+            assert(req && req->fault);
             assert(req->busy);
             assert(req->size == (1 + req->fault->rdahead) * CHUNK_SIZE);
             log_debug("%s - RDMA READ completed successfully", FSTR(req->fault));
-           
-            /* call completion hook */
-            r = cbs->read_completion(req->fault);
-            assertz(r);
+
+            /* call completion hook, unless a duplicate read beat us to it */
+            if (fault_read_claim(req->fault, (void*)req->local_addr)) {
+                r = cbs->read_completion(req->fault);
+                assertz(r);
+                if (nread)  (*nread)++;
+            }
+            else
+                nlost++;
 
             /* release request slot */
+            bkend_credit_return(chan_id, false, req->posted_tsc);
             store_release(&req->busy, 0);
             RSTAT(NET_READ)++;
-            if (nread)  (*nread)++;
         }
         else {
             /* handle write completion */
@@ -827,13 +937,14 @@ int rdma_check_cq(int chan_id, struct bkend_completion_cbs* cbs, int max_cqe,
             bkend_buf_free((void*)req->local_addr);
 
             /* release request slot */
+            bkend_credit_return(chan_id, true, req->posted_tsc);
             store_release(&req->busy, 0);
             RSTAT(NET_WRITE)++;
             if (nwrite)  (*nwrite)++;
         }
     }
 
-    assert(!(nread && nwrite) || (*nread + *nwrite == ncqe));
+    assert(!(nread && nwrite) || (*nread + *nwrite + nlost == ncqe));
     return ncqe;
 }
 
@@ -846,5 +957,7 @@ struct rmem_backend_ops rdma_backend_ops = {
     .remove_region = rdma_free_region,
     .post_read = rdma_post_read,
     .post_write = rdma_post_write,
+    .post_read_batch = rdma_post_read_batch,
+    .post_write_batch = rdma_post_write_batch,
     .check_for_completions = rdma_check_cq,
 };
\ No newline at end of file
@@ -14,12 +14,14 @@ const char *rstat_names[] = {
     "faults_wp",
     "faults_zp",
 	"faults_p0",
+    "faults_pinned",
     "faults_done",
     "wp_upgrades",
     "uffd_notif",
     "uffd_retries",
     "rdahead_ops",
     "rdahead_pages",
+    "hotset_pages",
 
     /* eviction stats */
     "evict_ops",
@@ -31,10 +33,14 @@ const char *rstat_names[] = {
     "evict_madv",
     "evict_ops_done",
     "evict_pages_done",
+    "evict_stream_pages",
 
     /* network read/writes */
     "net_reads",
     "net_writes",
+    "hedged_reads",
+    "hedge_wins",
+    "net_no_credits",
 
     /* work stealing */
     "steals_ready",
@@ -45,6 +51,8 @@ const char *rstat_names[] = {
     "rmalloc_size",
     "rmunmap_size",
     "rmadv_size",
+    "regions_added",
+    "pool_depot_retries",
 
     /* time accounting */
     "total_cycles",		/* only valid for handler cores */
@@ -178,6 +178,20 @@ static int parse_watchdog_flag(const char *name, const char *val)
 	return 0;
 }
 
+static int parse_stats_shm_interval(const char *name, const char *val)
+{
+	long tmp;
+	int ret;
+
+	ret = str_to_long(val, &tmp);
+	if (ret || tmp < 0 || tmp > UINT_MAX) {
+		log_err("Expecting 0 (off) or an interval in us for %s", name);
+		return -EINVAL;
+	}
+	stat_shm_interval_us = tmp;
+	return 0;
+}
+
 static int parse_remote_memory_flag(const char *name, const char *val)
 {
 	long tmp;
@@ -235,6 +249,86 @@ static int parse_rmem_local_memory_flag(const char *name, const char *val)
 	return 0;
 }
 
+static int parse_rmem_hot_memory_flag(const char *name, const char *val)
+{
+	int ret;
+	long tmp;
+
+	ret = str_to_long(val, &tmp);
+	if (ret || tmp <= 0) {
+		log_err("Expecting a positive number for %s", name);
+		return -EINVAL;
+	}
+
+	rmem_hot_memory = tmp;
+	return 0;
+}
+
+static int parse_alloc_class_sites(const char *name, const char *val)
+{
+	if (strlen(val) >= sizeof(alloc_class_sites_path)) {
+		log_err("%s path too long: %s", name, val);
+		return -EINVAL;
+	}
+
+	strcpy(alloc_class_sites_path, val);
+	return 0;
+}
+
+static int parse_rmem_hotset_file(const char *name, const char *val)
+{
+	if (strlen(val) >= sizeof(hotset_path)) {
+		log_err("%s path too long: %s", name, val);
+		return -EINVAL;
+	}
+
+	strcpy(hotset_path, val);
+	return 0;
+}
+
+static int parse_rmem_grow_memory_flag(const char *name, const char *val)
+{
+	int ret;
+	long tmp;
+
+	ret = str_to_long(val, &tmp);
+	if (ret || tmp < 0) {
+		log_err("Expecting a non-negative number for %s", name);
+		return -EINVAL;
+	}
+
+	rmem_grow_slabs = div_up(tmp, RMEM_SLAB_SIZE);
+	return 0;
+}
+
+static int parse_rmem_hedge_pct_flag(const char *name, const char *val)
+{
+	long tmp;
+	int ret;
+
+	ret = str_to_long(val, &tmp);
+	if (ret || !(tmp >= 0 && tmp < 100)) {
+		log_err("Expecting 0 (off) to 99 for %s", name);
+		return -EINVAL;
+	}
+	rmem_hedge_pct = tmp;
+	return 0;
+}
+
+static int parse_rmem_trace_records_flag(const char *name, const char *val)
+{
+	long tmp;
+	int ret;
+
+	ret = str_to_long(val, &tmp);
+	if (ret || tmp < 0) {
+		log_err("Expecting 0 (off) or records per thread for %s", name);
+		return -EINVAL;
+	}
+	rmem_trace_records = tmp;
+	return 0;
+}
+
 static int parse_rmem_evict_thr_flag(const char *name, const char *val)
 {
 	long tmp;
@@ -373,10 +467,17 @@ static const struct cfg_handler cfg_handlers[] = {
 	{ "static_arp", parse_static_arp_entry, false },
 	{ "log_level", parse_log_level, false },
 	{ "disable_watchdog", parse_watchdog_flag, false },
+	{ "runtime_stats_shm_us", parse_stats_shm_interval, false },
 	{ "remote_memory", parse_remote_memory_flag, false },
 	{ "rmem_hints", parse_rmem_hints_flag, false },
 	{ "rmem_backend", parse_rmem_backend_flag, false },
 	{ "rmem_local_memory", parse_rmem_local_memory_flag, false },
+	{ "rmem_grow_memory", parse_rmem_grow_memory_flag, false },
+	{ "rmem_hot_memory", parse_rmem_hot_memory_flag, false },
+	{ "rmem_alloc_class_sites", parse_alloc_class_sites, false },
+	{ "rmem_hotset_file", parse_rmem_hotset_file, false },
+	{ "rmem_hedge_pct", parse_rmem_hedge_pct_flag, false },
+	{ "rmem_trace_records", parse_rmem_trace_records_flag, false },
 	{ "rmem_evict_threshold", parse_rmem_evict_thr_flag, false },
 	{ "rmem_evict_batch_size", parse_rmem_evict_batch_size_flag, false },
 	{ "rmem_evict_ngens", parse_rmem_evict_ngens_flag, false },
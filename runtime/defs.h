@@ -101,6 +101,7 @@ struct thread {
 	unsigned int		main_thread:1;
 	unsigned int		state;
 	unsigned int		stack_busy;
+	unsigned int		id;	/* for fault traces, see __thread_create() */
 };
 
 typedef void (*runtime_fn_t)(void);
@@ -393,6 +394,9 @@ extern struct cpu_record cpu_map[NCPU];
  */
 #define STAT(counter) (myk()->stats[STAT_ ## counter])
 
+/* interval for exporting stats to shared memory, 0 if off (see stat_shm.h) */
+extern unsigned int stat_shm_interval_us;
+
 /*
  * Softirq support
  */
@@ -584,7 +584,8 @@ struct netaddr tcp_remote_addr(tcpconn_t *c)
 }
 
 static ssize_t tcp_read_wait(tcpconn_t *c, size_t len,
-			     struct list_head *q, struct mbuf **mout)
+			     struct list_head *q, struct mbuf **mout,
+			     bool block)
 {
 	struct mbuf *m;
 	size_t readlen = 0;
@@ -593,8 +594,13 @@ static ssize_t tcp_read_wait(tcpconn_t *c, size_t len,
 	spin_lock_np(&c->lock);
 
 	/* block until there is an actionable event */
-	while (!c->rx_closed && (c->rx_exclusive || list_empty(&c->rxq)))
+	while (!c->rx_closed && (c->rx_exclusive || list_empty(&c->rxq))) {
+		if (!block) {
+			spin_unlock_np(&c->lock);
+			return -EAGAIN;
+		}
 		waitq_wait(&c->rx_wq, &c->lock);
+	}
 
 	/* is the socket closed? */
 	if (c->rx_closed) {
@@ -651,16 +657,7 @@ static void tcp_read_finish(tcpconn_t *c, struct mbuf *m)
 	waitq_release_finish(&waiters);
 }
 
-/**
- * tcp_read - reads data from a TCP connection
- * @c: the TCP connection
- * @buf: a buffer to store the read data
- * @len: the length of @buf
- *
- * Returns the number of bytes read, 0 if the connection is closed, or < 0
- * if an error occurred.
- */
-ssize_t tcp_read(tcpconn_t *c, void *buf, size_t len)
+static ssize_t __tcp_read(tcpconn_t *c, void *buf, size_t len, bool block)
 {
 	char *pos = buf;
 	struct list_head q;
@@ -670,7 +667,7 @@ ssize_t tcp_read(tcpconn_t *c, void *buf, size_t len)
 	list_head_init(&q);
 
 	/* wait for data to become available */
-	ret = tcp_read_wait(c, len, &q, &m);
+	ret = tcp_read_wait(c, len, &q, &m, block);
 
 	/* check if connection was closed */
 	if (ret <= 0)
@@ -700,6 +697,33 @@ ssize_t tcp_read(tcpconn_t *c, void *buf, size_t len)
 	return ret;
 }
 
+/**
+ * tcp_read - reads data from a TCP connection
+ * @c: the TCP connection
+ * @buf: a buffer to store the read data
+ * @len: the length of @buf
+ *
+ * Returns the number of bytes read, 0 if the connection is closed, or < 0
+ * if an error occurred.
+ */
+ssize_t tcp_read(tcpconn_t *c, void *buf, size_t len)
+{
+	return __tcp_read(c, buf, len, true);
+}
+
+/**
+ * tcp_try_read - reads data from a TCP connection without blocking
+ * @c: the TCP connection
+ * @buf: a buffer to store the read data
+ * @len: the length of @buf
+ *
+ * Like tcp_read(), but returns -EAGAIN instead of waiting for data.
+ */
+ssize_t tcp_try_read(tcpconn_t *c, void *buf, size_t len)
+{
+	return __tcp_read(c, buf, len, false);
+}
+
 static size_t iov_len(const struct iovec *iov, int iovcnt)
 {
 	size_t len = 0;
@@ -731,7 +755,7 @@ ssize_t tcp_readv(tcpconn_t *c, const struct iovec *iov, int iovcnt)
 	list_head_init(&q);
 
 	/* wait for data to become available */
-	len = tcp_read_wait(c, len, &q, &m);
+	len = tcp_read_wait(c, len, &q, &m, true);
 
 	/* check if connection was closed */
 	if (len <= 0)
@@ -788,7 +812,7 @@ ssize_t tcp_readv(tcpconn_t *c, const struct iovec *iov, int iovcnt)
 	return len;
 }
 
-static int tcp_write_wait(tcpconn_t *c, size_t *winlen)
+static int tcp_write_wait(tcpconn_t *c, size_t *winlen, bool block)
 {
 	spin_lock_np(&c->lock);
 
@@ -796,6 +820,10 @@ static int tcp_write_wait(tcpconn_t *c, size_t *winlen)
 	while (!c->tx_closed &&
 	       (c->pcb.state < TCP_STATE_ESTABLISHED || c->tx_exclusive ||
 		wraps_lte(c->pcb.snd_una + c->pcb.snd_wnd, c->pcb.snd_nxt))) {
+		if (!block) {
+			spin_unlock_np(&c->lock);
+			return -EAGAIN;
+		}
 		waitq_wait(&c->tx_wq, &c->lock);
 	}
 
@@ -852,22 +880,14 @@ static void tcp_write_finish(tcpconn_t *c)
 	mbuf_list_free(&q);
 }
 
-/**
- * tcp_write - writes data to a TCP connection
- * @c: the TCP connection
- * @buf: a buffer from which to copy the data
- * @len: the length of the data
- *
- * Returns the number of bytes written (could be less than @len), or < 0
- * if there was a failure.
- */
-ssize_t tcp_write(tcpconn_t *c, const void *buf, size_t len)
+static ssize_t __tcp_write(tcpconn_t *c, const void *buf, size_t len,
+			   bool block)
 {
 	size_t winlen;
 	ssize_t ret;
 
 	/* block until the data can be sent */
-	ret = tcp_write_wait(c, &winlen);
+	ret = tcp_write_wait(c, &winlen, block);
 	if (ret)
 		return ret;
 
@@ -880,6 +900,33 @@ ssize_t tcp_write(tcpconn_t *c, const void *buf, size_t len)
 	return ret;
 }
 
+/**
+ * tcp_write - writes data to a TCP connection
+ * @c: the TCP connection
+ * @buf: a buffer from which to copy the data
+ * @len: the length of the data
+ *
+ * Returns the number of bytes written (could be less than @len), or < 0
+ * if there was a failure.
+ */
+ssize_t tcp_write(tcpconn_t *c, const void *buf, size_t len)
+{
+	return __tcp_write(c, buf, len, true);
+}
+
+/**
+ * tcp_try_write - writes data to a TCP connection without blocking
+ * @c: the TCP connection
+ * @buf: a buffer from which to copy the data
+ * @len: the length of the data
+ *
+ * Like tcp_write(), but returns -EAGAIN instead of waiting for the window.
+ */
+ssize_t tcp_try_write(tcpconn_t *c, const void *buf, size_t len)
+{
+	return __tcp_write(c, buf, len, false);
+}
+
 /**
  * tcp_writev - writes vectored data to a TCP connection
  * @c: the TCP connection
@@ -896,7 +943,7 @@ ssize_t tcp_writev(tcpconn_t *c, const struct iovec *iov, int iovcnt)
 	int i;
 
 	/* block until the data can be sent */
-	ret = tcp_write_wait(c, &winlen);
+	ret = tcp_write_wait(c, &winlen, true);
 	if (ret)
 		return ret;
 
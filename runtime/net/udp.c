@@ -256,21 +256,8 @@ int udp_set_buffers(udpconn_t *c, int read_mbufs, int write_mbufs)
 	return 0;
 }
 
-/**
- * udp_read_from - reads from a UDP socket
- * @c: the UDP socket
- * @buf: a buffer to store the datagram
- * @len: the size of @buf
- * @raddr: a pointer to store the remote address of the datagram (if not NULL)
- *
- * WARNING: This a blocking function. It will wait until a datagram is
- * available, an error occurs, or the socket is shutdown.
- *
- * Returns the number of bytes in the datagram, or @len if the datagram
- * is >= @len in size. If the socket has been shutdown, returns 0.
- */
-ssize_t udp_read_from(udpconn_t *c, void *buf, size_t len,
-                      struct netaddr *raddr)
+static ssize_t __udp_read_from(udpconn_t *c, void *buf, size_t len,
+			       struct netaddr *raddr, bool block)
 {
 	ssize_t ret;
 	struct mbuf *m;
@@ -278,8 +265,13 @@ ssize_t udp_read_from(udpconn_t *c, void *buf, size_t len,
 	spin_lock_np(&c->inq_lock);
 
 	/* block until there is an actionable event */
-	while (mbufq_empty(&c->inq) && !c->inq_err && !c->shutdown)
+	while (mbufq_empty(&c->inq) && !c->inq_err && !c->shutdown) {
+		if (!block) {
+			spin_unlock_np(&c->inq_lock);
+			return -EAGAIN;
+		}
 		waitq_wait(&c->inq_wq, &c->inq_lock);
+	}
 
 	/* is the socket drained and shutdown? */
 	if (mbufq_empty(&c->inq) && c->shutdown) {
@@ -314,6 +306,40 @@ ssize_t udp_read_from(udpconn_t *c, void *buf, size_t len,
 	return ret;
 }
 
+/**
+ * udp_read_from - reads from a UDP socket
+ * @c: the UDP socket
+ * @buf: a buffer to store the datagram
+ * @len: the size of @buf
+ * @raddr: a pointer to store the remote address of the datagram (if not NULL)
+ *
+ * WARNING: This a blocking function. It will wait until a datagram is
+ * available, an error occurs, or the socket is shutdown.
+ *
+ * Returns the number of bytes in the datagram, or @len if the datagram
+ * is >= @len in size. If the socket has been shutdown, returns 0.
+ */
+ssize_t udp_read_from(udpconn_t *c, void *buf, size_t len,
+                      struct netaddr *raddr)
+{
+	return __udp_read_from(c, buf, len, raddr, true);
+}
+
+/**
+ * udp_try_read_from - reads from a UDP socket without blocking
+ * @c: the UDP socket
+ * @buf: a buffer to store the datagram
+ * @len: the size of @buf
+ * @raddr: a pointer to store the remote address of the datagram (if not NULL)
+ *
+ * Like udp_read_from(), but returns -EAGAIN instead of waiting for a datagram.
+ */
+ssize_t udp_try_read_from(udpconn_t *c, void *buf, size_t len,
+			  struct netaddr *raddr)
+{
+	return __udp_read_from(c, buf, len, raddr, false);
+}
+
 static void udp_tx_release_mbuf(struct mbuf *m)
 {
 	udpconn_t *c = (udpconn_t *)m->release_data;
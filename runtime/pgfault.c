@@ -9,9 +9,13 @@
 #include "rmem/page.h"
 #include "rmem/pgnode.h"
 #include "rmem/common.h"
+#include "rmem/fault_trace.h"
+#include "rmem/hint_prof.h"
 #include "rmem/region.h"
 #include "runtime/pgfault.h"
 
+#include "defs.h"
+
 BUILD_ASSERT(EDEN_MAX_READAHEAD <= FAULT_MAX_RDAHEAD_SIZE);
 
 /* state */
@@ -84,16 +88,21 @@ static __always_inline bool __is_fault_pending_eden(void* address, bool write,
 
     /* find the region the page belongs to */
 #ifdef NO_DYNAMIC_REGIONS
-    /* we only support one region now so caching an unsafe reference for future 
-     * fast path accesses. this is not safe when we have multiple regions along
-     * with dynamic region updates */
-    if (unlikely(!__cached_mr)) {
-        __cached_mr = get_first_region_safe();
-        assert(__cached_mr);
+    /* regions are never deleted so caching an unsafe reference to the last 
+     * region we hit for future fast path accesses; we only need to walk the 
+     * region list when accesses move to another (e.g., newly added) region */
+    if (unlikely(!__cached_mr || 
+            !is_in_memory_region_unsafe(__cached_mr, (unsigned long) address))) {
+        mr = get_region_by_addr_unsafe((unsigned long) address);
+        if (unlikely(!mr))
+            return false;   /* not mapped by any region, nothing to fetch */
+        __cached_mr = mr;
     }
     mr = __cached_mr;
 #else
     mr = get_region_by_addr_unsafe((unsigned long) address);
+    if (unlikely(!mr))
+        return false;   /* not mapped by any region, nothing to fetch */
 #endif
 
     assert(is_in_memory_region_unsafe(mr, (unsigned long) address));
@@ -126,23 +135,22 @@ static __always_inline bool __is_fault_pending_eden(void* address, bool write,
             * epoch on a wrong page in a rare case - this is not that bad as 
             * page epoch it is only a hint for smarter eviction. */
             pgidx_t pgidx;
-            struct rmpage_node* page;
             pgidx = get_index_from_pginfo_unsafe(pginfo);
-            page = rmpage_get_node_by_id(pgidx);
-
-            /* this may not always be true due to the comment above */
-            // assert(page->addr & CHUNK_MASK == 0);
-            // assert((page->addr == ((unsigned long) address & ~CHUNK_MASK));
 
             log_debug("fault hint on %p. updating epoch on page idx %d to %lu",
                 address, pgidx, evict_epoch_now);
-            page->epoch = evict_epoch_now;
+            rmpage_set_epoch(pgidx, evict_epoch_now);
         }
 #endif
     }
 
     // log_debug("fault hinted on %p. faulting? %d", address, !nofault);
     RSTAT(ANNOT_HITS)++;
+
+    /* faults are traced when done; trace the other hinted accesses here */
+    if (nofault)
+        fault_trace_touch((unsigned long) address, write,
+            thread_self() ? thread_self()->id : 0);
     return !nofault;
 }
 
@@ -150,6 +158,8 @@ static __always_inline bool __is_fault_pending_eden(void* address, bool write,
  * (inlining in header file for low-overhead access) */
 bool __is_fault_pending(void* address, bool write, bool hint_eviction)
 {
+    bool pending;
+
 #ifndef REMOTE_MEMORY
     log_err("REMOTE_MEMORY not defined, hinting is not supported");
     BUG();
@@ -158,8 +168,14 @@ bool __is_fault_pending(void* address, bool write, bool hint_eviction)
 #if defined(SC_EVICTION) || defined(LRU_EVICTION)
 #error "Eviction hinting not supported with VDSO checks"
 #endif
-    return __is_fault_pending_vdso(address, write);
+    pending = __is_fault_pending_vdso(address, write);
 #else
-    return __is_fault_pending_eden(address, write, hint_eviction);
+    pending = __is_fault_pending_eden(address, write, hint_eviction);
+#endif
+
+#ifdef HINT_PROFILER
+    /* hints are inlined so the return address is the hint site */
+    hint_prof_check((unsigned long) __builtin_return_address(0), pending);
 #endif
+    return pending;
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #endif
 
 #include <sys/mman.h>
+#include "rmem/alloc_class.h"
 #include "rmem/backend.h"
 #include "rmem/common.h"
 #include "rmem/config.h"
@@ -44,6 +45,10 @@ int rmem_init()
             RMEM_HANDLER_CORE_HIGH, fsampler_samples_per_sec);
     if (r) return r;
 
+    /* memory classes of allocation sites, for the shim allocator */
+    r = alloc_class_init();
+    if (r) return r;
+
 #ifdef USE_VDSO_CHECKS
     /* init vdso objects */
     r = __vdso_init();
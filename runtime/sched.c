@@ -19,6 +19,7 @@
 #include <runtime/pgfault.h>
 #include "rmem/common.h"
 #include "rmem/eviction.h"
+#include "rmem/hint_prof.h"
 
 #include "defs.h"
 
@@ -38,6 +39,9 @@ bool disable_watchdog;
 static struct slab thread_slab;
 static struct tcache *thread_tcache;
 static DEFINE_PERTHREAD(struct tcache_perthread, thread_pt);
+/* thread ids are a per-kthread count interleaved across kthreads, so they are
+ * unique until a kthread has created 2^32 / NCPU threads */
+static __thread unsigned int thread_next_id;
 
 /* used to track cycle usage in scheduler */
 static __thread uint64_t last_tsc;
@@ -865,15 +869,21 @@ void thread_park_on_fault(void* address, bool write, int rdahead, int evprio)
         BUG();
     }
     memset(fault, 0, sizeof(fault_t));
+    fault->start_tsc = rdtsc();
     fault->page = ((unsigned long) address) & ~CHUNK_MASK;
     fault->is_read = !write;
     fault->is_write = write;
     fault->from_kernel = false;
+    fault->ip = (unsigned long) __builtin_return_address(0);
+    fault->tid = myth->id;
     fault->rdahead_max = rdahead;
     fault->rdahead = 0;
 	fault->evict_prio = evprio;
     fault->thread = myth;
     log_debug("fault posted at %lx write %d", fault->page, write);
+#ifdef HINT_PROFILER
+    hint_prof_park();
+#endif
 
 	/* enter scheduler with fault */
 	enter_schedule_with_fault(myth, fault);
@@ -1000,6 +1010,7 @@ static __always_inline thread_t *__thread_create(void)
 		preempt_enable();
 		return NULL;
 	}
+	th->id = thread_next_id++ * NCPU + my_kthr_id;
 	preempt_enable();
 
 	th->stack = s;
@@ -2,16 +2,23 @@
  * stat.c - support for statistics and counters
  */
 
+#include <fcntl.h>
 #include <string.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <sys/mman.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <base/atomic.h>
 #include <base/stddef.h>
 #include <base/log.h>
 #include <base/time.h>
+#include <rmem/alloc_prof.h>
 #include <rmem/common.h>
+#include <rmem/fault_hist.h>
+#include <rmem/hint_prof.h>
+#include <runtime/stat_shm.h>
 #include <runtime/thread.h>
 #include <runtime/udp.h>
 #include <runtime/timer.h>
@@ -27,6 +34,10 @@ static const char statsfile[] = "runtime.out";
 static const char rstatsfile[] = "rmem-stats.out";
 #endif
 
+/* shared-memory stats segment (off if 0) */
+unsigned int stat_shm_interval_us = 0;
+static struct stat_shm_hdr *stat_shm;
+
 static const char *stat_names[] = {
 	/* scheduler counters */
 	"reschedules",
@@ -278,6 +289,7 @@ static void* stat_worker_local(void *arg)
 
 	char buf[UDP_MAX_PAYLOAD];
 	char buf_hthr[UDP_MAX_PAYLOAD];
+	static struct fault_hist fhist_prev;
 	ssize_t len;
 	unsigned long now;
 	FILE* fp = fopen(statsfile, "w");
@@ -308,6 +320,15 @@ static void* stat_worker_local(void *arg)
 			}
 			fprintf(rfp, "%lu total-%s\n", now, buf);
 			fprintf(rfp, "%lu handler-%s\n", now, buf_hthr);
+
+			/* fault latency per phase, over the last interval */
+			ret = fault_hist_write_buf(buf, UDP_MAX_PAYLOAD, &fhist_prev);
+			if (ret < 0) {
+				log_err("rstat err %d: couldn't generate fault latency buffer",
+					ret);
+				continue;
+			}
+			fprintf(rfp, "%lu faultlat-%s\n", now, buf);
 			fflush(rfp);
 		}
 
@@ -319,10 +340,22 @@ static void* stat_worker_local(void *arg)
 		// }
 		// fprintf("%s\n", buf);
 
-#ifdef FAULT_SAMPLER
+#if defined(FAULT_SAMPLER) || defined(HINT_PROFILER) || defined(ALLOC_PROFILER)
         /* save latest process maps if recording fault trace because 
 		 * we will need this data to look up code locations */
         save_process_maps();
+#endif
+#ifdef HINT_PROFILER
+		/* latest hint profile */
+		hint_prof_dump();
+#endif
+#ifdef LOCK_PROFILER
+		/* latest lock contention profile */
+		lock_prof_dump();
+#endif
+#ifdef ALLOC_PROFILER
+		/* latest faults per allocation site */
+		alloc_prof_dump();
 #endif
 	}
 
@@ -332,6 +365,122 @@ static void* stat_worker_local(void *arg)
 }
 #endif
 
+static const char *stat_shm_global_names[] = {
+	"memory_used",
+	"memory_allocd",
+	"memory_freed",
+};
+
+/* creates the shared-memory stats segment and fills in the names */
+static int stat_shm_init(void)
+{
+	struct stat_shm_hdr *h, tmp;
+	char path[64];
+	size_t len;
+	int fd, i, n;
+
+	/* work out the layout */
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.name_len = STAT_SHM_NAME_LEN;
+	tmp.nstats = STAT_NR;
+	tmp.nrstats = RSTAT_NR;
+	tmp.nglobals = ARRAY_SIZE(stat_shm_global_names);
+	tmp.max_kthreads = maxks;
+	tmp.max_handlers = rmem_enabled ? nhandlers : 0;
+	tmp.names_off = align_up(sizeof(tmp), CACHE_LINE_SIZE);
+	tmp.data_off = align_up(tmp.names_off + STAT_SHM_NAME_LEN *
+		(tmp.nstats + tmp.nrstats + tmp.nglobals), CACHE_LINE_SIZE);
+	len = stat_shm_size(&tmp);
+
+	snprintf(path, sizeof(path), STAT_SHM_PATH, getpid());
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		log_err("stat: failed to create %s", path);
+		return -errno;
+	}
+	if (ftruncate(fd, len)) {
+		log_err("stat: failed to size %s to %lu B", path, len);
+		close(fd);
+		return -errno;
+	}
+	h = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (h == MAP_FAILED) {
+		log_err("stat: failed to map %s", path);
+		return -ENOMEM;
+	}
+
+	*h = tmp;
+	h->version = STAT_SHM_VERSION;
+	h->cycles_per_us = cycles_per_us;
+	h->interval_us = stat_shm_interval_us;
+	n = 0;
+	for (i = 0; i < STAT_NR; i++)
+		strncpy((char *)stat_shm_name(h, n++), stat_names[i],
+			STAT_SHM_NAME_LEN - 1);
+	for (i = 0; i < RSTAT_NR; i++)
+		strncpy((char *)stat_shm_name(h, n++), rstat_names[i],
+			STAT_SHM_NAME_LEN - 1);
+	for (i = 0; i < ARRAY_SIZE(stat_shm_global_names); i++)
+		strncpy((char *)stat_shm_name(h, n++), stat_shm_global_names[i],
+			STAT_SHM_NAME_LEN - 1);
+	store_release(&h->magic, STAT_SHM_MAGIC);	/* header is ready */
+
+	stat_shm = h;
+	log_info("stat: exporting stats to %s every %u us", path,
+		 stat_shm_interval_us);
+	return 0;
+}
+
+/* copies the counters into the segment under the seqlock */
+static void stat_shm_publish(void)
+{
+	struct stat_shm_hdr *h = stat_shm;
+	uint64_t *data;
+	int i;
+
+	store_release(&h->seq, h->seq + 1);
+	wmb();
+
+	/* FIXME: not correct when parked kthreads removed from @ks */
+	for (i = 0; i < h->max_kthreads; i++) {
+		data = stat_shm_kthread(h, i);
+		memcpy(data, allks[i]->stats, sizeof(allks[i]->stats));
+		memcpy(data + STAT_NR, allks[i]->rstats,
+		       sizeof(allks[i]->rstats));
+	}
+	for (i = 0; i < h->max_handlers; i++)
+		memcpy(stat_shm_handler(h, i), handlers[i]->rstats,
+		       sizeof(handlers[i]->rstats));
+
+	data = stat_shm_globals(h);
+	data[0] = atomic64_read(&max_memory_used);
+	data[1] = atomic64_read(&memory_allocd);
+	data[2] = atomic64_read(&memory_freed);
+
+	h->tsc = rdtsc();
+	h->nkthreads = h->max_kthreads;
+	h->nhandlers = h->max_handlers;
+	store_release(&h->seq, h->seq + 1);
+}
+
+static void *stat_worker_shm(void *arg)
+{
+	/* part of runtime */
+	preempt_disable();
+
+#ifdef STATS_CORE
+	if (cpu_pin_thread(pthread_self(), STATS_CORE))
+		log_warn("stat: couldn't pin shm worker to core %d", STATS_CORE);
+#endif
+
+	while (true) {
+		stat_shm_publish();
+		usleep(stat_shm_interval_us);
+	}
+	return NULL;
+}
+
 static void stat_worker_udp(void *arg)
 {
 	const size_t cmd_len = strlen("stat");
@@ -375,13 +524,26 @@ static void stat_worker_udp(void *arg)
  */
 int stat_init_late(void)
 {
-#ifdef STAT_REPORT_LOCAL
 	pthread_t stats_thread;		/* TODO: should we save this somewhere? */
-	int ret = pthread_create(&stats_thread, NULL, stat_worker_local, NULL);
+	int ret;
+
+#ifdef STAT_REPORT_LOCAL
+	ret = pthread_create(&stats_thread, NULL, stat_worker_local, NULL);
 	if (ret) {
 		log_err("pthread_create for stat worker failed: %d", errno);
 		return ret;
 	}
 #endif
+	if (stat_shm_interval_us) {
+		ret = stat_shm_init();
+		if (ret)
+			return ret;
+		ret = pthread_create(&stats_thread, NULL, stat_worker_shm, NULL);
+		if (ret) {
+			log_err("pthread_create for stat shm worker failed: %d",
+				errno);
+			return ret;
+		}
+	}
 	return thread_spawn(stat_worker_udp, NULL);
 }
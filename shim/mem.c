@@ -10,19 +10,30 @@
 #include <sys/mman.h>
 #include <jemalloc/jemalloc.h>
 
+#include "base/lock.h"
 #include "base/mem.h"
 #include "base/realmem.h"
+#include "rmem/alloc_class.h"
+#include "rmem/alloc_prof.h"
 #include "rmem/api.h"
 #include "rmem/common.h"
+#include "rmem/page.h"
 #include "runtime/preempt.h"
 
 #include "common.h"
 
-/* jemalloc state */
-__thread bool __from_jemalloc = false;
-#define JEMALLOC_BEGIN() __from_jemalloc = true
-#define JEMALLOC_END()   __from_jemalloc = false
-#define FROM_JEMALLOC()  __from_jemalloc
+/* jemalloc state. Application memory comes from arenas that get their 
+ * extents from remote memory through rmem_extent_hooks: one arena per 
+ * kthread (which it is bound to) and one for each of the hot and cold memory
+ * classes, created on first use. Class arenas bypass the tcache, which is 
+ * shared by all arenas of a thread. */
+#define JE_MAX_ARENAS       1024            /* arena ids we keep classes for */
+#define JE_OVERSIZE_SIZE    (8UL << 20)     /* jemalloc's oversize_threshold */
+static __thread unsigned int je_thread_arena = 0;
+static unsigned int je_class_arenas[RMEM_CLASS_NR];
+static unsigned char je_arena_classes[JE_MAX_ARENAS];
+static bool je_classes_used = false;
+static DEFINE_SPINLOCK(je_arena_lock);
 
 /**
  * Runtime entry/exit helpers
@@ -76,6 +87,256 @@ void *rmlib_rmmap(void *addr, size_t length, int prot,
     return p;
 }
 
+/**
+ * jemalloc extent hooks. Our arenas get and give back memory here, straight 
+ * from remote memory, instead of through mmap/munmap/madvise. jemalloc calls
+ * them from within our interface functions so preemption is disabled. Hooks 
+ * that return bool return false on success.
+ */
+
+static void *rmem_extent_alloc(extent_hooks_t *hooks, void *new_addr, 
+    size_t size, size_t alignment, bool *zero, bool *commit, 
+    unsigned arena_ind)
+{
+    unsigned long addr;
+    void *ptr;
+    int memclass;
+
+    /* rmalloc can't place memory at a given address */
+    if (new_addr)
+        return NULL;
+
+    memclass = arena_ind < JE_MAX_ARENAS ? 
+        load_acquire(&je_arena_classes[arena_ind]) : RMEM_CLASS_DEFAULT;
+    alignment = MAX(alignment, CHUNK_SIZE);
+    ptr = rmalloc_class(size + alignment - CHUNK_SIZE, memclass);
+    if (!ptr)
+        return NULL;
+    addr = align_up((unsigned long) ptr, alignment);
+    shim_log_debug("[%s] arena=%u size=%lu alignment=%lu return=%lx", __func__,
+        arena_ind, size, alignment, addr);
+
+    /* untouched remote memory reads as zeros and needs no commit */
+    *zero = true;
+    *commit = true;
+    return (void *) addr;
+}
+
+/* keep the range (opt out): jemalloc purges it and reuses it later, whereas
+ * rmalloc never hands out unmapped ranges again */
+static bool rmem_extent_dalloc(extent_hooks_t *hooks, void *addr, 
+    size_t size, bool committed, unsigned arena_ind)
+{
+    return true;
+}
+
+static void rmem_extent_destroy(extent_hooks_t *hooks, void *addr, 
+    size_t size, bool committed, unsigned arena_ind)
+{
+    shim_log_debug("[%s] addr=%p size=%lu", __func__, addr, size);
+    rmunmap(addr, size);
+}
+
+static bool rmem_extent_commit(extent_hooks_t *hooks, void *addr, 
+    size_t size, size_t offset, size_t length, unsigned arena_ind)
+{
+    return false;
+}
+
+/* decommit and forced purge drop the pages from local and remote memory, 
+ * after which they read as zeros */
+static bool rmem_extent_decommit(extent_hooks_t *hooks, void *addr, 
+    size_t size, size_t offset, size_t length, unsigned arena_ind)
+{
+    shim_log_debug("[%s] addr=%p offset=%lu length=%lu", __func__, addr, 
+        offset, length);
+    return rmadvise(addr + offset, length, MADV_DONTNEED) != 0;
+}
+
+static bool rmem_extent_purge_lazy(extent_hooks_t *hooks, void *addr, 
+    size_t size, size_t offset, size_t length, unsigned arena_ind)
+{
+    shim_log_debug("[%s] addr=%p offset=%lu length=%lu", __func__, addr, 
+        offset, length);
+    return rmadvise(addr + offset, length, MADV_FREE) != 0;
+}
+
+static bool rmem_extent_purge_forced(extent_hooks_t *hooks, void *addr, 
+    size_t size, size_t offset, size_t length, unsigned arena_ind)
+{
+    shim_log_debug("[%s] addr=%p offset=%lu length=%lu", __func__, addr, 
+        offset, length);
+    return rmadvise(addr + offset, length, MADV_DONTNEED) != 0;
+}
+
+static bool rmem_extent_split(extent_hooks_t *hooks, void *addr, 
+    size_t size, size_t size_a, size_t size_b, bool committed, 
+    unsigned arena_ind)
+{
+    return false;
+}
+
+/* regions are mapped separately so extents only merge within one */
+static bool rmem_extent_merge(extent_hooks_t *hooks, void *addr_a, 
+    size_t size_a, void *addr_b, size_t size_b, bool committed, 
+    unsigned arena_ind)
+{
+    struct region_t *mr;
+    bool same;
+
+    mr = get_region_by_addr_safe((unsigned long) addr_a);
+    if (!mr)
+        return true;
+    same = is_in_memory_region_unsafe(mr, (unsigned long) addr_b);
+    put_mr(mr);
+    return !same;
+}
+
+static extent_hooks_t rmem_extent_hooks = {
+    .alloc = rmem_extent_alloc,
+    .dalloc = rmem_extent_dalloc,
+    .destroy = rmem_extent_destroy,
+    .commit = rmem_extent_commit,
+    .decommit = rmem_extent_decommit,
+    .purge_lazy = rmem_extent_purge_lazy,
+    .purge_forced = rmem_extent_purge_forced,
+    .split = rmem_extent_split,
+    .merge = rmem_extent_merge,
+};
+
+/**
+ * Arenas
+ */
+
+/* creates an arena backed by remote memory of a memory class */
+static unsigned int je_create_arena(int memclass)
+{
+    extent_hooks_t *hooks = &rmem_extent_hooks;
+    unsigned int arena;
+    size_t len = sizeof(arena);
+    int ret;
+
+    ret = rmlib_je_mallctl("arenas.create", &arena, &len, &hooks, 
+        sizeof(hooks));
+    shim_bug_on(ret, "ERROR! cannot create arena for class %d: %d", 
+        memclass, ret);
+    shim_bug_on(arena >= JE_MAX_ARENAS, "ERROR! too many arenas: %u", arena);
+    store_release(&je_arena_classes[arena], memclass);
+    shim_log_debug("created arena %u for memory class %d", arena, memclass);
+    return arena;
+}
+
+/* binds the kthread to an arena of its own on its first allocation; 
+ * jemalloc's automatic arenas would get memory with the default hooks */
+static __noinline void __je_bind_thread(void)
+{
+    unsigned int arena;
+    int ret;
+
+    arena = je_create_arena(RMEM_CLASS_DEFAULT);
+    ret = rmlib_je_mallctl("thread.arena", NULL, NULL, &arena, sizeof(arena));
+    shim_bug_on(ret, "ERROR! cannot bind to arena %u: %d", arena, ret);
+    je_thread_arena = arena;
+}
+
+static __always_inline void je_bind_thread(void)
+{
+    if (unlikely(!je_thread_arena))
+        __je_bind_thread();
+}
+
+/* extra mallocx flags for a size: jemalloc sends automatic-arena allocations
+ * past its oversize threshold to a dedicated arena of its own */
+static __always_inline int je_size_flags(size_t size)
+{
+    return size >= JE_OVERSIZE_SIZE ? MALLOCX_ARENA(je_thread_arena) : 0;
+}
+
+/* returns the arena of a memory class, creating it if needed */
+static unsigned int je_class_arena(int memclass)
+{
+    unsigned int arena;
+
+    assert(memclass > RMEM_CLASS_DEFAULT && memclass < RMEM_CLASS_NR);
+    arena = load_acquire(&je_class_arenas[memclass]);
+    if (likely(arena))
+        return arena;
+
+    /* arena 0 is jemalloc's own so it never comes back from here */
+    spin_lock(&je_arena_lock);
+    arena = je_class_arenas[memclass];
+    if (!arena) {
+        arena = je_create_arena(memclass);
+        store_release(&je_class_arenas[memclass], arena);
+        store_release(&je_classes_used, true);
+        shim_log("created arena %u for memory class %d", arena, memclass);
+    }
+    spin_unlock(&je_arena_lock);
+    return arena;
+}
+
+/* allocates from the arena of a memory class */
+static void *je_class_alloc(size_t size, int memclass, int flags)
+{
+    flags |= MALLOCX_ARENA(je_class_arena(memclass)) | MALLOCX_TCACHE_NONE;
+    return rmlib_je_mallocx(size ? size : 1, flags);
+}
+
+/* memory class of an application pointer */
+static int je_ptr_class(void *ptr)
+{
+    struct region_t *mr;
+    int memclass;
+
+    if (likely(!load_acquire(&je_classes_used)))
+        return RMEM_CLASS_DEFAULT;
+
+    mr = get_region_by_addr_safe((unsigned long) ptr);
+    if (!mr)
+        return RMEM_CLASS_DEFAULT;
+    memclass = get_class_from_pginfo(get_page_info(mr, (unsigned long) ptr));
+    put_mr(mr);
+    return memclass;
+}
+
+/* allocation by memory class, from rmalloc_hot() and rmalloc_cold() */
+static __always_inline void *__rmalloc_class_obj(size_t size, int memclass)
+{
+    bool from_runtime;
+    void* retptr;
+
+    from_runtime = runtime_enter();
+    shim_log_debug("[%s], size=%lu, class=%d, from-runtime=%d", __func__, 
+        size, memclass, from_runtime);
+
+    if (from_runtime) {
+        shim_log_debug("%s from runtime, using libc", __func__);
+        retptr = real_malloc(size);
+        goto out;
+    }
+
+    shim_bug_on(!rmem_inited, "[%s] ERROR! rmem not initialized", __func__);
+    retptr = je_class_alloc(size, memclass, 0);
+#ifdef ALLOC_PROFILER
+    alloc_prof_sample(retptr, size);
+#endif
+
+out:
+    shim_log_debug("[%s] return=%p", __func__, retptr);
+    runtime_exit_on(!from_runtime);
+    return retptr;
+}
+
+void *rmalloc_hot(size_t size)
+{
+    return __rmalloc_class_obj(size, RMEM_CLASS_HOT);
+}
+
+void *rmalloc_cold(size_t size)
+{
+    return __rmalloc_class_obj(size, RMEM_CLASS_COLD);
+}
+
 /**
  *  Interface functions
  */
@@ -84,10 +345,11 @@ void *malloc(size_t size)
 {
     bool from_runtime;
     void* retptr;
+    int memclass;
 
     from_runtime = runtime_enter();
-    shim_log_debug("[%s], size=%lu, from-runtime=%d from-jemalloc=%d",
-        __func__, size, from_runtime, FROM_JEMALLOC());
+    shim_log_debug("[%s], size=%lu, from-runtime=%d", __func__, size, 
+        from_runtime);
 
     if (from_runtime) {
         shim_log_debug("%s from runtime, using libc", __func__);
@@ -97,10 +359,18 @@ void *malloc(size_t size)
 
     /* application malloc */
     shim_bug_on(!rmem_inited, "[%s] ERROR! rmem not initialized", __func__);
-    JEMALLOC_BEGIN();
+    memclass = alloc_class_of_site((unsigned long) __builtin_return_address(0));
+    je_bind_thread();
     shim_log_debug("using je_malloc");
-    retptr = rmlib_je_malloc(size);
-    JEMALLOC_END();
+    if (memclass != RMEM_CLASS_DEFAULT)
+        retptr = je_class_alloc(size, memclass, 0);
+    else if (unlikely(je_size_flags(size)))
+        retptr = rmlib_je_mallocx(size, je_size_flags(size));
+    else
+        retptr = rmlib_je_malloc(size);
+#ifdef ALLOC_PROFILER
+    alloc_prof_sample(retptr, size);
+#endif
 
 out:
     shim_log_debug("[%s] return=%p", __func__, retptr);
@@ -116,8 +386,8 @@ void free(void *ptr)
         return;
 
     from_runtime = runtime_enter();
-    shim_log_debug("[%s] ptr=%p from-runtime=%d from-jemalloc=%d", __func__,
-        ptr, from_runtime, FROM_JEMALLOC());
+    shim_log_debug("[%s] ptr=%p from-runtime=%d", __func__, ptr, 
+        from_runtime);
 
     if (from_runtime) {
         shim_log_debug("[%s] from runtime, using libc", __func__);
@@ -133,9 +403,10 @@ void free(void *ptr)
         goto out;
     }
 
-    JEMALLOC_BEGIN();
-    rmlib_je_free(ptr);
-    JEMALLOC_END();
+    if (je_ptr_class(ptr) != RMEM_CLASS_DEFAULT)
+        rmlib_je_dallocx(ptr, MALLOCX_TCACHE_NONE);
+    else
+        rmlib_je_free(ptr);
 
 out:
     shim_log_debug("[%s] return", __func__);
@@ -146,13 +417,14 @@ void *realloc(void *ptr, size_t size)
 {
     void *retptr;
     bool from_runtime;
+    int memclass;
 
     if (ptr == NULL) 
         return malloc(size);
 
     from_runtime = runtime_enter();
-    shim_log_debug("[%s] ptr=%p, size=%lu, from-runtime=%d from-jemalloc=%d",
-        __func__, ptr, size, from_runtime, FROM_JEMALLOC());
+    shim_log_debug("[%s] ptr=%p, size=%lu, from-runtime=%d", __func__, ptr, 
+        size, from_runtime);
 
     if (from_runtime) {
         shim_log_debug("%s from runtime, using libc", __func__);
@@ -162,9 +434,19 @@ void *realloc(void *ptr, size_t size)
     
     /* application realloc */
     shim_bug_on(!rmem_inited, "[%s] ERROR! rmem not initialized", __func__);
-    JEMALLOC_BEGIN();
-    retptr = rmlib_je_realloc(ptr, size);
-    JEMALLOC_END();
+    memclass = je_ptr_class(ptr);
+    je_bind_thread();
+    if (memclass != RMEM_CLASS_DEFAULT)
+        /* stay in the arena of the class */
+        retptr = rmlib_je_rallocx(ptr, size ? size : 1, MALLOCX_TCACHE_NONE |
+            MALLOCX_ARENA(je_class_arena(memclass)));
+    else if (unlikely(je_size_flags(size)))
+        retptr = rmlib_je_rallocx(ptr, size, je_size_flags(size));
+    else
+        retptr = rmlib_je_realloc(ptr, size);
+#ifdef ALLOC_PROFILER
+    alloc_prof_sample(retptr, size);
+#endif
 
 out:
     shim_log_debug("[%s] return=%p", __func__, retptr);
@@ -176,6 +458,8 @@ void *calloc(size_t nitems, size_t size)
 {
     void *retptr;
     bool from_runtime;
+    size_t total;
+    int memclass;
 
     from_runtime = runtime_enter();
     shim_log_debug("[%s] number=%lu, size=%lu, from-runtime=%d", 
@@ -189,9 +473,19 @@ void *calloc(size_t nitems, size_t size)
 
     /* application calloc */
     shim_bug_on(!rmem_inited, "[%s] ERROR! rmem not initialized", __func__);
-    JEMALLOC_BEGIN();
-    retptr = rmlib_je_calloc(nitems, size);
-    JEMALLOC_END();
+    memclass = alloc_class_of_site((unsigned long) __builtin_return_address(0));
+    je_bind_thread();
+    if (__builtin_mul_overflow(nitems, size, &total))
+        retptr = NULL;
+    else if (memclass != RMEM_CLASS_DEFAULT)
+        retptr = je_class_alloc(total, memclass, MALLOCX_ZERO);
+    else if (unlikely(je_size_flags(total)))
+        retptr = rmlib_je_mallocx(total, MALLOCX_ZERO | je_size_flags(total));
+    else
+        retptr = rmlib_je_calloc(nitems, size);
+#ifdef ALLOC_PROFILER
+    alloc_prof_sample(retptr, total);
+#endif
 
 out:
     shim_log_debug("[%s] return=%p", __func__, retptr);
@@ -216,9 +510,15 @@ void *__internal_aligned_alloc(size_t alignment, size_t size)
 
     /* application aligned alloc */
     shim_bug_on(!rmem_inited, "[%s] ERROR! rmem not initialized", __func__);
-    JEMALLOC_BEGIN();
-    retptr = rmlib_je_aligned_alloc(alignment, size);
-    JEMALLOC_END();
+    je_bind_thread();
+    if (unlikely(je_size_flags(size)))
+        retptr = rmlib_je_mallocx(size, MALLOCX_ALIGN(alignment) | 
+            je_size_flags(size));
+    else
+        retptr = rmlib_je_aligned_alloc(alignment, size);
+#ifdef ALLOC_PROFILER
+    alloc_prof_sample(retptr, size);
+#endif
 
 out:
     shim_log_debug("[%s] return=%p", __func__, retptr);
@@ -263,9 +563,7 @@ size_t malloc_usable_size(void * ptr)
 
     /* application call */
     shim_bug_on(!rmem_inited, "[%s] ERROR! rmem not initialized", __func__);
-    JEMALLOC_BEGIN();
     size = rmlib_je_malloc_usable_size(ptr);
-    JEMALLOC_END();
 
 out:
     shim_log_debug("[%s] return=%ld", __func__, size);
@@ -285,18 +583,8 @@ void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
     shim_log_debug("[%s] addr=%p,length=%lu,prot=%d,flags=%d,fd=%d,offset=%ld,from-"
     "runtime=%d", __func__, addr, length, prot, flags, fd, offset, from_runtime);
 
-    /* First check for calls coming from jemalloc. These allocations are 
-     * meant to be forwarded to remote memory; the tool must have been inited
-     * by now as jemalloc calls are triggered by our own calls after init */
-    if (FROM_JEMALLOC()) {
-        shim_log_debug("internal jemalloc mmap, fwd to RLib: addr=%p", addr);
-        shim_bug_on(!rmem_inited, "[je_mmap] ERROR! rmem not initialized");
-        shim_bug_on(flags & MAP_HUGETLB, "ERROR! MAP_HUGETLB from jemalloc");
-        retptr = rmlib_rmmap(addr, length, prot, flags, fd, offset);
-        goto out;
-    }
-
-    /* mmap coming directly from runtime */
+    /* mmap coming directly from runtime (or from jemalloc for its own 
+     * metadata, as our arenas get their memory through the extent hooks) */
     if (from_runtime) {
         shim_log_debug("%s from runtime, using real mmap", __func__);
         retptr = real_mmap(addr, length, prot, flags, fd, offset);
@@ -334,17 +622,6 @@ int munmap(void *ptr, size_t length)
     shim_log_debug("[%s] ptr=%p, length=%lu, from-runtime=%d", __func__, ptr, 
         length, from_runtime);
 
-    /* First check for calls coming from jemalloc. These deallocations are 
-     * meant to be forwarded to remote memory; the tool must have been init'd 
-     * by now as jemalloc calls are triggered by our own calls after init */
-    if (FROM_JEMALLOC()) {
-        shim_log_debug("internal jemalloc munmap, fwd to RLib: addr=%p", ptr);
-        shim_bug_on(!rmem_inited, "[je_mmap] ERROR! rmem not initialized");
-        assert(within_memory_region(ptr));
-        ret = rmunmap(ptr, length);
-        goto out;
-    }
-
     if (from_runtime) {
         shim_log_debug("%s from runtime, using real munmap", __func__);
         assert(!within_memory_region(ptr));
@@ -375,23 +652,12 @@ int madvise(void *addr, size_t length, int advice)
     bool from_runtime;
 
     from_runtime = runtime_enter();
-    shim_log_debug("[%s] addr=%p, size=%lu, advice=%d, from-runtime=%d from-je=%d", 
-        __func__, addr, length, advice, from_runtime, FROM_JEMALLOC());
+    shim_log_debug("[%s] addr=%p, size=%lu, advice=%d, from-runtime=%d", 
+        __func__, addr, length, advice, from_runtime);
     if (advice == MADV_DONTNEED)    shim_log_debug("MADV_DONTNEED flag");
     if (advice == MADV_HUGEPAGE)    shim_log_debug("MADV_HUGEPAGE flag");
     if (advice == MADV_FREE)        shim_log_debug("MADV_FREE flag");
 
-    /* First check for calls coming from jemalloc. These deallocations are 
-     * meant to be forwarded to remote memory; the tool must have been init'd 
-     * by now as jemalloc calls are triggered by our own calls after init */
-    if (FROM_JEMALLOC()) {
-        shim_log_debug("internal jemalloc madvise, fwd to RLib: addr=%p", addr);
-        shim_bug_on(!rmem_inited, "[je_mmap] ERROR! rmem not initialized");
-        assert(within_memory_region(addr));
-        ret = rmadvise(addr, length, advice);
-        goto out;
-    }
-
     if (from_runtime) {
         shim_log_debug("%s from runtime, using real madvise", __func__);
         ret = real_madvise(addr, length, advice);
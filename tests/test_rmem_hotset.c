@@ -0,0 +1,124 @@
+/*
+ * test_rmem_hotset.c - tests saving the hot set and reading it back at start,
+ * with hedged reads on. Run it twice with the same config, first with "save"
+ * and then with "check", e.g.
+ *
+ *	remote_memory 1
+ *	rmem_backend local
+ *	rmem_local_memory 33554432
+ *	rmem_hotset_file /tmp/test_rmem_hotset.txt
+ *	rmem_hedge_pct 50
+ *
+ * "save" fills a buffer twice the size of local memory, reads the start of it
+ * again to make it hot and saves the hot set. On the next start the handlers
+ * read the hot set back (if the backend keeps remote memory across restarts,
+ * see rmem_backend_ops.persistent) before "check" runs; it then reads the
+ * buffer from several threads and, if the hot set was read back, checks it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <base/stddef.h>
+#include <base/log.h>
+#include <runtime/preempt.h>
+#include <runtime/sync.h>
+#include <runtime/thread.h>
+
+#include "rmem/api.h"
+#include "rmem/backend.h"
+#include "rmem/common.h"
+#include "rmem/hotset.h"
+
+#define NTHREADS	8
+#define PATTERN		0x5eed5eed00000000UL
+
+static bool save;
+static uint64_t *buf;
+static size_t npages;
+
+static inline uint64_t *page_word(size_t page)
+{
+	return buf + page * (PGSIZE_4KB / sizeof(uint64_t));
+}
+
+static void read_handler(void *arg)
+{
+	waitgroup_t *wg = (waitgroup_t *)arg;
+	bool check = !save && rmbackend->persistent;
+	size_t i;
+
+	for (i = 0; i < npages; i++) {
+		if (ACCESS_ONCE(*page_word(i)) != (PATTERN | i) && check) {
+			log_err("page %lu of %lu lost its contents", i, npages);
+			BUG();
+		}
+	}
+	waitgroup_done(wg);
+}
+
+static void main_handler(void *arg)
+{
+	waitgroup_t wg;
+	size_t i;
+	int ret;
+
+	BUG_ON(!rmem_enabled);
+
+	/* the first allocation lands at the same offset in every run */
+	preempt_disable();
+	buf = rmalloc(2 * local_memory);
+	preempt_enable();
+	BUG_ON(!buf);
+	npages = 2 * local_memory / PGSIZE_4KB;
+
+	if (save) {
+		for (i = 0; i < npages; i++)
+			*page_word(i) = PATTERN | i;
+
+		/* make the first quarter hot */
+		npages /= 4;
+		for (i = 0; i < npages; i++)
+			ACCESS_ONCE(*page_word(i));
+	} else if (!rmbackend->persistent) {
+		log_info("backend does not keep remote memory, not checking it");
+	}
+
+	/* lots of faults at once, for hedging */
+	waitgroup_init(&wg);
+	waitgroup_add(&wg, NTHREADS);
+	for (i = 0; i < NTHREADS; i++) {
+		ret = thread_spawn(read_handler, &wg);
+		BUG_ON(ret);
+	}
+	waitgroup_wait(&wg);
+
+	if (save) {
+		preempt_disable();
+		ret = hotset_save();
+		preempt_enable();
+		BUG_ON(ret <= 0);
+		log_info("saved the hot set, run again with \"check\"");
+	} else {
+		log_info("hot set check done");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	if (argc < 3 || (strcmp(argv[2], "save") && strcmp(argv[2], "check"))) {
+		printf("usage: %s <config file> save|check\n", argv[0]);
+		return -EINVAL;
+	}
+	save = !strcmp(argv[2], "save");
+
+	ret = runtime_init(argv[1], main_handler, NULL);
+	if (ret) {
+		printf("failed to start runtime\n");
+		return ret;
+	}
+
+	return 0;
+}
@@ -28,6 +28,7 @@
 #include "base/log.h"
 #include "base/mem.h"
 #include "base/realmem.h"
+#include "rmem/alloc_prof.h"
 #include "rmem/api.h"
 #include "rmem/common.h"
 #include "rmem/region.h"
@@ -143,6 +144,18 @@ int parse_env_settings()
     if (parse_numeric_env_setting("FLTRACE_MAX_MEMORY_MB", &val) == 0)
         max_memory_mb = val;
 
+    /* parse backing memory to add whenever we run out */
+    if (parse_numeric_env_setting("FLTRACE_GROW_MEMORY_MB", &val) == 0)
+        rmem_grow_slabs = div_up(val * 1024L * 1024L, RMEM_SLAB_SIZE);
+
+    /* parse read latency percentile to hedge reads at */
+    if (parse_numeric_env_setting("FLTRACE_HEDGE_PCT", &val) == 0)
+        rmem_hedge_pct = val;
+
+    /* parse records per thread to keep in fault trace rings */
+    if (parse_numeric_env_setting("FLTRACE_TRACE_RECORDS", &val) == 0)
+        rmem_trace_records = val;
+
     /* parse sampling rate */
     if (parse_numeric_env_setting("FLTRACE_MAX_SAMPLES_PER_SEC", &val) == 0)
         samples_per_sec = val;
@@ -355,6 +368,9 @@ void *malloc(size_t size)
     ft_log_debug("using je_malloc");
     retptr = rmlib_je_malloc(size);
     __from_internal_jemalloc = false;
+#ifdef ALLOC_PROFILER
+    alloc_prof_sample(retptr, size);
+#endif
 
 out:
     ft_log_debug("[%s] return=%p", __func__, retptr);
@@ -438,6 +454,9 @@ void *realloc(void *ptr, size_t size)
     __from_internal_jemalloc = true;
     retptr = rmlib_je_realloc(ptr, size);
     __from_internal_jemalloc = false;
+#ifdef ALLOC_PROFILER
+    alloc_prof_sample(retptr, size);
+#endif
 
 out:
     ft_log_debug("[%s] return=%p", __func__, retptr);
@@ -474,6 +493,9 @@ void *calloc(size_t nitems, size_t size)
     __from_internal_jemalloc = true;
     retptr = rmlib_je_calloc(nitems, size);
     __from_internal_jemalloc = false;
+#ifdef ALLOC_PROFILER
+    alloc_prof_sample(retptr, nitems * size);
+#endif
 
 out:
     ft_log_debug("[%s] return=%p", __func__, retptr);
@@ -510,6 +532,9 @@ void *__internal_aligned_alloc(size_t alignment, size_t size)
     __from_internal_jemalloc = true;
     retptr = rmlib_je_aligned_alloc(alignment, size);
     __from_internal_jemalloc = false;
+#ifdef ALLOC_PROFILER
+    alloc_prof_sample(retptr, size);
+#endif
 
 out:
     ft_log_debug("[%s] return=%p", __func__, retptr);
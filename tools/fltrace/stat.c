@@ -11,7 +11,10 @@
 #include <base/stddef.h>
 #include <base/log.h>
 #include <base/time.h>
+#include <rmem/alloc_prof.h>
 #include <rmem/common.h>
+#include <rmem/fault_hist.h>
+#include <rmem/hint_prof.h>
 #include <runtime/thread.h>
 #include <runtime/udp.h>
 #include <runtime/timer.h>
@@ -142,6 +145,7 @@ static void* stats_worker(void *arg)
     RUNTIME_ENTER();
 
     char buf[MAX_STAT_STR_LEN];
+    static struct fault_hist fhist_prev;
     char fname[100];
     unsigned long now;
     FILE* fp;
@@ -163,10 +167,31 @@ static void* stats_worker(void *arg)
             continue;
         }
         fprintf(fp, "%lu %s\n", now, buf);
+
+        /* fault latency per phase, over the last interval */
+        ret = fault_hist_write_buf(buf, MAX_STAT_STR_LEN, &fhist_prev);
+        if (ret < 0) {
+            log_err("rstat err %d: couldn't generate fault latency buffer", 
+                ret);
+            continue;
+        }
+        fprintf(fp, "%lu faultlat-%s\n", now, buf);
         fflush(fp);
 
         /* save latest process maps */
         save_process_maps();
+#ifdef HINT_PROFILER
+        /* latest profile of kernel faults by ip */
+        hint_prof_dump();
+#endif
+#ifdef LOCK_PROFILER
+        /* latest lock contention profile */
+        lock_prof_dump();
+#endif
+#ifdef ALLOC_PROFILER
+        /* latest faults per allocation site */
+        alloc_prof_dump();
+#endif
     }
 
     fclose(fp);
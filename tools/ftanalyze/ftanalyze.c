@@ -0,0 +1,416 @@
+/*
+ * ftanalyze.c - offline analyzer for binary fault traces (see
+ * inc/rmem/fault_trace.h). Reports hot pages, hot callsites, reuse
+ * distances and sequentiality of the faults in a trace file.
+ *
+ * Usage: fltrace-analyze <trace file> [top N]
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define PAGE_SHIFT      12
+#define NEAR_STRIDE     16      /* strides (in pages) considered nearby */
+#define NBUCKETS        64      /* log2 histogram buckets */
+#define DEFAULT_TOPN    10
+
+/**
+ * Open-addressing hash table from 64-bit keys to some per-key counters
+ */
+struct entry {
+    uint64_t key;
+    uint64_t count;
+    uint64_t sum_lat;
+    uint64_t last;          /* last seen (position, page, ...) */
+    uint64_t run;           /* current sequential run */
+    bool used;
+};
+
+struct table {
+    struct entry* entries;
+    size_t size;            /* power of 2 */
+    size_t n;
+};
+
+static void table_init(struct table* t, size_t size)
+{
+    t->size = size;
+    t->n = 0;
+    t->entries = calloc(size, sizeof(struct entry));
+    if (!t->entries) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+static inline uint64_t hash64(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdUL;
+    key ^= key >> 33;
+    return key;
+}
+
+static struct entry* table_get(struct table* t, uint64_t key, bool* is_new);
+
+static void table_grow(struct table* t)
+{
+    struct table nt;
+    struct entry* e;
+    bool is_new;
+    size_t i;
+
+    table_init(&nt, t->size * 2);
+    for (i = 0; i < t->size; i++) {
+        if (!t->entries[i].used)
+            continue;
+        e = table_get(&nt, t->entries[i].key, &is_new);
+        *e = t->entries[i];
+    }
+    free(t->entries);
+    *t = nt;
+}
+
+/* table_get - finds the entry for a key, adding a zeroed one if not found */
+static struct entry* table_get(struct table* t, uint64_t key, bool* is_new)
+{
+    struct entry* e;
+    size_t i;
+
+    if (2 * (t->n + 1) > t->size)
+        table_grow(t);
+
+    i = hash64(key) & (t->size - 1);
+    for (;;) {
+        e = &t->entries[i];
+        if (!e->used) {
+            memset(e, 0, sizeof(*e));
+            e->used = true;
+            e->key = key;
+            t->n++;
+            *is_new = true;
+            return e;
+        }
+        if (e->key == key) {
+            *is_new = false;
+            return e;
+        }
+        i = (i + 1) & (t->size - 1);
+    }
+}
+
+static int cmp_entry_count(const void* a, const void* b)
+{
+    const struct entry *ea = a, *eb = b;
+    if (ea->count != eb->count)
+        return ea->count < eb->count ? 1 : -1;
+    return ea->key < eb->key ? -1 : ea->key > eb->key;
+}
+
+/* table_sorted - compacts the used entries, sorted by descending count */
+static size_t table_sorted(struct table* t)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i < t->size; i++)
+        if (t->entries[i].used)
+            t->entries[n++] = t->entries[i];
+    qsort(t->entries, n, sizeof(struct entry), cmp_entry_count);
+    return n;
+}
+
+/* faults in the trace, in time order */
+static struct fault_trace_rec* recs;
+static size_t nrecs;
+static size_t nhints;
+static double cycles_per_ns;
+
+/**
+ * Reports
+ */
+static inline int log2_bucket(uint64_t val)
+{
+    return val ? 64 - __builtin_clzl(val) : 0;
+}
+
+static void print_log2_hist(const char* name, uint64_t* hist, uint64_t total)
+{
+    uint64_t seen = 0;
+    char label[64];
+    int i, last = 0;
+
+    for (i = 0; i < NBUCKETS; i++)
+        if (hist[i])
+            last = i;
+    printf("  %-24s %10s %8s %8s\n", name, "count", "pct", "cdf");
+    for (i = 0; i <= last; i++) {
+        seen += hist[i];
+        snprintf(label, sizeof(label), "[%lu, %lu)",
+            i ? 1UL << (i - 1) : 0, 1UL << i);
+        printf("  %-24s %10lu %7.2f%% %7.2f%%\n", label, hist[i],
+            100.0 * hist[i] / total, 100.0 * seen / total);
+    }
+}
+
+static void report_summary(void)
+{
+    uint64_t nread = 0, nwrite = 0, nwp = 0, nkern = 0, nnoread = 0;
+    uint64_t nhedged = 0, sum_lat = 0, npages = 0;
+    size_t i;
+
+    for (i = 0; i < nrecs; i++) {
+        nread += !!(recs[i].flags & FTRACE_READ);
+        nwrite += !!(recs[i].flags & FTRACE_WRITE);
+        nwp += !!(recs[i].flags & FTRACE_WP);
+        nkern += !!(recs[i].flags & FTRACE_KERNEL);
+        nnoread += !!(recs[i].flags & FTRACE_NOREAD);
+        nhedged += !!(recs[i].flags & FTRACE_HEDGED);
+        sum_lat += recs[i].lat;
+        npages += recs[i].npages;
+    }
+
+    printf("== summary\n");
+    printf("  faults: %lu over %.3f s (%lu pages incl. read-ahead)\n", nrecs,
+        nrecs ? (recs[nrecs - 1].tsc - recs[0].tsc) / cycles_per_ns / 1e9 : 0,
+        npages);
+    if (!nrecs)
+        return;
+    printf("  read %lu, write %lu, wrprotect %lu\n", nread, nwrite, nwp);
+    printf("  from kernel %lu, without backend read %lu, hedged %lu\n",
+        nkern, nnoread, nhedged);
+    printf("  mean latency: %.0f ns\n", sum_lat / cycles_per_ns / nrecs);
+    printf("  hinted accesses without a fault: %lu\n", nhints);
+}
+
+static void report_hot_pages(int topn)
+{
+    struct table t;
+    struct entry* e;
+    size_t i, n;
+    bool is_new;
+
+    table_init(&t, 1024);
+    for (i = 0; i < nrecs; i++) {
+        e = table_get(&t, recs[i].addr, &is_new);
+        e->count++;
+        e->sum_lat += recs[i].lat;
+    }
+    n = table_sorted(&t);
+
+    printf("== hot pages (%lu distinct)\n", n);
+    printf("  %-18s %10s %8s %12s\n", "page", "faults", "pct", "mean ns");
+    for (i = 0; i < n && i < (size_t) topn; i++) {
+        e = &t.entries[i];
+        printf("  0x%-16lx %10lu %7.2f%% %12.0f\n", e->key, e->count,
+            100.0 * e->count / nrecs, e->sum_lat / cycles_per_ns / e->count);
+    }
+    free(t.entries);
+}
+
+static void report_hot_callsites(int topn)
+{
+    struct table t;
+    struct entry* e;
+    uint64_t nknown = 0;
+    size_t i, n;
+    bool is_new;
+
+    table_init(&t, 1024);
+    for (i = 0; i < nrecs; i++) {
+        if (!recs[i].ip)
+            continue;
+        e = table_get(&t, recs[i].ip, &is_new);
+        e->count++;
+        e->sum_lat += recs[i].lat;
+        nknown++;
+    }
+    n = table_sorted(&t);
+
+    printf("== hot callsites (%lu distinct, %lu faults with unknown ip)\n",
+        n, nrecs - nknown);
+    if (n)
+        printf("  %-18s %10s %8s %12s\n", "ip", "faults", "pct", "mean ns");
+    for (i = 0; i < n && i < (size_t) topn; i++) {
+        e = &t.entries[i];
+        printf("  0x%-16lx %10lu %7.2f%% %12.0f\n", e->key, e->count,
+            100.0 * e->count / nknown, e->sum_lat / cycles_per_ns / e->count);
+    }
+    free(t.entries);
+}
+
+/**
+ * Reuse distance: the number of distinct pages that faulted between two
+ * faults on the same page. Computed as an LRU stack distance with a Fenwick
+ * tree over trace positions that has a 1 at the latest fault of each page.
+ */
+static inline void fenwick_add(int64_t* tree, size_t n, size_t i, int val)
+{
+    for (i++; i <= n; i += i & -i)
+        tree[i - 1] += val;
+}
+
+static inline int64_t fenwick_sum(int64_t* tree, size_t i)  /* [0, i) */
+{
+    int64_t sum = 0;
+    for (; i > 0; i -= i & -i)
+        sum += tree[i - 1];
+    return sum;
+}
+
+static void report_reuse_distance(void)
+{
+    uint64_t hist[NBUCKETS] = {0};
+    uint64_t cold = 0, reuses, seen, dist;
+    int64_t* tree;
+    struct table t;
+    struct entry* e;
+    bool is_new;
+    size_t i;
+    int b;
+
+    tree = calloc(nrecs + 1, sizeof(int64_t));
+    if (!tree) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    table_init(&t, 1024);
+    for (i = 0; i < nrecs; i++) {
+        e = table_get(&t, recs[i].addr, &is_new);
+        if (is_new)
+            cold++;
+        else {
+            dist = fenwick_sum(tree, i) - fenwick_sum(tree, e->last + 1);
+            hist[log2_bucket(dist)]++;
+            fenwick_add(tree, nrecs, e->last, -1);
+        }
+        fenwick_add(tree, nrecs, i, 1);
+        e->last = i;
+    }
+
+    reuses = nrecs - cold;
+    printf("== reuse distance (distinct pages between faults on a page)\n");
+    printf("  first faults: %lu, re-faults: %lu\n", cold, reuses);
+    if (reuses) {
+        seen = 0;
+        for (b = 0; b < NBUCKETS; b++) {
+            seen += hist[b];
+            if (2 * seen >= reuses)
+                break;
+        }
+        printf("  median: [%lu, %lu)\n", b ? 1UL << (b - 1) : 0, 1UL << b);
+        print_log2_hist("distance", hist, reuses);
+    }
+    free(t.entries);
+    free(tree);
+}
+
+/**
+ * Sequentiality: how each thread's fault relates to its previous one, in
+ * pages. A fault right after the previous one's read-ahead also counts as
+ * sequential.
+ */
+static void report_sequentiality(void)
+{
+    uint64_t fwd = 0, bwd = 0, same = 0, near = 0, far = 0, first = 0;
+    uint64_t runs[NBUCKETS] = {0}, nruns = 0;
+    int64_t stride, prev_pages;
+    struct table t;
+    struct entry* e;
+    bool is_new;
+    size_t i;
+
+    table_init(&t, 64);
+    for (i = 0; i < nrecs; i++) {
+        e = table_get(&t, recs[i].tid, &is_new);
+        if (is_new) {
+            first++;
+            e->run = 1;
+        } else {
+            prev_pages = e->count;      /* npages of the last fault */
+            stride = ((int64_t) recs[i].addr - (int64_t) e->last)
+                >> PAGE_SHIFT;
+            if (stride == 1 || stride == prev_pages) {
+                fwd++;
+                e->run++;
+            } else {
+                if (stride == -1)
+                    bwd++;
+                else if (stride == 0)
+                    same++;
+                else if (stride > -NEAR_STRIDE && stride < NEAR_STRIDE)
+                    near++;
+                else
+                    far++;
+                runs[log2_bucket(e->run)]++;
+                nruns++;
+                e->run = 1;
+            }
+        }
+        e->last = recs[i].addr;
+        e->count = recs[i].npages;
+    }
+    for (i = 0; i < t.size; i++) {
+        if (t.entries[i].used) {
+            runs[log2_bucket(t.entries[i].run)]++;
+            nruns++;
+        }
+    }
+
+    printf("== sequentiality (per thread, %lu threads)\n", t.n);
+    if (nrecs <= first) {
+        free(t.entries);
+        return;
+    }
+    printf("  forward %.2f%%, backward %.2f%%, same page %.2f%%, "
+        "near (<%d pages) %.2f%%, far %.2f%%\n",
+        100.0 * fwd / (nrecs - first), 100.0 * bwd / (nrecs - first),
+        100.0 * same / (nrecs - first), NEAR_STRIDE,
+        100.0 * near / (nrecs - first), 100.0 * far / (nrecs - first));
+    print_log2_hist("forward run", runs, nruns);
+    free(t.entries);
+}
+
+int main(int argc, char** argv)
+{
+    struct ftrace trace;
+    int topn = DEFAULT_TOPN;
+    size_t i;
+
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <trace file> [top N]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 3)
+        topn = atoi(argv[2]);
+
+    if (ftrace_read(argv[1], &trace))
+        return 1;
+    cycles_per_ns = trace.cycles_per_ns;
+
+    /* only look at faults (hinted accesses are there for replaying) */
+    recs = trace.recs;
+    nrecs = 0;
+    for (i = 0; i < trace.nrecs; i++) {
+        if (trace.recs[i].flags & FTRACE_HINT)
+            nhints++;
+        else
+            recs[nrecs++] = trace.recs[i];
+    }
+
+    report_summary();
+    if (!nrecs)
+        return 0;
+    report_hot_pages(topn);
+    report_hot_callsites(topn);
+    report_reuse_distance();
+    report_sequentiality();
+    return 0;
+}
@@ -0,0 +1,642 @@
+/*
+ * ftsim.c - trace-driven eviction simulator. Replays the accesses in a
+ * binary fault trace (faults and hinted accesses, see
+ * inc/rmem/fault_trace.h) through models of the eviction policies in
+ * rmem/eviction.c at different local memory sizes and reports miss ratio
+ * and write-back volume for each, along with Belady's optimal policy as a
+ * baseline.
+ *
+ * Usage: fltrace-sim [options] <trace file>
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base/qestimator.h"
+#include "rmem/config.h"
+#include "trace.h"
+
+#define NONE            UINT32_MAX
+#define MAX_SIZES       16
+#define DEFAULT_SIZES   "10%,25%,50%,75%"
+#define DEFAULT_NGENS   4
+#define DEFAULT_BUMP_THR 0.9
+
+enum {
+    POLICY_FIFO = 0,    /* default policy: single list */
+    POLICY_SC,          /* second-chance (SC_EVICTION) */
+    POLICY_LRU,         /* hint epoch based lru (LRU_EVICTION) */
+    POLICY_OPT,         /* belady's optimal */
+    POLICY_NR
+};
+static const char* policy_names[] = {"fifo", "sc", "lru", "opt"};
+
+/* options */
+static int ngens = DEFAULT_NGENS;
+static int batch_size = 1;
+static double bump_thr = DEFAULT_BUMP_THR;
+static unsigned long epoch_len_us = EVICTION_EPOCH_LEN_MUS;
+static bool no_rdahead = false;
+
+/**
+ * The access stream: every record in the trace accesses its page, faults
+ * also bring in their read-ahead pages. Pages get dense ids.
+ */
+struct access {
+    uint32_t page;
+    uint16_t npages;
+    bool write;
+    uint64_t tsc;
+};
+static struct access* accs;
+static size_t naccs;
+static uint64_t* page_addrs;    /* sorted */
+static uint32_t npages;
+static double cycles_per_ns;
+static uint64_t trace_start_tsc;
+
+/* for opt: each page's access positions, in order */
+static uint32_t* occ_start;
+static uint32_t* occ;
+
+/**
+ * Simulated page state
+ */
+struct spage {
+    uint32_t next, prev;    /* links in gen lists */
+    uint32_t epoch;         /* last hinted access epoch (lru), 0 if none */
+    uint32_t occ_pos;       /* next access in occ[] (opt) */
+    bool resident;
+    bool dirty;
+    bool accessed;          /* (sc) */
+};
+
+struct slist {
+    uint32_t head, tail;
+    size_t n;
+};
+
+struct sim {
+    int policy;
+    uint64_t capacity;      /* pages */
+    struct spage* pages;
+    uint64_t resident;
+
+    /* eviction lists */
+    struct slist gens[EVICTION_MAX_GENS];
+    struct slist tmp_gens[EVICTION_MAX_GENS];
+    int ngens;
+    int gen_now;
+    unsigned long epoch_now;
+    int epoch_shift;
+    struct mov_p2estimator epoch_est;
+
+    /* opt: max-heap of (next use, page) with lazily dropped stale items */
+    uint64_t* heap;
+    size_t heap_n;
+    size_t heap_size;
+
+    /* results */
+    uint64_t misses;
+    uint64_t fetched;
+    uint64_t writebacks;
+    uint64_t evict_ops;
+    uint64_t popped;
+};
+
+static inline void slist_add_tail(struct sim* s, struct slist* l, uint32_t p)
+{
+    s->pages[p].next = NONE;
+    s->pages[p].prev = l->tail;
+    if (l->tail != NONE)
+        s->pages[l->tail].next = p;
+    else
+        l->head = p;
+    l->tail = p;
+    l->n++;
+}
+
+static inline uint32_t slist_pop(struct sim* s, struct slist* l)
+{
+    uint32_t p = l->head;
+
+    if (p == NONE)
+        return NONE;
+    l->head = s->pages[p].next;
+    if (l->head != NONE)
+        s->pages[l->head].prev = NONE;
+    else
+        l->tail = NONE;
+    l->n--;
+    return p;
+}
+
+static inline void slist_append(struct sim* s, struct slist* l,
+    struct slist* from)
+{
+    if (from->head == NONE)
+        return;
+    if (l->tail != NONE) {
+        s->pages[l->tail].next = from->head;
+        s->pages[from->head].prev = l->tail;
+    } else
+        l->head = from->head;
+    l->tail = from->tail;
+    l->n += from->n;
+    from->head = from->tail = NONE;
+    from->n = 0;
+}
+
+static inline uint64_t next_use(uint32_t p, struct spage* sp)
+{
+    uint32_t i = occ_start[p] + sp->occ_pos;
+    return i < occ_start[p + 1] ? occ[i] : UINT32_MAX;
+}
+
+static void heap_push(struct sim* s, uint64_t key)
+{
+    size_t i, parent;
+
+    if (s->heap_n == s->heap_size) {
+        s->heap_size *= 2;
+        s->heap = realloc(s->heap, s->heap_size * sizeof(uint64_t));
+        if (!s->heap) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    i = s->heap_n++;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (s->heap[parent] >= key)
+            break;
+        s->heap[i] = s->heap[parent];
+        i = parent;
+    }
+    s->heap[i] = key;
+}
+
+static uint64_t heap_pop(struct sim* s)
+{
+    uint64_t top = s->heap[0], last = s->heap[--s->heap_n];
+    size_t i = 0, c;
+
+    while ((c = 2 * i + 1) < s->heap_n) {
+        if (c + 1 < s->heap_n && s->heap[c + 1] > s->heap[c])
+            c++;
+        if (last >= s->heap[c])
+            break;
+        s->heap[i] = s->heap[c];
+        i = c;
+    }
+    s->heap[i] = last;
+    return top;
+}
+
+/* heap keys are the next use in the upper half and the page in the lower */
+#define OPT_KEY(use, p)     (((uint64_t)(use) << 32) | (p))
+
+/**
+ * Policies. These follow find_candidate_pages() and get_page_next_gen_*()
+ * in rmem/eviction.c with a single priority level.
+ */
+
+/* where new pages go, like get_highest_evict_gen() */
+static inline int highest_gen(struct sim* s)
+{
+    return (s->gen_now + s->ngens - 1) & (s->ngens - 1);
+}
+
+static int page_next_gen(struct sim* s, uint32_t p)
+{
+    struct spage* sp = &s->pages[p];
+    unsigned long gap, quantile;
+    int next_gen;
+
+    switch (s->policy) {
+    case POLICY_SC:
+        if (!sp->accessed)
+            return 0;
+        sp->accessed = false;
+        return 1;
+
+    case POLICY_LRU:
+        next_gen = 0;
+        if (sp->epoch) {
+            gap = (uint32_t) ((uint32_t) s->epoch_now - sp->epoch);
+            mov_p2estimator_add(&s->epoch_est, gap);
+            quantile = mov_p2estimator_get_quantile(&s->epoch_est);
+            if (gap < quantile)
+                next_gen = s->ngens - 1 - gap * (s->ngens - 1) / quantile;
+        }
+        sp->epoch = 0;
+        return next_gen;
+
+    default:
+        return 0;
+    }
+}
+
+static void evict_page(struct sim* s, uint32_t p)
+{
+    struct spage* sp = &s->pages[p];
+
+    assert(sp->resident);
+    if (sp->dirty)
+        s->writebacks++;
+    sp->resident = sp->dirty = sp->accessed = false;
+    sp->epoch = 0;
+    s->resident--;
+}
+
+static void evict_opt(struct sim* s, int n)
+{
+    struct spage* sp;
+    uint64_t key;
+    uint32_t p;
+
+    while (n > 0 && s->heap_n > 0) {
+        key = heap_pop(s);
+        p = (uint32_t) key;
+        sp = &s->pages[p];
+        if (!sp->resident || (key >> 32) != next_use(p, sp))
+            continue;   /* stale */
+        evict_page(s, p);
+        n--;
+    }
+}
+
+static void evict_lists(struct sim* s, int n, uint64_t now_tsc)
+{
+    int gen, start_gen, next_gen, nfound, npopped;
+    struct slist evict = {NONE, NONE, 0};
+    bool out_of_gens = false;
+    uint32_t p;
+
+    s->epoch_now = (now_tsc - trace_start_tsc) >> s->epoch_shift;
+    nfound = npopped = 0;
+    start_gen = -1;
+    for (;;) {
+        gen = s->gen_now;
+        if (gen == start_gen) {
+            out_of_gens = true;
+            break;
+        }
+        if (start_gen < 0)
+            start_gen = gen;
+
+        while (nfound < n && npopped < EVICTION_MAX_BUMPS_PER_OP) {
+            p = slist_pop(s, &s->gens[gen]);
+            if (p == NONE)
+                break;
+            npopped++;
+            next_gen = page_next_gen(s, p);
+            if (next_gen == 0) {
+                slist_add_tail(s, &evict, p);
+                nfound++;
+            } else
+                slist_add_tail(s, &s->tmp_gens[next_gen], p);
+        }
+        if (nfound == n || npopped == EVICTION_MAX_BUMPS_PER_OP)
+            break;
+        s->gen_now = (gen + 1) % s->ngens;
+    }
+
+    /* out of pages: take the rest from the bumped ones, lowest gen first */
+    if (nfound < n && out_of_gens) {
+        for (gen = 1; gen < s->ngens && nfound < n; gen++) {
+            while (nfound < n) {
+                p = slist_pop(s, &s->tmp_gens[gen]);
+                if (p == NONE)
+                    break;
+                slist_add_tail(s, &evict, p);
+                nfound++;
+            }
+        }
+    }
+
+    /* add bumped pages back to the higher lists */
+    for (gen = 1; gen < s->ngens; gen++)
+        slist_append(s, &s->gens[(s->gen_now + gen) & (s->ngens - 1)],
+            &s->tmp_gens[gen]);
+
+    while ((p = slist_pop(s, &evict)) != NONE)
+        evict_page(s, p);
+    s->evict_ops++;
+    s->popped += npopped;
+}
+
+/* fetch_page - brings in a page and makes room for it */
+static void fetch_page(struct sim* s, uint32_t p, uint64_t now_tsc)
+{
+    struct spage* sp = &s->pages[p];
+
+    assert(!sp->resident);
+    sp->resident = true;
+    s->resident++;
+    s->fetched++;
+    if (s->policy == POLICY_OPT)
+        heap_push(s, OPT_KEY(next_use(p, sp), p));
+    else
+        slist_add_tail(s, &s->gens[highest_gen(s)], p);
+
+    while (s->resident > s->capacity) {
+        if (s->policy == POLICY_OPT)
+            evict_opt(s, batch_size);
+        else
+            evict_lists(s, batch_size, now_tsc);
+    }
+}
+
+static void sim_run(struct sim* s)
+{
+    struct access* a;
+    struct spage* sp;
+    uint32_t p;
+    size_t i;
+    int j;
+
+    for (i = 0; i < naccs; i++) {
+        a = &accs[i];
+        sp = &s->pages[a->page];
+        sp->occ_pos++;  /* this access is no longer in the future */
+
+        if (sp->resident) {
+            /* what a hint on a present page does */
+            sp->accessed = true;
+            sp->epoch = (uint32_t) s->epoch_now ?: 1;
+            if (s->policy == POLICY_OPT)
+                heap_push(s, OPT_KEY(next_use(a->page, sp), a->page));
+            if (a->write)
+                sp->dirty = true;
+            continue;
+        }
+
+        s->misses++;
+        fetch_page(s, a->page, a->tsc);
+        /* before the read-ahead, which may evict the page again */
+        if (a->write && sp->resident)
+            sp->dirty = true;
+        for (j = 1; j < a->npages; j++) {
+            p = a->page + j;
+            if (p >= npages || page_addrs[p] != page_addrs[a->page] +
+                    ((uint64_t) j << CHUNK_SHIFT))
+                break;
+            if (!s->pages[p].resident)
+                fetch_page(s, p, a->tsc);
+        }
+    }
+}
+
+static void sim_init(struct sim* s, int policy, uint64_t capacity)
+{
+    unsigned long interval_tsc;
+    uint32_t p;
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    s->policy = policy;
+    s->capacity = capacity;
+    s->pages = calloc(npages, sizeof(struct spage));
+    s->heap_size = 2 * npages;
+    s->heap = policy == POLICY_OPT ?
+        malloc(s->heap_size * sizeof(uint64_t)) : NULL;
+    if (!s->pages || (policy == POLICY_OPT && !s->heap)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (p = 0; p < npages; p++)
+        s->pages[p].next = s->pages[p].prev = NONE;
+
+    s->ngens = policy == POLICY_SC ? 2 : (policy == POLICY_LRU ? ngens : 1);
+    for (i = 0; i < EVICTION_MAX_GENS; i++) {
+        s->gens[i] = (struct slist) {NONE, NONE, 0};
+        s->tmp_gens[i] = (struct slist) {NONE, NONE, 0};
+    }
+
+    /* same epoch length rounding as eviction_init() */
+    interval_tsc = epoch_len_us * cycles_per_ns * 1000;
+    s->epoch_shift = 1;
+    while (interval_tsc > 0) {
+        s->epoch_shift++;
+        interval_tsc >>= 1;
+    }
+    mov_p2estimator_init(&s->epoch_est, bump_thr, 10000);
+}
+
+static void sim_free(struct sim* s)
+{
+    free(s->pages);
+    free(s->heap);
+}
+
+/**
+ * Building the access stream
+ */
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t page_id(uint64_t addr)
+{
+    uint64_t* found = bsearch(&addr, page_addrs, npages, sizeof(uint64_t),
+        cmp_u64);
+    assert(found);
+    return found - page_addrs;
+}
+
+static void build_accesses(struct ftrace* t)
+{
+    uint64_t* addrs;
+    uint32_t *fill, p;
+    size_t i, n;
+    int j;
+
+    /* every page touched, including read-ahead */
+    n = 0;
+    for (i = 0; i < t->nrecs; i++)
+        n += no_rdahead ? 1 : t->recs[i].npages;
+    addrs = malloc(n * sizeof(uint64_t));
+    accs = malloc(t->nrecs * sizeof(struct access));
+    if (!addrs || !accs) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    n = 0;
+    for (i = 0; i < t->nrecs; i++)
+        for (j = 0; j < (no_rdahead ? 1 : t->recs[i].npages); j++)
+            addrs[n++] = t->recs[i].addr + ((uint64_t) j << CHUNK_SHIFT);
+    qsort(addrs, n, sizeof(uint64_t), cmp_u64);
+    npages = 0;
+    for (i = 0; i < n; i++)
+        if (npages == 0 || addrs[i] != addrs[npages - 1])
+            addrs[npages++] = addrs[i];
+    page_addrs = addrs;
+
+    naccs = t->nrecs;
+    for (i = 0; i < naccs; i++) {
+        accs[i].page = page_id(t->recs[i].addr);
+        accs[i].npages = no_rdahead ? 1 : t->recs[i].npages;
+        accs[i].write = !!(t->recs[i].flags & (FTRACE_WRITE | FTRACE_WP));
+        accs[i].tsc = t->recs[i].tsc;
+    }
+
+    /* per-page access positions, for opt */
+    occ_start = calloc(npages + 1, sizeof(uint32_t));
+    occ = malloc(naccs * sizeof(uint32_t));
+    if (!occ_start || !occ) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < naccs; i++)
+        occ_start[accs[i].page + 1]++;
+    for (p = 0; p < npages; p++)
+        occ_start[p + 1] += occ_start[p];
+    fill = malloc(npages * sizeof(uint32_t));
+    if (!fill) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    memcpy(fill, occ_start, npages * sizeof(uint32_t));
+    for (i = 0; i < naccs; i++)
+        occ[fill[accs[i].page]++] = i;
+    free(fill);
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [options] <trace file>\n"
+        "  -m <sizes>     local memory sizes, in MB or as %% of the pages "
+        "touched (default %s)\n"
+        "  -p <policies>  any of fifo,sc,lru,opt (default all)\n"
+        "  -g <ngens>     generations for lru, power of 2 up to %d "
+        "(default %d)\n"
+        "  -q <thr>       lru bump threshold quantile (default %.2f)\n"
+        "  -e <us>        lru epoch length (default %d)\n"
+        "  -b <pages>     eviction batch size (default 1)\n"
+        "  -r             ignore read-ahead\n",
+        prog, DEFAULT_SIZES, EVICTION_MAX_GENS, DEFAULT_NGENS,
+        DEFAULT_BUMP_THR, EVICTION_EPOCH_LEN_MUS);
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    const char* sizes_str = DEFAULT_SIZES;
+    bool policies[POLICY_NR] = {true, true, true, true};
+    uint64_t sizes[MAX_SIZES], nwrites;
+    int nsizes, opt, i, j;
+    size_t k;
+    char *str, *tok, *end;
+    struct ftrace trace;
+    struct sim s;
+    double val;
+
+    while ((opt = getopt(argc, argv, "m:p:g:q:e:b:r")) != -1) {
+        switch (opt) {
+        case 'm':
+            sizes_str = optarg;
+            break;
+        case 'p':
+            memset(policies, 0, sizeof(policies));
+            str = strdup(optarg);
+            for (tok = strtok(str, ","); tok; tok = strtok(NULL, ",")) {
+                for (i = 0; i < POLICY_NR; i++)
+                    if (!strcmp(tok, policy_names[i]))
+                        break;
+                if (i == POLICY_NR)
+                    usage(argv[0]);
+                policies[i] = true;
+            }
+            free(str);
+            break;
+        case 'g':
+            ngens = atoi(optarg);
+            if (ngens <= 0 || ngens > EVICTION_MAX_GENS
+                    || (ngens & (ngens - 1)))
+                usage(argv[0]);
+            break;
+        case 'q':
+            bump_thr = atof(optarg);
+            if (bump_thr <= 0 || bump_thr >= 1)
+                usage(argv[0]);
+            break;
+        case 'e':
+            epoch_len_us = atol(optarg);
+            if (epoch_len_us == 0)
+                usage(argv[0]);
+            break;
+        case 'b':
+            batch_size = atoi(optarg);
+            if (batch_size <= 0 || batch_size > EVICTION_MAX_BATCH_SIZE)
+                usage(argv[0]);
+            break;
+        case 'r':
+            no_rdahead = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    if (ftrace_read(argv[optind], &trace))
+        return 1;
+    if (trace.nrecs == 0) {
+        printf("no accesses in trace\n");
+        return 0;
+    }
+    cycles_per_ns = trace.cycles_per_ns;
+    trace_start_tsc = trace.start_tsc;
+    build_accesses(&trace);
+    free(trace.recs);
+
+    /* memory sizes in pages */
+    nsizes = 0;
+    str = strdup(sizes_str);
+    for (tok = strtok(str, ","); tok; tok = strtok(NULL, ",")) {
+        val = strtod(tok, &end);
+        if (val <= 0 || nsizes == MAX_SIZES)
+            usage(argv[0]);
+        sizes[nsizes++] = *end == '%' ? (uint64_t)(npages * val / 100)
+            : (uint64_t)(val * 1024 * 1024) >> CHUNK_SHIFT;
+        if (sizes[nsizes - 1] == 0)
+            sizes[nsizes - 1] = 1;
+    }
+    free(str);
+
+    nwrites = 0;
+    for (k = 0; k < naccs; k++)
+        nwrites += accs[k].write;
+    printf("accesses: %lu (%lu writes), pages touched: %u (%.1f MB)\n",
+        naccs, nwrites, npages, (double) npages * CHUNK_SIZE / 1024 / 1024);
+    printf("%-6s %10s %10s %10s %8s %10s %12s %10s\n", "policy", "mem(MB)",
+        "pages", "misses", "miss%", "fetched", "writeback(MB)", "popped/ev");
+    for (i = 0; i < nsizes; i++) {
+        for (j = 0; j < POLICY_NR; j++) {
+            if (!policies[j])
+                continue;
+            sim_init(&s, j, sizes[i]);
+            sim_run(&s);
+            printf("%-6s %10.1f %10lu %10lu %7.2f%% %10lu %12.1f %10.2f\n",
+                policy_names[j], (double) sizes[i] * CHUNK_SIZE / 1024 / 1024,
+                sizes[i], s.misses, 100.0 * s.misses / naccs, s.fetched,
+                (double) s.writebacks * CHUNK_SIZE / 1024 / 1024,
+                s.fetched > s.resident ?
+                    (double) s.popped / (s.fetched - s.resident) : 0);
+            sim_free(&s);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * trace.c - reading binary fault traces (see inc/rmem/fault_trace.h)
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+static int cmp_rec_tsc(const void* a, const void* b)
+{
+    const struct fault_trace_rec *ra = a, *rb = b;
+    return ra->tsc < rb->tsc ? -1 : ra->tsc > rb->tsc;
+}
+
+/**
+ * ftrace_read - copies out the records from all rings of a trace file,
+ * sorted by time. Works on traces of running processes too.
+ */
+int ftrace_read(const char* path, struct ftrace* t)
+{
+    struct fault_trace_hdr* hdr;
+    struct fault_trace_ring* ring;
+    struct fault_trace_rec* ring_recs;
+    uint64_t head, tail, start, skip, i, n, dropped;
+    unsigned int r, nrings;
+    struct stat st;
+    size_t pos;
+    void* base;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED || (size_t) st.st_size < sizeof(*hdr)) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return 1;
+    }
+
+    hdr = base;
+    if (load_acquire(&hdr->magic) != FAULT_TRACE_MAGIC
+            || hdr->version != FAULT_TRACE_VERSION
+            || hdr->rec_size != sizeof(struct fault_trace_rec)
+            || hdr->recs_off + hdr->max_rings * hdr->ring_nrecs *
+                hdr->rec_size > (size_t) st.st_size) {
+        fprintf(stderr, "%s is not a (supported) fault trace\n", path);
+        return 1;
+    }
+    t->cycles_per_ns = hdr->cycles_per_us / 1000.0;
+    t->start_tsc = hdr->start_tsc;
+    nrings = load_acquire(&hdr->nrings);
+    if (nrings > hdr->max_rings)
+        nrings = hdr->max_rings;
+    n = hdr->ring_nrecs;
+
+    t->recs = malloc(nrings * n * sizeof(struct fault_trace_rec));
+    if (!t->recs) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    /* copy records, dropping any that the owner overwrote meanwhile */
+    pos = 0;
+    dropped = 0;
+    for (r = 0; r < nrings; r++) {
+        ring = base + hdr->rings_off + r * sizeof(struct fault_trace_ring);
+        ring_recs = base + hdr->recs_off + r * n * hdr->rec_size;
+        head = load_acquire(&ring->head);
+        start = head > n ? head - n : 0;
+        for (i = start; i < head; i++)
+            t->recs[pos + i - start] = ring_recs[i & (n - 1)];
+
+        /* records below the latest tail may have been overwritten; the 
+         * owner may be writing record head' over slot head' - n right now. 
+         * The copies must be done before head is read again */
+        rmb();
+        tail = load_acquire(&ring->head);
+        tail = tail >= n ? tail - n + 1 : 0;
+        skip = tail > start ? MIN(tail, head) - start : 0;
+        if (skip) {
+            memmove(&t->recs[pos], &t->recs[pos + skip],
+                (head - start - skip) * sizeof(struct fault_trace_rec));
+            dropped += skip;
+        }
+        pos += head - start - skip;
+    }
+    t->nrecs = pos;
+    munmap(base, st.st_size);
+    if (dropped)
+        printf("dropped %lu records overwritten while reading\n", dropped);
+
+    qsort(t->recs, t->nrecs, sizeof(struct fault_trace_rec), cmp_rec_tsc);
+    return 0;
+}
@@ -0,0 +1,21 @@
+/*
+ * trace.h - reading binary fault traces (see inc/rmem/fault_trace.h)
+ */
+
+#ifndef __FTANALYZE_TRACE_H__
+#define __FTANALYZE_TRACE_H__
+
+#include <stddef.h>
+
+#include "rmem/fault_trace.h"
+
+struct ftrace {
+    struct fault_trace_rec* recs;   /* from all rings, sorted by time */
+    size_t nrecs;
+    double cycles_per_ns;
+    uint64_t start_tsc;
+};
+
+int ftrace_read(const char* path, struct ftrace* t);
+
+#endif  // __FTANALYZE_TRACE_H__
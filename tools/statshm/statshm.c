@@ -0,0 +1,190 @@
+/*
+ * statshm.c - samples the shared-memory stats of a running eden process
+ * (see inc/runtime/stat_shm.h) at any rate, without involving the process.
+ * Prints one line per sample in the format of runtime.out/rmem-stats.out.
+ *
+ * Usage: statshm [options] <pid>
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "runtime/stat_shm.h"
+
+static struct stat_shm_hdr* stat_shm_map(int pid)
+{
+    struct stat_shm_hdr* h;
+    struct stat st;
+    char path[64];
+    int fd;
+
+    snprintf(path, sizeof(path), STAT_SHM_PATH, pid);
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "cannot open %s (was runtime_stats_shm_us set?)\n",
+            path);
+        return NULL;
+    }
+    h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED || (size_t) st.st_size < sizeof(*h)) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return NULL;
+    }
+    if (load_acquire(&h->magic) != STAT_SHM_MAGIC
+            || h->version != STAT_SHM_VERSION
+            || stat_shm_size(h) > (size_t) st.st_size) {
+        fprintf(stderr, "%s is not a (supported) stats segment\n", path);
+        return NULL;
+    }
+    return h;
+}
+
+/* copies out a consistent snapshot of the counters, returns its sequence */
+static uint64_t stat_shm_snapshot(struct stat_shm_hdr* h, uint64_t* data,
+    uint64_t* tsc)
+{
+    size_t len = stat_shm_size(h) - h->data_off;
+    uint64_t seq;
+
+    do {
+        seq = stat_shm_read_begin(h);
+        memcpy(data, stat_shm_kthread(h, 0), len);
+        *tsc = h->tsc;
+    } while (stat_shm_read_retry(h, seq));
+    return seq;
+}
+
+static void print_counters(struct stat_shm_hdr* h, const char* prefix,
+    int first_name, uint64_t* cur, uint64_t* prev, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+        printf("%s%s:%lu%s", i ? "" : prefix,
+            stat_shm_name(h, first_name + i),
+            prev ? cur[i] - prev[i] : cur[i], i < n - 1 ? "," : "");
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [options] <pid>\n"
+        "  -i <us>   sampling interval (default: the export interval)\n"
+        "  -n <num>  number of samples (default: until interrupted)\n"
+        "  -d        print the change over each interval instead of totals\n"
+        "  -k        also print the counters of each kthread and handler\n",
+        prog);
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    struct stat_shm_hdr* h;
+    uint64_t *cur, *prev, *sum, *prev_sum, *k, *pk, seq, last_seq, tsc;
+    unsigned long interval_us = 0, nsamples = 0, taken;
+    bool deltas = false, per_thread = false;
+    size_t len;
+    unsigned int i, j, nstats, nrstats, nall;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:n:dk")) != -1) {
+        switch (opt) {
+        case 'i':
+            interval_us = atol(optarg);
+            if (!interval_us)
+                usage(argv[0]);
+            break;
+        case 'n':
+            nsamples = atol(optarg);
+            break;
+        case 'd':
+            deltas = true;
+            break;
+        case 'k':
+            per_thread = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    h = stat_shm_map(atoi(argv[optind]));
+    if (!h)
+        return 1;
+    if (!interval_us)
+        interval_us = h->interval_us;
+
+    nstats = h->nstats;
+    nrstats = h->nrstats;
+    nall = nstats + nrstats;
+    len = stat_shm_size(h) - h->data_off;
+    cur = malloc(len);
+    prev = malloc(len);
+    sum = calloc(nall, sizeof(uint64_t));
+    prev_sum = calloc(nall, sizeof(uint64_t));
+    if (!cur || !prev || !sum || !prev_sum) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    last_seq = 0;
+    for (taken = 0; !nsamples || taken < nsamples; usleep(interval_us)) {
+        seq = stat_shm_snapshot(h, cur, &tsc);
+        if (seq == last_seq)
+            continue;       /* not updated yet */
+
+        /* totals over kthreads and handlers */
+        memset(sum, 0, nall * sizeof(uint64_t));
+        for (i = 0; i < h->max_kthreads; i++)
+            for (j = 0; j < nall; j++)
+                sum[j] += cur[i * nall + j];
+        for (i = 0; i < h->max_handlers; i++)
+            for (j = 0; j < nrstats; j++)
+                sum[nstats + j] += cur[h->max_kthreads * nall +
+                    i * nrstats + j];
+
+        /* with deltas, the first snapshot is only the baseline */
+        if (!deltas || last_seq) {
+            printf("%.0f ", tsc / (double) h->cycles_per_us);
+            print_counters(h, "", 0, sum, deltas ? prev_sum : NULL, nall);
+            print_counters(h, ",", nall, cur + len / sizeof(uint64_t) -
+                h->nglobals, NULL, h->nglobals);
+            printf("\n");
+
+            for (i = 0; per_thread && i < h->max_kthreads; i++) {
+                k = cur + i * nall;
+                pk = prev + i * nall;
+                printf("%.0f kthread%u-", tsc / (double) h->cycles_per_us, i);
+                print_counters(h, "", 0, k, deltas ? pk : NULL, nall);
+                printf("\n");
+            }
+            for (i = 0; per_thread && i < h->max_handlers; i++) {
+                k = cur + h->max_kthreads * nall + i * nrstats;
+                pk = prev + h->max_kthreads * nall + i * nrstats;
+                printf("%.0f handler%u-", tsc / (double) h->cycles_per_us, i);
+                print_counters(h, "", nstats, k, deltas ? pk : NULL, nrstats);
+                printf("\n");
+            }
+            fflush(stdout);
+            taken++;
+        }
+
+        last_seq = seq;
+        memcpy(prev, cur, len);
+        memcpy(prev_sum, sum, nall * sizeof(uint64_t));
+    }
+    return 0;
+}